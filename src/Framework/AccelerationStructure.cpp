@@ -99,8 +99,10 @@ static void cmd_compact_blas(VkCommandBuffer cmdBuf, std::vector<uint32_t> indic
 	}
 }
 
+// in_place rebuilds into the existing acceleration structure, which only works for the instance count it was created for
 static void cmd_create_tlas(BVH& tlas, VkCommandBuffer cmdBuf, uint32_t countInstance, vk::Buffer** scratch_buffer,
-							VkDeviceAddress inst_buffer_addr, VkBuildAccelerationStructureFlagsKHR flags, bool update) {
+							VkDeviceAddress inst_buffer_addr, VkBuildAccelerationStructureFlagsKHR flags, bool update,
+							bool in_place = false) {
 	// Wraps a device pointer to the above uploaded instances.
 	VkAccelerationStructureGeometryInstancesDataKHR instances_vk{
 		VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
@@ -133,19 +135,22 @@ static void cmd_create_tlas(BVH& tlas, VkCommandBuffer cmdBuf, uint32_t countIns
 #endif
 
 	// Create TLAS
-	if (update == false) {
+	if (update == false && in_place == false) {
 		VkAccelerationStructureCreateInfoKHR create_info{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
 		create_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
 		create_info.size = size_info.accelerationStructureSize;
 		tlas = create_acceleration(create_info);
 	}
 
-	// Allocate the scratch memory
-	*scratch_buffer = drm::get({.name = "TLAS Scratch Buffer",
-								.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-								.memory_type = vk::BufferType::STAGING,
-								.size = size_info.buildScratchSize,
-								.dedicated_allocation = false});
+	// Allocate the scratch memory, unless the TLAS keeps its own
+	if (*scratch_buffer == nullptr) {
+		*scratch_buffer =
+			drm::get({.name = "TLAS Scratch Buffer",
+					  .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+					  .memory_type = vk::BufferType::STAGING,
+					  .size = update ? size_info.updateScratchSize : size_info.buildScratchSize,
+					  .dedicated_allocation = false});
+	}
 	// Update build information
 	build_info.srcAccelerationStructure = update ? tlas.accel : VK_NULL_HANDLE;
 	build_info.dstAccelerationStructure = tlas.accel;
@@ -302,7 +307,7 @@ void build_tlas(BVH& tlas, std::vector<VkAccelerationStructureInstanceKHR>& inst
 						 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0,
 						 nullptr);
 
-	vk::Buffer* scratch_buffer;
+	vk::Buffer* scratch_buffer = nullptr;
 	// Creating the TLAS
 	cmd_create_tlas(tlas, cmd.handle, count_instance, &scratch_buffer, instances_buf->get_device_address(), flags,
 					update);
@@ -311,7 +316,102 @@ void build_tlas(BVH& tlas, std::vector<VkAccelerationStructureInstanceKHR>& inst
 	cmd.submit();
 	drm::destroy(instances_buf);
 	drm::destroy(scratch_buffer);
+	if (has_flag(flags, VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) && !update) {
+		tlas.flags = flags;
+		tlas.instances = instances;
+		// Written by update_tlas
+		tlas.instance_buffer = prm::get_buffer(
+			{.name = "TLAS Instances Buffer",
+			 .usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+					  VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+			 .memory_type = vk::BufferType::CPU_TO_GPU,
+			 .size = sizeof(VkAccelerationStructureInstanceKHR) * instances.size() * MAX_FRAMES_IN_FLIGHT});
+		tlas.instance_slot = 0;
+		// Large enough for both refits and in place rebuilds
+		VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+		geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+		geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+		VkAccelerationStructureBuildGeometryInfoKHR build_info{
+			VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+		build_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+		build_info.flags = flags;
+		build_info.geometryCount = 1;
+		build_info.pGeometries = &geometry;
+		VkAccelerationStructureBuildSizesInfoKHR size_info{
+			VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+		vkGetAccelerationStructureBuildSizesKHR(vk::context().device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+												&build_info, &count_instance, &size_info);
+		tlas.scratch_buffer =
+			prm::get_buffer({.name = "TLAS Scratch Buffer",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = std::max(size_info.buildScratchSize, size_info.updateScratchSize)});
+	}
 	vk::render_graph()->set_pipelines_dirty(true, false);
 }
 
+void update_tlas(BVH& tlas, VkCommandBuffer cmd, bool refit) {
+	LUMEN_ASSERT(tlas.instance_buffer, "The TLAS was not built with ALLOW_UPDATE");
+	const uint32_t count_instance = static_cast<uint32_t>(tlas.instances.size());
+	const VkDeviceSize slot_size = sizeof(VkAccelerationStructureInstanceKHR) * tlas.instances.size();
+	// The frame that built from this slot before finished when prepare_frame waited on its fence
+	tlas.instance_slot = (tlas.instance_slot + 1) % MAX_FRAMES_IN_FLIGHT;
+	uint8_t* instances = (uint8_t*)vk::map_buffer(tlas.instance_buffer);
+	memcpy(instances + tlas.instance_slot * slot_size, tlas.instances.data(), slot_size);
+	vk::unmap_buffer(tlas.instance_buffer);
+	// Earlier frames on the queue may still be tracing against the TLAS or updating it
+	constexpr VkAccessFlags as_access =
+		VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+	VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+	barrier.srcAccessMask = as_access;
+	barrier.dstAccessMask = as_access;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	GPUQueryManager::begin(cmd, refit ? TLAS_REFIT_TIMESTAMP : TLAS_REBUILD_TIMESTAMP);
+	cmd_create_tlas(tlas, cmd, count_instance, &tlas.scratch_buffer,
+					tlas.instance_buffer->get_device_address() + tlas.instance_slot * slot_size, tlas.flags, refit,
+					true);
+	GPUQueryManager::end(cmd);
+	// The passes of the frame trace against the updated TLAS
+	barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+	barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void destroy_bvh(BVH& bvh) {
+	if (bvh.accel) {
+		prm::remove(bvh.buffer);
+		vkDestroyAccelerationStructureKHR(vk::context().device, bvh.accel, nullptr);
+	}
+	if (bvh.instance_buffer) {
+		prm::remove(bvh.instance_buffer);
+		prm::remove(bvh.scratch_buffer);
+	}
+	bvh = {};
+}
+
+bool TlasRefitHeuristic::should_rebuild(const std::vector<glm::vec3>& centers, float scene_radius) const {
+	if (num_refits >= max_refits || centers.size() != build_centers.size()) {
+		return true;
+	}
+	if (centers.empty()) {
+		return false;
+	}
+	float total_displacement = 0.0f;
+	for (size_t i = 0; i < centers.size(); i++) {
+		total_displacement += glm::distance(centers[i], build_centers[i]);
+	}
+	return total_displacement / centers.size() > max_displacement * scene_radius;
+}
+
+void TlasRefitHeuristic::on_update(const std::vector<glm::vec3>& centers, bool refit) {
+	if (refit) {
+		num_refits++;
+	} else {
+		build_centers = centers;
+		num_refits = 0;
+	}
+}
+
 }  // namespace vk
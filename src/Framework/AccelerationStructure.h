@@ -8,6 +8,13 @@ namespace vk {
 struct BVH {
 	VkAccelerationStructureKHR accel = VK_NULL_HANDLE;
 	vk::Buffer* buffer;
+	// Top level structures built with ALLOW_UPDATE keep their instances, a host visible copy of them per frame in
+	// flight and the scratch memory around so that update_tlas can rewrite the transforms in place
+	std::vector<VkAccelerationStructureInstanceKHR> instances;
+	vk::Buffer* instance_buffer = nullptr;
+	uint32_t instance_slot = 0;
+	vk::Buffer* scratch_buffer = nullptr;
+	VkBuildAccelerationStructureFlagsKHR flags = 0;
 
 	VkDeviceAddress get_blas_device_address() const {
 		VkAccelerationStructureDeviceAddressInfoKHR addr_info{
@@ -27,4 +34,25 @@ void build_blas(std::vector<BVH>& blases, const std::vector<BlasInput>& input,
 void build_tlas(BVH& tlas, std::vector<VkAccelerationStructureInstanceKHR>& instances,
 				VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
 				bool update = false);
+// Uploads tlas.instances and records a refit of the TLAS or a rebuild into the same acceleration structure into cmd,
+// at most once per frame. The handle stays valid in both cases, so no descriptor or pipeline has to be recreated. The
+// build is timed with GPUQueryManager under one of the names below
+void update_tlas(BVH& tlas, VkCommandBuffer cmd, bool refit);
+inline constexpr const char* TLAS_REFIT_TIMESTAMP = "TLAS Refit";
+inline constexpr const char* TLAS_REBUILD_TIMESTAMP = "TLAS Rebuild";
+void destroy_bvh(BVH& bvh);
+
+// Refitting keeps the topology of the last full build and only grows the node bounds, which degrades the tree as
+// instances move relative to each other. Asks for a rebuild once the mean displacement of the instance centers since
+// that build exceeds max_displacement times the scene radius, or after max_refits refits in a row
+struct TlasRefitHeuristic {
+	float max_displacement = 0.05f;
+	uint32_t max_refits = 256;
+	bool should_rebuild(const std::vector<glm::vec3>& centers, float scene_radius) const;
+	void on_update(const std::vector<glm::vec3>& centers, bool refit);
+
+   private:
+	std::vector<glm::vec3> build_centers;
+	uint32_t num_refits = 0;
+};
 }  // namespace vk
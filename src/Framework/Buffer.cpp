@@ -7,6 +7,7 @@
 #include "VulkanContext.h"
 #include "DynamicResourceManager.h"
 #include "VulkanStructs.h"
+#include "MemoryBudget.h"
 
 namespace vk {
 void create_buffer(Buffer* buffer, const BufferDesc& desc) {
@@ -35,8 +36,15 @@ void create_buffer(Buffer* buffer, const BufferDesc& desc) {
 		alloc_ci.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
 	}
 	VkBufferCreateInfo buffer_ci = vk::buffer(buffer->usage_flags, buffer->size, VK_SHARING_MODE_EXCLUSIVE);
+	MemoryBudget::check(buffer_ci, alloc_ci, buffer->name, desc.memory_type == BufferType::STAGING);
 	VmaAllocationInfo alloc_info;
-	vk::check(vmaCreateBuffer(vk::context().allocator, &buffer_ci, &alloc_ci, &buffer->handle, &buffer->allocation, &alloc_info));
+	VkResult result = vmaCreateBuffer(vk::context().allocator, &buffer_ci, &alloc_ci, &buffer->handle,
+									  &buffer->allocation, &alloc_info);
+	if (result != VK_SUCCESS) {
+		MemoryBudget::allocation_failed(buffer->name);
+	}
+	vk::check(result);
+	MemoryBudget::track(buffer->allocation, buffer->name, desc.memory_type == BufferType::STAGING);
 	if (!buffer->name.empty()) {
 		vk::DebugMarker::set_resource_name(vk::context().device, (uint64_t)buffer->handle, buffer->name.data(),
 										   VK_OBJECT_TYPE_BUFFER);
@@ -72,7 +80,10 @@ VkDescriptorBufferInfo get_buffer_descriptor(const vk::Buffer* buffer) {
 	return buffer_info;
 }
 
-void destroy_buffer(Buffer* buffer) { vmaDestroyBuffer(vk::context().allocator, buffer->handle, buffer->allocation); }
+void destroy_buffer(Buffer* buffer) {
+	MemoryBudget::untrack(buffer->allocation);
+	vmaDestroyBuffer(vk::context().allocator, buffer->handle, buffer->allocation);
+}
 
 void write_buffer(Buffer* buffer, void* data, size_t size) {
 	VkMemoryPropertyFlags mem_prop_flags;
@@ -0,0 +1,379 @@
+#include "LumenPCH.h"
+#include "CPUBVH.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LUMEN_BVH_SSE 1
+#include <emmintrin.h>
+#else
+#define LUMEN_BVH_SSE 0
+#endif
+
+namespace lumen {
+
+static constexpr uint32_t SAH_BINS = 12;
+static constexpr uint32_t MAX_LEAF_SIZE = 8;
+static constexpr uint32_t TRAVERSAL_STACK_SIZE = 256;
+
+struct CPUBVH::BuildNode {
+	glm::vec3 bmin{FLT_MAX};
+	glm::vec3 bmax{-FLT_MAX};
+	uint32_t left = 0;
+	uint32_t right = 0;
+	uint32_t first = 0;
+	// Non zero for leaves
+	uint32_t count = 0;
+};
+
+struct CPUBVH::TraversalRay {
+	glm::vec3 o;
+	glm::vec3 inv_d;
+	uint32_t sign[3];
+};
+
+static float half_area(const glm::vec3& bmin, const glm::vec3& bmax) {
+	const glm::vec3 e = glm::max(bmax - bmin, glm::vec3(0.0f));
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+void CPUBVH::build(const std::vector<glm::vec3>& triangle_vertices) {
+	nodes.clear();
+	triangles.clear();
+	max_depth = 0;
+	const uint32_t num_triangles = (uint32_t)triangle_vertices.size() / 3;
+	if (!num_triangles) {
+		return;
+	}
+	std::vector<glm::vec3> centroids(num_triangles);
+	std::vector<glm::vec3> tri_min(num_triangles);
+	std::vector<glm::vec3> tri_max(num_triangles);
+	std::vector<uint32_t> tri_indices(num_triangles);
+	for (uint32_t i = 0; i < num_triangles; i++) {
+		const glm::vec3& v0 = triangle_vertices[3 * i + 0];
+		const glm::vec3& v1 = triangle_vertices[3 * i + 1];
+		const glm::vec3& v2 = triangle_vertices[3 * i + 2];
+		tri_min[i] = glm::min(v0, glm::min(v1, v2));
+		tri_max[i] = glm::max(v0, glm::max(v1, v2));
+		centroids[i] = 0.5f * (tri_min[i] + tri_max[i]);
+		tri_indices[i] = i;
+	}
+
+	std::vector<BuildNode> build_nodes;
+	build_nodes.reserve(2 * num_triangles);
+	const uint32_t root = build_binary(build_nodes, tri_indices, centroids, tri_min, tri_max, 0, num_triangles);
+	nodes.reserve(build_nodes.size() / 2 + 1);
+	collapse(build_nodes, root, 1);
+
+	triangles.resize(num_triangles);
+	for (uint32_t i = 0; i < num_triangles; i++) {
+		const uint32_t idx = tri_indices[i];
+		const glm::vec3& v0 = triangle_vertices[3 * idx + 0];
+		triangles[i] = {v0, triangle_vertices[3 * idx + 1] - v0, triangle_vertices[3 * idx + 2] - v0, idx};
+	}
+}
+
+uint32_t CPUBVH::build_binary(std::vector<BuildNode>& build_nodes, std::vector<uint32_t>& tri_indices,
+							  const std::vector<glm::vec3>& centroids, const std::vector<glm::vec3>& tri_min,
+							  const std::vector<glm::vec3>& tri_max, uint32_t first, uint32_t count) {
+	const uint32_t node_idx = (uint32_t)build_nodes.size();
+	build_nodes.emplace_back();
+	BuildNode node;
+	glm::vec3 cmin{FLT_MAX};
+	glm::vec3 cmax{-FLT_MAX};
+	for (uint32_t i = first; i < first + count; i++) {
+		const uint32_t idx = tri_indices[i];
+		node.bmin = glm::min(node.bmin, tri_min[idx]);
+		node.bmax = glm::max(node.bmax, tri_max[idx]);
+		cmin = glm::min(cmin, centroids[idx]);
+		cmax = glm::max(cmax, centroids[idx]);
+	}
+
+	// Binned SAH, costs are relative to the cost of intersecting a single triangle
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	uint32_t best_bin = 0;
+	const glm::vec3 extent = cmax - cmin;
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] <= 1e-12f) {
+			continue;
+		}
+		glm::vec3 bin_min[SAH_BINS];
+		glm::vec3 bin_max[SAH_BINS];
+		uint32_t bin_count[SAH_BINS] = {};
+		std::fill_n(bin_min, SAH_BINS, glm::vec3(FLT_MAX));
+		std::fill_n(bin_max, SAH_BINS, glm::vec3(-FLT_MAX));
+		const float scale = SAH_BINS / extent[axis];
+		for (uint32_t i = first; i < first + count; i++) {
+			const uint32_t idx = tri_indices[i];
+			const uint32_t b = std::min(SAH_BINS - 1, uint32_t((centroids[idx][axis] - cmin[axis]) * scale));
+			bin_count[b]++;
+			bin_min[b] = glm::min(bin_min[b], tri_min[idx]);
+			bin_max[b] = glm::max(bin_max[b], tri_max[idx]);
+		}
+		// Sweep from the right to get the suffix areas, then evaluate every split plane from the left
+		float right_area[SAH_BINS];
+		uint32_t right_count[SAH_BINS];
+		glm::vec3 rmin{FLT_MAX};
+		glm::vec3 rmax{-FLT_MAX};
+		uint32_t rcount = 0;
+		for (uint32_t b = SAH_BINS - 1; b > 0; b--) {
+			rmin = glm::min(rmin, bin_min[b]);
+			rmax = glm::max(rmax, bin_max[b]);
+			rcount += bin_count[b];
+			right_area[b] = half_area(rmin, rmax);
+			right_count[b] = rcount;
+		}
+		glm::vec3 lmin{FLT_MAX};
+		glm::vec3 lmax{-FLT_MAX};
+		uint32_t lcount = 0;
+		for (uint32_t b = 0; b < SAH_BINS - 1; b++) {
+			lmin = glm::min(lmin, bin_min[b]);
+			lmax = glm::max(lmax, bin_max[b]);
+			lcount += bin_count[b];
+			if (!lcount || !right_count[b + 1]) {
+				continue;
+			}
+			const float cost = lcount * half_area(lmin, lmax) + right_count[b + 1] * right_area[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	const float node_area = half_area(node.bmin, node.bmax);
+	const float traversal_cost = 1.0f;
+	const bool split_pays_off =
+		best_axis >= 0 && (node_area <= 0.0f || traversal_cost + best_cost / node_area < float(count));
+	if (count <= 2 || (count <= MAX_LEAF_SIZE && !split_pays_off)) {
+		node.first = first;
+		node.count = count;
+		build_nodes[node_idx] = node;
+		return node_idx;
+	}
+
+	uint32_t mid;
+	if (best_axis >= 0) {
+		const float scale = SAH_BINS / extent[best_axis];
+		auto it = std::partition(
+			tri_indices.begin() + first, tri_indices.begin() + first + count, [&](uint32_t idx) {
+				return std::min(SAH_BINS - 1, uint32_t((centroids[idx][best_axis] - cmin[best_axis]) * scale)) <=
+					   best_bin;
+			});
+		mid = uint32_t(it - tri_indices.begin());
+	} else {
+		// All centroids coincide, any split is as good as the other
+		mid = first + count / 2;
+	}
+	const uint32_t left = build_binary(build_nodes, tri_indices, centroids, tri_min, tri_max, first, mid - first);
+	const uint32_t right =
+		build_binary(build_nodes, tri_indices, centroids, tri_min, tri_max, mid, first + count - mid);
+	node.left = left;
+	node.right = right;
+	build_nodes[node_idx] = node;
+	return node_idx;
+}
+
+uint32_t CPUBVH::collapse(const std::vector<BuildNode>& build_nodes, uint32_t build_node_idx, uint32_t depth) {
+	max_depth = std::max(max_depth, depth);
+	const uint32_t node_idx = (uint32_t)nodes.size();
+	nodes.emplace_back();
+	uint32_t children[WIDTH];
+	uint32_t num_children = 0;
+	const BuildNode& build_node = build_nodes[build_node_idx];
+	if (build_node.count) {
+		children[num_children++] = build_node_idx;
+	} else {
+		children[num_children++] = build_node.left;
+		children[num_children++] = build_node.right;
+		// Pull grandchildren up, opening the largest inner child first
+		while (num_children < WIDTH) {
+			int best = -1;
+			float best_area = -1.0f;
+			for (uint32_t i = 0; i < num_children; i++) {
+				const BuildNode& c = build_nodes[children[i]];
+				const float area = half_area(c.bmin, c.bmax);
+				if (!c.count && area > best_area) {
+					best = i;
+					best_area = area;
+				}
+			}
+			if (best < 0) {
+				break;
+			}
+			const BuildNode& c = build_nodes[children[best]];
+			children[best] = c.left;
+			children[num_children++] = c.right;
+		}
+	}
+
+	Node node;
+	for (uint32_t i = 0; i < WIDTH; i++) {
+		if (i >= num_children) {
+			// Inverted bounds are never hit by the slab test
+			for (int a = 0; a < 3; a++) {
+				node.bmin[a][i] = FLT_MAX;
+				node.bmax[a][i] = -FLT_MAX;
+			}
+			node.child[i] = 0;
+			node.count[i] = 0;
+			continue;
+		}
+		const BuildNode& c = build_nodes[children[i]];
+		for (int a = 0; a < 3; a++) {
+			node.bmin[a][i] = c.bmin[a];
+			node.bmax[a][i] = c.bmax[a];
+		}
+		if (c.count) {
+			node.child[i] = c.first;
+			node.count[i] = c.count;
+		} else {
+			node.child[i] = collapse(build_nodes, children[i], depth + 1);
+			node.count[i] = 0;
+		}
+	}
+	nodes[node_idx] = node;
+	return node_idx;
+}
+
+// Returns a bitmask of the children hit before t_max along with their entry distances
+static inline uint32_t intersect_children(const float (&bmin)[3][CPUBVH::WIDTH],
+										  const float (&bmax)[3][CPUBVH::WIDTH], const glm::vec3& o,
+										  const glm::vec3& inv_d, const uint32_t (&sign)[3], float t_min,
+										  float t_max, float* t_entry) {
+#if LUMEN_BVH_SSE
+	__m128 t_near = _mm_set1_ps(t_min);
+	__m128 t_far = _mm_set1_ps(t_max);
+	for (int a = 0; a < 3; a++) {
+		const __m128 near_plane = _mm_load_ps(sign[a] ? bmax[a] : bmin[a]);
+		const __m128 far_plane = _mm_load_ps(sign[a] ? bmin[a] : bmax[a]);
+		const __m128 origin = _mm_set1_ps(o[a]);
+		const __m128 inv = _mm_set1_ps(inv_d[a]);
+		t_near = _mm_max_ps(t_near, _mm_mul_ps(_mm_sub_ps(near_plane, origin), inv));
+		t_far = _mm_min_ps(t_far, _mm_mul_ps(_mm_sub_ps(far_plane, origin), inv));
+	}
+	_mm_storeu_ps(t_entry, t_near);
+	return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(t_near, t_far));
+#else
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < CPUBVH::WIDTH; i++) {
+		float t_near = t_min;
+		float t_far = t_max;
+		for (int a = 0; a < 3; a++) {
+			const float near_plane = sign[a] ? bmax[a][i] : bmin[a][i];
+			const float far_plane = sign[a] ? bmin[a][i] : bmax[a][i];
+			t_near = std::max(t_near, (near_plane - o[a]) * inv_d[a]);
+			t_far = std::min(t_far, (far_plane - o[a]) * inv_d[a]);
+		}
+		t_entry[i] = t_near;
+		mask |= uint32_t(t_near <= t_far) << i;
+	}
+	return mask;
+#endif
+}
+
+template <bool ANY_HIT>
+bool CPUBVH::traverse(const Ray& ray, Hit& hit) const {
+	if (nodes.empty()) {
+		return false;
+	}
+	TraversalRay r;
+	r.o = ray.o;
+	for (int a = 0; a < 3; a++) {
+		// Keep the reciprocal finite so that axis aligned rays don't produce NaNs in the slab test
+		const float d = std::abs(ray.d[a]) < 1e-12f ? std::copysign(1e-12f, ray.d[a]) : ray.d[a];
+		r.inv_d[a] = 1.0f / d;
+		r.sign[a] = r.inv_d[a] < 0.0f;
+	}
+	hit.t = std::min(hit.t, ray.t_max);
+
+	struct StackEntry {
+		uint32_t child;
+		uint32_t count;
+		float t;
+	};
+	// Every level leaves at most WIDTH - 1 siblings behind. Degenerate trees that are too deep for the local stack
+	// traverse with one on the heap
+	const uint32_t stack_size = 1 + (WIDTH - 1) * max_depth;
+	StackEntry local_stack[TRAVERSAL_STACK_SIZE];
+	std::vector<StackEntry> heap_stack;
+	StackEntry* stack = local_stack;
+	if (stack_size > TRAVERSAL_STACK_SIZE) {
+		heap_stack.resize(stack_size);
+		stack = heap_stack.data();
+	}
+	uint32_t sp = 0;
+	stack[sp++] = {0, 0, ray.t_min};
+	bool found = false;
+	while (sp) {
+		const StackEntry entry = stack[--sp];
+		if (entry.t > hit.t) {
+			continue;
+		}
+		if (entry.count) {
+			for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+				// Moller-Trumbore
+				const Triangle& tri = triangles[i];
+				const glm::vec3 p = glm::cross(ray.d, tri.e2);
+				const float det = glm::dot(tri.e1, p);
+				if (std::abs(det) < 1e-12f) {
+					continue;
+				}
+				const float inv_det = 1.0f / det;
+				const glm::vec3 s = ray.o - tri.v0;
+				const float u = glm::dot(s, p) * inv_det;
+				if (u < 0.0f || u > 1.0f) {
+					continue;
+				}
+				const glm::vec3 q = glm::cross(s, tri.e1);
+				const float v = glm::dot(ray.d, q) * inv_det;
+				if (v < 0.0f || u + v > 1.0f) {
+					continue;
+				}
+				const float t = glm::dot(tri.e2, q) * inv_det;
+				if (t <= ray.t_min || t >= hit.t) {
+					continue;
+				}
+				if constexpr (ANY_HIT) {
+					return true;
+				}
+				hit.t = t;
+				hit.u = u;
+				hit.v = v;
+				hit.triangle_idx = tri.idx;
+				found = true;
+			}
+			continue;
+		}
+		const Node& node = nodes[entry.child];
+		alignas(16) float t_entry[WIDTH];
+		uint32_t mask = intersect_children(node.bmin, node.bmax, r.o, r.inv_d, r.sign, ray.t_min, hit.t, t_entry);
+		// Push far to near so that the closest child is visited first
+		uint32_t order[WIDTH];
+		uint32_t num_hits = 0;
+		while (mask) {
+			const uint32_t i = std::countr_zero(mask);
+			mask &= mask - 1;
+			uint32_t j = num_hits++;
+			while (j > 0 && t_entry[order[j - 1]] < t_entry[i]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+		for (uint32_t j = 0; j < num_hits; j++) {
+			const uint32_t i = order[j];
+			stack[sp++] = {node.child[i], node.count[i], t_entry[i]};
+		}
+	}
+	return found;
+}
+
+bool CPUBVH::intersect(const Ray& ray, Hit& hit) const { return traverse<false>(ray, hit); }
+
+bool CPUBVH::occluded(const Ray& ray) const {
+	Hit hit;
+	return traverse<true>(ray, hit);
+}
+
+}  // namespace lumen
@@ -0,0 +1,65 @@
+#pragma once
+#include "../LumenPCH.h"
+
+namespace lumen {
+// 4-wide BVH over world space triangles for tracing on the CPU
+// A binary tree is built with binned SAH splits and then collapsed, so that every node holds the bounds of its
+// 4 children in SoA layout and a single SIMD test culls all of them
+class CPUBVH {
+   public:
+	static constexpr uint32_t WIDTH = 4;
+	struct Ray {
+		glm::vec3 o;
+		float t_min = 0.0f;
+		glm::vec3 d;
+		float t_max = FLT_MAX;
+	};
+
+	struct Hit {
+		float t = FLT_MAX;
+		float u = 0.0f;
+		float v = 0.0f;
+		// Index into the triangle list passed to build()
+		uint32_t triangle_idx = UINT32_MAX;
+		inline bool valid() const { return triangle_idx != UINT32_MAX; }
+	};
+
+	// Three consecutive vertices per triangle
+	void build(const std::vector<glm::vec3>& triangle_vertices);
+	bool intersect(const Ray& ray, Hit& hit) const;
+	bool occluded(const Ray& ray) const;
+
+	uint32_t node_count() const { return (uint32_t)nodes.size(); }
+	uint32_t triangle_count() const { return (uint32_t)triangles.size(); }
+
+   private:
+	struct alignas(16) Node {
+		float bmin[3][WIDTH];
+		float bmax[3][WIDTH];
+		// Inner children point into nodes, leaves point into triangles with a non zero count
+		uint32_t child[WIDTH];
+		uint32_t count[WIDTH];
+	};
+
+	struct Triangle {
+		glm::vec3 v0;
+		glm::vec3 e1;
+		glm::vec3 e2;
+		uint32_t idx;
+	};
+
+	struct BuildNode;
+	struct TraversalRay;
+	uint32_t build_binary(std::vector<BuildNode>& build_nodes, std::vector<uint32_t>& tri_indices,
+						  const std::vector<glm::vec3>& centroids, const std::vector<glm::vec3>& tri_min,
+						  const std::vector<glm::vec3>& tri_max, uint32_t first, uint32_t count);
+	uint32_t collapse(const std::vector<BuildNode>& build_nodes, uint32_t build_node_idx, uint32_t depth);
+	template <bool ANY_HIT>
+	bool traverse(const Ray& ray, Hit& hit) const;
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	// Inner node levels of the collapsed tree, which bound the traversal stack
+	uint32_t max_depth = 0;
+};
+}  // namespace lumen
@@ -0,0 +1,179 @@
+#include "LumenPCH.h"
+#include "EnvMapDistribution.h"
+#include "shaders/commons.h"
+#include <random>
+
+namespace lumen {
+
+static float luminance(const float* rgb) { return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2]; }
+
+// Largest i < count with cdf[i] <= xi, over a CDF of count + 1 entries
+static uint32_t find_interval(const float* cdf, uint32_t count, float xi) {
+	const float* it = std::upper_bound(cdf, cdf + count + 1, xi);
+	return (uint32_t)std::clamp<ptrdiff_t>(it - cdf - 1, 0, count - 1);
+}
+
+// Fills cdf with count + 1 entries and returns the integral of f over [0, 1]
+static float build_cdf(const float* f, uint32_t count, float* cdf) {
+	cdf[0] = 0.0f;
+	for (uint32_t i = 0; i < count; i++) {
+		cdf[i + 1] = cdf[i] + f[i] / count;
+	}
+	const float integral = cdf[count];
+	for (uint32_t i = 1; i <= count; i++) {
+		cdf[i] = integral > 0.0f ? cdf[i] / integral : float(i) / count;
+	}
+	return integral;
+}
+
+void EnvMapDistribution::build(const float* rgba, uint32_t width, uint32_t height) {
+	this->width = width;
+	this->height = height;
+	func.resize(size_t(width) * height);
+	for (uint32_t y = 0; y < height; y++) {
+		const float sin_theta = std::sin(glm::pi<float>() * (y + 0.5f) / height);
+		for (uint32_t x = 0; x < width; x++) {
+			// The shaders filter bilinearly, take the maximum over the neighborhood so that every direction with
+			// radiance keeps a non zero pdf
+			float max_lum = 0.0f;
+			for (int dy = -1; dy <= 1; dy++) {
+				const uint32_t ny = (uint32_t)std::clamp<int>(int(y) + dy, 0, int(height) - 1);
+				for (int dx = -1; dx <= 1; dx++) {
+					const uint32_t nx = (x + width + dx) % width;
+					max_lum = std::max(max_lum, luminance(&rgba[4 * (size_t(ny) * width + nx)]));
+				}
+			}
+			func[size_t(y) * width + x] = max_lum * sin_theta;
+		}
+	}
+
+	conditional_cdf.resize(size_t(height) * (width + 1));
+	marginal_cdf.resize(height + 1);
+	std::vector<float> marginal_func(height);
+	auto build_cdfs = [&] {
+		for (uint32_t y = 0; y < height; y++) {
+			marginal_func[y] = build_cdf(&func[size_t(y) * width], width, &conditional_cdf[size_t(y) * (width + 1)]);
+		}
+		integral = build_cdf(marginal_func.data(), height, marginal_cdf.data());
+	};
+	build_cdfs();
+	if (integral <= 0.0f) {
+		LUMEN_WARN("Environment map has no radiance, falling back to uniform sampling");
+		for (uint32_t y = 0; y < height; y++) {
+			std::fill_n(&func[size_t(y) * width], width, std::sin(glm::pi<float>() * (y + 0.5f) / height));
+		}
+		build_cdfs();
+	}
+}
+
+glm::vec2 EnvMapDistribution::sample(const glm::vec2& u, float& pdf) const {
+	const uint32_t y = find_interval(marginal_cdf.data(), height, u.y);
+	float dy = u.y - marginal_cdf[y];
+	if (marginal_cdf[y + 1] > marginal_cdf[y]) {
+		dy /= marginal_cdf[y + 1] - marginal_cdf[y];
+	}
+	const float* row_cdf = &conditional_cdf[size_t(y) * (width + 1)];
+	const uint32_t x = find_interval(row_cdf, width, u.x);
+	float dx = u.x - row_cdf[x];
+	if (row_cdf[x + 1] > row_cdf[x]) {
+		dx /= row_cdf[x + 1] - row_cdf[x];
+	}
+	pdf = func[size_t(y) * width + x] / integral;
+	return glm::vec2((x + dx) / width, (y + dy) / height);
+}
+
+float EnvMapDistribution::pdf(const glm::vec2& uv) const {
+	const uint32_t x = std::min(uint32_t(uv.x * width), width - 1);
+	const uint32_t y = std::min(uint32_t(uv.y * height), height - 1);
+	return func[size_t(y) * width + x] / integral;
+}
+
+float EnvMapDistribution::pdf_dir(const glm::vec3& dir) const {
+	const glm::vec2 uv = dir_to_uv(dir);
+	const float sin_theta = std::sin(uv.y * glm::pi<float>());
+	if (sin_theta <= 0.0f) {
+		return 0.0f;
+	}
+	return pdf(uv) / (2.0f * glm::pi<float>() * glm::pi<float>() * sin_theta);
+}
+
+glm::vec2 EnvMapDistribution::dir_to_uv(const glm::vec3& dir) {
+	const float phi = std::atan2(dir.z, dir.x);
+	const float u = phi * glm::one_over_two_pi<float>();
+	return glm::vec2(u < 0.0f ? u + 1.0f : u, std::acos(std::clamp(dir.y, -1.0f, 1.0f)) * glm::one_over_pi<float>());
+}
+
+glm::vec3 EnvMapDistribution::uv_to_dir(const glm::vec2& uv) {
+	const float phi = uv.x * glm::two_pi<float>();
+	const float theta = uv.y * glm::pi<float>();
+	const float sin_theta = std::sin(theta);
+	return glm::vec3(sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi));
+}
+
+std::vector<float> EnvMapDistribution::gpu_data(uint32_t light_idx) const {
+	constexpr size_t header_size = sizeof(EnvMapHeader) / sizeof(float);
+	std::vector<float> data(header_size + marginal_cdf.size() + conditional_cdf.size() + func.size());
+	EnvMapHeader header;
+	header.width = width;
+	header.height = height;
+	header.integral = integral;
+	header.light_idx = light_idx;
+	std::memcpy(data.data(), &header, sizeof(header));
+	float* dst = data.data() + header_size;
+	dst = std::copy(marginal_cdf.begin(), marginal_cdf.end(), dst);
+	dst = std::copy(conditional_cdf.begin(), conditional_cdf.end(), dst);
+	std::copy(func.begin(), func.end(), dst);
+	return data;
+}
+
+bool EnvMapDistribution::validate(uint32_t num_samples) const {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	// The solid angle pdf integrates to one over the sphere
+	double sphere_integral = 0.0;
+	for (uint32_t i = 0; i < num_samples; i++) {
+		const float z = 1.0f - 2.0f * uniform(rng);
+		const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		const float phi = glm::two_pi<float>() * uniform(rng);
+		sphere_integral += pdf_dir(glm::vec3(r * std::cos(phi), z, r * std::sin(phi)));
+	}
+	sphere_integral *= 4.0 * glm::pi<double>() / num_samples;
+
+	// Histogram of the sampled points against the mass of the texels falling into each bin
+	const uint32_t bins_x = std::min(width, 32u);
+	const uint32_t bins_y = std::min(height, 16u);
+	std::vector<double> expected(bins_x * bins_y, 0.0);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			const uint32_t bin = (y * bins_y / height) * bins_x + x * bins_x / width;
+			expected[bin] += func[size_t(y) * width + x] / (integral * width * height);
+		}
+	}
+	std::vector<uint32_t> counts(bins_x * bins_y, 0);
+	double max_pdf_error = 0.0;
+	for (uint32_t i = 0; i < num_samples; i++) {
+		float sample_pdf;
+		const glm::vec2 uv = sample(glm::vec2(uniform(rng), uniform(rng)), sample_pdf);
+		// The returned pdf has to agree with evaluating the pdf at the sampled point
+		max_pdf_error = std::max(max_pdf_error, double(std::abs(sample_pdf - pdf(uv))) / std::max(sample_pdf, 1e-8f));
+		const uint32_t bx = std::min(uint32_t(uv.x * width), width - 1) * bins_x / width;
+		const uint32_t by = std::min(uint32_t(uv.y * height), height - 1) * bins_y / height;
+		counts[by * bins_x + bx]++;
+	}
+	double max_bin_error = 0.0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		// Skip bins too unlikely to be estimated reliably
+		if (expected[i] * num_samples < 1000.0) {
+			continue;
+		}
+		const double observed = double(counts[i]) / num_samples;
+		max_bin_error = std::max(max_bin_error, std::abs(observed - expected[i]) / expected[i]);
+	}
+
+	LUMEN_TRACE("Environment map {}x{}: sphere integral {:.4f}, max bin error {:.3e}, max pdf mismatch {:.3e}", width,
+				height, sphere_integral, max_bin_error, max_pdf_error);
+	return std::abs(sphere_integral - 1.0) < 0.02 && max_bin_error < 0.1 && max_pdf_error < 1e-4;
+}
+
+}  // namespace lumen
@@ -0,0 +1,37 @@
+#pragma once
+#include "../LumenPCH.h"
+
+namespace lumen {
+// Piecewise constant 2D distribution over an equirectangular environment map
+// Texels are weighted by their luminance times sin(theta), so that directions are sampled proportionally to the
+// radiance they carry. A marginal CDF picks the row and the conditional CDF of that row picks the column
+class EnvMapDistribution {
+   public:
+	void build(const float* rgba, uint32_t width, uint32_t height);
+	// Maps two uniform numbers to a point of the unit square, pdf is with respect to the unit square
+	glm::vec2 sample(const glm::vec2& u, float& pdf) const;
+	float pdf(const glm::vec2& uv) const;
+	// Solid angle pdf of the direction towards the environment
+	float pdf_dir(const glm::vec3& dir) const;
+
+	// Equirectangular mapping with +y up, mirrored by the shaders
+	static glm::vec2 dir_to_uv(const glm::vec3& dir);
+	static glm::vec3 uv_to_dir(const glm::vec2& uv);
+
+	// Header (EnvMapHeader) followed by the marginal CDF, the conditional CDFs and the function values
+	std::vector<float> gpu_data(uint32_t light_idx) const;
+	// Checks the normalization over the sphere and compares a histogram of the samples against the pdf
+	bool validate(uint32_t num_samples) const;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Integral of the function over the unit square
+	float integral = 0.0f;
+
+   private:
+	std::vector<float> func;
+	// height rows of width + 1 entries
+	std::vector<float> conditional_cdf;
+	std::vector<float> marginal_cdf;
+};
+}  // namespace lumen
@@ -3,13 +3,80 @@
 
 namespace GPUQueryManager {
 
+using Interval = std::pair<uint64_t, uint64_t>;
+
 TimestampData _data;
 uint32_t _curr_query_idx = 0;
 uint32_t _curr_pool_idx = 0;
+// Async compute work of a frame overlaps the graphics work of the next one
+std::vector<Interval> _prev_async_intervals;
+
+static std::vector<Interval> merge_intervals(std::vector<Interval> intervals) {
+	std::sort(intervals.begin(), intervals.end());
+	std::vector<Interval> merged;
+	for (const Interval& interval : intervals) {
+		if (!merged.empty() && interval.first <= merged.back().second) {
+			merged.back().second = std::max(merged.back().second, interval.second);
+		} else {
+			merged.push_back(interval);
+		}
+	}
+	return merged;
+}
+
+static uint64_t total_length(const std::vector<Interval>& intervals) {
+	uint64_t res = 0;
+	for (const Interval& interval : intervals) {
+		res += interval.second - interval.first;
+	}
+	return res;
+}
+
+// Both inputs are sorted and disjoint
+static uint64_t intersection_length(const std::vector<Interval>& a, const std::vector<Interval>& b) {
+	uint64_t res = 0;
+	size_t i = 0, j = 0;
+	while (i < a.size() && j < b.size()) {
+		uint64_t lo = std::max(a[i].first, b[j].first);
+		uint64_t hi = std::min(a[i].second, b[j].second);
+		if (lo < hi) {
+			res += hi - lo;
+		}
+		if (a[i].second < b[j].second) {
+			i++;
+		} else {
+			j++;
+		}
+	}
+	return res;
+}
+
+static void compute_overlap() {
+	std::vector<Interval> gfx_intervals;
+	std::vector<Interval> async_intervals = _prev_async_intervals;
+	std::vector<Interval> curr_async_intervals;
+	for (uint32_t i = 0; i + 1 < _data.size; i += 2) {
+		Interval interval = {_data.timestamps[i], _data.timestamps[i + 1]};
+		if (interval.second <= interval.first) {
+			continue;
+		}
+		if (_data.async[i >> 1]) {
+			curr_async_intervals.push_back(interval);
+		} else {
+			gfx_intervals.push_back(interval);
+		}
+	}
+	async_intervals.insert(async_intervals.end(), curr_async_intervals.begin(), curr_async_intervals.end());
+	gfx_intervals = merge_intervals(std::move(gfx_intervals));
+	_data.gfx_busy_time = total_length(gfx_intervals);
+	_data.async_overlap_time = intersection_length(gfx_intervals, merge_intervals(std::move(async_intervals)));
+	_prev_async_intervals = std::move(curr_async_intervals);
+}
 
-void begin(VkCommandBuffer cmd, const char* name) {
+void begin(VkCommandBuffer cmd, const char* name, bool async) {
 	LUMEN_ASSERT(_curr_query_idx < 4096, "Query pool exhausted");
 	_data.names[_curr_query_idx >> 1] = std::string(name);
+	_data.async[_curr_query_idx >> 1] = async;
 	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vk::context().query_pool_timestamps[_curr_pool_idx],
 						_curr_query_idx++);
 }
@@ -26,6 +93,7 @@ void collect(uint32_t curr_frame_idx) {
 		vkGetQueryPoolResults(vk::context().device, vk::context().query_pool_timestamps[curr_frame_idx], 0,
 							  _curr_query_idx, sizeof(uint64_t) * _curr_query_idx, _data.timestamps, sizeof(uint64_t),
 							  VK_QUERY_RESULT_64_BIT);
+		compute_overlap();
 		_curr_query_idx = 0;
 	}
 	_curr_pool_idx = curr_frame_idx;
@@ -7,11 +7,16 @@ namespace GPUQueryManager {
 struct TimestampData {
 	std::string names[2048];
 	uint64_t timestamps[4096];
+	// Whether the timestamp pair was written by the async compute queue
+	bool async[2048];
 	uint32_t size;
+	// Time the graphics queue was busy, and how much of that overlapped with async compute work (in ticks)
+	uint64_t gfx_busy_time;
+	uint64_t async_overlap_time;
 };
-void begin(VkCommandBuffer cmd, const char* name);
+void begin(VkCommandBuffer cmd, const char* name, bool async = false);
 void end(VkCommandBuffer cmd);
 void collect(uint32_t curr_frame_idx);
 void collect();
 const TimestampData& get();
-}  // namespace GPUQueryManager
\ No newline at end of file
+}  // namespace GPUQueryManager
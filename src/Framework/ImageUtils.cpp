@@ -2,6 +2,7 @@
 #include "ImageUtils.h"
 #define TINYEXR_IMPLEMENTATION
 #include <tinyexr.h>
+#include <stb_image/stb_image.h>
 
 namespace ImageUtils {
 
@@ -19,6 +20,19 @@ float* load_exr(const char* img_name, int& width, int& height) {
 	return data;
 }
 
+float* load_hdr(const char* img_name, int& width, int& height) {
+	const std::string path = img_name;
+	if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0) {
+		return load_exr(img_name, width, height);
+	}
+	int channels;
+	float* data = stbi_loadf(img_name, &width, &height, &channels, 4);
+	if (!data) {
+		LUMEN_WARN("Could not load HDR image {}", img_name);
+	}
+	return data;
+}
+
 void save_exr(const float* rgb, int width, int height, const char* outfilename) {
 	EXRHeader header;
 	InitEXRHeader(&header);
@@ -87,4 +101,486 @@ void save_exr(const float* rgb, int width, int height, const char* outfilename)
 	free(header.pixel_types);
 	free(header.requested_pixel_types);
 }
-}  // namespace ImageUtils
\ No newline at end of file
+
+ExrTileWriter::ExrTileWriter(const char* path, int width, int height, bool full_precision)
+	: file(path, std::ios::binary), width(width), height(height), channel_size(full_precision ? 4 : 2) {
+	if (!file) {
+		LUMEN_ERROR("Could not open " + std::string(path));
+	}
+	const auto put = [this](const void* data, size_t size) { file.write((const char*)data, size); };
+	const auto attribute = [&](const char* name, const char* type, uint32_t size) {
+		put(name, strlen(name) + 1);
+		put(type, strlen(type) + 1);
+		put(&size, sizeof(size));
+	};
+	const uint32_t magic = 20000630;
+	// Single part scanline file
+	const uint32_t version = 2;
+	put(&magic, sizeof(magic));
+	put(&version, sizeof(version));
+	// Name, pixel type (1 for half, 2 for float), pLinear and reserved bytes, x and y sampling
+	attribute("channels", "chlist", 3 * 18 + 1);
+	for (const char* name : {"B", "G", "R"}) {
+		const int32_t channel[4] = {channel_size == 4 ? 2 : 1, 0, 1, 1};
+		put(name, 2);
+		put(channel, sizeof(channel));
+	}
+	put("", 1);
+	const uint8_t no_compression = 0;
+	attribute("compression", "compression", 1);
+	put(&no_compression, 1);
+	const int32_t window[4] = {0, 0, width - 1, height - 1};
+	attribute("dataWindow", "box2i", sizeof(window));
+	put(window, sizeof(window));
+	attribute("displayWindow", "box2i", sizeof(window));
+	put(window, sizeof(window));
+	const uint8_t increasing_y = 0;
+	attribute("lineOrder", "lineOrder", 1);
+	put(&increasing_y, 1);
+	const float one = 1.0f;
+	const float center[2] = {0.0f, 0.0f};
+	attribute("pixelAspectRatio", "float", sizeof(one));
+	put(&one, sizeof(one));
+	attribute("screenWindowCenter", "v2f", sizeof(center));
+	put(center, sizeof(center));
+	attribute("screenWindowWidth", "float", sizeof(one));
+	put(&one, sizeof(one));
+	put("", 1);
+	// Every scanline is a chunk of fixed size, so the offset table is known up front
+	chunks_offset = uint64_t(file.tellp()) + uint64_t(height) * sizeof(uint64_t);
+	for (int y = 0; y < height; y++) {
+		const uint64_t offset = chunks_offset + y * chunk_size();
+		put(&offset, sizeof(offset));
+	}
+}
+
+void ExrTileWriter::write(const float* rgba, int x, int y, int w, int h, int stride) {
+	const int x0 = std::max(x, 0);
+	const int x1 = std::min(x + w, width);
+	const int y0 = std::max(y, 0);
+	const int y1 = std::min(y + h, height);
+	if (x0 >= x1) {
+		return;
+	}
+	std::vector<uint16_t> half_segment(x1 - x0);
+	std::vector<float> segment(x1 - x0);
+	for (int row = y0; row < y1; row++) {
+		const uint64_t chunk = chunks_offset + row * chunk_size();
+		const int32_t prefix[2] = {row, int32_t(chunk_size() - 8)};
+		file.seekp(chunk);
+		file.write((const char*)prefix, sizeof(prefix));
+		const float* src = rgba + (size_t(row - y) * stride + (x0 - x)) * 4;
+		// Channels are stored B, G, R within a scanline
+		for (int c = 0; c < 3; c++) {
+			file.seekp(chunk + 8 + (uint64_t(c) * width + x0) * channel_size);
+			if (channel_size == 4) {
+				for (int i = 0; i < x1 - x0; i++) {
+					segment[i] = src[4 * i + 2 - c];
+				}
+				file.write((const char*)segment.data(), segment.size() * sizeof(float));
+			} else {
+				for (int i = 0; i < x1 - x0; i++) {
+					half_segment[i] = glm::packHalf1x16(src[4 * i + 2 - c]);
+				}
+				file.write((const char*)half_segment.data(), half_segment.size() * sizeof(uint16_t));
+			}
+		}
+	}
+}
+
+static int exr_compression(ExrCompression compression) {
+	switch (compression) {
+		case ExrCompression::ZIP:
+			return TINYEXR_COMPRESSIONTYPE_ZIP;
+		case ExrCompression::PIZ:
+			return TINYEXR_COMPRESSIONTYPE_PIZ;
+		default:
+			return TINYEXR_COMPRESSIONTYPE_NONE;
+	}
+}
+
+// Channel and part names have up to 255 characters
+static void copy_exr_name(char* dst, const std::string& name) {
+#ifdef _MSC_VER
+	strncpy_s(dst, 256, name.c_str(), 255);
+#else
+	strncpy(dst, name.c_str(), 255);
+	dst[255] = '\0';
+#endif
+}
+
+bool save_exr_layers(const std::vector<ExrLayer>& layers, int width, int height, const char* path) {
+	const size_t num_pixels = size_t(width) * height;
+	const bool multipart = layers.size() > 1;
+	std::vector<EXRHeader> headers(layers.size());
+	std::vector<EXRImage> images(layers.size());
+	std::vector<std::vector<EXRChannelInfo>> channel_infos(layers.size());
+	std::vector<std::vector<int>> pixel_types(layers.size());
+	std::vector<std::vector<int>> requested_pixel_types(layers.size());
+	std::vector<std::vector<std::vector<float>>> planes(layers.size());
+	std::vector<std::vector<unsigned char*>> plane_ptrs(layers.size());
+	for (size_t l = 0; l < layers.size(); l++) {
+		const ExrLayer& layer = layers[l];
+		const int num_channels = int(layer.channels.size());
+		// Readers expect the channels sorted by name, e.g. B, G, R
+		std::vector<int> order(num_channels);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return layer.channels[a] < layer.channels[b]; });
+		channel_infos[l].resize(num_channels);
+		planes[l].resize(num_channels);
+		for (int c = 0; c < num_channels; c++) {
+			const int src = order[c];
+			const std::string name = l > 0 ? layer.name + "." + layer.channels[src] : layer.channels[src];
+			copy_exr_name(channel_infos[l][c].name, name);
+			planes[l][c].resize(num_pixels);
+			for (size_t i = 0; i < num_pixels; i++) {
+				planes[l][c][i] = layer.pixels[4 * i + src];
+			}
+			plane_ptrs[l].push_back(reinterpret_cast<unsigned char*>(planes[l][c].data()));
+		}
+		pixel_types[l].assign(num_channels, TINYEXR_PIXELTYPE_FLOAT);
+		requested_pixel_types[l].assign(num_channels, layer.half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT);
+
+		EXRHeader& header = headers[l];
+		InitEXRHeader(&header);
+		header.num_channels = num_channels;
+		header.channels = channel_infos[l].data();
+		header.pixel_types = pixel_types[l].data();
+		header.requested_pixel_types = requested_pixel_types[l].data();
+		header.compression_type = exr_compression(layer.compression);
+		header.data_window = header.display_window = {0, 0, width - 1, height - 1};
+		copy_exr_name(header.name, layer.name);
+		EXRImage& image = images[l];
+		InitEXRImage(&image);
+		image.num_channels = num_channels;
+		image.images = plane_ptrs[l].data();
+		image.width = width;
+		image.height = height;
+	}
+	const char* err = nullptr;
+	int ret;
+	if (multipart) {
+		std::vector<const EXRHeader*> header_ptrs;
+		for (const EXRHeader& header : headers) {
+			header_ptrs.push_back(&header);
+		}
+		ret = SaveEXRMultipartImageToFile(images.data(), header_ptrs.data(), uint32_t(layers.size()), path, &err);
+	} else {
+		ret = SaveEXRImageToFile(images.data(), headers.data(), path, &err);
+	}
+	if (ret != TINYEXR_SUCCESS) {
+		LUMEN_WARN("Could not write {}: {}", path, err ? err : "");
+		FreeEXRErrorMessage(err);
+		return false;
+	}
+	LUMEN_TRACE("Saved exr file with {} layers. [ {} ]", layers.size(), path);
+	return true;
+}
+
+AsyncExrWriter::AsyncExrWriter(uint32_t max_pending) : max_pending(max_pending), thread([this]() { run(); }) {}
+
+AsyncExrWriter::~AsyncExrWriter() {
+	{
+		std::lock_guard lock(mutex);
+		done = true;
+	}
+	cv.notify_all();
+	thread.join();
+}
+
+void AsyncExrWriter::submit(const std::string& path, int width, int height, std::vector<ExrLayer>&& layers) {
+	std::unique_lock lock(mutex);
+	cv.wait(lock, [this]() { return jobs.size() < max_pending; });
+	jobs.push_back({path, width, height, std::move(layers)});
+	cv.notify_all();
+}
+
+void AsyncExrWriter::flush() {
+	std::unique_lock lock(mutex);
+	cv.wait(lock, [this]() { return jobs.empty() && !writing; });
+}
+
+void AsyncExrWriter::run() {
+	while (true) {
+		Job job;
+		{
+			std::unique_lock lock(mutex);
+			cv.wait(lock, [this]() { return done || !jobs.empty(); });
+			// Pending files are still written on shutdown
+			if (jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			writing = true;
+		}
+		cv.notify_all();
+		save_exr_layers(job.layers, job.width, job.height, job.path.c_str());
+		{
+			std::lock_guard lock(mutex);
+			writing = false;
+		}
+		cv.notify_all();
+	}
+}
+
+VkFormat output_format(OutputPrecision precision) {
+	switch (precision) {
+		case OutputPrecision::FP16:
+			return VK_FORMAT_R16G16B16A16_SFLOAT;
+		case OutputPrecision::RGB9E5:
+			return VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+		default:
+			return VK_FORMAT_R32G32B32A32_SFLOAT;
+	}
+}
+
+uint32_t texel_size(OutputPrecision precision) {
+	switch (precision) {
+		case OutputPrecision::FP16:
+			return 4 * sizeof(uint16_t);
+		case OutputPrecision::RGB9E5:
+			return sizeof(uint32_t);
+		default:
+			return 4 * sizeof(float);
+	}
+}
+
+const char* precision_name(OutputPrecision precision) {
+	switch (precision) {
+		case OutputPrecision::FP16:
+			return "RGBA16F";
+		case OutputPrecision::RGB9E5:
+			return "E5B9G9R9";
+		default:
+			return "RGBA32F";
+	}
+}
+
+void encode(const float* rgba, OutputPrecision precision, size_t num_pixels, void* dst) {
+	switch (precision) {
+		case OutputPrecision::FP16: {
+			uint16_t* out = (uint16_t*)dst;
+			for (size_t i = 0; i < 4 * num_pixels; i++) {
+				out[i] = glm::packHalf1x16(rgba[i]);
+			}
+			break;
+		}
+		case OutputPrecision::RGB9E5: {
+			uint32_t* out = (uint32_t*)dst;
+			for (size_t i = 0; i < num_pixels; i++) {
+				out[i] = glm::packF3x9_E1x5(glm::vec3(rgba[4 * i + 0], rgba[4 * i + 1], rgba[4 * i + 2]));
+			}
+			break;
+		}
+		default:
+			memcpy(dst, rgba, num_pixels * 4 * sizeof(float));
+			break;
+	}
+}
+
+void decode(const void* src, OutputPrecision precision, size_t num_pixels, float* rgba) {
+	switch (precision) {
+		case OutputPrecision::FP16: {
+			const uint16_t* in = (const uint16_t*)src;
+			for (size_t i = 0; i < 4 * num_pixels; i++) {
+				rgba[i] = glm::unpackHalf1x16(in[i]);
+			}
+			break;
+		}
+		case OutputPrecision::RGB9E5: {
+			const uint32_t* in = (const uint32_t*)src;
+			for (size_t i = 0; i < num_pixels; i++) {
+				glm::vec3 rgb = glm::unpackF3x9_E1x5(in[i]);
+				rgba[4 * i + 0] = rgb.r;
+				rgba[4 * i + 1] = rgb.g;
+				rgba[4 * i + 2] = rgb.b;
+				rgba[4 * i + 3] = 1.0f;
+			}
+			break;
+		}
+		default:
+			memcpy(rgba, src, num_pixels * 4 * sizeof(float));
+			break;
+	}
+}
+
+ErrorStats compare(const float* reference, const float* test, size_t num_pixels) {
+	ErrorStats stats;
+	if (num_pixels == 0) {
+		return stats;
+	}
+	double sq_err_sum = 0.0;
+	double rel_err_sum = 0.0;
+	double rel_sq_err_sum = 0.0;
+	double max_val = 0.0;
+	for (size_t i = 0; i < num_pixels; i++) {
+		for (int c = 0; c < 3; c++) {
+			const double ref = reference[4 * i + c];
+			const double err = std::abs(ref - (double)test[4 * i + c]);
+			sq_err_sum += err * err;
+			// Relative error with a small offset to keep dark pixels from dominating
+			rel_err_sum += err / (std::abs(ref) + 1e-2);
+			rel_sq_err_sum += err * err / (ref * ref + 1e-2);
+			stats.max_abs_error = std::max(stats.max_abs_error, err);
+			max_val = std::max(max_val, std::abs(ref));
+		}
+	}
+	const double mse = sq_err_sum / (3.0 * num_pixels);
+	stats.rmse = std::sqrt(mse);
+	stats.mean_rel_error = rel_err_sum / (3.0 * num_pixels);
+	stats.rel_mse = rel_sq_err_sum / (3.0 * num_pixels);
+	stats.psnr = mse > 0.0 ? 10.0 * std::log10(std::max(max_val, 1.0) * std::max(max_val, 1.0) / mse) : INFINITY;
+	return stats;
+}
+
+double mean_luminance(const float* rgba, size_t num_pixels) {
+	if (num_pixels == 0) {
+		return 0.0;
+	}
+	double sum = 0.0;
+	for (size_t i = 0; i < num_pixels; i++) {
+		sum += 0.2126 * rgba[4 * i] + 0.7152 * rgba[4 * i + 1] + 0.0722 * rgba[4 * i + 2];
+	}
+	return sum / num_pixels;
+}
+
+// Hunt adjusted CIELAB of a linear sRGB color (D65)
+static glm::vec3 flip_lab(const glm::vec3& rgb) {
+	const glm::vec3 xyz = glm::vec3(0.4124f * rgb.r + 0.3576f * rgb.g + 0.1805f * rgb.b,
+									0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b,
+									0.0193f * rgb.r + 0.1192f * rgb.g + 0.9505f * rgb.b) /
+						   glm::vec3(0.950489f, 1.0f, 1.08884f);
+	const float delta = 6.0f / 29.0f;
+	auto f = [delta](float t) {
+		return t > delta * delta * delta ? std::cbrt(t) : t / (3 * delta * delta) + 4.0f / 29;
+	};
+	const float l = 116.0f * f(xyz.y) - 16.0f;
+	return glm::vec3(l, 0.01f * l * 500.0f * (f(xyz.x) - f(xyz.y)), 0.01f * l * 200.0f * (f(xyz.y) - f(xyz.z)));
+}
+
+static float flip_hyab(const glm::vec3& a, const glm::vec3& b) {
+	return std::abs(a.x - b.x) + glm::length(glm::vec2(a.y - b.y, a.z - b.z));
+}
+
+double flip(const float* reference, const float* test, int width, int height) {
+	const size_t num_pixels = size_t(width) * height;
+	if (num_pixels == 0) {
+		return 0.0;
+	}
+	const float qc = 0.7f;
+	const float pc = 0.4f;
+	const float pt = 0.95f;
+	const float cmax = std::pow(flip_hyab(flip_lab(glm::vec3(0, 1, 0)), flip_lab(glm::vec3(0, 0, 1))), qc);
+	std::vector<float> color_error(num_pixels);
+	std::vector<float> lum[2] = {std::vector<float>(num_pixels), std::vector<float>(num_pixels)};
+	const float* images[2] = {reference, test};
+	for (size_t i = 0; i < num_pixels; i++) {
+		glm::vec3 lab[2];
+		for (int img = 0; img < 2; img++) {
+			const float* p = images[img] + 4 * i;
+			glm::vec3 rgb = glm::max(glm::vec3(p[0], p[1], p[2]), glm::vec3(0));
+			rgb = glm::clamp(rgb / (1.0f + rgb), 0.0f, 1.0f);
+			lab[img] = flip_lab(rgb);
+			lum[img][i] = 0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b;
+		}
+		const float e = std::pow(flip_hyab(lab[0], lab[1]), qc);
+		color_error[i] = e < pc * cmax ? e * pt / (pc * cmax) : pt + (e - pc * cmax) / (cmax - pc * cmax) * (1 - pt);
+	}
+	// Edge and point detectors: first and second derivatives of a Gaussian at 67 pixels per degree, with their
+	// positive and negative lobes normalized separately
+	const float sigma = 0.5f * 0.082f * 67.0f;
+	const int radius = int(std::ceil(3.0f * sigma));
+	std::vector<float> gauss(2 * radius + 1), edge(2 * radius + 1), point(2 * radius + 1);
+	float sums[5] = {};
+	for (int x = -radius; x <= radius; x++) {
+		const float g = std::exp(-float(x * x) / (2 * sigma * sigma));
+		gauss[x + radius] = g;
+		edge[x + radius] = -x * g;
+		point[x + radius] = (x * x / (sigma * sigma) - 1) * g;
+		sums[0] += g;
+		sums[1] += std::max(edge[x + radius], 0.0f);
+		sums[2] -= std::min(edge[x + radius], 0.0f);
+		sums[3] += std::max(point[x + radius], 0.0f);
+		sums[4] -= std::min(point[x + radius], 0.0f);
+	}
+	for (int k = 0; k < 2 * radius + 1; k++) {
+		gauss[k] /= sums[0];
+		edge[k] /= edge[k] > 0 ? sums[1] : sums[2];
+		point[k] /= point[k] > 0 ? sums[3] : sums[4];
+	}
+	// Separable filters: the derivative along one axis, the Gaussian along the other
+	auto filter = [&](const std::vector<float>& src, const std::vector<float>& kernel, bool horizontal) {
+		std::vector<float> dst(num_pixels);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				float sum = 0.0f;
+				for (int k = -radius; k <= radius; k++) {
+					const int sx = horizontal ? std::clamp(x + k, 0, width - 1) : x;
+					const int sy = horizontal ? y : std::clamp(y + k, 0, height - 1);
+					sum += kernel[k + radius] * src[size_t(sy) * width + sx];
+				}
+				dst[size_t(y) * width + x] = sum;
+			}
+		}
+		return dst;
+	};
+	std::vector<float> features[2][2];
+	for (int img = 0; img < 2; img++) {
+		const std::vector<float> blur_x = filter(lum[img], gauss, true);
+		const std::vector<float> blur_y = filter(lum[img], gauss, false);
+		const std::vector<float> edge_x = filter(blur_y, edge, true), edge_y = filter(blur_x, edge, false);
+		const std::vector<float> point_x = filter(blur_y, point, true), point_y = filter(blur_x, point, false);
+		features[img][0].resize(num_pixels);
+		features[img][1].resize(num_pixels);
+		for (size_t i = 0; i < num_pixels; i++) {
+			features[img][0][i] = glm::length(glm::vec2(edge_x[i], edge_y[i]));
+			features[img][1][i] = glm::length(glm::vec2(point_x[i], point_y[i]));
+		}
+	}
+	double error_sum = 0.0;
+	for (size_t i = 0; i < num_pixels; i++) {
+		const float feature_diff = std::max(std::abs(features[0][0][i] - features[1][0][i]),
+											std::abs(features[0][1][i] - features[1][1][i]));
+		const float feature_error = std::pow(feature_diff / std::sqrt(2.0f), 0.5f);
+		error_sum += std::pow(color_error[i], 1.0f - feature_error);
+	}
+	return error_sum / num_pixels;
+}
+
+void precision_report(const char* reference_img, const char* test_img) {
+	int width, height;
+	float* reference = load_exr(reference_img, width, height);
+	if (!reference) {
+		LUMEN_ERROR("Could not load the reference image");
+	}
+	const size_t num_pixels = size_t(width) * height;
+	auto print_stats = [](const char* label, const ErrorStats& stats, uint32_t bytes_per_pixel) {
+		LUMEN_TRACE("{:<24} {:>2} B/px  RMSE {:.3e}  PSNR {:7.2f} dB  max abs {:.3e}  mean rel {:.3e}", label,
+					bytes_per_pixel, stats.rmse, stats.psnr, stats.max_abs_error, stats.mean_rel_error);
+	};
+	LUMEN_TRACE("Precision report for {} ({}x{})", reference_img, width, height);
+	// Storage error: round trip the FP32 image through every reduced format
+	std::vector<uint8_t> packed(num_pixels * texel_size(OutputPrecision::FP32));
+	std::vector<float> decoded(num_pixels * 4);
+	for (OutputPrecision precision : {OutputPrecision::FP16, OutputPrecision::RGB9E5}) {
+		encode(reference, precision, num_pixels, packed.data());
+		decode(packed.data(), precision, num_pixels, decoded.data());
+		print_stats(precision_name(precision), compare(reference, decoded.data(), num_pixels), texel_size(precision));
+	}
+	// Accumulation error: an image rendered with a reduced precision output
+	if (test_img) {
+		int test_width, test_height;
+		float* test = load_exr(test_img, test_width, test_height);
+		if (!test || test_width != width || test_height != height) {
+			free(reference);
+			free(test);
+			LUMEN_ERROR("The test image could not be loaded or its size does not match the reference");
+		}
+		print_stats(test_img, compare(reference, test, num_pixels), 0);
+		free(test);
+	}
+	free(reference);
+}
+
+}  // namespace ImageUtils
@@ -1,6 +1,106 @@
 #pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace ImageUtils {
+// Storage precision of the integrator outputs. Buffers accumulated with atomic float adds always stay in FP32
+enum class OutputPrecision { FP32, FP16, RGB9E5 };
+
+struct ErrorStats {
+	double rmse = 0.0;
+	double psnr = 0.0;
+	double max_abs_error = 0.0;
+	double mean_rel_error = 0.0;
+	// Squared error over the squared reference, averaged
+	double rel_mse = 0.0;
+};
+
 float* load_exr(const char* img_name, int& width, int& height);
+// RGBA32F pixels of an .exr or any stb_image supported file (.hdr), released with free()
+float* load_hdr(const char* img_name, int& width, int& height);
 void save_exr(const float* rgb, int width, int height, const char* outfilename);
-}
+
+// Uncompressed scanline .exr that is assembled a block of pixels at a time, so that the image never has to be in
+// memory as a whole. Like save_exr, RGB is stored as half floats unless full_precision is set
+class ExrTileWriter {
+   public:
+	ExrTileWriter(const char* path, int width, int height, bool full_precision = false);
+	// RGBA32F pixels of a w x h block at (x, y), rows stride pixels apart. Pixels outside of the image are skipped
+	void write(const float* rgba, int x, int y, int w, int h, int stride);
+	bool good() const { return file.good(); }
+
+   private:
+	uint64_t chunk_size() const { return 8 + 3 * uint64_t(width) * channel_size; }
+	std::ofstream file;
+	int width;
+	int height;
+	uint32_t channel_size;
+	uint64_t chunks_offset = 0;
+};
+
+enum class ExrCompression { None, ZIP, PIZ };
+
+// Layer of a multi-layer .exr, stored as its own part with its own precision and compression. The channels are taken
+// in order from the RGBA32F pixels and named <layer>.<channel>, except for the first layer, the beauty image
+struct ExrLayer {
+	std::string name;
+	std::vector<std::string> channels;
+	std::vector<float> pixels;
+	bool half = true;
+	ExrCompression compression = ExrCompression::ZIP;
+};
+
+// A single layer is written as a plain single part file, like save_exr
+bool save_exr_layers(const std::vector<ExrLayer>& layers, int width, int height, const char* path);
+
+// Writes .exr files on a background thread, in submission order. submit() only blocks while max_pending files are
+// queued, so the render thread does not wait on the disk unless it falls behind
+class AsyncExrWriter {
+   public:
+	explicit AsyncExrWriter(uint32_t max_pending = 4);
+	~AsyncExrWriter();
+	void submit(const std::string& path, int width, int height, std::vector<ExrLayer>&& layers);
+	// Waits until every submitted file is written
+	void flush();
+
+   private:
+	struct Job {
+		std::string path;
+		int width;
+		int height;
+		std::vector<ExrLayer> layers;
+	};
+	void run();
+	std::deque<Job> jobs;
+	std::mutex mutex;
+	std::condition_variable cv;
+	uint32_t max_pending;
+	bool writing = false;
+	bool done = false;
+	std::thread thread;
+};
+
+VkFormat output_format(OutputPrecision precision);
+uint32_t texel_size(OutputPrecision precision);
+const char* precision_name(OutputPrecision precision);
+// Conversions between RGBA32F pixels and packed texels of the given precision
+void encode(const float* rgba, OutputPrecision precision, size_t num_pixels, void* dst);
+void decode(const void* src, OutputPrecision precision, size_t num_pixels, float* rgba);
+ErrorStats compare(const float* reference, const float* test, size_t num_pixels);
+// Average Rec. 709 luminance of RGBA32F pixels, proportional to the energy that reached the image
+double mean_luminance(const float* rgba, size_t num_pixels);
+// Mean perceptual error in [0, 1] following LDR-FLIP (Andersson et al. 2020) on Reinhard tone mapped images, without
+// the contrast sensitivity prefilter of the color pipeline
+double flip(const float* reference, const float* test, int width, int height);
+// CPU error analysis against an FP32 render. Reports the storage error of every reduced precision format and, if
+// given, the error of an image accumulated at reduced precision
+void precision_report(const char* reference_img, const char* test_img = nullptr);
+}  // namespace ImageUtils
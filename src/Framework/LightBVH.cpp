@@ -0,0 +1,545 @@
+#include "LumenPCH.h"
+#include "LightBVH.h"
+#include <random>
+
+namespace lumen {
+
+static constexpr uint32_t SPLIT_BINS = 12;
+// Keeps the rescaled random number of the traversal below one
+static constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+static float luminance(const glm::vec3& rgb) { return glm::dot(rgb, glm::vec3(0.2126f, 0.7152f, 0.0722f)); }
+
+static float safe_sqrt(float x) { return std::sqrt(std::max(x, 0.0f)); }
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+	return cos_a > cos_b ? 1.0f : cos_a * cos_b + sin_a * sin_b;
+}
+
+static float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+	return cos_a > cos_b ? 0.0f : sin_a * cos_b - cos_a * sin_b;
+}
+
+static float importance(const glm::vec3& bmin, const glm::vec3& bmax, float phi, const glm::vec3& axis,
+						float cos_theta_o, float cos_theta_e, bool two_sided, const glm::vec3* p) {
+	if (!p) {
+		return phi;
+	}
+	const glm::vec3 center = 0.5f * (bmin + bmax);
+	const glm::vec3 to_p = *p - center;
+	const float dist_sqr = glm::dot(to_p, to_p);
+	// Clamped so that the importance stays bounded close to the lights
+	const float d2 = std::max(dist_sqr, 0.5f * glm::length(bmax - bmin));
+	const float radius_sqr = glm::dot(bmax - center, bmax - center);
+	if (dist_sqr <= radius_sqr) {
+		// Inside the bounding sphere every direction may carry light
+		return cos_theta_e < 1.0f ? phi / d2 : 0.0f;
+	}
+	// Angle between the axis and the direction towards p, reduced by the spread of the normals and by the angle the
+	// bounds subtend from p
+	float cos_theta_w = glm::dot(axis, to_p / std::sqrt(dist_sqr));
+	if (two_sided) {
+		cos_theta_w = std::abs(cos_theta_w);
+	}
+	const float sin_theta_w = safe_sqrt(1.0f - cos_theta_w * cos_theta_w);
+	const float cos_theta_b = safe_sqrt(1.0f - radius_sqr / dist_sqr);
+	const float sin_theta_b = safe_sqrt(1.0f - cos_theta_b * cos_theta_b);
+	const float sin_theta_o = safe_sqrt(1.0f - cos_theta_o * cos_theta_o);
+	const float cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+	const float sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+	const float cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+	if (cos_theta_p <= cos_theta_e) {
+		return 0.0f;
+	}
+	return phi * cos_theta_p / d2;
+}
+
+float LightBounds::importance(const glm::vec3* p) const {
+	return lumen::importance(min, max, phi, axis, cos_theta_o, cos_theta_e, two_sided, p);
+}
+
+LightBounds LightBounds::merge(const LightBounds& a, const LightBounds& b) {
+	if (a.phi == 0.0f) {
+		return b;
+	}
+	if (b.phi == 0.0f) {
+		return a;
+	}
+	LightBounds result;
+	result.min = glm::min(a.min, b.min);
+	result.max = glm::max(a.max, b.max);
+	result.phi = a.phi + b.phi;
+	result.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+	result.two_sided = a.two_sided || b.two_sided;
+	// Smallest cone containing both normal cones
+	const float theta_a = std::acos(std::clamp(a.cos_theta_o, -1.0f, 1.0f));
+	const float theta_b = std::acos(std::clamp(b.cos_theta_o, -1.0f, 1.0f));
+	const float theta_d = std::acos(std::clamp(glm::dot(a.axis, b.axis), -1.0f, 1.0f));
+	if (std::min(theta_d + theta_b, glm::pi<float>()) <= theta_a) {
+		result.axis = a.axis;
+		result.cos_theta_o = a.cos_theta_o;
+		return result;
+	}
+	if (std::min(theta_d + theta_a, glm::pi<float>()) <= theta_b) {
+		result.axis = b.axis;
+		result.cos_theta_o = b.cos_theta_o;
+		return result;
+	}
+	const float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+	const glm::vec3 rotation_axis = glm::cross(a.axis, b.axis);
+	if (theta_o >= glm::pi<float>() || glm::dot(rotation_axis, rotation_axis) == 0.0f) {
+		result.axis = a.axis;
+		result.cos_theta_o = -1.0f;
+		return result;
+	}
+	const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), theta_o - theta_a, glm::normalize(rotation_axis));
+	result.axis = glm::normalize(glm::vec3(rotation * glm::vec4(a.axis, 0.0f)));
+	result.cos_theta_o = std::cos(theta_o);
+	return result;
+}
+
+LightBVH::Emitter LightBVH::triangle_emitter(uint32_t light_idx, uint32_t triangle_idx, const glm::vec3& v0,
+											 const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& L) {
+	Emitter emitter{light_idx, triangle_idx, v0, v1, v2, L, LIGHT_AREA};
+	const glm::vec3 n = glm::cross(v1 - v0, v2 - v0);
+	const float n_len = glm::length(n);
+	LightBounds& b = emitter.bounds;
+	b.min = glm::min(v0, glm::min(v1, v2));
+	b.max = glm::max(v0, glm::max(v1, v2));
+	if (n_len > 0.0f) {
+		b.axis = n / n_len;
+	}
+	// Area lights emit on both sides with a cosine falloff
+	b.phi = luminance(L) * 0.5f * n_len * glm::pi<float>() * 2.0f;
+	b.cos_theta_o = 1.0f;
+	b.cos_theta_e = 0.0f;
+	b.two_sided = true;
+	return emitter;
+}
+
+LightBVH::Emitter LightBVH::spot_emitter(uint32_t light_idx, const glm::vec3& pos, const glm::vec3& to,
+										 const glm::vec3& L) {
+	const glm::vec3 dir = glm::normalize(to - pos);
+	Emitter emitter{light_idx, 0, pos, dir, pos, L, LIGHT_SPOT};
+	// Same cone as the shaders: full intensity up to 25 degrees, falling off to zero at 30
+	const float cos_falloff_start = std::cos(glm::radians(25.0f));
+	const float cos_falloff_end = std::cos(glm::radians(30.0f));
+	LightBounds& b = emitter.bounds;
+	b.min = pos;
+	b.max = pos;
+	b.axis = dir;
+	b.phi = luminance(L) * glm::two_pi<float>() *
+			((1.0f - cos_falloff_start) + 0.5f * (cos_falloff_start - cos_falloff_end));
+	b.cos_theta_o = cos_falloff_start;
+	b.cos_theta_e = std::cos(glm::radians(5.0f));
+	return emitter;
+}
+
+// Directional variation of the emission over the cone, weighs the surface area in the split cost
+static float orientation_measure(const LightBounds& b) {
+	const float theta_o = std::acos(std::clamp(b.cos_theta_o, -1.0f, 1.0f));
+	const float theta_e = std::acos(std::clamp(b.cos_theta_e, -1.0f, 1.0f));
+	const float theta_w = std::min(theta_o + theta_e, glm::pi<float>());
+	const float sin_theta_o = safe_sqrt(1.0f - b.cos_theta_o * b.cos_theta_o);
+	return glm::two_pi<float>() * (1.0f - b.cos_theta_o) +
+		   glm::half_pi<float>() * (2.0f * theta_w * sin_theta_o - std::cos(theta_o - 2.0f * theta_w) -
+									2.0f * theta_o * sin_theta_o + b.cos_theta_o);
+}
+
+static float split_cost(const LightBounds& b, float aspect) {
+	if (b.phi == 0.0f) {
+		return 0.0f;
+	}
+	const glm::vec3 e = glm::max(b.max - b.min, glm::vec3(0.0f));
+	const float area = 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	return b.phi * orientation_measure(b) * area * aspect;
+}
+
+static LightBVHNode make_node(const LightBounds& b) {
+	LightBVHNode node{};
+	node.bounds_min = b.min;
+	node.bounds_max = b.max;
+	node.phi = b.phi;
+	node.axis = b.axis;
+	node.cos_theta_o = b.cos_theta_o;
+	node.cos_theta_e = b.cos_theta_e;
+	node.flags = b.two_sided ? LIGHT_BVH_TWO_SIDED : 0;
+	return node;
+}
+
+void LightBVH::build(std::vector<Emitter> emitters, const std::vector<Light>& lights, uint32_t num_prim_meshes) {
+	this->emitters = std::move(emitters);
+	nodes.clear();
+	infinite.clear();
+	light_leaves.assign(lights.size(), -1);
+	light_triangle_counts.assign(lights.size(), 0);
+	mesh_lights.assign(num_prim_meshes, -1);
+	leaves.assign(this->emitters.size(), -1);
+	for (uint32_t i = 0; i < lights.size(); i++) {
+		if (((lights[i].light_flags >> 4) & 0x1) == 0) {
+			infinite.push_back(i);
+		} else if ((lights[i].light_flags & 0x7) == LIGHT_AREA) {
+			mesh_lights[lights[i].prim_mesh_idx] = i;
+		}
+	}
+	for (uint32_t i = 0; i < this->emitters.size(); i++) {
+		const uint32_t light_idx = this->emitters[i].light_idx;
+		if (light_leaves[light_idx] == -1) {
+			light_leaves[light_idx] = i;
+		}
+		light_triangle_counts[light_idx]++;
+	}
+	// Emitters without power are never picked and get no leaf
+	std::vector<uint32_t> emitter_indices;
+	for (uint32_t i = 0; i < this->emitters.size(); i++) {
+		if (this->emitters[i].bounds.phi > 0.0f) {
+			emitter_indices.push_back(i);
+		}
+	}
+	if (emitter_indices.empty()) {
+		return;
+	}
+	nodes.reserve(2 * emitter_indices.size() - 1);
+	build_recursive(emitter_indices, 0, (uint32_t)emitter_indices.size(), -1);
+}
+
+uint32_t LightBVH::build_recursive(std::vector<uint32_t>& emitter_indices, uint32_t first, uint32_t count,
+								   uint32_t parent) {
+	const uint32_t node_idx = (uint32_t)nodes.size();
+	nodes.emplace_back();
+	if (count == 1) {
+		const uint32_t emitter_idx = emitter_indices[first];
+		const Emitter& emitter = emitters[emitter_idx];
+		LightBVHNode node = make_node(emitter.bounds);
+		node.child_or_light = emitter.light_idx;
+		node.triangle_idx = emitter.triangle_idx;
+		node.parent = parent;
+		node.flags |= LIGHT_BVH_LEAF;
+		nodes[node_idx] = node;
+		leaves[emitter_idx] = node_idx;
+		return node_idx;
+	}
+
+	LightBounds bounds;
+	glm::vec3 cmin{FLT_MAX};
+	glm::vec3 cmax{-FLT_MAX};
+	for (uint32_t i = first; i < first + count; i++) {
+		const LightBounds& b = emitters[emitter_indices[i]].bounds;
+		bounds = LightBounds::merge(bounds, b);
+		const glm::vec3 centroid = 0.5f * (b.min + b.max);
+		cmin = glm::min(cmin, centroid);
+		cmax = glm::max(cmax, centroid);
+	}
+
+	// Binned split minimizing the power weighted spatial and directional extent of both sides
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	uint32_t best_bin = 0;
+	const glm::vec3 extent = cmax - cmin;
+	const glm::vec3 node_extent = bounds.max - bounds.min;
+	const float max_extent = std::max(node_extent.x, std::max(node_extent.y, node_extent.z));
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] <= 1e-12f) {
+			continue;
+		}
+		// Penalizes thin slabs, which bound the emission poorly
+		const float aspect = node_extent[axis] > 0.0f ? max_extent / node_extent[axis] : 1.0f;
+		LightBounds bins[SPLIT_BINS];
+		uint32_t bin_count[SPLIT_BINS] = {};
+		const float scale = SPLIT_BINS / extent[axis];
+		for (uint32_t i = first; i < first + count; i++) {
+			const LightBounds& b = emitters[emitter_indices[i]].bounds;
+			const float centroid = 0.5f * (b.min[axis] + b.max[axis]);
+			const uint32_t bin = std::min(SPLIT_BINS - 1, uint32_t((centroid - cmin[axis]) * scale));
+			bins[bin] = LightBounds::merge(bins[bin], b);
+			bin_count[bin]++;
+		}
+		for (uint32_t split = 0; split < SPLIT_BINS - 1; split++) {
+			LightBounds left, right;
+			uint32_t left_count = 0, right_count = 0;
+			for (uint32_t b = 0; b <= split; b++) {
+				left = LightBounds::merge(left, bins[b]);
+				left_count += bin_count[b];
+			}
+			for (uint32_t b = split + 1; b < SPLIT_BINS; b++) {
+				right = LightBounds::merge(right, bins[b]);
+				right_count += bin_count[b];
+			}
+			if (!left_count || !right_count) {
+				continue;
+			}
+			const float cost = split_cost(left, aspect) + split_cost(right, aspect);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = split;
+			}
+		}
+	}
+
+	uint32_t mid = first + count / 2;
+	if (best_axis != -1) {
+		const float scale = SPLIT_BINS / extent[best_axis];
+		const auto it = std::partition(emitter_indices.begin() + first, emitter_indices.begin() + first + count,
+									   [&](uint32_t idx) {
+										   const LightBounds& b = emitters[idx].bounds;
+										   const float centroid = 0.5f * (b.min[best_axis] + b.max[best_axis]);
+										   return std::min(SPLIT_BINS - 1,
+														   uint32_t((centroid - cmin[best_axis]) * scale)) <= best_bin;
+									   });
+		mid = (uint32_t)(it - emitter_indices.begin());
+	}
+	build_recursive(emitter_indices, first, mid - first, node_idx);
+	const uint32_t second_child = build_recursive(emitter_indices, mid, first + count - mid, node_idx);
+	LightBVHNode node = make_node(bounds);
+	node.child_or_light = second_child;
+	node.triangle_idx = 0;
+	node.parent = parent;
+	nodes[node_idx] = node;
+	return node_idx;
+}
+
+float LightBVH::infinite_probability() const {
+	if (infinite.empty()) {
+		return 0.0f;
+	}
+	return float(infinite.size()) / (infinite.size() + (nodes.empty() ? 0 : 1));
+}
+
+float LightBVH::importance(uint32_t node_idx, const glm::vec3* p) const {
+	const LightBVHNode& node = nodes[node_idx];
+	return lumen::importance(node.bounds_min, node.bounds_max, node.phi, node.axis, node.cos_theta_o,
+							 node.cos_theta_e, (node.flags & LIGHT_BVH_TWO_SIDED) != 0, p);
+}
+
+float LightBVH::pick(float u, const glm::vec3* p, uint32_t& light_idx, uint32_t& triangle_idx) const {
+	const float p_infinite = infinite_probability();
+	if (u < p_infinite) {
+		const uint32_t idx = std::min(uint32_t(u / p_infinite * infinite.size()), uint32_t(infinite.size()) - 1);
+		light_idx = infinite[idx];
+		triangle_idx = 0;
+		return p_infinite / infinite.size();
+	}
+	if (nodes.empty() || importance(0, p) == 0.0f) {
+		return 0.0f;
+	}
+	u = std::min((u - p_infinite) / (1.0f - p_infinite), ONE_MINUS_EPSILON);
+	float pdf = 1.0f - p_infinite;
+	uint32_t node_idx = 0;
+	while ((nodes[node_idx].flags & LIGHT_BVH_LEAF) == 0) {
+		const uint32_t second_child = nodes[node_idx].child_or_light;
+		const float importance_0 = importance(node_idx + 1, p);
+		const float importance_1 = importance(second_child, p);
+		if (importance_0 == 0.0f && importance_1 == 0.0f) {
+			return 0.0f;
+		}
+		const float p_0 = importance_0 / (importance_0 + importance_1);
+		if (u < p_0) {
+			node_idx = node_idx + 1;
+			u = std::min(u / p_0, ONE_MINUS_EPSILON);
+			pdf *= p_0;
+		} else {
+			node_idx = second_child;
+			u = std::min((u - p_0) / (1.0f - p_0), ONE_MINUS_EPSILON);
+			pdf *= 1.0f - p_0;
+		}
+	}
+	light_idx = nodes[node_idx].child_or_light;
+	triangle_idx = nodes[node_idx].triangle_idx;
+	return pdf;
+}
+
+float LightBVH::pdf(const glm::vec3* p, uint32_t light_idx, uint32_t triangle_idx) const {
+	if (light_leaves[light_idx] == -1) {
+		return infinite_probability() / infinite.size();
+	}
+	uint32_t node_idx = leaves[light_leaves[light_idx] + triangle_idx];
+	if (node_idx == -1 || importance(0, p) == 0.0f) {
+		return 0.0f;
+	}
+	float pdf = 1.0f - infinite_probability();
+	while (node_idx != 0) {
+		const uint32_t parent = nodes[node_idx].parent;
+		const float importance_0 = importance(parent + 1, p);
+		const float importance_1 = importance(nodes[parent].child_or_light, p);
+		if (importance_0 == 0.0f && importance_1 == 0.0f) {
+			return 0.0f;
+		}
+		pdf *= (node_idx == parent + 1 ? importance_0 : importance_1) / (importance_0 + importance_1);
+		node_idx = parent;
+	}
+	return pdf;
+}
+
+std::vector<uint32_t> LightBVH::gpu_data() const {
+	constexpr uint32_t header_size = sizeof(LightBVHHeader) / sizeof(uint32_t);
+	constexpr uint32_t node_size = sizeof(LightBVHNode) / sizeof(uint32_t);
+	LightBVHHeader header{};
+	header.num_nodes = (uint32_t)nodes.size();
+	header.num_infinite = (uint32_t)infinite.size();
+	header.light_leaves_offset = header_size + node_size * header.num_nodes;
+	header.mesh_lights_offset = header.light_leaves_offset + (uint32_t)light_leaves.size();
+	header.leaves_offset = header.mesh_lights_offset + (uint32_t)mesh_lights.size();
+	header.infinite_offset = header.leaves_offset + (uint32_t)leaves.size();
+	std::vector<uint32_t> data(header.infinite_offset + infinite.size());
+	std::memcpy(data.data(), &header, sizeof(header));
+	if (!nodes.empty()) {
+		std::memcpy(data.data() + header_size, nodes.data(), nodes.size() * sizeof(LightBVHNode));
+	}
+	std::copy(light_leaves.begin(), light_leaves.end(), data.begin() + header.light_leaves_offset);
+	std::copy(mesh_lights.begin(), mesh_lights.end(), data.begin() + header.mesh_lights_offset);
+	std::copy(leaves.begin(), leaves.end(), data.begin() + header.leaves_offset);
+	std::copy(infinite.begin(), infinite.end(), data.begin() + header.infinite_offset);
+	return data;
+}
+
+float LightBVH::sample_contribution(const Emitter& emitter, const glm::vec3& p, const glm::vec2& u) const {
+	if (emitter.light_type == LIGHT_SPOT) {
+		const glm::vec3 wi = p - emitter.v0;
+		const float d2 = glm::dot(wi, wi);
+		if (d2 == 0.0f) {
+			return 0.0f;
+		}
+		const float cos_theta = glm::dot(wi, emitter.v1) / std::sqrt(d2);
+		const float cos_width = std::cos(glm::radians(30.0f));
+		const float cos_falloff = std::cos(glm::radians(25.0f));
+		float falloff = 1.0f;
+		if (cos_theta < cos_width) {
+			falloff = 0.0f;
+		} else if (cos_theta < cos_falloff) {
+			const float d = (cos_theta - cos_width) / (cos_falloff - cos_width);
+			falloff = (d * d) * (d * d);
+		}
+		return luminance(emitter.L) * falloff / d2;
+	}
+	const float su = std::sqrt(u.x);
+	const glm::vec3 q = (1.0f - su) * emitter.v0 + su * (1.0f - u.y) * emitter.v1 + su * u.y * emitter.v2;
+	const glm::vec3 n = glm::cross(emitter.v1 - emitter.v0, emitter.v2 - emitter.v0);
+	const float n_len = glm::length(n);
+	const glm::vec3 wi = q - p;
+	const float d2 = glm::dot(wi, wi);
+	if (d2 == 0.0f || n_len == 0.0f) {
+		return 0.0f;
+	}
+	const float cos_light = std::abs(glm::dot(n, wi)) / (n_len * std::sqrt(d2));
+	return luminance(emitter.L) * cos_light * 0.5f * n_len / d2;
+}
+
+bool LightBVH::validate(const glm::vec3& scene_min, const glm::vec3& scene_max, uint32_t num_points,
+						uint32_t samples_per_point) const {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	const uint32_t num_lights = (uint32_t)light_leaves.size();
+	std::vector<uint32_t> finite_lights;
+	for (uint32_t i = 0; i < num_lights; i++) {
+		if (light_triangle_counts[i]) {
+			finite_lights.push_back(i);
+		}
+	}
+	// Emitters first, then the infinite lights
+	auto slot_of = [&](uint32_t light_idx, uint32_t triangle_idx) {
+		if (light_leaves[light_idx] != -1) {
+			return light_leaves[light_idx] + triangle_idx;
+		}
+		const auto it = std::find(infinite.begin(), infinite.end(), light_idx);
+		return uint32_t(emitters.size() + (it - infinite.begin()));
+	};
+
+	double max_sum_error = 0.0;
+	double max_pdf_error = 0.0;
+	double max_bin_error = 0.0;
+	double max_bias = 0.0;
+	double log_variance_ratio = 0.0;
+	uint32_t variance_points = 0;
+	const uint32_t num_slots = uint32_t(emitters.size() + infinite.size());
+	// The last point tests the power only traversal
+	for (uint32_t point = 0; point <= num_points; point++) {
+		const glm::vec3 pos = scene_min + (scene_max - scene_min) * glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+		const glm::vec3* p = point < num_points ? &pos : nullptr;
+
+		// The probabilities of every light sum up to one, unless nothing reaches p
+		double pdf_sum = 0.0;
+		for (const Emitter& emitter : emitters) {
+			pdf_sum += pdf(p, emitter.light_idx, emitter.triangle_idx);
+		}
+		for (uint32_t light_idx : infinite) {
+			pdf_sum += pdf(p, light_idx, 0);
+		}
+		if (pdf_sum > 0.0) {
+			max_sum_error = std::max(max_sum_error, std::abs(pdf_sum - 1.0));
+		}
+
+		// Pick frequencies against the pdf, and the direct lighting estimates of both strategies
+		std::vector<uint32_t> counts(num_slots, 0);
+		double bvh_sum = 0.0, bvh_sum_sqr = 0.0;
+		double uniform_sum = 0.0, uniform_sum_sqr = 0.0;
+		for (uint32_t i = 0; i < samples_per_point; i++) {
+			uint32_t light_idx, triangle_idx;
+			const float pick_pdf = pick(uniform(rng), p, light_idx, triangle_idx);
+			const glm::vec2 u(uniform(rng), uniform(rng));
+			if (pick_pdf > 0.0f) {
+				const float expected = pdf(p, light_idx, triangle_idx);
+				max_pdf_error = std::max(max_pdf_error, double(std::abs(pick_pdf - expected)) / pick_pdf);
+				const uint32_t slot = slot_of(light_idx, triangle_idx);
+				counts[slot]++;
+				if (p && slot < emitters.size()) {
+					const double f = sample_contribution(emitters[slot], *p, u) / pick_pdf;
+					bvh_sum += f;
+					bvh_sum_sqr += f * f;
+				}
+			}
+			if (p && !finite_lights.empty()) {
+				// A light and then one of its triangles, uniformly
+				const uint32_t light_idx =
+					finite_lights[std::min(uint32_t(uniform(rng) * finite_lights.size()),
+										   uint32_t(finite_lights.size()) - 1)];
+				const uint32_t light_triangles = light_triangle_counts[light_idx];
+				const uint32_t triangle_idx = std::min(uint32_t(uniform(rng) * light_triangles), light_triangles - 1);
+				const double f = sample_contribution(emitters[light_leaves[light_idx] + triangle_idx], *p, u) *
+								 finite_lights.size() * light_triangles;
+				uniform_sum += f;
+				uniform_sum_sqr += f * f;
+			}
+		}
+		if (pdf_sum > 0.0) {
+			for (uint32_t slot = 0; slot < num_slots; slot++) {
+				const float expected_pdf = slot < emitters.size()
+											   ? pdf(p, emitters[slot].light_idx, emitters[slot].triangle_idx)
+											   : pdf(p, infinite[slot - emitters.size()], 0);
+				// Skip bins too unlikely to be estimated reliably
+				if (expected_pdf * samples_per_point < 4000.0) {
+					continue;
+				}
+				const double observed = double(counts[slot]) / samples_per_point;
+				max_bin_error = std::max(max_bin_error, std::abs(observed - expected_pdf) / expected_pdf);
+			}
+		}
+		if (p && uniform_sum > 0.0) {
+			const double n = samples_per_point;
+			const double bvh_mean = bvh_sum / n;
+			const double uniform_mean = uniform_sum / n;
+			const double bvh_variance = std::max(bvh_sum_sqr / n - bvh_mean * bvh_mean, 0.0);
+			const double uniform_variance = std::max(uniform_sum_sqr / n - uniform_mean * uniform_mean, 0.0);
+			// Both estimate the same integral, their difference has to stay within a few standard errors
+			const double std_error = std::sqrt((bvh_variance + uniform_variance) / n);
+			max_bias = std::max(max_bias, std::abs(bvh_mean - uniform_mean) / std::max(std_error, 1e-12));
+			if (bvh_variance > 0.0 && uniform_variance > 0.0) {
+				log_variance_ratio += std::log(uniform_variance / bvh_variance);
+				variance_points++;
+			}
+		}
+	}
+	const bool valid = max_sum_error < 1e-3 && max_pdf_error < 1e-4 && max_bin_error < 0.1 && max_bias < 6.0;
+	LUMEN_TRACE("Light BVH: {} nodes over {} emitters and {} infinite lights", nodes.size(), emitters.size(),
+				infinite.size());
+	LUMEN_TRACE("Max pdf sum error {:.3e}, max pdf mismatch {:.3e}, max bin error {:.3e}, max bias {:.2f} sigma",
+				max_sum_error, max_pdf_error, max_bin_error, max_bias);
+	if (variance_points) {
+		LUMEN_TRACE("Direct lighting variance is {:.2f}x lower than uniform light picking (geometric mean over {} points)",
+					std::exp(log_variance_ratio / variance_points), variance_points);
+	}
+	return valid;
+}
+
+}  // namespace lumen
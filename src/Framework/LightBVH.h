@@ -0,0 +1,74 @@
+#pragma once
+#include "../LumenPCH.h"
+#include "shaders/commons.h"
+
+namespace lumen {
+// Bounds of the emission of a set of lights: where it comes from, its power and the cone of directions it leaves in
+struct LightBounds {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+	float phi = 0.0f;
+	glm::vec3 axis = glm::vec3(0, 0, 1);
+	float cos_theta_o = 1.0f;
+	float cos_theta_e = 1.0f;
+	bool two_sided = false;
+
+	static LightBounds merge(const LightBounds& a, const LightBounds& b);
+	// Conservative estimate of the light reaching p, mirrored by the shaders. Without a point only the power counts
+	float importance(const glm::vec3* p) const;
+};
+
+// Binary BVH over the finite emitters of a scene, every triangle of an area light and every spot light get a leaf.
+// Directional and environment lights can't be bounded, they are picked with the same probability as the whole tree.
+// Traversal picks a child proportionally to its importance until it reaches a leaf, the probability of an emitter is
+// the product of the choices on its path from the root
+class LightBVH {
+   public:
+	struct Emitter {
+		uint32_t light_idx;
+		uint32_t triangle_idx;
+		// World space triangle of area lights, position and direction of spot lights
+		glm::vec3 v0;
+		glm::vec3 v1;
+		glm::vec3 v2;
+		glm::vec3 L;
+		uint32_t light_type;
+		LightBounds bounds;
+	};
+	static Emitter triangle_emitter(uint32_t light_idx, uint32_t triangle_idx, const glm::vec3& v0, const glm::vec3& v1,
+									const glm::vec3& v2, const glm::vec3& L);
+	static Emitter spot_emitter(uint32_t light_idx, const glm::vec3& pos, const glm::vec3& to, const glm::vec3& L);
+
+	// The emitters of an area light have to be consecutive and ordered by triangle
+	void build(std::vector<Emitter> emitters, const std::vector<Light>& lights, uint32_t num_prim_meshes);
+	// Returns the probability of the picked light, 0 when nothing reaches p. A null p picks proportionally to power
+	float pick(float u, const glm::vec3* p, uint32_t& light_idx, uint32_t& triangle_idx) const;
+	float pdf(const glm::vec3* p, uint32_t light_idx, uint32_t triangle_idx) const;
+
+	// LightBVHHeader followed by the nodes and the lookup tables
+	std::vector<uint32_t> gpu_data() const;
+	// Checks the normalization of the pdf and the pick frequencies at random points of the bounds, then compares the
+	// variance of the unoccluded direct lighting estimate against picking a light and a triangle uniformly
+	bool validate(const glm::vec3& scene_min, const glm::vec3& scene_max, uint32_t num_points,
+				  uint32_t samples_per_point) const;
+
+	inline bool empty() const { return nodes.empty() && infinite.empty(); }
+	inline uint32_t node_count() const { return (uint32_t)nodes.size(); }
+	inline uint32_t emitter_count() const { return (uint32_t)emitters.size(); }
+
+   private:
+	uint32_t build_recursive(std::vector<uint32_t>& emitter_indices, uint32_t first, uint32_t count, uint32_t parent);
+	float infinite_probability() const;
+	float importance(uint32_t node_idx, const glm::vec3* p) const;
+	// Light from an emitter reaching p without occlusion, with a uniformly sampled point on triangles
+	float sample_contribution(const Emitter& emitter, const glm::vec3& p, const glm::vec2& u) const;
+
+	std::vector<LightBVHNode> nodes;
+	std::vector<Emitter> emitters;
+	std::vector<uint32_t> light_leaves;
+	std::vector<uint32_t> mesh_lights;
+	std::vector<uint32_t> leaves;
+	std::vector<uint32_t> infinite;
+	std::vector<uint32_t> light_triangle_counts;
+};
+}  // namespace lumen
@@ -0,0 +1,220 @@
+#include "../LumenPCH.h"
+#include "MemoryBudget.h"
+#include <tinygltf/json.hpp>
+
+namespace MemoryBudget {
+struct Allocation {
+	std::string name;
+	VkDeviceSize size;
+	Category category;
+	bool device_local;
+};
+
+static const char* CATEGORY_NAMES[] = {"Scene", "Integrator", "Render graph", "Post FX", "Staging", "Output", "Other"};
+static_assert(IM_ARRAYSIZE(CATEGORY_NAMES) == int(Category::Count));
+
+static std::mutex _mutex;
+static std::unordered_map<VmaAllocation, Allocation> _allocations;
+static VkDeviceSize _device_usage[int(Category::Count)] = {};
+static VkDeviceSize _host_usage[int(Category::Count)] = {};
+static VkDeviceSize _budget = 0;
+// Per thread, as render graph workers open their own scopes while the main thread allocates
+static thread_local Category _current = Category::Other;
+
+Scope::Scope(Category category) : prev(_current) { _current = category; }
+Scope::~Scope() { _current = prev; }
+
+const char* category_name(Category category) { return CATEGORY_NAMES[int(category)]; }
+
+void set_budget(VkDeviceSize bytes) { _budget = bytes; }
+
+VkDeviceSize budget() { return _budget; }
+
+VkDeviceSize usage(Category category) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (category != Category::Count) {
+		return _device_usage[int(category)];
+	}
+	return std::accumulate(std::begin(_device_usage), std::end(_device_usage), VkDeviceSize(0));
+}
+
+VkDeviceSize available() {
+	if (_budget) {
+		const VkDeviceSize used = usage();
+		return used < _budget ? _budget - used : 0;
+	}
+	const VkPhysicalDeviceMemoryProperties* props;
+	vmaGetMemoryProperties(vk::context().allocator, &props);
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(vk::context().allocator, budgets);
+	VkDeviceSize result = 0;
+	for (uint32_t i = 0; i < props->memoryHeapCount; i++) {
+		if ((props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && budgets[i].usage < budgets[i].budget) {
+			result += budgets[i].budget - budgets[i].usage;
+		}
+	}
+	return result;
+}
+
+bool fits(VkDeviceSize size) { return size <= available(); }
+
+static void check(const VkMemoryRequirements& reqs, uint32_t memory_type_idx, std::string_view name, bool staging) {
+	const VkPhysicalDeviceMemoryProperties* props;
+	vmaGetMemoryProperties(vk::context().allocator, &props);
+	if ((props->memoryTypes[memory_type_idx].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0) {
+		return;
+	}
+	const VkDeviceSize used = usage();
+	if (used + reqs.size <= _budget) {
+		return;
+	}
+	LUMEN_WARN("{} ({:.1f} MB, {}) exceeds the memory budget of {:.1f} MB", name.empty() ? "Unnamed" : name,
+			   reqs.size * 1e-6, category_name(staging ? Category::Staging : _current), _budget * 1e-6);
+	log_report();
+	LUMEN_ERROR("Out of the memory budget");
+}
+
+void check(const VkBufferCreateInfo& buffer_ci, const VmaAllocationCreateInfo& alloc_ci, std::string_view name,
+		   bool staging) {
+	if (!_budget) {
+		return;
+	}
+	const VkDeviceBufferMemoryRequirements info = {.sType = VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS,
+												   .pCreateInfo = &buffer_ci};
+	VkMemoryRequirements2 reqs = {.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+	vkGetDeviceBufferMemoryRequirements(vk::context().device, &info, &reqs);
+	uint32_t memory_type_idx;
+	if (vmaFindMemoryTypeIndexForBufferInfo(vk::context().allocator, &buffer_ci, &alloc_ci, &memory_type_idx) ==
+		VK_SUCCESS) {
+		check(reqs.memoryRequirements, memory_type_idx, name, staging);
+	}
+}
+
+void check(const VkImageCreateInfo& image_ci, const VmaAllocationCreateInfo& alloc_ci, std::string_view name) {
+	if (!_budget) {
+		return;
+	}
+	const VkDeviceImageMemoryRequirements info = {.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+												  .pCreateInfo = &image_ci};
+	VkMemoryRequirements2 reqs = {.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+	vkGetDeviceImageMemoryRequirements(vk::context().device, &info, &reqs);
+	uint32_t memory_type_idx;
+	if (vmaFindMemoryTypeIndexForImageInfo(vk::context().allocator, &image_ci, &alloc_ci, &memory_type_idx) ==
+		VK_SUCCESS) {
+		check(reqs.memoryRequirements, memory_type_idx, name, false);
+	}
+}
+
+void track(VmaAllocation allocation, std::string_view name, bool staging) {
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(vk::context().allocator, allocation, &info);
+	VkMemoryPropertyFlags mem_prop_flags;
+	vmaGetAllocationMemoryProperties(vk::context().allocator, allocation, &mem_prop_flags);
+	const Allocation entry = {.name = std::string(name),
+							  .size = info.size,
+							  .category = staging ? Category::Staging : _current,
+							  .device_local = (mem_prop_flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0};
+	std::lock_guard<std::mutex> lock(_mutex);
+	_allocations[allocation] = entry;
+	(entry.device_local ? _device_usage : _host_usage)[int(entry.category)] += entry.size;
+}
+
+void untrack(VmaAllocation allocation) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _allocations.find(allocation);
+	if (it == _allocations.end()) {
+		return;
+	}
+	const Allocation& entry = it->second;
+	(entry.device_local ? _device_usage : _host_usage)[int(entry.category)] -= entry.size;
+	_allocations.erase(it);
+}
+
+void allocation_failed(std::string_view name) {
+	LUMEN_WARN("Could not allocate {} ({})", name.empty() ? "Unnamed" : name, category_name(_current));
+	log_report();
+}
+
+void log_report(uint32_t max_allocations) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	const VkDeviceSize device_total =
+		std::accumulate(std::begin(_device_usage), std::end(_device_usage), VkDeviceSize(0));
+	const VkDeviceSize host_total = std::accumulate(std::begin(_host_usage), std::end(_host_usage), VkDeviceSize(0));
+	LUMEN_TRACE("Memory: {:.1f} MB device local, {:.1f} MB host, budget {}", device_total * 1e-6, host_total * 1e-6,
+				_budget ? fmt::format("{:.1f} MB", _budget * 1e-6) : "none");
+	const VkPhysicalDeviceMemoryProperties* props;
+	vmaGetMemoryProperties(vk::context().allocator, &props);
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(vk::context().allocator, budgets);
+	for (uint32_t i = 0; i < props->memoryHeapCount; i++) {
+		LUMEN_TRACE("  Heap {} ({}): {:.1f} / {:.1f} MB used by the process", i,
+					props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? "device local" : "host",
+					budgets[i].usage * 1e-6, budgets[i].budget * 1e-6);
+	}
+	// Largest allocations first
+	std::vector<const Allocation*> sorted;
+	sorted.reserve(_allocations.size());
+	for (const auto& [_, entry] : _allocations) {
+		sorted.push_back(&entry);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const Allocation* a, const Allocation* b) { return a->size > b->size; });
+	for (int c = 0; c < int(Category::Count); c++) {
+		if (!_device_usage[c] && !_host_usage[c]) {
+			continue;
+		}
+		LUMEN_TRACE("  {}: {:.1f} MB device local, {:.1f} MB host", CATEGORY_NAMES[c], _device_usage[c] * 1e-6,
+					_host_usage[c] * 1e-6);
+		uint32_t cnt = 0;
+		for (const Allocation* entry : sorted) {
+			if (int(entry->category) == c && cnt++ < max_allocations) {
+				LUMEN_TRACE("    {:.1f} MB {}", entry->size * 1e-6, entry->name.empty() ? "Unnamed" : entry->name);
+			}
+		}
+		if (cnt > max_allocations) {
+			LUMEN_TRACE("    {} more", cnt - max_allocations);
+		}
+	}
+}
+
+bool write_report(const std::string& path) {
+	using json = nlohmann::json;
+	json j;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		j["budget"] = _budget;
+		json categories = json::object();
+		for (int c = 0; c < int(Category::Count); c++) {
+			categories[CATEGORY_NAMES[c]] = {{"device_local", _device_usage[c]}, {"host", _host_usage[c]}};
+		}
+		j["categories"] = std::move(categories);
+		json allocations = json::array();
+		for (const auto& [_, entry] : _allocations) {
+			allocations.push_back({{"name", entry.name},
+								   {"category", CATEGORY_NAMES[int(entry.category)]},
+								   {"size", entry.size},
+								   {"device_local", entry.device_local}});
+		}
+		j["allocations"] = std::move(allocations);
+	}
+	const VkPhysicalDeviceMemoryProperties* props;
+	vmaGetMemoryProperties(vk::context().allocator, &props);
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(vk::context().allocator, budgets);
+	json heaps = json::array();
+	for (uint32_t i = 0; i < props->memoryHeapCount; i++) {
+		heaps.push_back({{"size", props->memoryHeaps[i].size},
+						 {"device_local", (props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0},
+						 {"usage", budgets[i].usage},
+						 {"budget", budgets[i].budget}});
+	}
+	j["heaps"] = std::move(heaps);
+	std::ofstream out(path);
+	out << j.dump(1);
+	if (!out) {
+		LUMEN_WARN("Could not write the memory report {}", path);
+		return false;
+	}
+	LUMEN_TRACE("Wrote the memory report [ {} ]", path);
+	return true;
+}
+}  // namespace MemoryBudget
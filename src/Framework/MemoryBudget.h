@@ -0,0 +1,45 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Accounting of every allocation made through vk::create_buffer and vk::create_texture. Allocations are tagged with
+// the category of the innermost Scope of their thread, staging buffers always count as Staging. Live totals come from
+// these tags and from the heap budgets of VK_EXT_memory_budget. With a budget set (--memory-budget <MB>), a device
+// local allocation that would exceed it fails before anything is allocated, with a report of where the memory went
+namespace MemoryBudget {
+enum class Category { Scene, Integrator, RenderGraph, PostFX, Staging, Output, Other, Count };
+
+// Tags the allocations made on the current thread while it is alive
+class Scope {
+   public:
+	explicit Scope(Category category);
+	~Scope();
+
+   private:
+	Category prev;
+};
+
+const char* category_name(Category category);
+// Device local bytes, 0 for no budget
+void set_budget(VkDeviceSize bytes);
+VkDeviceSize budget();
+// Device local bytes of a category, Category::Count for all of them
+VkDeviceSize usage(Category category = Category::Count);
+// Device local bytes left, either in the budget or, without one, in the heap budgets reported by the driver
+VkDeviceSize available();
+// For optional buffers, which are downscaled or skipped when they do not fit
+bool fits(VkDeviceSize size);
+
+// Raises the allocation error when the device local memory of a resource about to be created exceeds the budget
+void check(const VkBufferCreateInfo& buffer_ci, const VmaAllocationCreateInfo& alloc_ci, std::string_view name,
+		   bool staging = false);
+void check(const VkImageCreateInfo& image_ci, const VmaAllocationCreateInfo& alloc_ci, std::string_view name);
+void track(VmaAllocation allocation, std::string_view name, bool staging = false);
+void untrack(VmaAllocation allocation);
+// Logs the report when the driver could not allocate, before the allocation error is raised
+void allocation_failed(std::string_view name);
+
+// Totals per category and heap, followed by the largest allocations of every category
+void log_report(uint32_t max_allocations = 5);
+// The same breakdown with every allocation, as json
+bool write_report(const std::string& path);
+}  // namespace MemoryBudget
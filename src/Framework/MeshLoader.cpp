@@ -0,0 +1,638 @@
+#include "../LumenPCH.h"
+#include "MeshLoader.h"
+#include <tiny_obj_loader.h>
+#include <miniz.h>
+#include <charconv>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MeshLoader {
+
+MappedFile::MappedFile(const std::string& path) {
+#if defined(_WIN32) || defined(_WIN64)
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+					   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		LUMEN_ERROR("Could not open " + path);
+	}
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	length = size_t(file_size.QuadPart);
+	if (length == 0) {
+		return;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	ptr = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		LUMEN_ERROR("Could not open " + path);
+	}
+	struct stat st;
+	fstat(fd, &st);
+	length = size_t(st.st_size);
+	if (length > 0) {
+		void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		ptr = mapped == MAP_FAILED ? nullptr : (const uint8_t*)mapped;
+		if (ptr) {
+			madvise((void*)ptr, length, MADV_SEQUENTIAL);
+		}
+	}
+	close(fd);
+#endif
+	if (length > 0 && !ptr) {
+		LUMEN_ERROR("Could not map " + path);
+	}
+}
+
+MappedFile::~MappedFile() {
+#if defined(_WIN32) || defined(_WIN64)
+	if (ptr) {
+		UnmapViewOfFile(ptr);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+#else
+	if (ptr) {
+		munmap((void*)ptr, length);
+	}
+#endif
+}
+
+void load_obj(const std::string& path, MeshData& mesh) {
+	tinyobj::ObjReaderConfig reader_config;
+	tinyobj::ObjReader reader;
+	if (!reader.ParseFromFile(path, reader_config)) {
+		LUMEN_ERROR("TinyObjReader: " + reader.Error());
+	}
+	if (!reader.Warning().empty()) {
+		LUMEN_WARN("TinyObjReader: {}", reader.Warning());
+	}
+	const auto& attrib = reader.GetAttrib();
+	bool has_normals = true;
+	for (const auto& shape : reader.GetShapes()) {
+		for (const tinyobj::index_t& idx : shape.mesh.indices) {
+			mesh.indices.push_back((uint32_t)mesh.positions.size());
+			const float* v = &attrib.vertices[3 * size_t(idx.vertex_index)];
+			mesh.positions.emplace_back(v[0], v[1], v[2]);
+			if (idx.normal_index >= 0) {
+				const float* n = &attrib.normals[3 * size_t(idx.normal_index)];
+				mesh.normals.emplace_back(n[0], n[1], n[2]);
+			} else {
+				mesh.normals.emplace_back(0.0f);
+				has_normals = false;
+			}
+			if (idx.texcoord_index >= 0) {
+				const float* t = &attrib.texcoords[2 * size_t(idx.texcoord_index)];
+				mesh.texcoords0.emplace_back(t[0], t[1]);
+			} else {
+				mesh.texcoords0.emplace_back(0.0f);
+			}
+		}
+	}
+	if (!has_normals) {
+		compute_normals(mesh);
+	}
+}
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+struct PlyProperty {
+	std::string name;
+	PlyType type;
+	// Lists store their length with count_type, followed by that many values of type
+	bool list = false;
+	PlyType count_type;
+};
+
+struct PlyElement {
+	std::string name;
+	size_t count = 0;
+	std::vector<PlyProperty> properties;
+};
+
+static PlyType ply_type(const std::string& name, const std::string& path) {
+	static const std::unordered_map<std::string, PlyType> types = {
+		{"char", PlyType::Int8},	  {"int8", PlyType::Int8},		{"uchar", PlyType::UInt8},
+		{"uint8", PlyType::UInt8},	  {"short", PlyType::Int16},	{"int16", PlyType::Int16},
+		{"ushort", PlyType::UInt16},  {"uint16", PlyType::UInt16},	{"int", PlyType::Int32},
+		{"int32", PlyType::Int32},	  {"uint", PlyType::UInt32},	{"uint32", PlyType::UInt32},
+		{"float", PlyType::Float32},  {"float32", PlyType::Float32}, {"double", PlyType::Float64},
+		{"float64", PlyType::Float64}};
+	auto it = types.find(name);
+	if (it == types.end()) {
+		LUMEN_ERROR("Unknown PLY property type " + name + " in " + path);
+	}
+	return it->second;
+}
+
+static size_t ply_type_size(PlyType type) {
+	switch (type) {
+		case PlyType::Int8:
+		case PlyType::UInt8:
+			return 1;
+		case PlyType::Int16:
+		case PlyType::UInt16:
+			return 2;
+		case PlyType::Int32:
+		case PlyType::UInt32:
+		case PlyType::Float32:
+			return 4;
+		default:
+			return 8;
+	}
+}
+
+// Binary value at p, swap for big endian files
+static double ply_read(const uint8_t* p, PlyType type, bool swap) {
+	uint8_t swapped[8];
+	const uint8_t* bytes = p;
+	if (swap) {
+		const size_t size = ply_type_size(type);
+		for (size_t i = 0; i < size; i++) {
+			swapped[i] = p[size - 1 - i];
+		}
+		bytes = swapped;
+	}
+	switch (type) {
+		case PlyType::Int8:
+			return double(int8_t(bytes[0]));
+		case PlyType::UInt8:
+			return double(bytes[0]);
+		case PlyType::Int16: {
+			int16_t v;
+			memcpy(&v, bytes, 2);
+			return double(v);
+		}
+		case PlyType::UInt16: {
+			uint16_t v;
+			memcpy(&v, bytes, 2);
+			return double(v);
+		}
+		case PlyType::Int32: {
+			int32_t v;
+			memcpy(&v, bytes, 4);
+			return double(v);
+		}
+		case PlyType::UInt32: {
+			uint32_t v;
+			memcpy(&v, bytes, 4);
+			return double(v);
+		}
+		case PlyType::Float32: {
+			float v;
+			memcpy(&v, bytes, 4);
+			return double(v);
+		}
+		default: {
+			double v;
+			memcpy(&v, bytes, 8);
+			return v;
+		}
+	}
+}
+
+// Sequential reader over the body of a .ply file, binary or whitespace separated ASCII
+class PlyReader {
+   public:
+	PlyReader(const uint8_t* begin, const uint8_t* end, bool ascii, bool swap, const std::string& path)
+		: p(begin), end(end), ascii(ascii), swap(swap), path(path) {}
+
+	double read(PlyType type) {
+		if (ascii) {
+			while (p < end && std::isspace(*p)) {
+				p++;
+			}
+			double v = 0.0;
+			const auto result = std::from_chars((const char*)p, (const char*)end, v);
+			if (result.ec != std::errc()) {
+				LUMEN_ERROR("Malformed PLY body in " + path);
+			}
+			p = (const uint8_t*)result.ptr;
+			return v;
+		}
+		const size_t size = ply_type_size(type);
+		if (size_t(end - p) < size) {
+			LUMEN_ERROR("Truncated PLY file " + path);
+		}
+		const double v = ply_read(p, type, swap);
+		p += size;
+		return v;
+	}
+
+	void skip(const PlyProperty& prop) {
+		const uint32_t count = prop.list ? (uint32_t)read(prop.count_type) : 1;
+		for (uint32_t i = 0; i < count; i++) {
+			read(prop.type);
+		}
+	}
+
+   private:
+	const uint8_t* p;
+	const uint8_t* end;
+	bool ascii;
+	bool swap;
+	const std::string& path;
+};
+
+void load_ply(const std::string& path, MeshData& mesh) {
+	MappedFile file(path);
+	const char* text = (const char*)file.data();
+	const size_t size = file.size();
+	// Header
+	const std::string end_header = "end_header";
+	const char* header_end = std::search(text, text + size, end_header.begin(), end_header.end());
+	if (size < 3 || memcmp(text, "ply", 3) != 0 || header_end == text + size) {
+		LUMEN_ERROR("Not a PLY file: " + path);
+	}
+	const char* body = std::find(header_end, text + size, '\n');
+	body = body == text + size ? body : body + 1;
+	std::istringstream header(std::string(text, header_end));
+	std::vector<PlyElement> elements;
+	bool ascii = false;
+	bool swap = false;
+	std::string line;
+	while (std::getline(header, line)) {
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+		if (keyword == "format") {
+			std::string format;
+			tokens >> format;
+			ascii = format == "ascii";
+			swap = format == "binary_big_endian";
+			if (!ascii && !swap && format != "binary_little_endian") {
+				LUMEN_ERROR("Unknown PLY format " + format + " in " + path);
+			}
+		} else if (keyword == "element") {
+			PlyElement element;
+			tokens >> element.name >> element.count;
+			elements.push_back(element);
+		} else if (keyword == "property" && !elements.empty()) {
+			PlyProperty prop;
+			std::string type;
+			tokens >> type;
+			if (type == "list") {
+				std::string count_type;
+				tokens >> count_type >> type;
+				prop.list = true;
+				prop.count_type = ply_type(count_type, path);
+			}
+			prop.type = ply_type(type, path);
+			tokens >> prop.name;
+			elements.back().properties.push_back(prop);
+		}
+	}
+
+	// Destinations of the vertex properties: position, normal, texture coordinate
+	enum Slot { PX, PY, PZ, NX, NY, NZ, U, V, NONE };
+	const auto vertex_slot = [](const std::string& name) {
+		static const std::unordered_map<std::string, Slot> slots = {
+			{"x", PX},		   {"y", PY},		  {"z", PZ},		 {"nx", NX},		{"ny", NY},
+			{"nz", NZ},		   {"u", U},		  {"v", V},			 {"s", U},			{"t", V},
+			{"texture_u", U}, {"texture_v", V}, {"texture_s", U}, {"texture_t", V}};
+		auto it = slots.find(name);
+		return it == slots.end() ? NONE : it->second;
+	};
+	PlyReader reader((const uint8_t*)body, file.data() + size, ascii, swap, path);
+	bool has_normals = false;
+	uint32_t num_vertices = 0;
+	for (const PlyElement& element : elements) {
+		if (element.name == "vertex") {
+			std::vector<Slot> slots;
+			for (const PlyProperty& prop : element.properties) {
+				slots.push_back(prop.list ? NONE : vertex_slot(prop.name));
+				has_normals |= slots.back() == NX;
+			}
+			num_vertices = (uint32_t)element.count;
+			mesh.positions.resize(element.count);
+			mesh.normals.resize(element.count, glm::vec3(0));
+			mesh.texcoords0.resize(element.count, glm::vec2(0));
+			for (size_t i = 0; i < element.count; i++) {
+				float values[NONE] = {};
+				for (size_t j = 0; j < element.properties.size(); j++) {
+					if (slots[j] == NONE) {
+						reader.skip(element.properties[j]);
+					} else {
+						values[slots[j]] = (float)reader.read(element.properties[j].type);
+					}
+				}
+				mesh.positions[i] = glm::vec3(values[PX], values[PY], values[PZ]);
+				mesh.normals[i] = glm::vec3(values[NX], values[NY], values[NZ]);
+				mesh.texcoords0[i] = glm::vec2(values[U], values[V]);
+			}
+		} else if (element.name == "face") {
+			mesh.indices.reserve(mesh.indices.size() + 3 * element.count);
+			for (size_t i = 0; i < element.count; i++) {
+				for (const PlyProperty& prop : element.properties) {
+					if (!prop.list || (prop.name != "vertex_indices" && prop.name != "vertex_index")) {
+						reader.skip(prop);
+						continue;
+					}
+					const uint32_t count = (uint32_t)reader.read(prop.count_type);
+					uint32_t first = 0, prev = 0;
+					for (uint32_t k = 0; k < count; k++) {
+						const uint32_t idx = (uint32_t)reader.read(prop.type);
+						if (idx >= num_vertices) {
+							LUMEN_ERROR("PLY face references a missing vertex in " + path);
+						}
+						if (k == 0) {
+							first = idx;
+						} else if (k >= 2) {
+							mesh.indices.insert(mesh.indices.end(), {first, prev, idx});
+						}
+						prev = idx;
+					}
+				}
+			}
+		} else {
+			for (size_t i = 0; i < element.count; i++) {
+				for (const PlyProperty& prop : element.properties) {
+					reader.skip(prop);
+				}
+			}
+		}
+	}
+	if (!has_normals) {
+		compute_normals(mesh);
+	}
+}
+
+// Mitsuba's TriMesh serialization
+#define MTS_FILEFORMAT_HEADER 0x041C
+#define MTS_HAS_NORMALS 0x0001
+#define MTS_HAS_TEXCOORDS 0x0002
+#define MTS_HAS_COLORS 0x0008
+#define MTS_FACE_NORMALS 0x0010
+#define MTS_DOUBLE_PRECISION 0x2000
+
+void load_serialized(const std::string& path, uint32_t shape_index, MeshData& mesh) {
+	MappedFile file(path);
+	const uint8_t* data = file.data();
+	const size_t size = file.size();
+	const auto read_u16 = [&](size_t offset) {
+		uint16_t v;
+		memcpy(&v, data + offset, 2);
+		return v;
+	};
+	if (size < 8 || read_u16(0) != MTS_FILEFORMAT_HEADER) {
+		LUMEN_ERROR("Not a Mitsuba serialized file: " + path);
+	}
+	const uint16_t version = read_u16(2);
+	if (version != 3 && version != 4) {
+		LUMEN_ERROR("Unsupported serialized format version " + std::to_string(version) + " in " + path);
+	}
+	// Dictionary of the shape offsets at the end of the file, followed by the shape count
+	uint32_t count;
+	memcpy(&count, data + size - 4, 4);
+	const size_t offset_size = version == 4 ? 8 : 4;
+	const size_t dictionary = size - 4 - size_t(count) * offset_size;
+	if (shape_index >= count || dictionary > size) {
+		LUMEN_ERROR("Shape " + std::to_string(shape_index) + " not found in " + path);
+	}
+	const auto shape_offset = [&](uint32_t i) {
+		uint64_t offset = 0;
+		memcpy(&offset, data + dictionary + i * offset_size, offset_size);
+		return size_t(offset);
+	};
+	// Format and version of the shape precede its zlib stream
+	const size_t begin = shape_offset(shape_index) + 4;
+	const size_t end = shape_index + 1 < count ? shape_offset(shape_index + 1) : dictionary;
+	if (begin >= end || end > dictionary) {
+		LUMEN_ERROR("Corrupt shape dictionary in " + path);
+	}
+	size_t stream_size = 0;
+	uint8_t* stream =
+		(uint8_t*)tinfl_decompress_mem_to_heap(data + begin, end - begin, &stream_size, TINFL_FLAG_PARSE_ZLIB_HEADER);
+	if (!stream) {
+		LUMEN_ERROR("Could not decompress shape " + std::to_string(shape_index) + " of " + path);
+	}
+	size_t p = 0;
+	const auto read = [&](void* dst, size_t bytes) {
+		if (p + bytes > stream_size) {
+			mz_free(stream);
+			LUMEN_ERROR("Truncated shape " + std::to_string(shape_index) + " in " + path);
+		}
+		memcpy(dst, stream + p, bytes);
+		p += bytes;
+	};
+	uint32_t flags;
+	read(&flags, 4);
+	if (version == 4) {
+		// Shape name
+		while (p < stream_size && stream[p] != 0) {
+			p++;
+		}
+		p++;
+	}
+	uint64_t num_vertices, num_triangles;
+	read(&num_vertices, 8);
+	read(&num_triangles, 8);
+	const bool double_precision = flags & MTS_DOUBLE_PRECISION;
+	const auto read_floats = [&](float* dst, size_t n) {
+		if (!double_precision) {
+			read(dst, n * sizeof(float));
+			return;
+		}
+		for (size_t i = 0; i < n; i++) {
+			double v;
+			read(&v, sizeof(double));
+			dst[i] = (float)v;
+		}
+	};
+	mesh.positions.resize(num_vertices);
+	read_floats(glm::value_ptr(mesh.positions[0]), 3 * num_vertices);
+	mesh.normals.assign(num_vertices, glm::vec3(0));
+	if (flags & MTS_HAS_NORMALS) {
+		read_floats(glm::value_ptr(mesh.normals[0]), 3 * num_vertices);
+	}
+	mesh.texcoords0.assign(num_vertices, glm::vec2(0));
+	if (flags & MTS_HAS_TEXCOORDS) {
+		read_floats(glm::value_ptr(mesh.texcoords0[0]), 2 * num_vertices);
+	}
+	if (flags & MTS_HAS_COLORS) {
+		p += (double_precision ? 8 : 4) * 3 * num_vertices;
+	}
+	mesh.indices.resize(3 * num_triangles);
+	if (num_vertices > 0xFFFFFFFFull) {
+		mz_free(stream);
+		LUMEN_ERROR("Meshes with more than 2^32 vertices are not supported: " + path);
+	}
+	read(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	mz_free(stream);
+	for (uint32_t idx : mesh.indices) {
+		if (idx >= num_vertices) {
+			LUMEN_ERROR("Serialized triangle references a missing vertex in " + path);
+		}
+	}
+	if (flags & MTS_FACE_NORMALS) {
+		use_face_normals(mesh);
+	} else if (!(flags & MTS_HAS_NORMALS)) {
+		compute_normals(mesh);
+	}
+}
+
+static void add_quad(MeshData& mesh, const glm::vec3& origin, const glm::vec3& u, const glm::vec3& v) {
+	const uint32_t base = (uint32_t)mesh.positions.size();
+	const glm::vec3 n = glm::normalize(glm::cross(u, v));
+	const glm::vec2 uvs[4] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+	for (const glm::vec2& uv : uvs) {
+		mesh.positions.push_back(origin + uv.x * u + uv.y * v);
+		mesh.normals.push_back(n);
+		mesh.texcoords0.push_back(uv);
+	}
+	mesh.indices.insert(mesh.indices.end(), {base, base + 1, base + 2, base + 2, base + 3, base});
+}
+
+void rectangle(MeshData& mesh) { add_quad(mesh, glm::vec3(-1, -1, 0), glm::vec3(2, 0, 0), glm::vec3(0, 2, 0)); }
+
+void cube(MeshData& mesh) {
+	// Origin and edges of every face, counter clockwise seen from outside
+	add_quad(mesh, glm::vec3(-1, -1, 1), glm::vec3(2, 0, 0), glm::vec3(0, 2, 0));
+	add_quad(mesh, glm::vec3(1, -1, -1), glm::vec3(-2, 0, 0), glm::vec3(0, 2, 0));
+	add_quad(mesh, glm::vec3(1, -1, 1), glm::vec3(0, 0, -2), glm::vec3(0, 2, 0));
+	add_quad(mesh, glm::vec3(-1, -1, -1), glm::vec3(0, 0, 2), glm::vec3(0, 2, 0));
+	add_quad(mesh, glm::vec3(-1, 1, 1), glm::vec3(2, 0, 0), glm::vec3(0, 0, -2));
+	add_quad(mesh, glm::vec3(-1, -1, -1), glm::vec3(2, 0, 0), glm::vec3(0, 0, 2));
+}
+
+void disk(MeshData& mesh, uint32_t segments) {
+	const uint32_t center = (uint32_t)mesh.positions.size();
+	mesh.positions.emplace_back(0.0f);
+	mesh.normals.emplace_back(0, 0, 1);
+	mesh.texcoords0.emplace_back(0.5f);
+	for (uint32_t i = 0; i < segments; i++) {
+		const float phi = 2.0f * glm::pi<float>() * i / segments;
+		const glm::vec2 p(std::cos(phi), std::sin(phi));
+		mesh.positions.emplace_back(p, 0.0f);
+		mesh.normals.emplace_back(0, 0, 1);
+		mesh.texcoords0.push_back(0.5f * p + 0.5f);
+		mesh.indices.insert(mesh.indices.end(), {center, center + 1 + i, center + 1 + (i + 1) % segments});
+	}
+}
+
+void sphere(MeshData& mesh, const glm::vec3& center, float radius, uint32_t segments) {
+	// Latitude-longitude grid, the seam and the poles duplicate their vertices for the texture coordinates
+	const uint32_t rings = std::max(2u, segments / 2);
+	const uint32_t base = (uint32_t)mesh.positions.size();
+	for (uint32_t r = 0; r <= rings; r++) {
+		const float theta = glm::pi<float>() * r / rings;
+		for (uint32_t s = 0; s <= segments; s++) {
+			const float phi = 2.0f * glm::pi<float>() * s / segments;
+			const glm::vec3 n(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+			mesh.positions.push_back(center + radius * n);
+			mesh.normals.push_back(n);
+			mesh.texcoords0.emplace_back(float(s) / segments, float(r) / rings);
+		}
+	}
+	for (uint32_t r = 0; r < rings; r++) {
+		for (uint32_t s = 0; s < segments; s++) {
+			const uint32_t i0 = base + r * (segments + 1) + s;
+			const uint32_t i1 = i0 + segments + 1;
+			if (r > 0) {
+				mesh.indices.insert(mesh.indices.end(), {i0, i1, i0 + 1});
+			}
+			if (r + 1 < rings) {
+				mesh.indices.insert(mesh.indices.end(), {i0 + 1, i1, i1 + 1});
+			}
+		}
+	}
+}
+
+void compute_normals(MeshData& mesh) {
+	mesh.normals.assign(mesh.positions.size(), glm::vec3(0));
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const uint32_t* tri = &mesh.indices[i];
+		// Unnormalized, weighs the faces by their area
+		const glm::vec3 n = glm::cross(mesh.positions[tri[1]] - mesh.positions[tri[0]],
+									   mesh.positions[tri[2]] - mesh.positions[tri[0]]);
+		for (int k = 0; k < 3; k++) {
+			mesh.normals[tri[k]] += n;
+		}
+	}
+	for (glm::vec3& n : mesh.normals) {
+		const float len = glm::length(n);
+		n = len > 0.0f ? n / len : glm::vec3(0, 0, 1);
+	}
+}
+
+void use_face_normals(MeshData& mesh) {
+	MeshData flat;
+	flat.positions.reserve(mesh.indices.size());
+	flat.normals.reserve(mesh.indices.size());
+	flat.texcoords0.reserve(mesh.indices.size());
+	flat.indices.reserve(mesh.indices.size());
+	const bool has_texcoords = mesh.texcoords0.size() == mesh.positions.size();
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const uint32_t* tri = &mesh.indices[i];
+		glm::vec3 n = glm::cross(mesh.positions[tri[1]] - mesh.positions[tri[0]],
+								 mesh.positions[tri[2]] - mesh.positions[tri[0]]);
+		const float len = glm::length(n);
+		n = len > 0.0f ? n / len : glm::vec3(0, 0, 1);
+		for (int k = 0; k < 3; k++) {
+			flat.indices.push_back((uint32_t)flat.positions.size());
+			flat.positions.push_back(mesh.positions[tri[k]]);
+			flat.normals.push_back(n);
+			flat.texcoords0.push_back(has_texcoords ? mesh.texcoords0[tri[k]] : glm::vec2(0));
+		}
+	}
+	mesh = std::move(flat);
+}
+
+void flip_normals(MeshData& mesh) {
+	for (glm::vec3& n : mesh.normals) {
+		n = -n;
+	}
+	// Keep the winding consistent with the shading normals
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+	}
+}
+
+MeshData load_mitsuba_shape(const MitsubaParser::MitsubaMesh& shape, const std::string& root) {
+	using MitsubaShape = MitsubaParser::MitsubaShape;
+	MeshData mesh;
+	switch (shape.shape) {
+		case MitsubaShape::Obj:
+			load_obj(root + shape.file, mesh);
+			break;
+		case MitsubaShape::Ply:
+			load_ply(root + shape.file, mesh);
+			break;
+		case MitsubaShape::Serialized:
+			load_serialized(root + shape.file, shape.shape_index, mesh);
+			break;
+		case MitsubaShape::Rectangle:
+			rectangle(mesh);
+			break;
+		case MitsubaShape::Cube:
+			cube(mesh);
+			break;
+		case MitsubaShape::Disk:
+			disk(mesh);
+			break;
+		case MitsubaShape::Sphere:
+			sphere(mesh, shape.center, shape.radius);
+			break;
+	}
+	if (shape.face_normals) {
+		use_face_normals(mesh);
+	}
+	if (shape.flip_normals) {
+		flip_normals(mesh);
+	}
+	return mesh;
+}
+}  // namespace MeshLoader
@@ -0,0 +1,62 @@
+#pragma once
+#include "../LumenPCH.h"
+#include "MitsubaParser.h"
+
+struct MeshData {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec4> tangents;
+	std::vector<glm::vec2> texcoords0;
+	std::vector<glm::vec2> texcoords1;
+	std::vector<glm::vec4> colors0;
+};
+
+// Mesh ingestion of the scene loaders. Every loader returns an indexed triangle mesh in object space with a normal
+// and a texture coordinate per vertex, and throws through LUMEN_ERROR on files it cannot read
+namespace MeshLoader {
+
+// Read only view of a whole file, memory mapped so that large meshes are parsed without copying them first
+class MappedFile {
+   public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	const uint8_t* data() const { return ptr; }
+	size_t size() const { return length; }
+
+   private:
+	const uint8_t* ptr = nullptr;
+	size_t length = 0;
+#if defined(_WIN32) || defined(_WIN64)
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
+
+// Every shape of the file merged into one mesh, a vertex per corner
+void load_obj(const std::string& path, MeshData& mesh);
+// ASCII and binary (either endianness) .ply. Polygons are triangulated as fans
+void load_ply(const std::string& path, MeshData& mesh);
+// Shape shape_index of a Mitsuba .serialized file, format versions 3 and 4
+void load_serialized(const std::string& path, uint32_t shape_index, MeshData& mesh);
+
+// Mitsuba's analytic shapes before their to_world transform
+// [-1, 1]^2 in the z = 0 plane, facing +z
+void rectangle(MeshData& mesh);
+// [-1, 1]^3
+void cube(MeshData& mesh);
+// Unit disk in the z = 0 plane, facing +z
+void disk(MeshData& mesh, uint32_t segments = 64);
+void sphere(MeshData& mesh, const glm::vec3& center, float radius, uint32_t segments = 64);
+
+// Area weighted vertex normals, for files without normals
+void compute_normals(MeshData& mesh);
+// Unwelds the triangles so that each has the normal of its face
+void use_face_normals(MeshData& mesh);
+void flip_normals(MeshData& mesh);
+
+// Geometry of a shape of a Mitsuba scene, file names are relative to root
+MeshData load_mitsuba_shape(const MitsubaParser::MitsubaMesh& shape, const std::string& root);
+}  // namespace MeshLoader
@@ -40,8 +40,27 @@ void MitsubaParser::parse(const std::string& path) {
 			case OT_BSDF: {
 				MitsubaBSDF bsdf;
 				bsdf.name = obj->id();
-				while ((obj->pluginType() == "twosided" || obj->pluginType() == "mask") &&
+				auto texture_file = [](Object* texture) {
+					for (const auto& texture_prop : texture->properties()) {
+						if (texture_prop.first == "filename") {
+							return texture_prop.second.getString();
+						}
+					}
+					return std::string();
+				};
+				while ((obj->pluginType() == "twosided" || obj->pluginType() == "mask" ||
+						obj->pluginType() == "normalmap") &&
 					   obj->anonymousChildren().size()) {
+					for (const auto& named_child : obj->namedChildren()) {
+						if (named_child.second.get()->type() != OT_TEXTURE) {
+							continue;
+						}
+						if (obj->pluginType() == "mask" && named_child.first == "opacity") {
+							bsdf.alpha_mask = texture_file(named_child.second.get());
+						} else if (obj->pluginType() == "normalmap" && named_child.first == "normalmap") {
+							bsdf.normal_map = texture_file(named_child.second.get());
+						}
+					}
 					obj = obj->anonymousChildren()[0].get();
 				}
 				bsdf.type = obj->pluginType();
@@ -64,12 +83,18 @@ void MitsubaParser::parse(const std::string& path) {
 					}
 				}
 				for (const auto& named_child : obj->namedChildren()) {
-					if (named_child.second.get()->type() == OT_TEXTURE) {
-						for (const auto& texture_prop : named_child.second.get()->properties()) {
-							if (texture_prop.first == "filename") {
-								bsdf.texture = texture_prop.second.getString();
-							}
-						}
+					const std::string file = named_child.second.get()->type() == OT_TEXTURE
+												 ? texture_file(named_child.second.get())
+												 : std::string();
+					if (file.empty()) {
+						continue;
+					}
+					if (named_child.first == "roughness") {
+						bsdf.roughness_texture = file;
+					} else if (named_child.first == "metallic") {
+						bsdf.metallic_texture = file;
+					} else if (named_child.first != "alpha") {
+						bsdf.texture = file;
 					}
 				}
 				for (const auto& prop : obj->properties()) {
@@ -91,10 +116,35 @@ void MitsubaParser::parse(const std::string& path) {
 			} break;
 			case OT_SHAPE: {
 				MitsubaMesh mesh;
+				static const std::unordered_map<std::string, MitsubaShape> shape_types = {
+					{"obj", MitsubaShape::Obj},
+					{"ply", MitsubaShape::Ply},
+					{"serialized", MitsubaShape::Serialized},
+					{"rectangle", MitsubaShape::Rectangle},
+					{"cube", MitsubaShape::Cube},
+					{"disk", MitsubaShape::Disk},
+					{"sphere", MitsubaShape::Sphere},
+				};
+				auto shape_type = shape_types.find(obj->pluginType());
+				if (shape_type == shape_types.end()) {
+					LUMEN_WARN("Unsupported Mitsuba shape type {}", obj->pluginType());
+					break;
+				}
+				mesh.shape = shape_type->second;
 				for (const auto& prop : obj->properties()) {
 					if (prop.first == "filename") {
 						mesh.file = prop.second.getString();
-
+					} else if (prop.first == "shape_index") {
+						mesh.shape_index = (uint32_t)prop.second.getInteger();
+					} else if (prop.first == "center") {
+						auto center = prop.second.getVector();
+						mesh.center = glm::vec3({center.x, center.y, center.z});
+					} else if (prop.first == "radius") {
+						mesh.radius = prop.second.getNumber();
+					} else if (prop.first == "face_normals") {
+						mesh.face_normals = prop.second.getBool();
+					} else if (prop.first == "flip_normals") {
+						mesh.flip_normals = prop.second.getBool();
 					} else if (prop.first == "to_world") {
 						float* p_dst = (float*)glm::value_ptr(mesh.transform);
 						const auto& src = prop.second.getTransform();
@@ -106,8 +156,17 @@ void MitsubaParser::parse(const std::string& path) {
 					}
 				}
 
-				// Assume refs to BSDFs
+				// Assume refs to BSDFs, apart from area emitters
 				for (const auto& mesh_child : obj->anonymousChildren()) {
+					if (mesh_child.get()->type() == OT_EMITTER) {
+						for (const auto& prop : mesh_child.get()->properties()) {
+							if (prop.first == "radiance" && prop.second.type() == PT_COLOR) {
+								const auto& col = prop.second.getColor();
+								mesh.emission = glm::vec3({col.r, col.g, col.b});
+							}
+						}
+						continue;
+					}
 					auto ref = mesh_child.get()->id();
 					for (int i = 0; i < bsdfs.size(); i++) {
 						if (bsdfs[i].name == ref) {
@@ -122,10 +181,17 @@ void MitsubaParser::parse(const std::string& path) {
 				MitsubaLight light;
 				if (obj->pluginType() == "sunsky") {
 					light.type = "directional";
+				} else if (obj->pluginType() == "envmap") {
+					light.type = "envmap";
+					light.L = glm::vec3(1.0f);
 				}
 				light.to = glm::vec3(0);
 				for (const auto& prop : obj->properties()) {
-					if (prop.first == "sun_direction") {
+					if (prop.first == "filename") {
+						light.env_map = prop.second.getString();
+					} else if (prop.first == "scale") {
+						light.L *= prop.second.getNumber();
+					} else if (prop.first == "sun_direction") {
 						auto dir = prop.second.getVector();
 						light.from = glm::vec3({dir.x, dir.y, dir.z});
 					} else if (prop.first == "sun_color") {
@@ -8,6 +8,12 @@ struct MitsubaParser {
 		std::string name = "";
 		std::string type = "";
 		std::string texture = "";
+		// Opacity texture of an enclosing mask plugin
+		std::string alpha_mask = "";
+		// Tangent space normals of an enclosing normalmap plugin
+		std::string normal_map = "";
+		std::string roughness_texture = "";
+		std::string metallic_texture = "";
 		glm::vec3 albedo = glm::vec3(1);
 		glm::vec3 emissive_factor = glm::vec3(0);
 		float roughness = 0;
@@ -21,13 +27,15 @@ struct MitsubaParser {
 		glm::vec3 sky_col;
 	};
 
-	enum class MitsubaShape { Rectangle };
+	enum class MitsubaShape { Obj, Ply, Serialized, Rectangle, Cube, Disk, Sphere };
 
 	struct MitsubaLight {
 		std::string type;
 		glm::vec3 from;
 		glm::vec3 to;
 		glm::vec3 L;
+		// Equirectangular image of an envmap emitter
+		std::string env_map = "";
 	};
 
 	struct MitsubaMesh {
@@ -35,7 +43,16 @@ struct MitsubaParser {
 		// In case
 		std::string bsdf_ref = "";
 		int bsdf_idx = -1;
-		MitsubaShape shape;
+		MitsubaShape shape = MitsubaShape::Obj;
+		// Shape of a .serialized file
+		uint32_t shape_index = 0;
+		// Sphere
+		glm::vec3 center = glm::vec3(0);
+		float radius = 1.0f;
+		bool face_normals = false;
+		bool flip_normals = false;
+		// Radiance of an area emitter attached to the shape
+		glm::vec3 emission = glm::vec3(0);
 		glm::mat4 transform = glm::mat4(1);
 	};
 
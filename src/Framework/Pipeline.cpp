@@ -170,7 +170,8 @@ void Pipeline::create_gfx_pipeline(const GraphicsPassSettings& settings, const s
 	pipeline_CI.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline_CI.pDepthStencilState = &depth_stencil_state_ci;
 
-	vk::check(vkCreateGraphicsPipelines(vk::context().device, VK_NULL_HANDLE, 1, &pipeline_CI, nullptr, &handle));
+	vk::check(vkCreateGraphicsPipelines(vk::context().device, vk::context().pipeline_cache, 1, &pipeline_CI, nullptr,
+										&handle));
 	for (auto& stage : stages) {
 		vkDestroyShaderModule(vk::context().device, stage.module, nullptr);
 	}
@@ -210,7 +211,21 @@ void Pipeline::create_rt_pipeline(const RTPassSettings& settings, const std::vec
 	stage.pName = "main";
 
 	int stage_idx = 0;
-	for (const auto& shader : settings.shaders) {
+	for (uint32_t i = 0; i < settings.shaders.size(); i++) {
+		const auto& shader = settings.shaders[i];
+		const bool combined_any_hit =
+			shader.stage == VK_SHADER_STAGE_ANY_HIT_BIT_KHR && i > 0 &&
+			std::find(settings.combined_hit_groups.begin(), settings.combined_hit_groups.end(), i - 1) !=
+				settings.combined_hit_groups.end();
+		if (combined_any_hit) {
+			// Joins the hit group of the preceding closest hit shader
+			stage.module = shader.create_vk_shader_module(vk::context().device);
+			stage.stage = shader.stage;
+			groups.back().anyHitShader = stage_idx;
+			stages.push_back(stage);
+			stage_idx++;
+			continue;
+		}
 		VkRayTracingShaderGroupCreateInfoKHR group{VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR};
 		group.anyHitShader = VK_SHADER_UNUSED_KHR;
 		group.closestHitShader = VK_SHADER_UNUSED_KHR;
@@ -275,7 +290,8 @@ void Pipeline::create_rt_pipeline(const RTPassSettings& settings, const std::vec
 	pipeline_CI.maxPipelineRayRecursionDepth = settings.recursion_depth;
 	pipeline_CI.layout = pipeline_layout;
 	pipeline_CI.flags = 0;
-	vk::check(vkCreateRayTracingPipelinesKHR(vk::context().device, {}, {}, 1, &pipeline_CI, nullptr, &handle));
+	vk::check(vkCreateRayTracingPipelinesKHR(vk::context().device, {}, vk::context().pipeline_cache, 1, &pipeline_CI,
+											 nullptr, &handle));
 	sbt_wrapper.setup(vk::context().queue_indices.gfx_family.value(), vk::context().rt_props);
 	sbt_wrapper.create(handle, pipeline_CI);
 	if (!name.empty()) {
@@ -324,7 +340,8 @@ void Pipeline::create_compute_pipeline(const ComputePassSettings& settings,
 	pipeline_CI.stage = shader_stage_ci;
 	pipeline_CI.flags |= VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
 	pipeline_CI.layout = pipeline_layout;
-	vk::check(vkCreateComputePipelines(vk::context().device, VK_NULL_HANDLE, 1, &pipeline_CI, nullptr, &handle));
+	vk::check(vkCreateComputePipelines(vk::context().device, vk::context().pipeline_cache, 1, &pipeline_CI, nullptr,
+									   &handle));
 	vkDestroyShaderModule(vk::context().device, compute_shader_module, nullptr);
 	if (!name.empty()) {
 		vk::DebugMarker::set_resource_name(vk::context().device, (uint64_t)handle, name.c_str(),
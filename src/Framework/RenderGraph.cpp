@@ -3,6 +3,7 @@
 #include "RenderGraph.h"
 #include "VkUtils.h"
 #include "GPUQueryManager.h"
+#include <tinygltf/json.hpp>
 
 namespace lumen {
 #define DIRTY_CHECK(x) \
@@ -26,6 +27,10 @@ void RenderPass::register_dependencies(vk::Buffer* buffer, VkAccessFlags dst_acc
 	auto opposing_pass_idx = rg->buffer_resource_map[buffer->handle].first;
 	if (opposing_pass_idx < rg->passes.size()) {
 		RenderPass& opposing_pass = rg->passes[opposing_pass_idx];
+		if (opposing_pass.pass_idx < pass_idx && opposing_pass.queue != queue) {
+			// Cross-queue dependencies are synchronized by the queue ownership transfers
+			return;
+		}
 		if (opposing_pass_idx < rg->passes.size() && opposing_pass.pass_idx < pass_idx) {
 			if (wait_signals_buffer.find(buffer->handle) == wait_signals_buffer.end()) {
 				wait_signals_buffer[buffer->handle] = BufferSyncDescriptor{
@@ -74,7 +79,13 @@ void RenderPass::register_dependencies(vk::Texture* tex, VkImageLayout dst_layou
 		tex->layout = dst_layout;
 	} else if (img_resource->second < rg->passes.size()) {
 		RenderPass& opposing_pass = rg->passes[img_resource->second];
-		if (opposing_pass.pass_idx < pass_idx) {
+		if (opposing_pass.pass_idx < pass_idx && opposing_pass.queue != queue) {
+			// Cross-queue dependencies are synchronized by the queue ownership transfers, only the layout changes here
+			if (tex->layout != dst_layout) {
+				layout_transitions.push_back({tex, tex->layout, dst_layout});
+				tex->layout = dst_layout;
+			}
+		} else if (opposing_pass.pass_idx < pass_idx) {
 			// Set current pass dependencies (Waiting pass)
 			if (wait_signals_img.find(tex->handle) == wait_signals_img.end()) {
 				wait_signals_img[tex->handle] = ImageSyncDescriptor{.old_layout = tex->layout,
@@ -131,7 +142,12 @@ void RenderPass::transition_resources() {
 			descriptor_infos[i] = pipeline_storage->bound_resources[i].get_descriptor_info();
 		}
 		for (const auto& [buffer_str, status] : pipeline_storage->affected_buffer_pointers) {
-			vk::Buffer* buffer = rg->registered_buffer_pointers[buffer_str];
+			// Cached shaders report every buffer pointer they access, only the registered ones are tracked
+			auto registered_it = rg->registered_buffer_pointers.find(buffer_str);
+			if (registered_it == rg->registered_buffer_pointers.end()) {
+				continue;
+			}
+			vk::Buffer* buffer = registered_it->second;
 			if (status.write) {
 				write_impl(buffer, VK_ACCESS_SHADER_WRITE_BIT);
 			} else if (status.read) {
@@ -181,6 +197,51 @@ void RenderPass::transition_resources() {
 	}
 }
 
+// Copies the cached shader under the lock, other passes and the prewarm threads insert concurrently
+static bool find_cached_shader(RenderPass* pass, vk::Shader* shader) {
+	std::lock_guard<std::mutex> lock(pass->rg->shader_map_mutex);
+	auto shader_it = pass->rg->shader_cache.find(shader->name_with_macros);
+	if (shader_it == pass->rg->shader_cache.end()) {
+		return false;
+	}
+	*shader = shader_it->second;
+	return true;
+}
+
+static void cache_shader(RenderPass* pass, const vk::Shader& shader) {
+	std::lock_guard<std::mutex> lock(pass->rg->shader_map_mutex);
+	pass->rg->shader_cache[shader.name_with_macros] = shader;
+	const RenderGraph::ShaderVariant variant{shader.filename, pass->macro_defines};
+	if (pass->rg->shader_variants.try_emplace(shader.name_with_macros, variant).second) {
+		pass->rg->shader_variants_dirty = true;
+	}
+}
+
+// Compile errors are returned instead of thrown, so that every task is joined before the pass reports them
+static vk::Shader* compile_task(RenderPass* pass, vk::Shader* shader) {
+	try {
+		shader->compile(pass);
+	} catch (const std::exception& e) {
+		LUMEN_WARN("Could not compile {}: {}", shader->name_with_macros, e.what());
+		return nullptr;
+	}
+	return shader;
+}
+
+static void wait_shader_tasks(RenderPass* pass, std::vector<std::future<vk::Shader*>>& shader_tasks) {
+	bool failed = false;
+	for (auto& task : shader_tasks) {
+		vk::Shader* shader = task.get();
+		if (shader) {
+			cache_shader(pass, *shader);
+		}
+		failed |= !shader;
+	}
+	if (failed) {
+		LUMEN_ERROR("Could not compile the shaders of " + pass->name);
+	}
+}
+
 static void build_shaders(RenderPass* pass, const std::vector<vk::Shader*>& active_shaders) {
 	// todo: make resource processing in order
 	auto process_bindless_resources = [pass](const vk::Shader& shader) {
@@ -209,27 +270,11 @@ static void build_shaders(RenderPass* pass, const std::vector<vk::Shader*>& acti
 			std::vector<std::future<vk::Shader*>> shader_tasks;
 			shader_tasks.reserve(pass->gfx_settings->shaders.size());
 			for (auto& shader : active_shaders) {
-				pass->rg->shader_map_mutex.lock();
-				auto shader_it = pass->rg->shader_cache.find(shader->name_with_macros);
-				pass->rg->shader_map_mutex.unlock();
-				if (shader_it != pass->rg->shader_cache.end()) {
-					*shader = shader_it->second;
-				} else {
-					shader_tasks.push_back(ThreadPool::submit(
-						[pass](vk::Shader* shader) {
-							shader->compile(pass);
-							return shader;
-						},
-						shader));
-				}
-			}
-			for (auto& task : shader_tasks) {
-				auto shader = task.get();
-				{
-					std::lock_guard<std::mutex> lock(pass->rg->shader_map_mutex);
-					pass->rg->shader_cache[shader->name_with_macros] = *shader;
+				if (!find_cached_shader(pass, shader)) {
+					shader_tasks.push_back(ThreadPool::submit(&compile_task, pass, shader));
 				}
 			}
+			wait_shader_tasks(pass, shader_tasks);
 			for (auto& shader : active_shaders) {
 				process_bindless_resources(*shader);
 				process_bindings(*shader);
@@ -239,28 +284,12 @@ static void build_shaders(RenderPass* pass, const std::vector<vk::Shader*>& acti
 			std::vector<std::future<vk::Shader*>> shader_tasks;
 			shader_tasks.reserve(pass->rt_settings->shaders.size());
 			for (auto& shader : active_shaders) {
-				pass->rg->shader_map_mutex.lock();
-				auto shader_it = pass->rg->shader_cache.find(shader->name_with_macros);
-				pass->rg->shader_map_mutex.unlock();
-				if (shader_it != pass->rg->shader_cache.end()) {
-					*shader = shader_it->second;
-				} else {
-					shader_tasks.push_back(ThreadPool::submit(
-						[pass](vk::Shader* shader) {
-							shader->compile(pass);
-							return shader;
-						},
-						shader));
+				if (!find_cached_shader(pass, shader)) {
+					shader_tasks.push_back(ThreadPool::submit(&compile_task, pass, shader));
 					// shader->compile(pass);
 				}
 			}
-			for (auto& task : shader_tasks) {
-				auto shader = task.get();
-				{
-					std::lock_guard<std::mutex> lock(pass->rg->shader_map_mutex);
-					pass->rg->shader_cache[shader->name_with_macros] = *shader;
-				}
-			}
+			wait_shader_tasks(pass, shader_tasks);
 			for (auto& shader : active_shaders) {
 				process_bindless_resources(*shader);
 				process_bindings(*shader);
@@ -269,17 +298,9 @@ static void build_shaders(RenderPass* pass, const std::vector<vk::Shader*>& acti
 		} break;
 		case vk::PassType::Compute: {
 			for (auto& shader : active_shaders) {
-				pass->rg->shader_map_mutex.lock();
-				auto shader_it = pass->rg->shader_cache.find(shader->name_with_macros);
-				pass->rg->shader_map_mutex.unlock();
-				if (shader_it != pass->rg->shader_cache.end()) {
-					*shader = shader_it->second;
-				} else {
+				if (!find_cached_shader(pass, shader)) {
 					shader->compile(pass);
-					{
-						std::lock_guard<std::mutex> lock(pass->rg->shader_map_mutex);
-						pass->rg->shader_cache[shader->name_with_macros] = *shader;
-					}
+					cache_shader(pass, *shader);
 				}
 				// shader->compile(pass);
 				pass->pipeline_storage->affected_buffer_pointers = shader->buffer_status_map;
@@ -293,9 +314,278 @@ static void build_shaders(RenderPass* pass, const std::vector<vk::Shader*>& acti
 
 RenderGraph::RenderGraph() { pipeline_tasks.reserve(32); }
 
+std::string RenderGraph::get_macro_string(const std::vector<vk::ShaderMacro>& macros) const {
+	std::string macro_string;
+	if (!macros.empty() || !global_macro_defines.empty()) {
+		macro_string += '(';
+	}
+	bool prev_nonempty = false;
+	auto populate_macros = [&](const std::vector<vk::ShaderMacro>& list) {
+		for (size_t i = 0; i < list.size(); i++) {
+			if (!list[i].visible) {
+				continue;
+			}
+			if (!list[i].name.empty()) {
+				if (prev_nonempty) {
+					macro_string += ",";
+				}
+				macro_string += list[i].name;
+				prev_nonempty = true;
+			}
+			if (list[i].has_val) {
+				macro_string += "=" + std::to_string(list[i].val);
+			}
+		}
+	};
+	populate_macros(macros);
+	populate_macros(global_macro_defines);
+	if (!macros.empty() || !global_macro_defines.empty()) {
+		macro_string += ')';
+	}
+	if (macro_string == "()") {
+		macro_string.clear();
+	}
+	return macro_string;
+}
+
+void RenderGraph::load_shader_variants() {
+	using json = nlohmann::json;
+	shader_variants_loaded = true;
+	std::ifstream in(settings.shader_manifest);
+	if (!in) {
+		return;
+	}
+	const json manifest = json::parse(in, nullptr, /* allow_exceptions = */ false);
+	if (manifest.is_discarded() || !manifest.contains("variants")) {
+		LUMEN_WARN("Ignoring the malformed shader manifest {}", settings.shader_manifest);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(shader_map_mutex);
+	for (const json& entry : manifest["variants"]) {
+		ShaderVariant variant{entry.value("shader", std::string())};
+		for (const json& m : entry.value("macros", json::array())) {
+			vk::ShaderMacro macro(m.value("name", std::string()));
+			macro.val = m.value("val", 0);
+			macro.has_val = m.value("has_val", false);
+			macro.visible = m.value("visible", true);
+			variant.macros.push_back(macro);
+		}
+		if (variant.filename.empty() || !std::filesystem::exists(variant.filename)) {
+			continue;
+		}
+		// Keyed with the current global macros, variants recorded for other scenes compile to unused entries
+		const std::string key = variant.filename + get_macro_string(variant.macros);
+		shader_variants.try_emplace(key, std::move(variant));
+	}
+}
+
+void RenderGraph::save_shader_variants() {
+	using json = nlohmann::json;
+	// Keep the variants of the earlier runs, typically those of the integrators that were not used this time
+	if (!shader_variants_loaded) {
+		load_shader_variants();
+	}
+	json variants = json::array();
+	{
+		std::lock_guard<std::mutex> lock(shader_map_mutex);
+		for (const auto& [_, variant] : shader_variants) {
+			json macros = json::array();
+			for (const vk::ShaderMacro& macro : variant.macros) {
+				macros.push_back({{"name", macro.name},
+								  {"val", macro.val},
+								  {"has_val", macro.has_val},
+								  {"visible", macro.visible}});
+			}
+			variants.push_back({{"shader", variant.filename}, {"macros", macros}});
+		}
+		shader_variants_dirty = false;
+	}
+	std::ofstream out(settings.shader_manifest);
+	if (!out) {
+		LUMEN_WARN("Could not write the shader manifest {}", settings.shader_manifest);
+		return;
+	}
+	out << json{{"variants", variants}}.dump(1, '\t');
+}
+
+void RenderGraph::prewarm_shaders() {
+#if USE_SHADERC
+	cancel_prewarm();
+	if (settings.shader_manifest.empty()) {
+		return;
+	}
+	if (!shader_variants_loaded) {
+		load_shader_variants();
+	}
+	auto pending = std::make_shared<std::vector<std::pair<std::string, ShaderVariant>>>();
+	{
+		std::lock_guard<std::mutex> lock(shader_map_mutex);
+		for (const auto& [key, variant] : shader_variants) {
+			if (shader_cache.find(key) == shader_cache.end()) {
+				pending->emplace_back(key, variant);
+			}
+		}
+	}
+	if (pending->empty()) {
+		return;
+	}
+	// A share of the cores, the thread pool keeps compiling the passes of the frames meanwhile
+	const uint32_t num_threads =
+		std::clamp<uint32_t>(std::thread::hardware_concurrency() / 4, 1, uint32_t(pending->size()));
+	LUMEN_TRACE("Prewarming {} shader variants on {} threads", pending->size(), num_threads);
+	auto next = std::make_shared<std::atomic_uint32_t>(0);
+	auto running = std::make_shared<std::atomic_uint32_t>(num_threads);
+	const auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t t = 0; t < num_threads; t++) {
+		prewarm_threads.emplace_back([this, pending, next, running, start]() {
+			for (uint32_t i = (*next)++; i < pending->size() && !prewarm_cancelled; i = (*next)++) {
+				const auto& [key, variant] = (*pending)[i];
+				{
+					std::lock_guard<std::mutex> lock(shader_map_mutex);
+					if (shader_cache.find(key) != shader_cache.end()) {
+						continue;
+					}
+				}
+				vk::Shader shader;
+				if (!compile_variant(key, variant, shader)) {
+					continue;
+				}
+				std::lock_guard<std::mutex> lock(shader_map_mutex);
+				shader_cache.try_emplace(key, shader);
+			}
+			if (--(*running) == 0 && !prewarm_cancelled) {
+				const auto end = std::chrono::high_resolution_clock::now();
+				LUMEN_TRACE("Shader prewarm finished in {:.2f} s",
+							std::chrono::duration<double>(end - start).count());
+			}
+		});
+	}
+#else
+	LUMEN_WARN("Shader prewarming needs the shaderc backend");
+#endif
+}
+
+void RenderGraph::cancel_prewarm() {
+	prewarm_cancelled = true;
+	for (std::thread& thread : prewarm_threads) {
+		thread.join();
+	}
+	prewarm_threads.clear();
+	prewarm_cancelled = false;
+}
+
+bool RenderGraph::compile_variant(const std::string& key, const ShaderVariant& variant, vk::Shader& shader) {
+	// Shader::compile only reads the macros and the render graph from the pass
+	const vk::ComputePassSettings pass_settings{.shader = vk::Shader(variant.filename), .macros = variant.macros};
+	RenderPass pass(vk::PassType::Compute, "Variant", this, 0, pass_settings, get_macro_string(variant.macros),
+					nullptr);
+	try {
+		pass.compute_settings->shader.compile(&pass);
+	} catch (const std::exception& e) {
+		LUMEN_WARN("Could not compile {}: {}", key, e.what());
+		return false;
+	}
+	shader = pass.compute_settings->shader;
+	return true;
+}
+
+uint32_t RenderGraph::invalidate_shaders(const std::vector<std::string>& changed_files) {
+	cancel_prewarm();
+	std::unordered_set<std::string> changed;
+	for (const std::string& file : changed_files) {
+		changed.insert(vk::normalize_shader_path(file));
+	}
+	std::vector<std::pair<std::string, ShaderVariant>> affected;
+	size_t num_shaders;
+	{
+		std::lock_guard<std::mutex> lock(shader_map_mutex);
+		num_shaders = shader_cache.size();
+		for (const auto& [key, shader] : shader_cache) {
+			const bool depends = shader.dependencies.empty() ||
+								 std::any_of(shader.dependencies.begin(), shader.dependencies.end(),
+											 [&changed](const std::string& dep) { return changed.count(dep) > 0; });
+			auto variant_it = shader_variants.find(key);
+			if (depends && variant_it != shader_variants.end()) {
+				affected.emplace_back(key, variant_it->second);
+			}
+		}
+	}
+	if (affected.empty()) {
+		return 0;
+	}
+	const std::string what =
+		changed_files.size() == 1 ? changed_files[0] : std::to_string(changed_files.size()) + " files";
+	LUMEN_TRACE("{} changed, recompiling {} of {} shaders", what, affected.size(), num_shaders);
+	// The new versions only replace the cached ones once they compiled, a broken save keeps the running pipelines
+	std::vector<vk::Shader> shaders(affected.size());
+	std::vector<std::future<bool>> tasks;
+	tasks.reserve(affected.size());
+	for (size_t i = 0; i < affected.size(); i++) {
+		tasks.push_back(ThreadPool::submit(
+			[this, &affected, &shaders](size_t idx) {
+				return compile_variant(affected[idx].first, affected[idx].second, shaders[idx]);
+			},
+			i));
+	}
+	std::vector<size_t> compiled;
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (tasks[i].get()) {
+			compiled.push_back(i);
+		}
+	}
+	if (compiled.size() < affected.size()) {
+		LUMEN_WARN("{} of {} shaders failed to compile, keeping their previous versions",
+				   affected.size() - compiled.size(), affected.size());
+	}
+	if (compiled.empty()) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(shader_map_mutex);
+	shader_generation++;
+	for (size_t i : compiled) {
+		shader_cache[affected[i].first] = std::move(shaders[i]);
+		shader_replacements[affected[i].first] = shader_generation;
+	}
+	return uint32_t(compiled.size());
+}
+
 RenderPass& RenderGraph::current_pass() { return passes[passes.size() - 1]; }
 
+// Appends an alpha tested copy of every hit group. Closest hit groups get the alpha test as their any hit shader,
+// any hit groups are replaced by it
+static vk::RTPassSettings append_alpha_masked_hit_groups(const vk::RTPassSettings& settings) {
+	static const std::string alpha_mask_shader = "src/shaders/alpha_mask.rahit";
+	vk::RTPassSettings masked_settings = settings;
+	uint32_t num_hit_groups = 0;
+	for (uint32_t i = 0; i < settings.shaders.size(); i++) {
+		const vk::Shader& shader = settings.shaders[i];
+		if (vk::has_extension(shader.filename, ".rchit")) {
+			masked_settings.combined_hit_groups.push_back((uint32_t)masked_settings.shaders.size());
+			masked_settings.shaders.push_back(shader);
+			masked_settings.shaders.emplace_back(alpha_mask_shader);
+			num_hit_groups++;
+		} else if (vk::has_extension(shader.filename, ".rahit")) {
+			const bool combined = i > 0 && std::find(settings.combined_hit_groups.begin(),
+													 settings.combined_hit_groups.end(),
+													 i - 1) != settings.combined_hit_groups.end();
+			if (!combined) {
+				masked_settings.shaders.emplace_back(alpha_mask_shader);
+				num_hit_groups++;
+			}
+		}
+	}
+	// Masked instances offset their SBT records by MASKED_HIT_GROUP_OFFSET, checked in release builds too
+	if (num_hit_groups != vk::MASKED_HIT_GROUP_OFFSET) {
+		LUMEN_ERROR("Alpha masked hit groups expect " + std::to_string(vk::MASKED_HIT_GROUP_OFFSET) +
+					" hit groups, the pass has " + std::to_string(num_hit_groups));
+	}
+	return masked_settings;
+}
+
 RenderPass& RenderGraph::add_rt(const std::string& name, const vk::RTPassSettings& settings) {
+	if (this->settings.alpha_masked_geometry && settings.alpha_masking) {
+		return add_pass_impl(name, append_alpha_masked_hit_groups(settings));
+	}
 	return add_pass_impl(name, settings);
 }
 
@@ -446,6 +736,11 @@ RenderPass& RenderPass::skip_execution(bool condition) {
 	return *this;
 }
 
+RenderPass& RenderPass::async_compute(bool condition) {
+	async_requested = condition && type == vk::PassType::Compute;
+	return *this;
+}
+
 RenderPass& RenderPass::zero(const Resource& resource) {
 	if (resource.tex) {
 		LUMEN_ERROR("Unimplemented: Immage zeroing")
@@ -561,11 +856,14 @@ void RenderPass::finalize() {
 
 		// Need to retrieve cached shaders' stage flags as we have the temporary shaders in the settings
 		VkShaderStageFlags stage_flags = 0;
-		for (const auto& temp_shader : rt_settings->shaders) {
-			auto find_it = rg->shader_cache.find(temp_shader.name_with_macros);
-			assert(find_it != rg->shader_cache.end());
-			const vk::Shader& shader = find_it->second;
-			stage_flags |= shader.stage;
+		{
+			std::lock_guard<std::mutex> lock(rg->shader_map_mutex);
+			for (const auto& temp_shader : rt_settings->shaders) {
+				auto find_it = rg->shader_cache.find(temp_shader.name_with_macros);
+				assert(find_it != rg->shader_cache.end());
+				const vk::Shader& shader = find_it->second;
+				stage_flags |= shader.stage;
+			}
 		}
 		pipeline_storage->pipeline->create_rt_set_layout(stage_flags);
 		update_rt_descriptors();
@@ -574,12 +872,14 @@ void RenderPass::finalize() {
 }
 
 void RenderPass::write_impl(vk::Buffer* buffer, VkAccessFlags access_flags) {
+	track_queue_usage(buffer);
 	register_dependencies(buffer, access_flags);
 	rg->buffer_resource_map[buffer->handle] = {pass_idx, access_flags};
 }
 
 void RenderPass::write_impl(vk::Texture* tex, VkAccessFlags access_flags) {
 	VkImageLayout target_layout = vk::get_target_img_layout(tex, access_flags);
+	track_queue_usage(tex);
 	register_dependencies(tex, target_layout);
 	rg->img_resource_map[tex->handle] = pass_idx;
 }
@@ -587,12 +887,14 @@ void RenderPass::write_impl(vk::Texture* tex, VkAccessFlags access_flags) {
 void RenderPass::read_impl(vk::Buffer* buffer) { read_impl(buffer, VK_ACCESS_SHADER_READ_BIT); }
 
 void RenderPass::read_impl(vk::Buffer* buffer, VkAccessFlags access_flags) {
+	track_queue_usage(buffer);
 	register_dependencies(buffer, access_flags);
 	rg->buffer_resource_map[buffer->handle] = {pass_idx, access_flags};
 }
 
 void RenderPass::read_impl(vk::Texture* tex) {
 	VkImageLayout target_layout = vk::get_target_img_layout(tex, VK_ACCESS_SHADER_READ_BIT);
+	track_queue_usage(tex);
 	register_dependencies(tex, target_layout);
 	rg->img_resource_map[tex->handle] = pass_idx;
 }
@@ -602,14 +904,38 @@ void RenderPass::post_execution_barrier(vk::Buffer* buffer, VkAccessFlags access
 	post_execution_buffer_barriers.push_back({buffer->handle, src_access_flags, access_flags});
 }
 
+void RenderPass::track_queue_usage(vk::Buffer* buffer) {
+	if (std::find(touched_buffers.begin(), touched_buffers.end(), buffer) == touched_buffers.end()) {
+		touched_buffers.push_back(buffer);
+	}
+}
+
+void RenderPass::track_queue_usage(vk::Texture* tex) {
+	auto it = std::find_if(touched_images.begin(), touched_images.end(),
+						   [tex](const std::pair<vk::Texture*, VkImageLayout>& p) { return p.first == tex; });
+	if (it == touched_images.end()) {
+		touched_images.push_back({tex, tex->layout});
+	}
+}
+
 void RenderPass::run(VkCommandBuffer cmd) {
 	std::vector<VkEvent> wait_events;
 	const bool use_events = rg->settings.use_events;
 	if (use_events) {
 		wait_events.reserve(wait_signals_buffer.size());
 	}
+	const bool is_async = queue == vk::QueueType::COMPUTE;
+	const uint32_t queue_family_idx = is_async ? vk::context().queue_indices.compute_family.value()
+											   : vk::context().queue_indices.gfx_family.value();
 	vk::DebugMarker::begin_region(vk::context().device, cmd, name.c_str(), glm::vec4(1.0f, 0.78f, 0.05f, 1.0f));
-	GPUQueryManager::begin(cmd, name.c_str());
+	GPUQueryManager::begin(cmd, name.c_str(), is_async);
+	// Queue family ownership acquires
+	if (queue_acquire_buffer_barriers.size() || queue_acquire_img_barriers.size()) {
+		auto dependency_info = vk::dependency_info(
+			(uint32_t)queue_acquire_buffer_barriers.size(), queue_acquire_buffer_barriers.data(),
+			(uint32_t)queue_acquire_img_barriers.size(), queue_acquire_img_barriers.data());
+		vkCmdPipelineBarrier2(cmd, &dependency_info);
+	}
 	// Wait: Buffer
 	auto& buffer_sync = rg->buffer_sync_resources[pass_idx];
 	auto& img_sync = rg->img_sync_resources[pass_idx];
@@ -674,7 +1000,7 @@ void RenderPass::run(VkCommandBuffer cmd) {
 		auto dst_stage = vk::get_pipeline_stage(type, dst_access_flags);
 		img_sync.img_barriers[i] =
 			vk::image_barrier2(k, src_access_flags, dst_access_flags, v.old_layout, v.new_layout, v.image_aspect,
-							   src_stage, dst_stage, vk::context().queue_indices.gfx_family.value());
+							   src_stage, dst_stage, queue_family_idx);
 		img_sync.dependency_infos[i] = vk::dependency_info(1, &img_sync.img_barriers[i]);
 		if (use_events) {
 			wait_events.push_back(rg->passes[v.opposing_pass_idx].set_signals_img[k].event);
@@ -885,8 +1211,7 @@ void RenderPass::run(VkCommandBuffer cmd) {
 		auto mem_barrier = vk::image_barrier2(
 			k, vk::access_flags_for_img_layout(v.old_layout), vk::access_flags_for_img_layout(v.new_layout),
 			v.old_layout, v.new_layout, v.image_aspect, vk::get_pipeline_stage(type, src_access_flags),
-			vk::get_pipeline_stage(rg->passes[v.opposing_pass_idx].type, dst_access_flags),
-			vk::context().queue_indices.gfx_family.value());
+			vk::get_pipeline_stage(rg->passes[v.opposing_pass_idx].type, dst_access_flags), queue_family_idx);
 
 		VkDependencyInfo dependency_info = vk::dependency_info(1, &mem_barrier);
 		if (use_events) {
@@ -898,9 +1223,161 @@ void RenderPass::run(VkCommandBuffer cmd) {
 	GPUQueryManager::end(cmd);
 }
 
-void RenderGraph::run(VkCommandBuffer cmd) {
+static void pipeline_barrier(VkCommandBuffer cmd, const std::vector<VkBufferMemoryBarrier2>& buffer_barriers,
+							 const std::vector<VkImageMemoryBarrier2>& img_barriers) {
+	if (buffer_barriers.empty() && img_barriers.empty()) {
+		return;
+	}
+	auto dependency_info = vk::dependency_info((uint32_t)buffer_barriers.size(), buffer_barriers.data(),
+											   (uint32_t)img_barriers.size(), img_barriers.data());
+	vkCmdPipelineBarrier2(cmd, &dependency_info);
+}
+
+void RenderGraph::resolve_queue_transfers(VkCommandBuffer handoff_cmd) {
+	if (buffer_queue_owners.empty() && img_queue_owners.empty() && !handoff_cmd) {
+		return;
+	}
+	const uint32_t gfx_family = vk::context().queue_indices.gfx_family.value();
+	const uint32_t compute_family = vk::context().queue_indices.compute_family.value();
+	const VkAccessFlags memory_access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	const VkPipelineStageFlags all_commands = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	// Releases from the graphics queue to the compute queue, recorded into the handoff command buffer
+	std::vector<VkBufferMemoryBarrier2> buffer_releases;
+	std::vector<VkImageMemoryBarrier2> img_releases;
+	// Resources released by the compute queue in a previous frame that are needed by the compute queue again without
+	// the graphics queue using them in between. The graphics queue acquires and releases them right back
+	std::vector<VkBuffer> buffer_bounces;
+	std::vector<std::pair<VkImage, QueueOwnership>> img_bounces;
+
+	for (auto& pass : passes) {
+		const bool is_async = pass.queue == vk::QueueType::COMPUTE;
+		const VkPipelineStageFlags pass_stage =
+			is_async ? all_commands : vk::get_pipeline_stage(pass.type, VK_ACCESS_TRANSFER_READ_BIT);
+		for (vk::Buffer* buf : pass.touched_buffers) {
+			auto it = buffer_queue_owners.find(buf->handle);
+			if (!is_async) {
+				if (it == buffer_queue_owners.end()) {
+					continue;
+				}
+				if (!it->second.pending_acquire) {
+					LUMEN_ERROR("Pass " + pass.name + " uses a buffer written by async compute in the same frame");
+				}
+				pass.queue_acquire_buffer_barriers.push_back(vk::buffer_ownership_barrier2(
+					buf->handle, compute_family, gfx_family, 0, memory_access, pass_stage, pass_stage));
+				async_submission.gfx_wait_stages |= pass_stage;
+				buffer_queue_owners.erase(it);
+				continue;
+			}
+			if (it == buffer_queue_owners.end()) {
+				buffer_releases.push_back(vk::buffer_ownership_barrier2(buf->handle, gfx_family, compute_family,
+																		VK_ACCESS_MEMORY_WRITE_BIT, 0, all_commands,
+																		VK_PIPELINE_STAGE_NONE));
+				buffer_queue_owners[buf->handle] = QueueOwnership{.owner = vk::QueueType::COMPUTE};
+			} else if (it->second.pending_acquire) {
+				buffer_bounces.push_back(buf->handle);
+				it->second.pending_acquire = false;
+			} else {
+				continue;
+			}
+			pass.queue_acquire_buffer_barriers.push_back(vk::buffer_ownership_barrier2(
+				buf->handle, gfx_family, compute_family, 0, memory_access, all_commands, all_commands));
+		}
+		for (auto& [tex, layout] : pass.touched_images) {
+			auto it = img_queue_owners.find(tex->handle);
+			if (!is_async) {
+				if (it == img_queue_owners.end()) {
+					continue;
+				}
+				if (!it->second.pending_acquire) {
+					LUMEN_ERROR("Pass " + pass.name + " uses an image written by async compute in the same frame");
+				}
+				pass.queue_acquire_img_barriers.push_back(
+					vk::image_ownership_barrier2(tex->handle, it->second.layout, it->second.aspect, compute_family,
+												 gfx_family, 0, memory_access, pass_stage, pass_stage));
+				async_submission.gfx_wait_stages |= pass_stage;
+				img_queue_owners.erase(it);
+				continue;
+			}
+			if (it == img_queue_owners.end()) {
+				img_releases.push_back(vk::image_ownership_barrier2(tex->handle, layout, tex->aspect_flags, gfx_family,
+																	compute_family, VK_ACCESS_MEMORY_WRITE_BIT, 0,
+																	all_commands, VK_PIPELINE_STAGE_NONE));
+				it = img_queue_owners.insert({tex->handle, QueueOwnership{.owner = vk::QueueType::COMPUTE}}).first;
+			} else if (it->second.pending_acquire) {
+				img_bounces.push_back({tex->handle, it->second});
+				it->second.pending_acquire = false;
+			} else {
+				continue;
+			}
+			it->second.aspect = tex->aspect_flags;
+			// By now the layout tracking has reached the end of the frame, which is the layout the compute queue
+			// releases the image with
+			it->second.layout = tex->layout;
+			pass.queue_acquire_img_barriers.push_back(vk::image_ownership_barrier2(
+				tex->handle, layout, tex->aspect_flags, gfx_family, compute_family, 0, memory_access, all_commands,
+				all_commands));
+		}
+	}
+	if (!handoff_cmd) {
+		return;
+	}
+	// The acquire has to chain with the stages that waited on the previous compute submission
+	const VkPipelineStageFlags bounce_stage =
+		async_submission.gfx_wait_stages ? async_submission.gfx_wait_stages : all_commands;
+	std::vector<VkBufferMemoryBarrier2> buffer_acquires;
+	std::vector<VkImageMemoryBarrier2> img_acquires;
+	for (VkBuffer buf : buffer_bounces) {
+		buffer_acquires.push_back(vk::buffer_ownership_barrier2(buf, compute_family, gfx_family, 0, memory_access,
+																bounce_stage, all_commands));
+		buffer_releases.push_back(
+			vk::buffer_ownership_barrier2(buf, gfx_family, compute_family, 0, 0, all_commands, VK_PIPELINE_STAGE_NONE));
+	}
+	for (auto& [img, ownership] : img_bounces) {
+		img_acquires.push_back(vk::image_ownership_barrier2(img, ownership.layout, ownership.aspect, compute_family,
+															gfx_family, 0, memory_access, bounce_stage, all_commands));
+		img_releases.push_back(vk::image_ownership_barrier2(img, ownership.layout, ownership.aspect, gfx_family,
+															compute_family, 0, 0, all_commands, VK_PIPELINE_STAGE_NONE));
+	}
+	pipeline_barrier(handoff_cmd, buffer_acquires, img_acquires);
+	pipeline_barrier(handoff_cmd, buffer_releases, img_releases);
+}
+
+void RenderGraph::release_async_resources(VkCommandBuffer async_cmd) {
+	// Everything the compute queue owns goes back to the graphics queue, which acquires it on first use
+	const uint32_t gfx_family = vk::context().queue_indices.gfx_family.value();
+	const uint32_t compute_family = vk::context().queue_indices.compute_family.value();
+	std::vector<VkBufferMemoryBarrier2> buffer_releases;
+	std::vector<VkImageMemoryBarrier2> img_releases;
+	for (auto& [buf, ownership] : buffer_queue_owners) {
+		if (ownership.pending_acquire) {
+			continue;
+		}
+		buffer_releases.push_back(vk::buffer_ownership_barrier2(buf, compute_family, gfx_family,
+																VK_ACCESS_MEMORY_WRITE_BIT, 0,
+																VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_NONE));
+		ownership.pending_acquire = true;
+	}
+	for (auto& [img, ownership] : img_queue_owners) {
+		if (ownership.pending_acquire) {
+			continue;
+		}
+		img_releases.push_back(vk::image_ownership_barrier2(
+			img, ownership.layout, ownership.aspect, compute_family, gfx_family, VK_ACCESS_MEMORY_WRITE_BIT, 0,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_NONE));
+		ownership.pending_acquire = true;
+	}
+	pipeline_barrier(async_cmd, buffer_releases, img_releases);
+}
+
+void RenderGraph::run(VkCommandBuffer cmd) { run(cmd, VK_NULL_HANDLE, VK_NULL_HANDLE); }
+
+void RenderGraph::run(VkCommandBuffer cmd, VkCommandBuffer async_cmd, VkCommandBuffer handoff_cmd) {
 	buffer_sync_resources.resize(passes.size());
 	img_sync_resources.resize(passes.size());
+	const bool async = async_cmd != VK_NULL_HANDLE && handoff_cmd != VK_NULL_HANDLE && async_compute_enabled();
+	for (auto& pass : passes) {
+		pass.queue = async && pass.async_requested ? vk::QueueType::COMPUTE : vk::QueueType::GFX;
+	}
 
 	// Compile shaders and process resources
 	const bool recording_or_reload = dirty_pass_encountered || reload_shaders;
@@ -956,6 +1433,10 @@ void RenderGraph::run(VkCommandBuffer cmd) {
 		}
 	}
 
+	if (shader_variants_dirty && !settings.shader_manifest.empty()) {
+		save_shader_variants();
+	}
+
 	for (auto i = 0; i < passes.size(); i++) {
 		passes[i].finalize();
 	}
@@ -980,14 +1461,28 @@ void RenderGraph::run(VkCommandBuffer cmd) {
 	for (auto i = 0; i < passes.size(); i++) {
 		passes[i].transition_resources();
 	}
+	resolve_queue_transfers(async ? handoff_cmd : VK_NULL_HANDLE);
 
 	for (auto i = 0; i < passes.size(); i++) {
 		buffer_sync_resources[i].buffer_bariers.resize(passes[i].wait_signals_buffer.size());
 		buffer_sync_resources[i].dependency_infos.resize(passes[i].wait_signals_buffer.size());
 		img_sync_resources[i].img_barriers.resize(passes[i].wait_signals_img.size());
 		img_sync_resources[i].dependency_infos.resize(passes[i].wait_signals_img.size());
-		passes[i].run(cmd);
+		passes[i].run(passes[i].queue == vk::QueueType::COMPUTE ? async_cmd : cmd);
 	}
+	if (async) {
+		release_async_resources(async_cmd);
+		async_submission.recorded = true;
+	}
+}
+
+bool RenderGraph::async_compute_enabled() const {
+	return settings.async_compute && vk::context().queue_indices.has_async_compute();
+}
+
+void RenderGraph::reset_queue_ownership() {
+	buffer_queue_owners.clear();
+	img_queue_owners.clear();
 }
 
 void RenderGraph::reset() {
@@ -1004,6 +1499,7 @@ void RenderGraph::reset() {
 	buffer_sync_resources.clear();
 	img_sync_resources.clear();
 	reload_shaders = false;
+	async_submission = {};
 }
 
 void RenderGraph::submit(vk::CommandBuffer& cmd) {
@@ -1028,6 +1524,7 @@ void RenderGraph::run_and_submit(vk::CommandBuffer& cmd) {
 }
 
 void RenderGraph::destroy() {
+	cancel_prewarm();
 	// TODO: This is bad. We need a custom allocator inside the Render Graoh
 	for (auto& pass : passes) {
 		if (pass.push_constant_data) {
@@ -1040,6 +1537,7 @@ void RenderGraph::destroy() {
 	}
 	buffer_resource_map.clear();
 	img_resource_map.clear();
+	reset_queue_ownership();
 	registered_buffer_pointers.clear();
 	shader_cache.clear();
 	pipeline_cache.clear();
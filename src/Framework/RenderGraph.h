@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <map>
 #include "../LumenPCH.h"
 #include "CommandBuffer.h"
 #include "Framework/RenderGraphTypes.h"
@@ -34,6 +35,8 @@ struct PipelineStorage {
 	std::unordered_map<std::string, vk::BufferStatus> affected_buffer_pointers;
 	bool update_as_descriptor = false;
 	bool update_scene_descriptor = false;
+	// RenderGraph::shader_generation when the shaders of the pipeline were last found in shader_cache
+	uint32_t shader_generation = 0;
 };
 
 class RenderGraph {
@@ -44,17 +47,43 @@ class RenderGraph {
 	RenderPass& add_gfx(const std::string& name, const vk::GraphicsPassSettings& settings);
 	RenderPass& add_compute(const std::string& name, const vk::ComputePassSettings& settings);
 	void run(VkCommandBuffer cmd);
+	// Passes marked with async_compute() are recorded into async_cmd. handoff_cmd is submitted to the graphics queue
+	// after cmd and releases the resources of these passes to the compute queue
+	void run(VkCommandBuffer cmd, VkCommandBuffer async_cmd, VkCommandBuffer handoff_cmd);
+	bool async_compute_enabled() const;
+	// Forget the queue ownership of the resources, the device should be idle
+	void reset_queue_ownership();
 	void reset();
 	void submit(vk::CommandBuffer& cmd);
 	void run_and_submit(vk::CommandBuffer& cmd);
 	void destroy();
 	void set_pipelines_dirty(bool mark_tlas_dirty, bool mark_scene_dirty);
+	// Suffix of the shader and pipeline names for the pass macros and the visible global macros, e.g. (A,B=1)
+	std::string get_macro_string(const std::vector<vk::ShaderMacro>& macros) const;
+	// Compiles the shader variants listed in settings.shader_manifest on background threads, so that passes seen in
+	// earlier runs (typically those of the other integrators) find their shaders in shader_cache
+	void prewarm_shaders();
+	// Joins the prewarm threads. Needed before shader_cache is cleared or global_macro_defines change
+	void cancel_prewarm();
+	// Recompiles the cached shaders that depend on one of the changed files and replaces them in shader_cache. Shaders
+	// that fail to compile keep their previous version. Only the pipelines of the replaced shaders are rebuilt, the
+	// next time their passes are added. Returns the number of replaced shaders
+	uint32_t invalidate_shaders(const std::vector<std::string>& changed_files);
 	friend RenderPass;
 	bool reload_shaders = false;
 	std::unordered_map<std::string, vk::Buffer*> registered_buffer_pointers;
 	// vk::Shader Name + Macro String -> vk::Shader
 	std::unordered_map<std::string, vk::Shader> shader_cache;
+	// Source and pass macros of every shader that was compiled, keyed like shader_cache. Guarded by shader_map_mutex
+	struct ShaderVariant {
+		std::string filename;
+		std::vector<vk::ShaderMacro> macros;
+	};
+	std::map<std::string, ShaderVariant> shader_variants;
+	bool shader_variants_dirty = false;
+	bool shader_variants_loaded = false;
 	RenderGraphSettings settings;
+	AsyncComputeSubmission async_submission;
 	std::mutex shader_map_mutex;
 	std::vector<vk::ShaderMacro> global_macro_defines;
 
@@ -80,11 +109,38 @@ class RenderGraph {
 	std::unordered_map<VkBuffer, std::pair<uint32_t, VkAccessFlags>>
 		buffer_resource_map;								 // Buffer handle - { Write Pass Idx, Access Type }
 	std::unordered_map<VkImage, uint32_t> img_resource_map;	 // Tex2D handle - Pass Idx
+	// Resources that were touched by async compute passes. Absence means they are owned by the graphics queue.
+	// These persist between frames because async compute results are consumed by the next frame
+	struct QueueOwnership {
+		vk::QueueType owner = vk::QueueType::GFX;
+		// Released by the compute queue, waiting to be acquired by the graphics queue
+		bool pending_acquire = false;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+	std::unordered_map<VkBuffer, QueueOwnership> buffer_queue_owners;
+	std::unordered_map<VkImage, QueueOwnership> img_queue_owners;
 	const bool multithreaded_pipeline_compilation = true;
+	std::vector<std::thread> prewarm_threads;
+	std::atomic_bool prewarm_cancelled = false;
+	// Incremented whenever invalidate_shaders replaces shaders, shader_replacements holds the last generation in which
+	// each shader was replaced. Guarded by shader_map_mutex
+	uint32_t shader_generation = 0;
+	std::unordered_map<std::string, uint32_t> shader_replacements;
 	static const uint32_t INVALID_PASS_IDX = UINT_MAX;
 
 	template <typename Settings>
 	RenderPass& add_pass_impl(const std::string& name, const Settings& settings);
+	// Whether a shader of a pass was replaced after the given generation
+	template <typename Settings>
+	bool shaders_replaced(const Settings& settings, const std::string& macro_string, uint32_t generation);
+	void resolve_queue_transfers(VkCommandBuffer handoff_cmd);
+	// Compiles a variant outside of a frame, logs and returns false on failure
+	bool compile_variant(const std::string& key, const ShaderVariant& variant, vk::Shader& shader);
+	// Merges the variants of settings.shader_manifest into shader_variants
+	void load_shader_variants();
+	void save_shader_variants();
+	void release_async_resources(VkCommandBuffer async_cmd);
 
    private:
 	bool dirty_pass_encountered = false;
@@ -154,6 +210,9 @@ class RenderPass {
 	RenderPass& write(std::initializer_list<vk::Texture*> texes);
 
 	RenderPass& skip_execution(bool condition = true);
+	// Only compute passes can be run on the async compute queue. Their results are meant to be consumed by the
+	// graphics passes of the next frame
+	RenderPass& async_compute(bool condition = true);
 	template <typename T>
 	RenderPass& push_constants(T* data);
 	RenderPass& zero(const Resource& resource);
@@ -205,6 +264,13 @@ class RenderPass {
 	std::vector<BufferBarrier> buffer_barriers;
 	std::vector<BufferBarrier> post_execution_buffer_barriers;
 	bool disable_execution = false;
+	bool async_requested = false;
+	vk::QueueType queue = vk::QueueType::GFX;
+	// Resources touched by the pass, images along with their layouts prior to the pass
+	std::vector<vk::Buffer*> touched_buffers;
+	std::vector<std::pair<vk::Texture*, VkImageLayout>> touched_images;
+	std::vector<VkBufferMemoryBarrier2> queue_acquire_buffer_barriers;
+	std::vector<VkImageMemoryBarrier2> queue_acquire_img_barriers;
 	RenderPass& read(vk::Texture* tex);
 	RenderPass& read(vk::Buffer* buffer);
 
@@ -224,6 +290,8 @@ class RenderPass {
 	void read_impl(vk::Buffer* buffer, VkAccessFlags access_flags);
 	void read_impl(vk::Texture* tex);
 	void post_execution_barrier(vk::Buffer* buffer, VkAccessFlags access_flags);
+	void track_queue_usage(vk::Buffer* buffer);
+	void track_queue_usage(vk::Texture* tex);
 
 	void run(VkCommandBuffer cmd);
 	void register_dependencies(vk::Buffer* buffer, VkAccessFlags dst_access_flags);
@@ -238,43 +306,8 @@ inline RenderPass& RenderGraph::add_pass_impl(const std::string& name, const Set
 	PipelineStorage* pipeline_storage;
 	bool cached = false;
 
-	std::string name_with_macros = name;
-	std::string macro_string;
-
-	std::vector<vk::ShaderMacro> combined_macros;
-	if (!settings.macros.empty() || !global_macro_defines.empty()) {
-		macro_string += '(';
-	}
-
-	auto populate_macros = [](const std::vector<vk::ShaderMacro>& macros, std::string& macro_string,
-							  bool& prev_nonempty) {
-		for (size_t i = 0; i < macros.size(); i++) {
-			if (!macros[i].visible) {
-				continue;
-			}
-			if (!macros[i].name.empty()) {
-				if (prev_nonempty) {
-					macro_string += ",";
-				}
-				macro_string += macros[i].name;
-				prev_nonempty = true;
-			}
-			if (macros[i].has_val) {
-				macro_string += "=" + std::to_string(macros[i].val);
-			}
-		}
-	};
-	bool prev_nonempty = false;
-	populate_macros(settings.macros, macro_string, prev_nonempty);
-	populate_macros(global_macro_defines, macro_string, prev_nonempty);
-
-	if (!settings.macros.empty() || !global_macro_defines.empty()) {
-		macro_string += ')';
-	}
-	if (macro_string == "()") {
-		macro_string.clear();
-	}
-	name_with_macros += macro_string;
+	const std::string macro_string = get_macro_string(settings.macros);
+	const std::string name_with_macros = name + macro_string;
 
 	size_t hash = 0;
 	util::hash_combine(hash, name_with_macros);
@@ -282,7 +315,13 @@ inline RenderPass& RenderGraph::add_pass_impl(const std::string& name, const Set
 		util::hash_combine(hash, spec_data);
 	}
 
-	if (auto cache_it = pipeline_cache.find(hash); cache_it != pipeline_cache.end() && !reload_shaders) {
+	auto cache_it = pipeline_cache.find(hash);
+	// Pipelines whose shaders were replaced by invalidate_shaders are rebuilt, the others are kept
+	if (cache_it != pipeline_cache.end() && !reload_shaders && cache_it->second.shader_generation != shader_generation &&
+		!shaders_replaced(settings, macro_string, cache_it->second.shader_generation)) {
+		cache_it->second.shader_generation = shader_generation;
+	}
+	if (cache_it != pipeline_cache.end() && !reload_shaders && cache_it->second.shader_generation == shader_generation) {
 		pipeline_storage = &cache_it->second;
 		cached = true;
 	} else {
@@ -293,6 +332,7 @@ inline RenderPass& RenderGraph::add_pass_impl(const std::string& name, const Set
 		}
 		pipeline_cache[hash] = PipelineStorage(std::make_unique<vk::Pipeline>(name_with_macros));
 		pipeline_storage = &pipeline_cache[hash];
+		pipeline_storage->shader_generation = shader_generation;
 	}
 	vk::PassType type;
 	if constexpr (std::is_same_v<vk::ComputePassSettings, Settings>) {
@@ -306,6 +346,21 @@ inline RenderPass& RenderGraph::add_pass_impl(const std::string& name, const Set
 							   cached);
 }
 
+template <typename Settings>
+inline bool RenderGraph::shaders_replaced(const Settings& settings, const std::string& macro_string,
+										  uint32_t generation) {
+	std::lock_guard<std::mutex> lock(shader_map_mutex);
+	auto replaced = [&](const vk::Shader& shader) {
+		auto it = shader_replacements.find(shader.filename + macro_string);
+		return it != shader_replacements.end() && it->second > generation;
+	};
+	if constexpr (std::is_same_v<vk::ComputePassSettings, Settings>) {
+		return replaced(settings.shader);
+	} else {
+		return std::any_of(settings.shaders.begin(), settings.shaders.end(), replaced);
+	}
+}
+
 template <typename T>
 inline RenderPass& RenderPass::push_constants(T* data) {
 	if (!push_constant_data) {
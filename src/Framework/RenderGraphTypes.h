@@ -49,6 +49,10 @@ struct GraphicsPassSettings {
 	PassType type = PassType::Graphics;
 };
 
+// Instances with alpha masked materials offset their SBT records past the regular hit groups
+// (closest hit and shadow any hit) to reach the alpha tested copies appended by RenderGraph::add_rt
+constexpr uint32_t MASKED_HIT_GROUP_OFFSET = 2;
+
 struct RTPassSettings {
 	std::vector<vk::Shader> shaders;
 	std::vector<ShaderMacro> macros = {};
@@ -57,6 +61,10 @@ struct RTPassSettings {
 	lumen::dim3 dims;
 	std::function<void(VkCommandBuffer cmd, const lumen::RenderPass& pass)> pass_func;
 	PassType type = PassType::RT;
+	// Closest hit shaders at these indices share their hit group with the any hit shader that follows them
+	std::vector<uint32_t> combined_hit_groups = {};
+	// Set to false for passes that never trace the scene TLAS
+	bool alpha_masking = true;
 };
 
 struct ComputePassSettings {
@@ -75,6 +83,19 @@ class RenderPass;
 struct RenderGraphSettings {
 	bool shader_inference = false;
 	bool use_events = false;
+	// Compute passes marked with async_compute() run on a separate compute queue when the device has one
+	bool async_compute = false;
+	// Set by the scene when some material has an alpha mask, RT passes then get alpha tested hit groups
+	bool alpha_masked_geometry = false;
+	// Compiled shader variants are appended to this file for RenderGraph::prewarm_shaders, empty to disable
+	std::string shader_manifest = "shader_variants.json";
+};
+
+struct AsyncComputeSubmission {
+	// Whether the async compute and handoff command buffers were recorded for the current frame
+	bool recorded = false;
+	// Graphics stages that acquire resources released by the previous async compute submission
+	VkPipelineStageFlags gfx_wait_stages = 0;
 };
 
 struct ResourceBinding {
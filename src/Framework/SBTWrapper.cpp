@@ -3,6 +3,7 @@
 #include "VkUtils.h"
 #include "CommandBuffer.h"
 #include "PersistentResourceManager.h"
+#include "MemoryBudget.h"
 
 namespace vk {
 
@@ -51,6 +52,7 @@ void SBTWrapper::add_indices(VkRayTracingPipelineCreateInfoKHR info) {
 	}
 }
 void SBTWrapper::create(VkPipeline rt_pipeline, VkRayTracingPipelineCreateInfoKHR pipeline_info /*= {}*/) {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::RenderGraph);
 	for (GroupData& group : group_data) {
 		prm::remove(group.buffer);
 	}
@@ -203,17 +203,13 @@ static void parse_spirv(spirv_cross::CompilerGLSL& glsl, const spirv_cross::Shad
 					auto var_type = glsl.get_type_from_variable(ptr_var_id);
 					assert(buffer_ptr_hash_map.find(ptr_var_id) != buffer_ptr_hash_map.end());
 					const auto& res = buffer_ptr_hash_map[ptr_var_id];
-					if (pass->rg->registered_buffer_pointers.find(res) != pass->rg->registered_buffer_pointers.end()) {
-						shader.buffer_status_map[res].write = true;
-					}
+					shader.buffer_status_map[res].write = true;
 				}
 			} else if (load_map.find(access_chain.base_ptr_id) != load_map.end()) {
 				// Access chain has loads
 				// If it has loads, it should be a buffer pointer
 				const auto& res = buffer_ptr_hash_map[load_map[access_chain.base_ptr_id]];
-				if (pass->rg->registered_buffer_pointers.find(res) != pass->rg->registered_buffer_pointers.end()) {
-					shader.buffer_status_map[res].write = true;
-				}
+				shader.buffer_status_map[res].write = true;
 			}
 		}
 		// Theoretical case where _%a_ in _OpStore %a %b_ is already a
@@ -310,10 +306,7 @@ static void parse_spirv(spirv_cross::CompilerGLSL& glsl, const spirv_cross::Shad
 								// TODO: Distinguish buffer and image pointers
 								// when we add bindless images in the future
 								const auto& res = buffer_ptr_hash_map[load_map[access_chain.base_ptr_id]];
-								if (pass->rg->registered_buffer_pointers.find(res) !=
-									pass->rg->registered_buffer_pointers.end()) {
-									shader.buffer_status_map[res].read = true;
-								}
+								shader.buffer_status_map[res].read = true;
 							}
 						}
 					}
@@ -322,9 +315,7 @@ static void parse_spirv(spirv_cross::CompilerGLSL& glsl, const spirv_cross::Shad
 					// TODO: Distinguish buffer and image pointers when we add
 					// bindless images in the future
 					const auto& res = buffer_ptr_hash_map[ptr_var_id];
-					if (pass->rg->registered_buffer_pointers.find(res) != pass->rg->registered_buffer_pointers.end()) {
-						shader.buffer_status_map[res].read = true;
-					}
+					shader.buffer_status_map[res].read = true;
 				}
 
 				if (variable_map.find(ptr_var_id) != variable_map.end()) {
@@ -468,7 +459,8 @@ static std::unordered_map<std::string, shaderc_shader_kind> mstages = {
 };
 
 static std::vector<uint32_t> compile_file(const std::string& source_name, shaderc_shader_kind kind,
-										  const std::string& source, lumen::RenderPass* pass, bool optimize = false) {
+										  const std::string& source, lumen::RenderPass* pass,
+										  std::vector<std::string>& includes, bool optimize = false) {
 	shaderc::Compiler compiler;
 	shaderc::CompileOptions options;
 
@@ -489,7 +481,10 @@ static std::vector<uint32_t> compile_file(const std::string& source_name, shader
 	}
 
 	shaderc_util::FileFinder fileFinder;
-	options.SetIncluder(std::make_unique<glslc::FileIncluder>(&fileFinder));
+	// The options own the includer, it records every file included while compiling
+	auto includer = std::make_unique<glslc::FileIncluder>(&fileFinder);
+	const glslc::FileIncluder* include_trace = includer.get();
+	options.SetIncluder(std::move(includer));
 	options.SetTargetSpirv(shaderc_spirv_version_1_6);
 	options.SetTargetEnvironment(shaderc_target_env_vulkan, 2);
 #if 1
@@ -497,6 +492,7 @@ static std::vector<uint32_t> compile_file(const std::string& source_name, shader
 #endif
 
 	shaderc::SpvCompilationResult module = compiler.CompileGlslToSpv(source, kind, source_name.c_str(), options);
+	includes.assign(include_trace->file_path_trace().begin(), include_trace->file_path_trace().end());
 
 	if (module.GetCompilationStatus() != shaderc_compilation_status_success) {
 		std::cerr << module.GetErrorMessage();
@@ -507,6 +503,10 @@ static std::vector<uint32_t> compile_file(const std::string& source_name, shader
 }
 #endif
 
+std::string normalize_shader_path(const std::string& path) {
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
 Shader::Shader(const std::string& filename) : filename(filename) {}
 int Shader::compile(lumen::RenderPass* pass) {
 	LUMEN_TRACE("Compiling shader: {0}", name_with_macros);
@@ -522,7 +522,15 @@ int Shader::compile(lumen::RenderPass* pass) {
 	buffer << "\n";
 	const auto& str = buffer.str();
 	// Compiling
-	binary = compile_file(filename, mstages[get_ext(filename)], str, pass);
+	std::vector<std::string> includes;
+	binary = compile_file(filename, mstages[get_ext(filename)], str, pass, includes);
+	if (binary.empty()) {
+		LUMEN_ERROR("Shader compilation failed: " + name_with_macros);
+	}
+	dependencies = {normalize_shader_path(filename)};
+	for (const std::string& include : includes) {
+		dependencies.push_back(normalize_shader_path(include));
+	}
 	parse_shader(*this, binary.data(), binary.size(), pass);
 	return 0;
 #else
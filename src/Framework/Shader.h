@@ -14,6 +14,9 @@ struct Shader {
 	std::vector<uint32_t> binary;
 	std::string filename;
 	std::string name_with_macros;
+	// The source and every file it includes, see normalize_shader_path. Empty when the compiler does not report its
+	// includes, such shaders are treated as depending on every file
+	std::vector<std::string> dependencies;
 
 	VkShaderStageFlagBits stage = VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
 	VkDescriptorType descriptor_types[32] = {};
@@ -36,4 +39,7 @@ struct Shader {
 	std::unordered_map<uint32_t, BindingStatus> resource_binding_map;
 };
 
+// Lexically normal path with forward slashes, so that include paths like a/b/../c.glsl match the watched files
+std::string normalize_shader_path(const std::string& path);
+
 }  // namespace vk
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "../LumenPCH.h"
+#include "ShaderWatcher.h"
+#include "Shader.h"
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace lumen {
+// Generated files such as the .spv of the glslangValidator backend are ignored
+static bool is_shader_source(const std::filesystem::path& path) {
+	static const std::unordered_set<std::string> extensions = {".glsl", ".h",	  ".rgen", ".rchit", ".rahit",
+															   ".rmiss", ".rint", ".comp", ".vert",	 ".frag"};
+	return extensions.count(path.extension().string()) > 0;
+}
+
+ShaderWatcher::~ShaderWatcher() { destroy(); }
+
+#if defined(__linux__)
+bool ShaderWatcher::init(const std::string& root) {
+	destroy();
+	this->root = root;
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		LUMEN_WARN("Could not watch the shaders in {}", root);
+		return false;
+	}
+	std::error_code ec;
+	std::vector<std::string> paths = {vk::normalize_shader_path(root)};
+	for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+		 !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+		if (it->is_directory()) {
+			paths.push_back(vk::normalize_shader_path(it->path().string()));
+		}
+	}
+	// Editors either rewrite a file in place or move a new file over it
+	for (const std::string& path : paths) {
+		const int wd = inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd >= 0) {
+			dirs[wd] = path;
+		}
+	}
+	LUMEN_TRACE("Watching {} shader directories under {}", dirs.size(), root);
+	return !dirs.empty();
+}
+
+std::vector<std::string> ShaderWatcher::poll() {
+	std::vector<std::string> changed;
+	if (fd < 0) {
+		return changed;
+	}
+	alignas(inotify_event) char buffer[4096];
+	for (;;) {
+		const ssize_t len = read(fd, buffer, sizeof(buffer));
+		if (len <= 0) {
+			break;
+		}
+		for (ssize_t offset = 0; offset < len;) {
+			const inotify_event* event = (const inotify_event*)(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+			auto dir_it = dirs.find(event->wd);
+			if (!event->len || dir_it == dirs.end()) {
+				continue;
+			}
+			const std::string path = dir_it->second + "/" + event->name;
+			if (event->mask & IN_ISDIR) {
+				// New directories are watched from now on
+				const int wd = inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+				if (wd >= 0) {
+					dirs[wd] = path;
+				}
+			} else if (!(event->mask & IN_CREATE) && is_shader_source(path)) {
+				changed.push_back(path);
+			}
+		}
+	}
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+	return changed;
+}
+
+void ShaderWatcher::destroy() {
+	if (fd >= 0) {
+		close(fd);
+	}
+	fd = -1;
+	dirs.clear();
+}
+#else
+bool ShaderWatcher::init(const std::string& root) {
+	destroy();
+	this->root = root;
+	scan(nullptr);
+	last_poll = std::chrono::steady_clock::now();
+	LUMEN_TRACE("Watching {} shader sources under {}", write_times.size(), root);
+	return !write_times.empty();
+}
+
+void ShaderWatcher::scan(std::vector<std::string>* changed) {
+	std::error_code ec;
+	for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+		 !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+		if (!it->is_regular_file() || !is_shader_source(it->path())) {
+			continue;
+		}
+		const std::filesystem::file_time_type write_time = it->last_write_time(ec);
+		if (ec) {
+			ec.clear();
+			continue;
+		}
+		auto [time_it, inserted] = write_times.try_emplace(vk::normalize_shader_path(it->path().string()), write_time);
+		if (!inserted && time_it->second != write_time) {
+			time_it->second = write_time;
+			if (changed) {
+				changed->push_back(time_it->first);
+			}
+		}
+	}
+}
+
+std::vector<std::string> ShaderWatcher::poll() {
+	std::vector<std::string> changed;
+	const auto now = std::chrono::steady_clock::now();
+	if (root.empty() || std::chrono::duration<double>(now - last_poll).count() < poll_interval) {
+		return changed;
+	}
+	last_poll = now;
+	scan(&changed);
+	return changed;
+}
+
+void ShaderWatcher::destroy() { write_times.clear(); }
+#endif
+}  // namespace lumen
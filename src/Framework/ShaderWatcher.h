@@ -0,0 +1,31 @@
+#pragma once
+#include "../LumenPCH.h"
+
+namespace lumen {
+// Reports the shader sources under a directory that changed since the last poll, for RenderGraph::invalidate_shaders.
+// Uses inotify on Linux. Elsewhere the modification times are compared, at most every poll_interval seconds
+class ShaderWatcher {
+   public:
+	ShaderWatcher() = default;
+	~ShaderWatcher();
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+	bool init(const std::string& root);
+	// Normalized paths of the changed sources, see vk::normalize_shader_path
+	std::vector<std::string> poll();
+	void destroy();
+	double poll_interval = 0.25;
+
+   private:
+	std::string root;
+#if defined(__linux__)
+	int fd = -1;
+	// Watch descriptor -> directory
+	std::unordered_map<int, std::string> dirs;
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> write_times;
+	std::chrono::steady_clock::time_point last_poll;
+	void scan(std::vector<std::string>* changed);
+#endif
+};
+}  // namespace lumen
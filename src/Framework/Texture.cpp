@@ -10,6 +10,7 @@
 #include <stb_image/stb_image.h>
 #include <vulkan/vulkan_core.h>
 #include "PersistentResourceManager.h"
+#include "MemoryBudget.h"
 
 static void cmd_generate_mipmaps2(vk::Texture* texture, const VkImageCreateInfo& info, VkCommandBuffer cmd) {
 	VkFormatProperties format_properties;
@@ -98,12 +99,19 @@ void create_texture(Texture* texture, const TextureDesc& desc) {
 		VmaAllocationCreateInfo alloc_ci = {};
 		alloc_ci.usage = VMA_MEMORY_USAGE_AUTO;
 
+		MemoryBudget::check(image_ci, alloc_ci, texture->name);
 		VmaAllocationInfo alloc_info;
 
-		vk::check(vmaCreateImage(vk::context().allocator, &image_ci, &alloc_ci, &texture->handle, &texture->allocation,
-								 &alloc_info));
+		VkResult result = vmaCreateImage(vk::context().allocator, &image_ci, &alloc_ci, &texture->handle,
+										 &texture->allocation, &alloc_info);
+		if (result != VK_SUCCESS) {
+			MemoryBudget::allocation_failed(texture->name);
+		}
+		vk::check(result);
+		MemoryBudget::track(texture->allocation, texture->name);
 	} else {
 		texture->handle = desc.image;
+		texture->allocation = VK_NULL_HANDLE;
 	}
 
 	if (!texture->name.empty()) {
@@ -150,21 +158,26 @@ void create_texture(Texture* texture, const TextureDesc& desc) {
 		// Copy from staging buffer to image
 		vk::CommandBuffer copy_cmd(true);
 
-		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
-		region.bufferRowLength = 0;
-		region.bufferImageHeight = 0;
-		region.imageSubresource.aspectMask = texture->aspect_flags;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-		region.imageSubresource.layerCount = 1;
-		region.imageExtent.width = texture->extent.width;
-		region.imageExtent.height = texture->extent.height;
-		region.imageExtent.depth = 1;
+		std::vector<VkBufferImageCopy> regions(std::max<size_t>(desc.data.mip_offsets.size(), 1));
+		for (uint32_t i = 0; i < regions.size(); i++) {
+			const uint32_t mip = desc.data.mip_offsets.empty() ? 0 : desc.data.first_mip + i;
+			VkBufferImageCopy& region = regions[i];
+			region = {};
+			region.bufferOffset = desc.data.mip_offsets.empty() ? 0 : desc.data.mip_offsets[i];
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = texture->aspect_flags;
+			region.imageSubresource.mipLevel = mip;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent.width = std::max(texture->extent.width >> mip, 1u);
+			region.imageExtent.height = std::max(texture->extent.height >> mip, 1u);
+			region.imageExtent.depth = 1;
+		}
 		transition_image_layout(copy_cmd.handle, texture->handle, texture->layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 								subresource_range, texture->aspect_flags);
 		vkCmdCopyBufferToImage(copy_cmd.handle, staging_buffer->handle, texture->handle,
-							   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+							   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
 		if (desc.calc_mips) {
 			LUMEN_ASSERT(!desc.image, "Cannot generate mips for an image that was not created by the texture");
 			cmd_generate_mipmaps2(texture, image_ci, copy_cmd.handle);
@@ -189,8 +202,50 @@ void create_texture(Texture* texture, const TextureDesc& desc) {
 														 texture->mip_levels, texture->array_layers);
 	vk::check(vkCreateImageView(vk::context().device, &image_view_ci, nullptr, &texture->view));
 }
+VkImageView create_texture_view(const Texture* tex, uint32_t base_mip) {
+	VkImageViewCreateInfo image_view_ci =
+		vk::image_view(tex->handle, tex->format, tex->aspect_flags, tex->mip_levels, tex->array_layers);
+	image_view_ci.subresourceRange.baseMipLevel = base_mip;
+	image_view_ci.subresourceRange.levelCount = tex->mip_levels - base_mip;
+	VkImageView view;
+	vk::check(vkCreateImageView(vk::context().device, &image_view_ci, nullptr, &view));
+	return view;
+}
+
+void upload_texture_mip(Texture* tex, uint32_t mip, const void* data, VkDeviceSize size) {
+	LUMEN_ASSERT(tex->layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, "Texture is not in a readable layout");
+	Buffer* staging_buffer = drm::get({.name = "Scratch Buffer",
+									   .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+									   .memory_type = BufferType::STAGING,
+									   .size = size,
+									   .data = const_cast<void*>(data),
+									   .dedicated_allocation = false});
+	VkImageSubresourceRange subresource_range;
+	subresource_range.aspectMask = tex->aspect_flags;
+	subresource_range.baseArrayLayer = 0;
+	subresource_range.layerCount = 1;
+	subresource_range.baseMipLevel = mip;
+	subresource_range.levelCount = 1;
+	VkBufferImageCopy region{};
+	region.imageSubresource.aspectMask = tex->aspect_flags;
+	region.imageSubresource.mipLevel = mip;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = {std::max(tex->extent.width >> mip, 1u), std::max(tex->extent.height >> mip, 1u), 1};
+	vk::CommandBuffer copy_cmd(true);
+	transition_image_layout(copy_cmd.handle, tex->handle, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+							VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresource_range, tex->aspect_flags);
+	vkCmdCopyBufferToImage(copy_cmd.handle, staging_buffer->handle, tex->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						   1, &region);
+	transition_image_layout(copy_cmd.handle, tex->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+							VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, tex->aspect_flags);
+	copy_cmd.submit();
+	drm::destroy(staging_buffer);
+}
+
 void destroy_texture(Texture* texture) {
 	if (texture->allocation) {
+		MemoryBudget::untrack(texture->allocation);
 		vmaDestroyImage(vk::context().allocator, texture->handle, texture->allocation);
 	}
 	vkDestroyImageView(vk::context().device, texture->view, nullptr);
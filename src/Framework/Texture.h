@@ -17,6 +17,10 @@ struct TextureDesc {
 	struct {
 		void* data = nullptr;
 		VkDeviceSize size = 0;
+		// Offsets of pre-built mip levels in data, uploaded to the levels starting at first_mip. Without them only
+		// mip 0 is uploaded
+		std::span<const VkDeviceSize> mip_offsets = {};
+		uint32_t first_mip = 0;
 	} data;
 	VkImageType image_type = VK_IMAGE_TYPE_2D;
 	VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -51,6 +55,11 @@ VkDescriptorImageInfo get_texture_descriptor(const Texture* tex, VkSampler sampl
 VkDescriptorImageInfo get_texture_descriptor(const Texture* tex, VkImageLayout layout);
 VkDescriptorImageInfo get_texture_descriptor(const Texture* tex, VkSampler sampler);
 VkDescriptorImageInfo get_texture_descriptor(const Texture* tex);
+// View of the mips starting at base_mip, the caller owns the returned view
+VkImageView create_texture_view(const Texture* tex, uint32_t base_mip);
+// Uploads a single mip level of a texture in SHADER_READ_ONLY_OPTIMAL layout. The level must not be visible through
+// a view that is in use
+void upload_texture_mip(Texture* tex, uint32_t mip, const void* data, VkDeviceSize size);
 void force_transition_texture(Texture* tex, VkCommandBuffer cmd, VkImageLayout old_layout, VkImageLayout new_layout);
 void transition_texture(Texture* tex, VkCommandBuffer cmd, VkImageLayout new_layout);
 
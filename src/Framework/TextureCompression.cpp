@@ -0,0 +1,621 @@
+#include "LumenPCH.h"
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+#include <stb_image/stb_image.h>
+#include <filesystem>
+#include <fstream>
+
+namespace TextureCompression {
+
+static constexpr uint32_t CACHE_MAGIC = 0x5443424c;	 // "LBCT"
+static constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t srgb;
+	uint32_t width;
+	uint32_t height;
+	uint32_t num_mips;
+};
+
+static const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+VkFormat vk_format(Format format, bool srgb) {
+	switch (format) {
+		case Format::BC1:
+			return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		case Format::BC4:
+			return VK_FORMAT_BC4_UNORM_BLOCK;
+		case Format::BC5:
+			return VK_FORMAT_BC5_UNORM_BLOCK;
+		case Format::BC7:
+			return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+const char* format_name(Format format) {
+	switch (format) {
+		case Format::BC1:
+			return "BC1";
+		case Format::BC4:
+			return "BC4";
+		case Format::BC5:
+			return "BC5";
+		case Format::BC7:
+			return "BC7";
+	}
+	return "";
+}
+
+uint32_t block_bytes(Format format) { return format == Format::BC1 || format == Format::BC4 ? 8 : 16; }
+
+size_t compressed_size(Format format, uint32_t width, uint32_t height) {
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+// Principal axis of the block through power iteration on the covariance matrix. The endpoints are the extreme
+// projections of the texels onto that axis, e0 being the one furthest along it
+template <int N>
+static void fit_line(const uint8_t* rgba, float* e0, float* e1) {
+	float mean[N] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < N; c++) {
+			mean[c] += rgba[4 * i + c] / 16.0f;
+		}
+	}
+	float cov[N][N] = {};
+	for (int i = 0; i < 16; i++) {
+		float d[N];
+		for (int c = 0; c < N; c++) {
+			d[c] = rgba[4 * i + c] - mean[c];
+		}
+		for (int a = 0; a < N; a++) {
+			for (int b = 0; b < N; b++) {
+				cov[a][b] += d[a] * d[b];
+			}
+		}
+	}
+	// Start from the channel with the largest variance
+	int max_c = 0;
+	for (int c = 1; c < N; c++) {
+		if (cov[c][c] > cov[max_c][max_c]) {
+			max_c = c;
+		}
+	}
+	float axis[N];
+	for (int c = 0; c < N; c++) {
+		axis[c] = cov[max_c][c];
+	}
+	for (int iter = 0; iter < 8; iter++) {
+		float next[N] = {};
+		float len = 0.0f;
+		for (int a = 0; a < N; a++) {
+			for (int b = 0; b < N; b++) {
+				next[a] += cov[a][b] * axis[b];
+			}
+			len += next[a] * next[a];
+		}
+		if (len <= 0.0f) {
+			break;
+		}
+		len = std::sqrt(len);
+		for (int c = 0; c < N; c++) {
+			axis[c] = next[c] / len;
+		}
+	}
+	float t_min = 0.0f;
+	float t_max = 0.0f;
+	if (cov[max_c][max_c] > 0.0f) {
+		t_min = FLT_MAX;
+		t_max = -FLT_MAX;
+		for (int i = 0; i < 16; i++) {
+			float t = 0.0f;
+			for (int c = 0; c < N; c++) {
+				t += (rgba[4 * i + c] - mean[c]) * axis[c];
+			}
+			t_min = std::min(t_min, t);
+			t_max = std::max(t_max, t);
+		}
+	}
+	for (int c = 0; c < N; c++) {
+		e0[c] = std::clamp(mean[c] + axis[c] * t_max, 0.0f, 255.0f);
+		e1[c] = std::clamp(mean[c] + axis[c] * t_min, 0.0f, 255.0f);
+	}
+}
+
+template <int N>
+static uint32_t nearest(const uint8_t* texel, const int (*palette)[4], uint32_t palette_size) {
+	uint32_t best = 0;
+	int best_err = INT_MAX;
+	for (uint32_t p = 0; p < palette_size; p++) {
+		int err = 0;
+		for (int c = 0; c < N; c++) {
+			const int d = int(texel[c]) - palette[p][c];
+			err += d * d;
+		}
+		if (err < best_err) {
+			best_err = err;
+			best = p;
+		}
+	}
+	return best;
+}
+
+static uint16_t pack_565(const float* c) {
+	const uint32_t r = (uint32_t)std::lround(c[0] * 31.0f / 255.0f);
+	const uint32_t g = (uint32_t)std::lround(c[1] * 63.0f / 255.0f);
+	const uint32_t b = (uint32_t)std::lround(c[2] * 31.0f / 255.0f);
+	return uint16_t(r << 11 | g << 5 | b);
+}
+
+static void unpack_565(uint16_t v, int* c) {
+	const int r = (v >> 11) & 31;
+	const int g = (v >> 5) & 63;
+	const int b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+	c[3] = 255;
+}
+
+static void encode_bc1(const uint8_t* rgba, uint8_t* dst) {
+	float e0[3], e1[3];
+	fit_line<3>(rgba, e0, e1);
+	uint16_t c0 = pack_565(e0);
+	uint16_t c1 = pack_565(e1);
+	// c0 > c1 selects the four color mode
+	if (c0 < c1) {
+		std::swap(c0, c1);
+	}
+	int palette[4][4];
+	unpack_565(c0, palette[0]);
+	unpack_565(c1, palette[1]);
+	for (int c = 0; c < 4; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+	uint32_t indices = 0;
+	// Equal endpoints decode in the three color mode, where index 0 still is c0
+	if (c0 != c1) {
+		for (int i = 0; i < 16; i++) {
+			indices |= nearest<3>(&rgba[4 * i], palette, 4) << (2 * i);
+		}
+	}
+	std::memcpy(dst, &c0, 2);
+	std::memcpy(dst + 2, &c1, 2);
+	std::memcpy(dst + 4, &indices, 4);
+}
+
+static void decode_bc1(const uint8_t* src, uint8_t* rgba) {
+	uint16_t c0, c1;
+	uint32_t indices;
+	std::memcpy(&c0, src, 2);
+	std::memcpy(&c1, src + 2, 2);
+	std::memcpy(&indices, src + 4, 4);
+	int palette[4][4];
+	unpack_565(c0, palette[0]);
+	unpack_565(c1, palette[1]);
+	for (int c = 0; c < 4; c++) {
+		if (c0 > c1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	for (int i = 0; i < 16; i++) {
+		const uint32_t idx = (indices >> (2 * i)) & 3;
+		for (int c = 0; c < 4; c++) {
+			rgba[4 * i + c] = uint8_t(palette[idx][c]);
+		}
+	}
+}
+
+// Single channel block of the given channel, eight interpolated values between the extremes
+static void encode_bc4(const uint8_t* rgba, int channel, uint8_t* dst) {
+	uint8_t lo = 255;
+	uint8_t hi = 0;
+	for (int i = 0; i < 16; i++) {
+		lo = std::min(lo, rgba[4 * i + channel]);
+		hi = std::max(hi, rgba[4 * i + channel]);
+	}
+	int palette[8][4] = {};
+	palette[0][0] = hi;
+	palette[1][0] = lo;
+	for (int i = 1; i < 7; i++) {
+		palette[i + 1][0] = ((7 - i) * hi + i * lo) / 7;
+	}
+	uint64_t bits = 0;
+	if (hi != lo) {
+		for (int i = 0; i < 16; i++) {
+			bits |= uint64_t(nearest<1>(&rgba[4 * i + channel], palette, 8)) << (3 * i);
+		}
+	}
+	dst[0] = hi;
+	dst[1] = lo;
+	for (int b = 0; b < 6; b++) {
+		dst[2 + b] = uint8_t(bits >> (8 * b));
+	}
+}
+
+static void decode_bc4(const uint8_t* src, int channel, uint8_t* rgba) {
+	const int r0 = src[0];
+	const int r1 = src[1];
+	int palette[8];
+	palette[0] = r0;
+	palette[1] = r1;
+	if (r0 > r1) {
+		for (int i = 1; i < 7; i++) {
+			palette[i + 1] = ((7 - i) * r0 + i * r1) / 7;
+		}
+	} else {
+		for (int i = 1; i < 5; i++) {
+			palette[i + 1] = ((5 - i) * r0 + i * r1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	uint64_t bits = 0;
+	for (int b = 0; b < 6; b++) {
+		bits |= uint64_t(src[2 + b]) << (8 * b);
+	}
+	for (int i = 0; i < 16; i++) {
+		rgba[4 * i + channel] = uint8_t(palette[(bits >> (3 * i)) & 7]);
+	}
+}
+
+// Endpoints are stored as 7 bits per channel plus a p-bit shared by the channels of the endpoint
+static void quantize_bc7_endpoint(const float* e, uint32_t* q, uint32_t& pbit) {
+	float best_err = FLT_MAX;
+	for (uint32_t p = 0; p < 2; p++) {
+		float err = 0.0f;
+		uint32_t v[4];
+		for (int c = 0; c < 4; c++) {
+			v[c] = (uint32_t)std::clamp<long>(std::lround((e[c] - p) * 0.5f), 0, 127);
+			const float d = float(v[c] * 2 + p) - e[c];
+			err += d * d;
+		}
+		if (err < best_err) {
+			best_err = err;
+			pbit = p;
+			std::copy(v, v + 4, q);
+		}
+	}
+}
+
+static void encode_bc7(const uint8_t* rgba, uint8_t* dst) {
+	float e0[4], e1[4];
+	fit_line<4>(rgba, e0, e1);
+	uint32_t q[2][4];
+	uint32_t pbits[2];
+	quantize_bc7_endpoint(e0, q[0], pbits[0]);
+	quantize_bc7_endpoint(e1, q[1], pbits[1]);
+	int palette[16][4];
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			const int a = int(q[0][c] << 1 | pbits[0]);
+			const int b = int(q[1][c] << 1 | pbits[1]);
+			palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * a + BC7_WEIGHTS4[i] * b + 32) >> 6;
+		}
+	}
+	uint32_t indices[16];
+	for (int i = 0; i < 16; i++) {
+		indices[i] = nearest<4>(&rgba[4 * i], palette, 16);
+	}
+	// The most significant bit of the first index is implicitly zero. The weights are symmetric, so swapping the
+	// endpoints and inverting the indices decodes to the same texels
+	if (indices[0] & 8) {
+		std::swap(q[0], q[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (uint32_t& idx : indices) {
+			idx = 15 - idx;
+		}
+	}
+	std::memset(dst, 0, 16);
+	uint32_t pos = 0;
+	auto write = [&](uint32_t value, uint32_t num_bits) {
+		for (uint32_t b = 0; b < num_bits; b++, pos++) {
+			dst[pos >> 3] |= uint8_t(((value >> b) & 1) << (pos & 7));
+		}
+	};
+	// Mode 6
+	write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		write(q[0][c], 7);
+		write(q[1][c], 7);
+	}
+	write(pbits[0], 1);
+	write(pbits[1], 1);
+	write(indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		write(indices[i], 4);
+	}
+}
+
+// Only decodes mode 6, the one emitted by encode_bc7
+static void decode_bc7(const uint8_t* src, uint8_t* rgba) {
+	uint32_t pos = 0;
+	auto read = [&](uint32_t num_bits) {
+		uint32_t value = 0;
+		for (uint32_t b = 0; b < num_bits; b++, pos++) {
+			value |= uint32_t((src[pos >> 3] >> (pos & 7)) & 1) << b;
+		}
+		return value;
+	};
+	if (read(7) != (1 << 6)) {
+		std::fill_n(rgba, 64, uint8_t(0));
+		return;
+	}
+	uint32_t q[2][4];
+	for (int c = 0; c < 4; c++) {
+		q[0][c] = read(7);
+		q[1][c] = read(7);
+	}
+	const uint32_t p0 = read(1);
+	const uint32_t p1 = read(1);
+	for (int i = 0; i < 16; i++) {
+		const uint32_t idx = read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++) {
+			const int a = int(q[0][c] << 1 | p0);
+			const int b = int(q[1][c] << 1 | p1);
+			rgba[4 * i + c] = uint8_t(((64 - BC7_WEIGHTS4[idx]) * a + BC7_WEIGHTS4[idx] * b + 32) >> 6);
+		}
+	}
+}
+
+void encode_block(Format format, const uint8_t* rgba, uint8_t* dst) {
+	switch (format) {
+		case Format::BC1:
+			encode_bc1(rgba, dst);
+			break;
+		case Format::BC4:
+			encode_bc4(rgba, 0, dst);
+			break;
+		case Format::BC5:
+			encode_bc4(rgba, 0, dst);
+			encode_bc4(rgba, 1, dst + 8);
+			break;
+		case Format::BC7:
+			encode_bc7(rgba, dst);
+			break;
+	}
+}
+
+void decode_block(Format format, const uint8_t* src, uint8_t* rgba) {
+	switch (format) {
+		case Format::BC1:
+			decode_bc1(src, rgba);
+			break;
+		case Format::BC4:
+		case Format::BC5:
+			for (int i = 0; i < 16; i++) {
+				rgba[4 * i + 0] = rgba[4 * i + 1] = rgba[4 * i + 2] = 0;
+				rgba[4 * i + 3] = 255;
+			}
+			decode_bc4(src, 0, rgba);
+			if (format == Format::BC5) {
+				decode_bc4(src + 8, 1, rgba);
+			}
+			break;
+		case Format::BC7:
+			decode_bc7(src, rgba);
+			break;
+	}
+}
+
+static float srgb_to_linear(float c) {
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<std::vector<uint8_t>> build_mips(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb) {
+	float to_linear[256];
+	for (int i = 0; i < 256; i++) {
+		to_linear[i] = srgb ? srgb_to_linear(i / 255.0f) : i / 255.0f;
+	}
+	std::vector<std::vector<uint8_t>> mips;
+	mips.emplace_back(rgba, rgba + size_t(width) * height * 4);
+	while (width > 1 || height > 1) {
+		const std::vector<uint8_t>& src = mips.back();
+		const uint32_t mip_width = std::max(width >> 1, 1u);
+		const uint32_t mip_height = std::max(height >> 1, 1u);
+		std::vector<uint8_t> dst(size_t(mip_width) * mip_height * 4);
+		for (uint32_t y = 0; y < mip_height; y++) {
+			for (uint32_t x = 0; x < mip_width; x++) {
+				const uint32_t x0 = std::min(2 * x, width - 1);
+				const uint32_t x1 = std::min(2 * x + 1, width - 1);
+				const uint32_t y0 = std::min(2 * y, height - 1);
+				const uint32_t y1 = std::min(2 * y + 1, height - 1);
+				const size_t texels[4] = {size_t(y0) * width + x0, size_t(y0) * width + x1, size_t(y1) * width + x0,
+										  size_t(y1) * width + x1};
+				for (int c = 0; c < 4; c++) {
+					float sum = 0.0f;
+					for (size_t t : texels) {
+						sum += c < 3 ? to_linear[src[4 * t + c]] : src[4 * t + c] / 255.0f;
+					}
+					float avg = sum * 0.25f;
+					if (srgb && c < 3) {
+						avg = linear_to_srgb(avg);
+					}
+					dst[4 * (size_t(y) * mip_width + x) + c] = uint8_t(std::lround(std::clamp(avg, 0.0f, 1.0f) * 255.0f));
+				}
+			}
+		}
+		mips.push_back(std::move(dst));
+		width = mip_width;
+		height = mip_height;
+	}
+	return mips;
+}
+
+static void compress_rows(const uint8_t* rgba, uint32_t width, uint32_t height, Format format, uint32_t first_row,
+						  uint32_t last_row, uint8_t* dst) {
+	const uint32_t blocks_x = (width + 3) / 4;
+	const uint32_t bytes = block_bytes(format);
+	uint8_t block[64];
+	for (uint32_t by = first_row; by < last_row; by++) {
+		for (uint32_t bx = 0; bx < blocks_x; bx++) {
+			// Partial blocks at the borders replicate the last row and column
+			for (uint32_t i = 0; i < 16; i++) {
+				const uint32_t x = std::min(4 * bx + (i & 3), width - 1);
+				const uint32_t y = std::min(4 * by + (i >> 2), height - 1);
+				std::memcpy(&block[4 * i], &rgba[4 * (size_t(y) * width + x)], 4);
+			}
+			encode_block(format, block, dst + (size_t(by) * blocks_x + bx) * bytes);
+		}
+	}
+}
+
+CompressedTexture compress(const uint8_t* rgba, uint32_t width, uint32_t height, Format format, bool srgb) {
+	CompressedTexture result;
+	result.format = format;
+	result.srgb = srgb;
+	result.width = width;
+	result.height = height;
+	const auto mips = build_mips(rgba, width, height, srgb);
+	size_t total_size = 0;
+	for (uint32_t mip = 0; mip < mips.size(); mip++) {
+		result.mip_offsets.push_back(total_size);
+		total_size += compressed_size(format, std::max(width >> mip, 1u), std::max(height >> mip, 1u));
+	}
+	result.data.resize(total_size);
+
+	constexpr uint32_t ROWS_PER_TASK = 16;
+	std::vector<std::future<void>> futures;
+	for (uint32_t mip = 0; mip < mips.size(); mip++) {
+		const uint32_t mip_width = std::max(width >> mip, 1u);
+		const uint32_t mip_height = std::max(height >> mip, 1u);
+		const uint32_t blocks_y = (mip_height + 3) / 4;
+		uint8_t* dst = result.data.data() + result.mip_offsets[mip];
+		for (uint32_t row = 0; row < blocks_y; row += ROWS_PER_TASK) {
+			futures.push_back(lumen::ThreadPool::submit(compress_rows, mips[mip].data(), mip_width, mip_height, format,
+														row, std::min(row + ROWS_PER_TASK, blocks_y), dst));
+		}
+	}
+	for (auto& f : futures) {
+		f.wait();
+	}
+	return result;
+}
+
+std::vector<uint8_t> decompress(const CompressedTexture& texture, uint32_t mip) {
+	const uint32_t width = std::max(texture.width >> mip, 1u);
+	const uint32_t height = std::max(texture.height >> mip, 1u);
+	const uint32_t blocks_x = (width + 3) / 4;
+	const uint32_t bytes = block_bytes(texture.format);
+	const uint8_t* src = texture.data.data() + texture.mip_offsets[mip];
+	std::vector<uint8_t> rgba(size_t(width) * height * 4);
+	uint8_t block[64];
+	for (uint32_t by = 0; by < (height + 3) / 4; by++) {
+		for (uint32_t bx = 0; bx < blocks_x; bx++) {
+			decode_block(texture.format, src + (size_t(by) * blocks_x + bx) * bytes, block);
+			for (uint32_t i = 0; i < 16; i++) {
+				const uint32_t x = 4 * bx + (i & 3);
+				const uint32_t y = 4 * by + (i >> 2);
+				if (x < width && y < height) {
+					std::memcpy(&rgba[4 * (size_t(y) * width + x)], &block[4 * i], 4);
+				}
+			}
+		}
+	}
+	return rgba;
+}
+
+Format pick_format(const uint8_t* rgba, uint32_t width, uint32_t height) {
+	for (size_t i = 0; i < size_t(width) * height; i++) {
+		if (rgba[4 * i + 3] != 255) {
+			return Format::BC7;
+		}
+	}
+	return Format::BC1;
+}
+
+std::string cache_path(const std::string& source, const std::string& variant) { return source + variant + ".bct"; }
+
+bool load_cache(const std::string& source, CompressedTexture& texture, const std::string& variant) {
+	const std::string path = cache_path(source, variant);
+	std::error_code ec;
+	const auto cache_time = std::filesystem::last_write_time(path, ec);
+	if (ec) {
+		return false;
+	}
+	const auto source_time = std::filesystem::last_write_time(source, ec);
+	if (ec || cache_time < source_time) {
+		return false;
+	}
+	std::ifstream file(path, std::ios::binary);
+	CacheHeader header;
+	if (!file.read((char*)&header, sizeof(header)) || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+		return false;
+	}
+	texture.format = Format(header.format);
+	texture.srgb = header.srgb != 0;
+	texture.width = header.width;
+	texture.height = header.height;
+	texture.mip_offsets.resize(header.num_mips);
+	size_t total_size = 0;
+	for (uint32_t mip = 0; mip < header.num_mips; mip++) {
+		texture.mip_offsets[mip] = total_size;
+		total_size += compressed_size(texture.format, std::max(header.width >> mip, 1u),
+									  std::max(header.height >> mip, 1u));
+	}
+	texture.data.resize(total_size);
+	return bool(file.read((char*)texture.data.data(), total_size));
+}
+
+void save_cache(const std::string& source, const CompressedTexture& texture, const std::string& variant) {
+	std::ofstream file(cache_path(source, variant), std::ios::binary);
+	if (!file) {
+		LUMEN_WARN("Could not write the texture cache of {}", source);
+		return;
+	}
+	const CacheHeader header = {CACHE_MAGIC,   CACHE_VERSION,  uint32_t(texture.format), uint32_t(texture.srgb),
+								texture.width, texture.height, texture.num_mips()};
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)texture.data.data(), texture.data.size());
+}
+
+void compression_report(const char* img_name) {
+	int width, height, n;
+	uint8_t* rgba = stbi_load(img_name, &width, &height, &n, 4);
+	if (!rgba) {
+		LUMEN_WARN("Could not load {}", img_name);
+		return;
+	}
+	size_t uncompressed_size = 0;
+	for (const auto& mip : build_mips(rgba, width, height, false)) {
+		uncompressed_size += mip.size();
+	}
+	LUMEN_TRACE("{}: {}x{}, RGBA8 mip chain {:.2f} MB", img_name, width, height, uncompressed_size * 1e-6);
+	const Format formats[] = {Format::BC1, Format::BC4, Format::BC5, Format::BC7};
+	const int channels[] = {3, 1, 2, 4};
+	for (int f = 0; f < 4; f++) {
+		const auto t_begin = std::chrono::high_resolution_clock::now();
+		const CompressedTexture texture = compress(rgba, width, height, formats[f], false);
+		const auto t_end = std::chrono::high_resolution_clock::now();
+		const std::vector<uint8_t> decoded = decompress(texture);
+		double sq_err = 0.0;
+		for (size_t i = 0; i < size_t(width) * height; i++) {
+			for (int c = 0; c < channels[f]; c++) {
+				const double d = double(rgba[4 * i + c]) - decoded[4 * i + c];
+				sq_err += d * d;
+			}
+		}
+		const double mse = sq_err / (double(width) * height * channels[f]);
+		const double psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+		LUMEN_TRACE("{} ({} channels): {:.2f} dB PSNR, {:.2f} MB ({:.1f}x smaller), encoded in {:.1f} ms",
+					format_name(formats[f]), channels[f], psnr, texture.data.size() * 1e-6,
+					double(uncompressed_size) / texture.data.size(),
+					std::chrono::duration<double, std::milli>(t_end - t_begin).count());
+	}
+	stbi_image_free(rgba);
+}
+
+}  // namespace TextureCompression
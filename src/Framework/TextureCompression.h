@@ -0,0 +1,57 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// CPU transcoding of 8 bit textures to block compressed formats, with a cache of the results next to the sources
+namespace TextureCompression {
+// BC1: opaque RGB, 8 bytes per block
+// BC4: single channel, 8 bytes per block
+// BC5: two channels, 16 bytes per block
+// BC7: RGBA, 16 bytes per block. Only mode 6 (a single RGBA line with 4 bit indices) is emitted
+enum class Format : uint32_t { BC1, BC4, BC5, BC7 };
+
+struct CompressedTexture {
+	Format format = Format::BC1;
+	bool srgb = false;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Full mip chain, tightly packed from the finest level
+	std::vector<uint8_t> data;
+	std::vector<VkDeviceSize> mip_offsets;
+	inline uint32_t num_mips() const { return (uint32_t)mip_offsets.size(); }
+	inline VkDeviceSize mip_size(uint32_t mip) const {
+		return (mip + 1 < num_mips() ? mip_offsets[mip + 1] : data.size()) - mip_offsets[mip];
+	}
+};
+
+VkFormat vk_format(Format format, bool srgb);
+const char* format_name(Format format);
+uint32_t block_bytes(Format format);
+size_t compressed_size(Format format, uint32_t width, uint32_t height);
+
+// Block encoders and decoders, pixels are 16 RGBA8 texels in row major order
+void encode_block(Format format, const uint8_t* rgba, uint8_t* dst);
+void decode_block(Format format, const uint8_t* src, uint8_t* rgba);
+
+// Box filtered RGBA8 mip chain including the source level, averaged in linear space for sRGB data
+std::vector<std::vector<uint8_t>> build_mips(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb);
+// Compresses all the mips of an RGBA8 image, rows of blocks are encoded in parallel on the thread pool
+CompressedTexture compress(const uint8_t* rgba, uint32_t width, uint32_t height, Format format, bool srgb);
+// RGBA8 pixels of the given mip level
+std::vector<uint8_t> decompress(const CompressedTexture& texture, uint32_t mip = 0);
+
+// BC7 if any texel is not fully opaque, BC1 otherwise
+Format pick_format(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+// <source><variant>.bct, only valid while it is newer than the source file. The variant tells apart different
+// transcodes of the same source
+std::string cache_path(const std::string& source, const std::string& variant = "");
+bool load_cache(const std::string& source, CompressedTexture& texture, const std::string& variant = "");
+void save_cache(const std::string& source, const CompressedTexture& texture, const std::string& variant = "");
+
+// Transcodes every format and prints the PSNR of the finest mip and the memory savings over RGBA8
+void compression_report(const char* img_name);
+}  // namespace TextureCompression
@@ -210,7 +210,8 @@ VkImageView create_image_view(VkDevice device, const VkImage& img, VkFormat form
 	return image_view;
 }
 
-BlasInput to_vk_geometry(LumenPrimMesh& prim, VkDeviceAddress vertexAddress, VkDeviceAddress indexAddress) {
+BlasInput to_vk_geometry(LumenPrimMesh& prim, VkDeviceAddress vertexAddress, VkDeviceAddress indexAddress,
+						 bool alpha_masked) {
 	uint32_t maxPrimitiveCount = prim.idx_count / 3;
 
 	// Describe buffer as array of VertexObj.
@@ -227,10 +228,10 @@ BlasInput to_vk_geometry(LumenPrimMesh& prim, VkDeviceAddress vertexAddress, VkD
 	// triangles.transformData = {};
 	triangles.maxVertex = prim.vtx_count;
 
-	// Identify the above data as containing opaque triangles.
+	// Only alpha masked triangles invoke any hit shaders, everything else is opaque
 	VkAccelerationStructureGeometryKHR asGeom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
 	asGeom.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-	asGeom.flags = VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR;	 // For AnyHit
+	asGeom.flags = alpha_masked ? VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR : VK_GEOMETRY_OPAQUE_BIT_KHR;
 	asGeom.geometry.triangles = triangles;
 
 	VkAccelerationStructureBuildRangeInfoKHR offset;
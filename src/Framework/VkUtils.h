@@ -13,7 +13,8 @@ void transition_image_layout(VkCommandBuffer copy_cmd, VkImage image, VkImageLay
 VkImageView create_image_view(VkDevice device, const VkImage& img, VkFormat format,
 							  VkImageAspectFlags flags = VK_IMAGE_ASPECT_COLOR_BIT);
 
-BlasInput to_vk_geometry(LumenPrimMesh& prim, VkDeviceAddress vertex_address, VkDeviceAddress index_address);
+BlasInput to_vk_geometry(LumenPrimMesh& prim, VkDeviceAddress vertex_address, VkDeviceAddress index_address,
+						 bool alpha_masked = false);
 
 inline bool has_extension(std::string_view filename, std::string_view ext) { return filename.ends_with(ext); }
 
@@ -54,6 +55,15 @@ inline VkBufferMemoryBarrier2 buffer_barrier2(VkBuffer buffer, VkAccessFlags src
 	return result;
 }
 
+inline VkBufferMemoryBarrier2 buffer_ownership_barrier2(VkBuffer buffer, uint32_t src_queue_idx, uint32_t dst_queue_idx,
+													   VkAccessFlags src_access, VkAccessFlags dst_access,
+													   VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) {
+	VkBufferMemoryBarrier2 result = buffer_barrier2(buffer, src_access, dst_access, src_stage, dst_stage);
+	result.srcQueueFamilyIndex = src_queue_idx;
+	result.dstQueueFamilyIndex = dst_queue_idx;
+	return result;
+}
+
 inline VkImageMemoryBarrier image_barrier(VkImage image, VkAccessFlags src_accesss, VkAccessFlags dst_access,
 										  VkImageLayout old_layout, VkImageLayout new_layout,
 										  VkImageAspectFlags aspect_mask) {
@@ -115,6 +125,18 @@ inline VkImageMemoryBarrier2 image_barrier2(VkImage image, VkAccessFlags src_acc
 	return result;
 }
 
+// Queue family ownership transfer, the layout is kept as is
+inline VkImageMemoryBarrier2 image_ownership_barrier2(VkImage image, VkImageLayout layout, VkImageAspectFlags aspect_mask,
+													  uint32_t src_queue_idx, uint32_t dst_queue_idx,
+													  VkAccessFlags src_access, VkAccessFlags dst_access,
+													  VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) {
+	VkImageMemoryBarrier2 result =
+		image_barrier2(image, src_access, dst_access, layout, layout, aspect_mask, src_stage, dst_stage);
+	result.srcQueueFamilyIndex = src_queue_idx;
+	result.dstQueueFamilyIndex = dst_queue_idx;
+	return result;
+}
+
 inline VkDeviceSize get_memory_usage(VkPhysicalDevice physical_device) {
 	VkPhysicalDeviceMemoryProperties2 props = {};
 	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
@@ -21,6 +21,7 @@ struct SwapChainSupportDetails {
 const std::vector<const char*> _validation_layers_lst = {"VK_LAYER_KHRONOS_validation"};
 
 std::vector<const char*> _device_extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+uint32_t _device_index = 0;
 
 size_t current_frame = 0;
 // Sync primitives
@@ -28,6 +29,12 @@ std::vector<VkSemaphore> _image_available_sem;
 std::vector<VkSemaphore> _render_finished_sem;
 std::vector<VkFence> _in_flight_fences;
 std::vector<VkFence> _images_in_flight;
+// Async compute sync primitives
+std::vector<VkSemaphore> _gfx_to_compute_sem;
+std::vector<VkSemaphore> _compute_done_sem;
+std::vector<VkFence> _compute_fences;
+// The compute submission of the previous frame that the graphics queue hasn't waited on yet
+VkSemaphore _pending_compute_sem = VK_NULL_HANDLE;
 std::vector<VkQueueFamilyProperties> _queue_families;
 std::unique_ptr<lumen::RenderGraph> _rg;
 VkFormat _swapchain_format;
@@ -59,23 +66,29 @@ static QueueFamilyIndices find_queue_families(VkPhysicalDevice device) {
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, _queue_families.data());
 
 	int i = 0;
+	bool dedicated_compute = false;
 	for (const auto& queueFamily : _queue_families) {
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.gfx_family.has_value()) {
 			indices.gfx_family = i;
 		}
 
+		// Prefer a compute family without graphics support so that async compute can overlap graphics work
 		if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) {
-			indices.compute_family = i;
+			const bool is_dedicated = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0;
+			if (!indices.compute_family.has_value() || (is_dedicated && !dedicated_compute)) {
+				indices.compute_family = i;
+				dedicated_compute = is_dedicated;
+			}
 		}
 
 		VkBool32 present_support = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, context().surface, &present_support);
 
-		if (present_support) {
+		if (present_support && !indices.present_family.has_value()) {
 			indices.present_family = i;
 		}
 
-		if (indices.is_complete()) {
+		if (indices.is_complete() && dedicated_compute) {
 			break;
 		}
 
@@ -262,13 +275,16 @@ static void pick_physical_device() {
 		// swapchain, return true
 		return indices.is_complete() && extensions_supported && swapchain_adequate;
 	};
-	for (const auto& device : devices) {
-		if (is_suitable(device)) {
-			context().physical_device = device;
-			vkGetPhysicalDeviceFeatures(context().physical_device, &context().supported_features);
-			vkGetPhysicalDeviceProperties(context().physical_device, &context().device_properties);
-			vkGetPhysicalDeviceMemoryProperties(context().physical_device, &context().memory_properties);
-			break;
+	std::vector<VkPhysicalDevice> suitable_devices;
+	std::copy_if(devices.begin(), devices.end(), std::back_inserter(suitable_devices), is_suitable);
+	if (!suitable_devices.empty()) {
+		context().physical_device = suitable_devices[_device_index % suitable_devices.size()];
+		vkGetPhysicalDeviceFeatures(context().physical_device, &context().supported_features);
+		vkGetPhysicalDeviceProperties(context().physical_device, &context().device_properties);
+		vkGetPhysicalDeviceMemoryProperties(context().physical_device, &context().memory_properties);
+		if (suitable_devices.size() > 1) {
+			LUMEN_TRACE("Using {} ({} of {} GPUs)", context().device_properties.deviceName,
+						_device_index % suitable_devices.size(), suitable_devices.size());
 		}
 	}
 
@@ -277,6 +293,7 @@ static void pick_physical_device() {
 	}
 	VkPhysicalDeviceProperties2 prop2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
 	prop2.pNext = &context().rt_props;
+	context().rt_props.pNext = &context().subgroup_props;
 	vkGetPhysicalDeviceProperties2(context().physical_device, &prop2);
 }
 
@@ -350,6 +367,8 @@ static void create_logical_device() {
 	}
 
 	device_features2.features.samplerAnisotropy = true;
+	// Block compressed scene textures, LumenScene falls back to RGBA8 without it
+	device_features2.features.textureCompressionBC = context().supported_features.textureCompressionBC;
 	device_features2.features.shaderInt64 = true;
 	//
 	device_features2.features.fragmentStoresAndAtomics = true;
@@ -500,6 +519,11 @@ static void create_command_pools() {
 		check(vkCreateCommandPool(context().device, &pool_info, nullptr, &context().cmd_pools[i]),
 			  "Failed to create command pool!");
 	}
+	if (queue_family_idxs.has_async_compute()) {
+		pool_info.queueFamilyIndex = queue_family_idxs.compute_family.value();
+		check(vkCreateCommandPool(context().device, &pool_info, nullptr, &context().compute_cmd_pool),
+			  "Failed to create compute command pool!");
+	}
 }
 
 static void create_command_buffers() {
@@ -510,6 +534,19 @@ static void create_command_buffers() {
 		context().cmd_pools[0], VK_COMMAND_BUFFER_LEVEL_PRIMARY, (uint32_t)context().command_buffers.size());
 	check(vkAllocateCommandBuffers(context().device, &alloc_info, context().command_buffers.data()),
 		  "Failed to allocate command buffers!");
+	if (!context().queue_indices.has_async_compute()) {
+		return;
+	}
+	context().compute_command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+	context().handoff_command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+	alloc_info = command_buffer_allocate_info(context().compute_cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+											  MAX_FRAMES_IN_FLIGHT);
+	check(vkAllocateCommandBuffers(context().device, &alloc_info, context().compute_command_buffers.data()),
+		  "Failed to allocate compute command buffers!");
+	alloc_info =
+		command_buffer_allocate_info(context().cmd_pools[0], VK_COMMAND_BUFFER_LEVEL_PRIMARY, MAX_FRAMES_IN_FLIGHT);
+	check(vkAllocateCommandBuffers(context().device, &alloc_info, context().handoff_command_buffers.data()),
+		  "Failed to allocate handoff command buffers!");
 }
 
 static void create_sync_primitives() {
@@ -528,6 +565,18 @@ static void create_sync_primitives() {
 				  vkCreateFence(context().device, &fence_info, nullptr, &_in_flight_fences[i])},
 				 "Failed to create synchronization primitives for a frame");
 	}
+	if (!context().queue_indices.has_async_compute()) {
+		return;
+	}
+	_gfx_to_compute_sem.resize(MAX_FRAMES_IN_FLIGHT);
+	_compute_done_sem.resize(MAX_FRAMES_IN_FLIGHT);
+	_compute_fences.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		check<3>({vkCreateSemaphore(context().device, &semaphore_info, nullptr, &_gfx_to_compute_sem[i]),
+				  vkCreateSemaphore(context().device, &semaphore_info, nullptr, &_compute_done_sem[i]),
+				  vkCreateFence(context().device, &fence_info, nullptr, &_compute_fences[i])},
+				 "Failed to create async compute synchronization primitives for a frame");
+	}
 }
 
 // Called after window resize
@@ -606,6 +655,38 @@ static void create_instance() {
 	}
 }
 
+static const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+// The driver validates the header of the data and starts empty if it was written by another device or driver
+static void create_pipeline_cache() {
+	std::vector<char> data;
+	if (std::ifstream in(PIPELINE_CACHE_FILE, std::ios::binary | std::ios::ate); in) {
+		data.resize(size_t(in.tellg()));
+		in.seekg(0);
+		in.read(data.data(), data.size());
+	}
+	VkPipelineCacheCreateInfo cache_CI{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+	cache_CI.initialDataSize = data.size();
+	cache_CI.pInitialData = data.empty() ? nullptr : data.data();
+	if (vkCreatePipelineCache(context().device, &cache_CI, nullptr, &context().pipeline_cache) != VK_SUCCESS) {
+		cache_CI.initialDataSize = 0;
+		cache_CI.pInitialData = nullptr;
+		vk::check(vkCreatePipelineCache(context().device, &cache_CI, nullptr, &context().pipeline_cache));
+	}
+}
+
+static void destroy_pipeline_cache() {
+	size_t size = 0;
+	if (vkGetPipelineCacheData(context().device, context().pipeline_cache, &size, nullptr) == VK_SUCCESS && size) {
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(context().device, context().pipeline_cache, &size, data.data()) == VK_SUCCESS) {
+			std::ofstream(PIPELINE_CACHE_FILE, std::ios::binary).write(data.data(), size);
+		}
+	}
+	vkDestroyPipelineCache(context().device, context().pipeline_cache, nullptr);
+	context().pipeline_cache = VK_NULL_HANDLE;
+}
+
 static VkQueryPool create_query_pool(VkQueryType query_type, uint32_t count) {
 	VkQueryPoolCreateInfo create_info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
 	create_info.queryType = query_type;
@@ -623,6 +704,7 @@ void init(bool validation_layers) {
 	pick_physical_device();
 	create_logical_device();
 	create_allocator();
+	create_pipeline_cache();
 	create_swapchain();
 	create_command_pools();
 	create_command_buffers();
@@ -692,6 +774,8 @@ void destroy_imgui() {
 
 void add_device_extension(const char* name) { _device_extensions.push_back(name); }
 
+void set_device_index(uint32_t index) { _device_index = index; }
+
 std::vector<Texture*>& swapchain_images() { return _swapchain_images; }
 
 uint32_t prepare_frame() {
@@ -710,17 +794,37 @@ uint32_t prepare_frame() {
 	vkResetFences(context().device, 1, &_in_flight_fences[current_frame]);
 	_images_in_flight[image_idx] = _in_flight_fences[current_frame];
 	check(vkResetCommandBuffer(context().command_buffers[image_idx], 0));
+	if (context().queue_indices.has_async_compute()) {
+		// The timestamps of this frame slot are also written by the compute queue
+		check(vkWaitForFences(context().device, 1, &_compute_fences[current_frame], VK_TRUE, ~0ull), "Timeout");
+		check(vkResetCommandBuffer(context().compute_command_buffers[current_frame], 0));
+		check(vkResetCommandBuffer(context().handoff_command_buffers[current_frame], 0));
+	}
 	GPUQueryManager::collect(uint32_t(current_frame));
 	return image_idx;
 }
 
 VkResult submit_frame(uint32_t image_idx) {
-	VkSubmitInfo submit_info = vk::submit_info();
-	VkSemaphore wait_semaphores[] = {_image_available_sem[current_frame]};
-	VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+	const lumen::AsyncComputeSubmission& async_submission = _rg->async_submission;
+	VkSubmitInfo submit_infos[2] = {vk::submit_info(), vk::submit_info()};
+	uint32_t submit_cnt = 1;
+	VkSubmitInfo& submit_info = submit_infos[0];
+	VkSemaphore wait_semaphores[] = {_image_available_sem[current_frame], _pending_compute_sem};
+	VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+										  async_submission.gfx_wait_stages};
 	submit_info.waitSemaphoreCount = 1;
 	submit_info.pWaitSemaphores = wait_semaphores;
 	submit_info.pWaitDstStageMask = wait_stages;
+	// Only the passes that acquire resources released by the previous async compute submission wait on it
+	if (_pending_compute_sem && async_submission.gfx_wait_stages) {
+		submit_info.waitSemaphoreCount = 2;
+		_pending_compute_sem = VK_NULL_HANDLE;
+	} else if (_pending_compute_sem && !async_submission.recorded) {
+		// Async compute got disabled, wait on the last compute submission before anything else executes
+		wait_stages[1] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		submit_info.waitSemaphoreCount = 2;
+		_pending_compute_sem = VK_NULL_HANDLE;
+	}
 
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers = &context().command_buffers[image_idx];
@@ -729,8 +833,40 @@ VkResult submit_frame(uint32_t image_idx) {
 	submit_info.signalSemaphoreCount = 1;
 	submit_info.pSignalSemaphores = signal_semaphores;
 
-	check(vkQueueSubmit(context().queues[(int)QueueType::GFX], 1, &submit_info, _in_flight_fences[current_frame]),
+	// Handoff batch: Releases the resources used by the async compute passes to the compute queue
+	VkPipelineStageFlags handoff_wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	if (async_submission.recorded) {
+		VkSubmitInfo& handoff_info = submit_infos[submit_cnt++];
+		if (_pending_compute_sem) {
+			handoff_info.waitSemaphoreCount = 1;
+			handoff_info.pWaitSemaphores = &_pending_compute_sem;
+			handoff_info.pWaitDstStageMask = &handoff_wait_stage;
+		}
+		handoff_info.commandBufferCount = 1;
+		handoff_info.pCommandBuffers = &context().handoff_command_buffers[current_frame];
+		handoff_info.signalSemaphoreCount = 1;
+		handoff_info.pSignalSemaphores = &_gfx_to_compute_sem[current_frame];
+	}
+
+	check(vkQueueSubmit(context().queues[(int)QueueType::GFX], submit_cnt, submit_infos,
+						_in_flight_fences[current_frame]),
 		  "Failed to submit draw command buffer");
+
+	if (async_submission.recorded) {
+		VkSubmitInfo compute_submit_info = vk::submit_info();
+		compute_submit_info.waitSemaphoreCount = 1;
+		compute_submit_info.pWaitSemaphores = &_gfx_to_compute_sem[current_frame];
+		compute_submit_info.pWaitDstStageMask = &handoff_wait_stage;
+		compute_submit_info.commandBufferCount = 1;
+		compute_submit_info.pCommandBuffers = &context().compute_command_buffers[current_frame];
+		compute_submit_info.signalSemaphoreCount = 1;
+		compute_submit_info.pSignalSemaphores = &_compute_done_sem[current_frame];
+		vkResetFences(context().device, 1, &_compute_fences[current_frame]);
+		check(vkQueueSubmit(context().queues[(int)QueueType::COMPUTE], 1, &compute_submit_info,
+							_compute_fences[current_frame]),
+			  "Failed to submit async compute command buffer");
+		_pending_compute_sem = _compute_done_sem[current_frame];
+	}
 	current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
 	VkPresentInfoKHR present_info{};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -756,6 +892,10 @@ VkResult submit_frame(uint32_t image_idx) {
 	return result;
 }
 
+VkCommandBuffer compute_command_buffer() { return context().compute_command_buffers[current_frame]; }
+
+VkCommandBuffer handoff_command_buffer() { return context().handoff_command_buffers[current_frame]; }
+
 lumen::RenderGraph* render_graph() { return _rg.get(); }
 
 void cleanup_app_data() { _rg->destroy(); }
@@ -775,6 +915,20 @@ void cleanup() {
 		vkDestroySemaphore(context().device, _render_finished_sem[i], nullptr);
 		vkDestroyFence(context().device, _in_flight_fences[i], nullptr);
 	}
+	if (context().queue_indices.has_async_compute()) {
+		vkFreeCommandBuffers(context().device, context().cmd_pools[0],
+							 static_cast<uint32_t>(context().handoff_command_buffers.size()),
+							 context().handoff_command_buffers.data());
+		vkFreeCommandBuffers(context().device, context().compute_cmd_pool,
+							 static_cast<uint32_t>(context().compute_command_buffers.size()),
+							 context().compute_command_buffers.data());
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			vkDestroySemaphore(context().device, _gfx_to_compute_sem[i], nullptr);
+			vkDestroySemaphore(context().device, _compute_done_sem[i], nullptr);
+			vkDestroyFence(context().device, _compute_fences[i], nullptr);
+		}
+		vkDestroyCommandPool(context().device, context().compute_cmd_pool, nullptr);
+	}
 
 	for (auto pool : context().cmd_pools) {
 		vkDestroyCommandPool(context().device, pool, nullptr);
@@ -783,6 +937,7 @@ void cleanup() {
 	prm::destroy();
 	vmaDestroyAllocator(context().allocator);
 
+	destroy_pipeline_cache();
 	vkDestroyDevice(context().device, nullptr);
 	if (_enable_validation_layers) {
 		vkExt_destroy_debug_messenger(context().instance, context().debug_messenger, nullptr);
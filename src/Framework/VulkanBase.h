@@ -9,9 +9,14 @@ void init_imgui();
 void init(bool validation_layers);
 void destroy_imgui();
 void add_device_extension(const char* name);
+// Picks the index-th suitable GPU, modulo their count, instead of the first one. Called before init()
+void set_device_index(uint32_t index);
 std::vector<Texture*>& swapchain_images();
 uint32_t prepare_frame();
 VkResult submit_frame(uint32_t image_idx);
+// Only valid when the device exposes a separate compute queue family
+VkCommandBuffer compute_command_buffer();
+VkCommandBuffer handoff_command_buffer();
 lumen::RenderGraph* render_graph();
 void cleanup_app_data();
 void cleanup();
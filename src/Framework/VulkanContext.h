@@ -20,12 +20,20 @@ struct VulkanContext {
 	std::vector<VkQueue> queues;
 	QueueFamilyIndices queue_indices;
 	std::vector<VkCommandBuffer> command_buffers;
+	// Async compute: one command buffer per frame in flight on the compute queue, plus a graphics queue command
+	// buffer that hands resources over to the compute queue
+	VkCommandPool compute_cmd_pool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> compute_command_buffers;
+	std::vector<VkCommandBuffer> handoff_command_buffers;
 	VkPhysicalDeviceFeatures supported_features;
 	VkPhysicalDeviceProperties device_properties;
 	VkPhysicalDeviceMemoryProperties memory_properties;
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR rt_props{
 		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
+	VkPhysicalDeviceSubgroupProperties subgroup_props{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES};
 	VmaAllocator allocator;
+	// Driver side pipeline cache, persisted to PIPELINE_CACHE_FILE so that later runs skip the backend compilation
+	VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
 	VkQueryPool query_pool_timestamps[3];
 };
 
@@ -27,6 +27,10 @@ struct QueueFamilyIndices {
 
 	// TODO: Extend to other families
 	bool is_complete() { return (gfx_family.has_value() && present_family.has_value()) && compute_family.has_value(); }
+	// A compute family separate from the graphics family allows async compute submissions
+	bool has_async_compute() const {
+		return gfx_family.has_value() && compute_family.has_value() && gfx_family.value() != compute_family.value();
+	}
 };
 
 struct DescriptorInfo {
@@ -667,6 +671,17 @@ inline VkDependencyInfo dependency_info(uint32_t cnt, const VkImageMemoryBarrier
 	return res;
 }
 
+inline VkDependencyInfo dependency_info(uint32_t buffer_cnt, const VkBufferMemoryBarrier2* p_buffer_memory_barriers,
+									   uint32_t img_cnt, const VkImageMemoryBarrier2* p_img_memory_barriers) {
+	VkDependencyInfo res = {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+	res.dependencyFlags = 0;
+	res.bufferMemoryBarrierCount = buffer_cnt;
+	res.pBufferMemoryBarriers = p_buffer_memory_barriers;
+	res.imageMemoryBarrierCount = img_cnt;
+	res.pImageMemoryBarriers = p_img_memory_barriers;
+	return res;
+}
+
 inline VkRenderingAttachmentInfo rendering_attachment_info(VkImageView image_view, VkImageLayout image_layout,
 														   VkAttachmentLoadOp load_op, VkAttachmentStoreOp store_op,
 														   VkClearValue clear_value) {
@@ -88,9 +88,10 @@ static void scroll_callback(GLFWwindow* window, double x, double y) {
 	for (auto& cb : window_ptr->mouse_scroll_callbacks) cb(x, y);
 }
 
-void init(int width, int height, bool fullscreen) {
+void init(int width, int height, bool fullscreen, bool visible) {
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 	_window.window_handle =
 		glfwCreateWindow(width, height, "Lumen", fullscreen ? glfwGetPrimaryMonitor() : nullptr, nullptr);
 	LUMEN_ASSERT(_window.window_handle, "Failed to create a window!");
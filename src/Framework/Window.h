@@ -158,7 +158,8 @@ struct Window {
 	uint32_t viewport_width;
 	uint32_t viewport_height;
 };
-void init(int width, int height, bool fullscreen);
+// Hidden windows get no input, e.g. for replays
+void init(int width, int height, bool fullscreen, bool visible = true);
 Window* get();
 void update_window_size();
 void poll();
@@ -4,33 +4,25 @@
 void BDPT::init() {
 	Integrator::init();
 
+	// The camera subpaths stay in the shader invocations, see bdpt_commons.glsl
 	light_path_buffer = prm::get_buffer(
 		{.name = "Light Path Buffer",
 		 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 				  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		 .memory_type = vk::BufferType::GPU,
-		 .size = Window::width() * Window::height()  * (lumen_scene->config->path_length + 1) * sizeof(PathVertex)});
-	camera_path_buffer = prm::get_buffer(
-		{.name = "Camera Path Buffer",
-		 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-				  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		 .memory_type = vk::BufferType::GPU,
-		 .size = Window::width() * Window::height()  * (lumen_scene->config->path_length + 1) * sizeof(PathVertex)});
+		 .size = Window::width() * Window::height() * (config->path_length + 1) * sizeof(PackedPathVertex)});
 	color_storage_buffer =
 		prm::get_buffer({.name = "Color Storage Buffer",
-						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+								  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 						 .memory_type = vk::BufferType::GPU,
 						 .size = Window::width() * Window::height()  * 3 * 4});
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	lumen_scene->fill_scene_desc(desc);
 	// BDPT
 	desc.light_path_addr = light_path_buffer->get_device_address();
-	desc.camera_path_addr = camera_path_buffer->get_device_address();
 	desc.color_storage_addr = color_storage_buffer->get_device_address();
+	set_adaptive_addrs(desc);
 
 	lumen_scene->scene_desc_buffer =
 		prm::get_buffer({.name = "Scene Desc",
@@ -42,12 +34,8 @@ void BDPT::init() {
 	frame_num = 0;
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer,
-								 vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, light_path_addr, light_path_buffer,
 								 vk::render_graph());
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, camera_path_addr, camera_path_buffer,
-								 vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, color_storage_addr, color_storage_buffer,
 								 vk::render_graph());
 }
@@ -62,6 +50,22 @@ void BDPT::render() {
 	pc_ray.frame_num = frame_num;
 	pc_ray.size_x = Window::width();
 	pc_ray.size_y = Window::height();
+	pc_ray.adaptive = adaptive.enabled;
+	uint32_t dims[2] = {Window::width(), Window::height()};
+	std::vector<vk::ShaderMacro> macros = sampler_macros();
+	std::vector<vk::ShaderMacro> splat = splat_macros();
+	macros.insert(macros.end(), splat.begin(), splat.end());
+	macros.emplace_back("BDPT_MAX_PATH_VERTICES", config->path_length + 1);
+	if (adaptive.enabled) {
+		// Light tracing splats are normalized by the number of active pixels, so every active tile has to be traced
+		const uint32_t launch_tiles = adaptive_launch_tiles({Window::width(), Window::height()}, true);
+		if (launch_tiles == 0) {
+			return;
+		}
+		add_adaptive_mask_pass({Window::width(), Window::height()});
+		dims[0] = ADAPTIVE_TILE_SIZE * ADAPTIVE_TILE_SIZE;
+		dims[1] = launch_tiles;
+	}
 	vk::render_graph()
 		->add_rt("BDPT",
 				 {
@@ -71,12 +75,13 @@ void BDPT::render() {
 								 {"src/shaders/ray_shadow.rmiss"},
 								 {"src/shaders/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
-					 .dims = {Window::width(), Window::height() },
+					 .macros = macros,
+					 .dims = {dims[0], dims[1]},
 				 })
 		.zero(light_path_buffer)
-		.zero(camera_path_buffer)
+		// Splats that landed after their pixel was taken belong to the previous accumulation
+		.zero(color_storage_buffer, frame_num == 0)
 		//.read(light_path_buffer) // Needed if shader inference is disabled
-		//.read(camera_path_buffer)
 		.push_constants(&pc_ray)
 		//.write(output_tex)
 		.bind({
@@ -88,6 +93,9 @@ void BDPT::render() {
 		.bind_texture_array(lumen_scene->scene_textures)
 		.bind_tlas(tlas);
 	//.finalize();
+	if (adaptive.enabled) {
+		queue_adaptive_readback();
+	}
 }
 
 bool BDPT::update() {
@@ -99,9 +107,17 @@ bool BDPT::update() {
 	return updated;
 }
 
+bool BDPT::gui() {
+	bool result = Integrator::gui();
+	result |= sampler_gui();
+	result |= splat_gui();
+	result |= adaptive_gui();
+	return result;
+}
+
 void BDPT::destroy() {
 	Integrator::destroy();
-	auto buffer_list = {light_path_buffer, camera_path_buffer, color_storage_buffer};
+	auto buffer_list = {light_path_buffer, color_storage_buffer};
 	for (vk::Buffer* b : buffer_list) {
 		prm::remove(b);
 	}
@@ -10,11 +10,12 @@ class BDPT final : public Integrator {
 	virtual void render() override;
 	virtual bool update() override;
 	virtual void destroy() override;
+	virtual bool gui() override;
+	virtual bool supports_adaptive_sampling() const override { return true; }
 
    private:
 	PCBDPT pc_ray{};
 	vk::Buffer* light_path_buffer;
-	vk::Buffer* camera_path_buffer;
 	vk::Buffer* color_storage_buffer;
 	BDPTConfig* config;
 };
@@ -0,0 +1,244 @@
+#include "LumenPCH.h"
+#include "Benchmark.h"
+#include "Framework/ImageUtils.h"
+#include <tinygltf/json.hpp>
+
+using json = nlohmann::json;
+
+namespace Benchmark {
+
+void RunStats::add_frame(const GPUQueryManager::TimestampData& timestamps) {
+	if (timestamps.size == 0) {
+		return;
+	}
+	uint64_t gpu_start = UINT64_MAX;
+	uint64_t gpu_end = 0;
+	for (size_t i = 0; i < timestamps.size; i += 2) {
+		const std::string& name = timestamps.names[i >> 1];
+		const double ms = (timestamps.timestamps[i + 1] - timestamps.timestamps[i]) * 1e-6;
+		auto it = std::find_if(pass_ms.begin(), pass_ms.end(), [&](const auto& pass) { return pass.first == name; });
+		if (it == pass_ms.end()) {
+			pass_ms.emplace_back(name, ms);
+		} else {
+			it->second += ms;
+		}
+		gpu_start = std::min(gpu_start, timestamps.timestamps[i]);
+		gpu_end = std::max(gpu_end, timestamps.timestamps[i + 1]);
+	}
+	gpu_frame_ms += (gpu_end - gpu_start) * 1e-6;
+	timed_frames++;
+}
+
+void write_run_stats(const RunStats& stats, const std::string& path) {
+	json j;
+	j["frames"] = stats.frames;
+	j["elapsed_s"] = stats.elapsed_s;
+	j["timed_frames"] = stats.timed_frames;
+	j["gpu_frame_ms"] = stats.timed_frames ? stats.gpu_frame_ms / stats.timed_frames : 0.0;
+	j["peak_memory_mb"] = stats.peak_memory * 1e-6;
+	json passes = json::object();
+	for (const auto& [name, ms] : stats.pass_ms) {
+		passes[name] = stats.timed_frames ? ms / stats.timed_frames : 0.0;
+	}
+	j["passes"] = passes;
+	std::ofstream(path) << j.dump(4);
+}
+
+static std::string quote(const std::string& arg) { return "\"" + arg + "\""; }
+
+static std::string run_name(const json& entry) {
+	return entry.value("name", std::filesystem::path(std::string(entry["scene"])).stem().string());
+}
+
+// Previous result of the same run and integrator
+static const json* find_baseline(const json& baseline, const std::string& name, const std::string& integrator) {
+	if (!baseline.count("runs")) {
+		return nullptr;
+	}
+	for (const json& entry : baseline["runs"]) {
+		if (run_name(entry) == name && entry["integrator"] == integrator) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+int run(int argc, char* argv[]) {
+	const std::string matrix_path = argv[2];
+	std::string baseline_path;
+	for (int i = 3; i < argc; i++) {
+		if (std::string(argv[i]) == "--baseline" && i + 1 < argc) {
+			baseline_path = argv[++i];
+		}
+	}
+	std::ifstream matrix_file(matrix_path);
+	if (!matrix_file) {
+		LUMEN_ERROR("Could not open the benchmark matrix " + matrix_path);
+	}
+	json matrix;
+	matrix_file >> matrix;
+	const std::filesystem::path output_dir = matrix.value("output_dir", std::string("benchmark"));
+	std::filesystem::create_directories(output_dir);
+	const uint32_t default_spp = matrix.value("spp", 64u);
+	const float default_time_budget = matrix.value("time_budget", 0.0f);
+	const json thresholds = matrix.value("thresholds", json::object());
+	const double max_rel_mse = thresholds.value("rel_mse", 0.0);
+	const double max_flip = thresholds.value("flip", 0.0);
+	const double max_energy_error = thresholds.value("energy", 0.0);
+	const double max_time_regression = thresholds.value("time_regression", 0.1);
+	const double max_quality_regression = thresholds.value("quality_regression", 0.1);
+	if (baseline_path.empty()) {
+		baseline_path = matrix.value("baseline", std::string());
+	}
+	json baseline = json::object();
+	if (!baseline_path.empty()) {
+		std::ifstream baseline_file(baseline_path);
+		if (baseline_file) {
+			baseline_file >> baseline;
+		} else {
+			LUMEN_WARN("Could not open the baseline report {}, regressions are not checked", baseline_path);
+		}
+	}
+
+	json report;
+	report["matrix"] = matrix_path;
+	report["runs"] = json::array();
+	bool passed = true;
+	for (const json& entry : matrix["runs"]) {
+		const std::string scene = entry["scene"];
+		const std::string name = run_name(entry);
+		const std::string reference_path = entry.value("reference", std::string());
+		const uint32_t spp = entry.value("spp", default_spp);
+		const float time_budget = entry.value("time_budget", default_time_budget);
+		std::string extra_args;
+		for (const std::string arg : entry.value("args", json::array())) {
+			extra_args += " " + arg;
+		}
+		int ref_width = 0, ref_height = 0;
+		float* reference = nullptr;
+		double ref_mean = 0.0;
+		if (!reference_path.empty()) {
+			try {
+				reference = ImageUtils::load_exr(reference_path.c_str(), ref_width, ref_height);
+			} catch (const std::exception&) {
+				reference = nullptr;
+			}
+			if (!reference) {
+				LUMEN_WARN("Could not load the reference {}", reference_path);
+			} else {
+				ref_mean = ImageUtils::mean_luminance(reference, size_t(ref_width) * ref_height);
+			}
+		}
+		for (const std::string integrator : entry["integrators"]) {
+			const std::string output_name = name + "_" + integrator;
+			const std::string output_path = (output_dir / (output_name + ".exr")).string();
+			const std::string stats_path = (output_dir / (output_name + "_stats.json")).string();
+			std::filesystem::remove(output_path);
+			std::filesystem::remove(stats_path);
+			std::string cmd = quote(argv[0]) + " " + quote(scene) + " --integrator " + integrator +
+							  " --spp " + std::to_string(spp) + " --output " + quote(output_path) + " --stats " +
+							  quote(stats_path) + extra_args;
+			if (time_budget > 0.0f) {
+				cmd += " --time-budget " + std::to_string(time_budget);
+			}
+			LUMEN_TRACE("Benchmark: {}", cmd);
+			const int exit_code = std::system(cmd.c_str());
+
+			json result;
+			result["scene"] = scene;
+			result["name"] = name;
+			result["integrator"] = integrator;
+			result["output"] = output_path;
+			std::vector<std::string> failures;
+			std::ifstream stats_file(stats_path);
+			if (exit_code != 0 || !stats_file) {
+				failures.push_back("renderer exited with code " + std::to_string(exit_code));
+			} else {
+				json stats;
+				stats_file >> stats;
+				result["frames"] = stats["frames"];
+				result["elapsed_s"] = stats["elapsed_s"];
+				result["gpu_frame_ms"] = stats["gpu_frame_ms"];
+				result["peak_memory_mb"] = stats["peak_memory_mb"];
+				result["passes"] = stats["passes"];
+			}
+			if (failures.empty()) {
+				int width, height;
+				float* output = nullptr;
+				try {
+					output = ImageUtils::load_exr(output_path.c_str(), width, height);
+				} catch (const std::exception&) {
+					output = nullptr;
+				}
+				if (output) {
+					result["mean_luminance"] = ImageUtils::mean_luminance(output, size_t(width) * height);
+				}
+				if (reference && (!output || width != ref_width || height != ref_height)) {
+					failures.push_back("output missing or its size does not match the reference");
+				} else if (reference) {
+					const ImageUtils::ErrorStats error = ImageUtils::compare(reference, output, size_t(width) * height);
+					result["rmse"] = error.rmse;
+					result["rel_mse"] = error.rel_mse;
+					result["psnr"] = error.psnr;
+					const double flip = ImageUtils::flip(reference, output, width, height);
+					result["flip"] = flip;
+					if (max_rel_mse > 0.0 && error.rel_mse > max_rel_mse) {
+						failures.push_back(fmt::format("relMSE {:.4e} above {:.4e}", error.rel_mse, max_rel_mse));
+					}
+					if (max_flip > 0.0 && flip > max_flip) {
+						failures.push_back(fmt::format("FLIP {:.4f} above {:.4f}", flip, max_flip));
+					}
+					if (ref_mean > 0.0) {
+						const double energy_ratio = (double)result["mean_luminance"] / ref_mean;
+						result["energy_ratio"] = energy_ratio;
+						if (max_energy_error > 0.0 && std::abs(energy_ratio - 1.0) > max_energy_error) {
+							failures.push_back(fmt::format("energy ratio {:.4f} to the reference", energy_ratio));
+						}
+					}
+				}
+				free(output);
+			}
+			if (const json* base = find_baseline(baseline, name, integrator); base && failures.empty()) {
+				const double base_ms = base->value("gpu_frame_ms", 0.0);
+				const double ms = result["gpu_frame_ms"];
+				if (base_ms > 0.0 && ms > base_ms * (1.0 + max_time_regression)) {
+					failures.push_back(fmt::format("GPU frame time {:.3f} ms, baseline {:.3f} ms", ms, base_ms));
+				}
+				if (result.count("rel_mse") && base->count("rel_mse")) {
+					const double base_rel_mse = (*base)["rel_mse"];
+					if ((double)result["rel_mse"] > base_rel_mse * (1.0 + max_quality_regression)) {
+						failures.push_back(fmt::format("relMSE {:.4e}, baseline {:.4e}", (double)result["rel_mse"],
+													   base_rel_mse));
+					}
+				}
+			}
+			result["failures"] = failures;
+			result["passed"] = failures.empty();
+			passed &= failures.empty();
+			report["runs"].push_back(result);
+		}
+		free(reference);
+	}
+	report["passed"] = passed;
+	const std::string report_path = (output_dir / "report.json").string();
+	std::ofstream(report_path) << report.dump(4);
+
+	LUMEN_TRACE("{:<24} {:<14} {:>7} {:>10} {:>11} {:>7} {:>10} {:>9}  {}", "Run", "Integrator", "Frames", "GPU ms",
+				"relMSE", "FLIP", "Mean lum", "Mem MB", "Status");
+	for (const json& result : report["runs"]) {
+		auto num = [&](const char* key, const char* format) {
+			return result.count(key) ? fmt::format(fmt::runtime(format), (double)result[key]) : std::string("-");
+		};
+		std::string status = result["passed"].get<bool>() ? "ok" : "FAILED";
+		for (const std::string failure : result["failures"]) {
+			status += ": " + failure;
+		}
+		LUMEN_TRACE("{:<24} {:<14} {:>7} {:>10} {:>11} {:>7} {:>10} {:>9}  {}", std::string(result["name"]),
+					std::string(result["integrator"]), num("frames", "{:.0f}"), num("gpu_frame_ms", "{:.3f}"),
+					num("rel_mse", "{:.4e}"), num("flip", "{:.4f}"), num("mean_luminance", "{:.5f}"),
+					num("peak_memory_mb", "{:.0f}"), status);
+	}
+	LUMEN_TRACE("Benchmark report written to {}, {}", report_path, passed ? "passed" : "failed");
+	return passed ? 0 : 1;
+}
+}  // namespace Benchmark
@@ -0,0 +1,37 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Regression and performance runs over a matrix of scenes and integrators. Every run is a separate process of the
+// renderer, so that a crash or a device loss only fails its own entry. The outputs are compared against their
+// references on the CPU and the results are written to <output_dir>/report.json along with a summary table.
+// Matrix file:
+// {
+//   "output_dir": "benchmark",
+//   "spp": 64,                  frames of accumulation per run, or
+//   "time_budget": 0,           seconds per run, whichever comes first (0 disables either)
+//   "baseline": "report.json",  earlier report to detect regressions against, --baseline overrides it
+//   "thresholds": {"rel_mse": 0.05, "flip": 0.1, "energy": 0.02, "time_regression": 0.1, "quality_regression": 0.1},
+//   "runs": [{"scene": "scenes/x.json", "integrators": ["path", "bdpt"], "reference": "refs/x.exr",
+//             "spp": 128, "args": ["--half-precision"], "name": "x_fp16"}]
+// }
+// The name defaults to the scene file name, runs of the same scene with different arguments need their own
+// Regressions are relative: a run fails when its GPU frame time or relMSE exceeds the baseline by the given fraction.
+// The energy threshold bounds the deviation of the mean luminance from the one of the reference
+namespace Benchmark {
+
+// Collected by a renderer process started with --stats
+struct RunStats {
+	uint32_t frames = 0;
+	double elapsed_s = 0.0;
+	// Per pass GPU time summed over the timed frames. Passes recorded several times per frame add up
+	std::vector<std::pair<std::string, double>> pass_ms;
+	double gpu_frame_ms = 0.0;
+	uint32_t timed_frames = 0;
+	uint64_t peak_memory = 0;
+	void add_frame(const GPUQueryManager::TimestampData& timestamps);
+};
+
+void write_run_stats(const RunStats& stats, const std::string& path);
+// Handles --benchmark <matrix.json> [--baseline <report.json>]
+int run(int argc, char* argv[]);
+}  // namespace Benchmark
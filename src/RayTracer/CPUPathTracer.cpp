@@ -0,0 +1,462 @@
+#include "LumenPCH.h"
+#include "CPUPathTracer.h"
+#include "Framework/ImageUtils.h"
+#include "shaders/sampling.h"
+
+#define RR_MIN_DEPTH 3
+
+static constexpr float INV_PI = 0.31830988618f;
+static constexpr float TWO_PI = 6.28318530718f;
+
+// Same integer offsetting as offset_ray() in utils.glsl
+static glm::vec3 offset_ray(const glm::vec3& p, const glm::vec3& n) {
+	const float origin = 1.0f / 32.0f;
+	const float float_scale = 1.0f / 65536.0f;
+	const float int_scale = 256.0f;
+	glm::vec3 res;
+	for (int a = 0; a < 3; a++) {
+		const int of_i = int(int_scale * n[a]);
+		const float p_i = std::bit_cast<float>(std::bit_cast<int>(p[a]) + (p[a] < 0 ? -of_i : of_i));
+		res[a] = std::abs(p[a]) < origin ? p[a] + float_scale * n[a] : p_i;
+	}
+	return res;
+}
+
+static float luminance(const glm::vec3& c) { return glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f)); }
+
+static glm::vec3 to_world(const glm::vec3& v, const glm::vec3& n) {
+	const glm::vec3 t = std::abs(n.x) > std::abs(n.z) ? glm::normalize(glm::vec3(-n.y, n.x, 0.0f))
+													   : glm::normalize(glm::vec3(0.0f, -n.z, n.y));
+	const glm::vec3 b = glm::cross(n, t);
+	return v.x * t + v.y * b + v.z * n;
+}
+
+// eta is the ratio of the incident and transmitted indices of refraction
+static float fresnel_dielectric(float cos_i, float eta) {
+	const float sin2_t = eta * eta * std::max(0.0f, 1.0f - cos_i * cos_i);
+	if (sin2_t >= 1.0f) {
+		return 1.0f;
+	}
+	const float cos_t = std::sqrt(1.0f - sin2_t);
+	const float rs = (eta * cos_i - cos_t) / (eta * cos_i + cos_t);
+	const float rp = (cos_i - eta * cos_t) / (cos_i + eta * cos_t);
+	return 0.5f * (rs * rs + rp * rp);
+}
+
+static glm::vec3 fresnel_conductor(float cos_i, const glm::vec3& eta, const glm::vec3& k) {
+	cos_i = glm::clamp(cos_i, 0.0f, 1.0f);
+	const float cos2 = cos_i * cos_i;
+	const float sin2 = 1.0f - cos2;
+	const glm::vec3 eta2 = eta * eta;
+	const glm::vec3 k2 = k * k;
+	const glm::vec3 t0 = eta2 - k2 - sin2;
+	const glm::vec3 a2b2 = glm::sqrt(glm::max(t0 * t0 + 4.0f * eta2 * k2, 0.0f));
+	const glm::vec3 t1 = a2b2 + cos2;
+	const glm::vec3 a = glm::sqrt(glm::max(0.5f * (a2b2 + t0), 0.0f));
+	const glm::vec3 t2 = 2.0f * cos_i * a;
+	const glm::vec3 rs = (t1 - t2) / (t1 + t2);
+	const glm::vec3 t3 = cos2 * a2b2 + sin2 * sin2;
+	const glm::vec3 t4 = t2 * sin2;
+	const glm::vec3 rp = rs * (t3 - t4) / (t3 + t4);
+	return 0.5f * (rp + rs);
+}
+
+// Glossy and layered lobes are traced in their smooth or diffuse limit
+static bool is_diffuse(const Material& mat) {
+	return mat.bsdf_type == BSDF_TYPE_DIFFUSE || mat.bsdf_type == BSDF_TYPE_PRINCIPLED;
+}
+
+CPUPathTracer::CPUPathTracer(LumenScene* scene, uint32_t width, uint32_t height)
+	: scene(scene), width(width), height(height) {
+	scene->create_camera((float)width / height);
+	scene->camera->update_view_matrix();
+	inv_view = glm::inverse(scene->camera->view);
+	inv_projection = glm::inverse(scene->camera->projection);
+	max_depth = scene->config->path_length;
+	sky_col = scene->config->sky_col;
+	output.resize(4 * size_t(width) * height);
+}
+
+void CPUPathTracer::build() {
+	auto t_begin = std::chrono::high_resolution_clock::now();
+	world_vertices.clear();
+	triangle_infos.clear();
+	mesh_triangle_offsets.resize(scene->prim_meshes.size());
+	normal_matrices.resize(scene->prim_meshes.size());
+	for (uint32_t m = 0; m < scene->prim_meshes.size(); m++) {
+		const LumenPrimMesh& pm = scene->prim_meshes[m];
+		mesh_triangle_offsets[m] = (uint32_t)triangle_infos.size();
+		normal_matrices[m] = glm::transpose(glm::inverse(glm::mat3(pm.world_matrix)));
+		for (uint32_t i = 0; i < pm.idx_count / 3; i++) {
+			const uint32_t first_idx = pm.first_idx + 3 * i;
+			for (uint32_t v = 0; v < 3; v++) {
+				const glm::vec3& p = scene->positions[pm.vtx_offset + scene->indices[first_idx + v]];
+				world_vertices.push_back(glm::vec3(pm.world_matrix * glm::vec4(p, 1.0f)));
+			}
+			triangle_infos.push_back({first_idx, m});
+		}
+	}
+
+	light_pdf_area.assign(triangle_infos.size(), 0.0f);
+	const float num_lights = (float)scene->gpu_lights.size();
+	for (const Light& light : scene->gpu_lights) {
+		if ((light.light_flags & 0x7) != LIGHT_AREA) {
+			continue;
+		}
+		const uint32_t offset = mesh_triangle_offsets[light.prim_mesh_idx];
+		for (uint32_t i = 0; i < light.num_triangles; i++) {
+			const glm::vec3* v = &world_vertices[3 * (offset + i)];
+			const float area = 0.5f * glm::length(glm::cross(v[1] - v[0], v[2] - v[0]));
+			light_pdf_area[offset + i] = area > 0.0f ? 1.0f / (num_lights * light.num_triangles * area) : 0.0f;
+		}
+	}
+
+	bvh.build(world_vertices);
+	auto t_end = std::chrono::high_resolution_clock::now();
+	render_stats.build_ms = std::chrono::duration<double, std::milli>(t_end - t_begin).count();
+}
+
+void CPUPathTracer::render(uint32_t spp) {
+	std::fill(output.begin(), output.end(), 0.0f);
+	auto t_begin = std::chrono::high_resolution_clock::now();
+	const uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+	const uint32_t tiles_y = (height + tile_size - 1) / tile_size;
+	std::vector<uint64_t> tile_rays(tiles_x * tiles_y, 0);
+	std::vector<std::future<void>> futures;
+	futures.reserve(tile_rays.size());
+	for (uint32_t ty = 0; ty < tiles_y; ty++) {
+		for (uint32_t tx = 0; tx < tiles_x; tx++) {
+			uint64_t* num_rays = &tile_rays[ty * tiles_x + tx];
+			futures.push_back(lumen::ThreadPool::submit(
+				[this, tx, ty, spp, num_rays] { render_tile(tx * tile_size, ty * tile_size, spp, *num_rays); }));
+		}
+	}
+	for (auto& f : futures) {
+		f.get();
+	}
+	auto t_end = std::chrono::high_resolution_clock::now();
+	render_stats.render_ms = std::chrono::duration<double, std::milli>(t_end - t_begin).count();
+	render_stats.num_rays = std::accumulate(tile_rays.begin(), tile_rays.end(), uint64_t(0));
+}
+
+void CPUPathTracer::render_tile(uint32_t x0, uint32_t y0, uint32_t spp, uint64_t& num_rays) {
+	const uint32_t x1 = std::min(x0 + tile_size, width);
+	const uint32_t y1 = std::min(y0 + tile_size, height);
+	const glm::vec3 origin = glm::vec3(inv_view * glm::vec4(0, 0, 0, 1));
+	uint64_t rays = 0;
+	for (uint32_t y = y0; y < y1; y++) {
+		for (uint32_t x = x0; x < x1; x++) {
+			glm::vec3 col(0.0f);
+			for (uint32_t s = 0; s < spp; s++) {
+				uvec4 sampler(x, y, s, 0);
+				const glm::vec2 jitter(sample_ld(sampler, SAMPLER_SOBOL), sample_ld(sampler, SAMPLER_SOBOL));
+				const glm::vec2 uv = (glm::vec2(x, y) + jitter) / glm::vec2(width, height);
+				const glm::vec2 d = uv * 2.0f - 1.0f;
+				// Same camera model as sample_camera() in commons.glsl
+				const glm::vec4 target = inv_projection * glm::vec4(d.x, d.y, 1, 1);
+				lumen::CPUBVH::Ray ray;
+				ray.o = origin;
+				ray.d = glm::normalize(glm::vec3(inv_view * glm::vec4(glm::normalize(glm::vec3(target)), 0)));
+				ray.t_min = 0.001f;
+				ray.t_max = 10000.0f;
+				const glm::vec3 sample_col = trace_path(sampler, ray, rays);
+				if (!std::isnan(luminance(sample_col))) {
+					col += sample_col;
+				}
+			}
+			col /= float(spp);
+			float* dst = &output[4 * (size_t(y) * width + x)];
+			dst[0] = col.x;
+			dst[1] = col.y;
+			dst[2] = col.z;
+			dst[3] = 1.0f;
+		}
+	}
+	num_rays = rays;
+}
+
+glm::vec3 CPUPathTracer::trace_path(uvec4& sampler, lumen::CPUBVH::Ray ray, uint64_t& num_rays) const {
+	glm::vec3 col(0.0f);
+	glm::vec3 throughput(1.0f);
+	bool last_specular = true;
+	float prev_bsdf_pdf = 0.0f;
+	for (uint32_t depth = 0;; depth++) {
+		lumen::CPUBVH::Hit hit;
+		num_rays++;
+		if (!bvh.intersect(ray, hit)) {
+			col += throughput * sky_col;
+			break;
+		}
+		const SurfaceInteraction si = surface_interaction(ray, hit);
+		const Material& mat = scene->materials[si.material_idx];
+		if (mat.emissive_factor != glm::vec3(0.0f)) {
+			if (last_specular) {
+				col += throughput * mat.emissive_factor;
+			} else if (light_pdf_area[si.triangle_idx] > 0.0f) {
+				// BSDF sampled half of the MIS estimator from the previous vertex
+				const float cos_light = std::abs(glm::dot(si.n_g, ray.d));
+				const float light_pdf_w = light_pdf_area[si.triangle_idx] * hit.t * hit.t / cos_light;
+				col += throughput * mat.emissive_factor * prev_bsdf_pdf / (prev_bsdf_pdf + light_pdf_w);
+			}
+		}
+		// Unsigned, a path length of 0 must not wrap
+		if (depth + 1 >= max_depth) {
+			break;
+		}
+		const glm::vec3 wo = -ray.d;
+		const bool front_face = glm::dot(si.n_g, wo) > 0.0f;
+		const glm::vec3 n_g = front_face ? si.n_g : -si.n_g;
+		glm::vec3 n_s = si.n_s;
+		if (glm::dot(n_g, n_s) < 0.0f) {
+			n_s = -n_s;
+		}
+		if (is_diffuse(mat)) {
+			col += throughput * sample_lights(sampler, si, n_s, n_g, mat, num_rays);
+		}
+		BSDFSample bs;
+		if (!sample_bsdf(sampler, mat, wo, n_s, n_g, front_face, bs)) {
+			break;
+		}
+		throughput *= bs.weight;
+		last_specular = bs.specular;
+		prev_bsdf_pdf = bs.pdf;
+		ray.o = offset_ray(si.pos, glm::dot(bs.wi, n_g) > 0.0f ? n_g : -n_g);
+		ray.d = bs.wi;
+		ray.t_min = 0.0f;
+		ray.t_max = 10000.0f;
+
+		float rr_scale = 1.0f;
+		if (mat.bsdf_props & BSDF_FLAG_TRANSMISSION) {
+			rr_scale *= front_face ? 1.0f / mat.ior : mat.ior;
+		}
+		if (depth > RR_MIN_DEPTH) {
+			const float rr_prob = std::min(0.95f, luminance(throughput) * rr_scale);
+			if (rr_prob == 0.0f || rr_prob < sample_ld(sampler, SAMPLER_SOBOL)) {
+				break;
+			}
+			throughput /= rr_prob;
+		}
+	}
+	return col;
+}
+
+CPUPathTracer::SurfaceInteraction CPUPathTracer::surface_interaction(const lumen::CPUBVH::Ray& ray,
+																	 const lumen::CPUBVH::Hit& hit) const {
+	SurfaceInteraction si;
+	const TriangleInfo& info = triangle_infos[hit.triangle_idx];
+	const LumenPrimMesh& pm = scene->prim_meshes[info.prim_mesh_idx];
+	const glm::vec3* v = &world_vertices[3 * hit.triangle_idx];
+	const glm::vec3 e1 = v[1] - v[0];
+	const glm::vec3 e2 = v[2] - v[0];
+	si.pos = v[0] + hit.u * e1 + hit.v * e2;
+	si.n_g = glm::normalize(glm::cross(e1, e2));
+	si.n_s = si.n_g;
+	if (scene->normals.size() == scene->positions.size()) {
+		const glm::vec3& n0 = scene->normals[pm.vtx_offset + scene->indices[info.first_idx + 0]];
+		const glm::vec3& n1 = scene->normals[pm.vtx_offset + scene->indices[info.first_idx + 1]];
+		const glm::vec3& n2 = scene->normals[pm.vtx_offset + scene->indices[info.first_idx + 2]];
+		const glm::vec3 n = normal_matrices[info.prim_mesh_idx] * ((1.0f - hit.u - hit.v) * n0 + hit.u * n1 + hit.v * n2);
+		if (glm::dot(n, n) > 0.0f) {
+			si.n_s = glm::normalize(n);
+		}
+	}
+	si.material_idx = pm.material_idx;
+	si.triangle_idx = hit.triangle_idx;
+	return si;
+}
+
+glm::vec3 CPUPathTracer::sample_lights(uvec4& sampler, const SurfaceInteraction& si, const glm::vec3& n_s,
+									   const glm::vec3& n_g, const Material& mat, uint64_t& num_rays) const {
+	const uint32_t num_lights = (uint32_t)scene->gpu_lights.size();
+	if (!num_lights) {
+		return glm::vec3(0.0f);
+	}
+	glm::vec4 u;
+	for (int i = 0; i < 4; i++) {
+		u[i] = sample_ld(sampler, SAMPLER_SOBOL);
+	}
+	const Light& light = scene->gpu_lights[std::min(uint32_t(u.x * num_lights), num_lights - 1)];
+	glm::vec3 wi;
+	float wi_len;
+	float pdf_w;
+	glm::vec3 Le;
+	bool is_delta = true;
+	switch (light.light_flags & 0x7) {
+		case LIGHT_AREA: {
+			const uint32_t tri = mesh_triangle_offsets[light.prim_mesh_idx] +
+								 std::min(uint32_t(u.y * light.num_triangles), light.num_triangles - 1);
+			if (light_pdf_area[tri] == 0.0f) {
+				return glm::vec3(0.0f);
+			}
+			const glm::vec3* v = &world_vertices[3 * tri];
+			const float su = std::sqrt(u.z);
+			const glm::vec3 p = (1.0f - su) * v[0] + su * (1.0f - u.w) * v[1] + su * u.w * v[2];
+			const glm::vec3 n_light = glm::normalize(glm::cross(v[1] - v[0], v[2] - v[0]));
+			wi = p - si.pos;
+			const float wi_len_sqr = glm::dot(wi, wi);
+			wi_len = std::sqrt(wi_len_sqr);
+			wi /= wi_len;
+			const float cos_light = std::abs(glm::dot(n_light, wi));
+			if (cos_light <= 0.0f) {
+				return glm::vec3(0.0f);
+			}
+			pdf_w = light_pdf_area[tri] * wi_len_sqr / cos_light;
+			Le = scene->materials[scene->prim_meshes[light.prim_mesh_idx].material_idx].emissive_factor;
+			is_delta = false;
+		} break;
+		case LIGHT_SPOT: {
+			wi = light.pos - si.pos;
+			const float wi_len_sqr = glm::dot(wi, wi);
+			wi_len = std::sqrt(wi_len_sqr);
+			wi /= wi_len;
+			const float cos_light = glm::dot(-wi, glm::normalize(light.to - light.pos));
+			const float cos_width = std::cos(glm::pi<float>() / 6);
+			const float cos_faloff = std::cos(25 * glm::pi<float>() / 180);
+			float faloff = 1.0f;
+			if (cos_light < cos_width) {
+				faloff = 0.0f;
+			} else if (cos_light < cos_faloff) {
+				const float d = (cos_light - cos_width) / (cos_faloff - cos_width);
+				faloff = (d * d) * (d * d);
+			}
+			pdf_w = wi_len_sqr / num_lights;
+			Le = light.L * faloff;
+		} break;
+		case LIGHT_DIRECTIONAL: {
+			wi = glm::normalize(light.pos - light.to);
+			wi_len = 2.0f * light.world_radius;
+			pdf_w = 1.0f / num_lights;
+			Le = light.L;
+		} break;
+		default:
+			return glm::vec3(0.0f);
+	}
+	const float cos_x = glm::dot(n_s, wi);
+	if (cos_x <= 0.0f || glm::dot(n_g, wi) <= 0.0f || Le == glm::vec3(0.0f)) {
+		return glm::vec3(0.0f);
+	}
+	lumen::CPUBVH::Ray shadow_ray;
+	shadow_ray.o = offset_ray(si.pos, n_g);
+	shadow_ray.d = wi;
+	shadow_ray.t_max = wi_len * (1.0f - 1e-4f);
+	num_rays++;
+	if (bvh.occluded(shadow_ray)) {
+		return glm::vec3(0.0f);
+	}
+	const glm::vec3 f = mat.albedo * INV_PI;
+	const float bsdf_pdf = cos_x * INV_PI;
+	const float mis_weight = is_delta ? 1.0f : pdf_w / (pdf_w + bsdf_pdf);
+	return mis_weight * f * cos_x * Le / pdf_w;
+}
+
+bool CPUPathTracer::sample_bsdf(uvec4& sampler, const Material& mat, const glm::vec3& wo, const glm::vec3& n_s,
+								const glm::vec3& n_g, bool front_face, BSDFSample& bs) const {
+	const float u0 = sample_ld(sampler, SAMPLER_SOBOL);
+	const float u1 = sample_ld(sampler, SAMPLER_SOBOL);
+	const float cos_o = glm::dot(wo, n_s);
+	switch (mat.bsdf_type) {
+		case BSDF_TYPE_MIRROR:
+		case BSDF_TYPE_CONDUCTOR: {
+			bs.wi = glm::reflect(-wo, n_s);
+			bs.weight = mat.bsdf_type == BSDF_TYPE_MIRROR ? mat.albedo : fresnel_conductor(cos_o, mat.albedo, mat.k);
+			bs.pdf = 0.0f;
+			bs.specular = true;
+			return true;
+		}
+		case BSDF_TYPE_GLASS:
+		case BSDF_TYPE_DIELECTRIC: {
+			const float eta = front_face ? 1.0f / mat.ior : mat.ior;
+			const bool reflection = mat.bsdf_type == BSDF_TYPE_GLASS || (mat.bsdf_props & BSDF_FLAG_REFLECTION);
+			const bool transmission = mat.bsdf_type == BSDF_TYPE_GLASS || (mat.bsdf_props & BSDF_FLAG_TRANSMISSION);
+			const float F = fresnel_dielectric(std::abs(cos_o), eta);
+			float reflect_prob = reflection ? (transmission ? F : 1.0f) : 0.0f;
+			const glm::vec3 refracted = glm::refract(-wo, n_s, eta);
+			if (refracted == glm::vec3(0.0f)) {
+				// Total internal reflection
+				reflect_prob = 1.0f;
+			}
+			bs.specular = true;
+			bs.pdf = 0.0f;
+			if (u0 < reflect_prob) {
+				bs.wi = glm::reflect(-wo, n_s);
+				bs.weight = mat.albedo * (transmission ? 1.0f : F);
+			} else {
+				bs.wi = glm::normalize(refracted);
+				bs.weight = mat.albedo * (reflection ? 1.0f : 1.0f - F);
+			}
+			return bs.weight != glm::vec3(0.0f);
+		}
+		default: {
+			// Cosine weighted hemisphere
+			const float r = std::sqrt(u0);
+			const float phi = TWO_PI * u1;
+			const glm::vec3 local(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u0)));
+			bs.wi = to_world(local, n_s);
+			bs.pdf = local.z * INV_PI;
+			if (bs.pdf <= 0.0f || glm::dot(bs.wi, n_g) <= 0.0f) {
+				return false;
+			}
+			bs.weight = mat.albedo;
+			bs.specular = false;
+			return true;
+		}
+	}
+}
+
+void CPUPathTracer::save_exr(const std::string& path) const {
+	ImageUtils::save_exr(output.data(), width, height, path.c_str());
+}
+
+int CPUPathTracer::run(int argc, char* argv[]) {
+	const bool benchmark = std::string(argv[1]) == "--cpu-benchmark";
+	std::vector<std::string> scene_paths;
+	uint32_t width = benchmark ? 640 : 1280;
+	uint32_t height = benchmark ? 360 : 720;
+	uint32_t spp = benchmark ? 4 : 64;
+	std::string output_path = "cpu_output.exr";
+	std::regex fn("(.*).(.json|.xml)");
+	for (int i = 2; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (std::regex_match(arg, fn)) {
+			scene_paths.push_back(arg);
+		} else if (arg == "--spp" && i + 1 < argc) {
+			spp = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--res" && i + 1 < argc) {
+			if (std::sscanf(argv[++i], "%ux%u", &width, &height) != 2 || !width || !height) {
+				LUMEN_ERROR("Expected the resolution as WIDTHxHEIGHT");
+			}
+		} else if (arg == "--output" && i + 1 < argc) {
+			output_path = argv[++i];
+		}
+	}
+	if (scene_paths.empty()) {
+		if (!benchmark) {
+			scene_paths.push_back("scenes/caustics.json");
+		} else {
+			// Every bundled scene
+			for (const auto& entry : std::filesystem::recursive_directory_iterator("scenes")) {
+				if (entry.is_regular_file() && std::regex_match(entry.path().string(), fn)) {
+					scene_paths.push_back(entry.path().string());
+				}
+			}
+			std::sort(scene_paths.begin(), scene_paths.end());
+		}
+	}
+
+	for (const std::string& scene_path : scene_paths) {
+		LumenScene scene;
+		scene.load_scene(scene_path, /* host_only = */ true);
+		CPUPathTracer tracer(&scene, width, height);
+		tracer.build();
+		tracer.render(spp);
+		const Stats& stats = tracer.stats();
+		LUMEN_TRACE("{}: {} triangles, {} BVH nodes built in {:.1f} ms, {}x{} @ {} spp in {:.1f} ms, {:.2f} Mrays/s",
+					scene_path, tracer.bvh.triangle_count(), tracer.bvh.node_count(), stats.build_ms, width, height,
+					spp, stats.render_ms, stats.mrays_per_sec());
+		if (!benchmark) {
+			tracer.save_exr(output_path);
+			LUMEN_TRACE("Saved {}", output_path);
+		}
+	}
+	return 0;
+}
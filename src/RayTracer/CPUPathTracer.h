@@ -0,0 +1,75 @@
+#pragma once
+#include "../LumenPCH.h"
+#include "LumenScene.h"
+#include "Framework/CPUBVH.h"
+
+// Fallback path integrator that runs without a Vulkan device
+// Traces the host side LumenScene data through a 4-wide BVH in parallel tiles on the thread pool and mirrors the
+// estimator of the Path integrator: NEE with MIS for area lights, Russian roulette after RR_MIN_DEPTH
+class CPUPathTracer {
+   public:
+	struct Stats {
+		double build_ms = 0.0;
+		double render_ms = 0.0;
+		uint64_t num_rays = 0;
+		inline double mrays_per_sec() const { return render_ms > 0.0 ? num_rays / (render_ms * 1e3) : 0.0; }
+	};
+
+	CPUPathTracer(LumenScene* scene, uint32_t width, uint32_t height);
+	void build();
+	void render(uint32_t spp);
+	void save_exr(const std::string& path) const;
+	const Stats& stats() const { return render_stats; }
+	// Handles the --cpu and --cpu-benchmark command lines
+	static int run(int argc, char* argv[]);
+
+	uint32_t tile_size = 32;
+
+   private:
+	struct TriangleInfo {
+		uint32_t first_idx;
+		uint32_t prim_mesh_idx;
+	};
+
+	struct SurfaceInteraction {
+		glm::vec3 pos;
+		glm::vec3 n_g;
+		glm::vec3 n_s;
+		uint32_t material_idx;
+		uint32_t triangle_idx;
+	};
+
+	struct BSDFSample {
+		glm::vec3 wi;
+		glm::vec3 weight;
+		float pdf;
+		bool specular;
+	};
+
+	void render_tile(uint32_t x0, uint32_t y0, uint32_t spp, uint64_t& num_rays);
+	glm::vec3 trace_path(uvec4& sampler, lumen::CPUBVH::Ray ray, uint64_t& num_rays) const;
+	SurfaceInteraction surface_interaction(const lumen::CPUBVH::Ray& ray, const lumen::CPUBVH::Hit& hit) const;
+	glm::vec3 sample_lights(uvec4& sampler, const SurfaceInteraction& si, const glm::vec3& n_s,
+							const glm::vec3& n_g, const Material& mat, uint64_t& num_rays) const;
+	bool sample_bsdf(uvec4& sampler, const Material& mat, const glm::vec3& wo, const glm::vec3& n_s,
+					 const glm::vec3& n_g, bool front_face, BSDFSample& bs) const;
+
+	LumenScene* scene;
+	uint32_t width;
+	uint32_t height;
+	uint32_t max_depth;
+	glm::vec3 sky_col;
+	glm::mat4 inv_view;
+	glm::mat4 inv_projection;
+
+	lumen::CPUBVH bvh;
+	// Three world space vertices per triangle, in the order of LumenScene::prim_meshes
+	std::vector<glm::vec3> world_vertices;
+	std::vector<TriangleInfo> triangle_infos;
+	std::vector<uint32_t> mesh_triangle_offsets;
+	std::vector<glm::mat3> normal_matrices;
+	// Area measure pdf of picking a point on each emissive triangle through light sampling
+	std::vector<float> light_pdf_area;
+	std::vector<float> output;
+	Stats render_stats;
+};
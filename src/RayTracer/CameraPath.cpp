@@ -0,0 +1,90 @@
+#include "LumenPCH.h"
+#include "CameraPath.h"
+#include <tinygltf/json.hpp>
+
+using json = nlohmann::json;
+
+bool CameraPath::load(const std::string& path) {
+	std::ifstream in(path);
+	const json j = json::parse(in, nullptr, /* allow_exceptions = */ false);
+	if (j.is_discarded() || !j.count("frames")) {
+		LUMEN_WARN("Could not load the camera path {}", path);
+		return false;
+	}
+	scene = j.value("scene", "");
+	seed = j.value("seed", int64_t(0));
+	width = j.value("width", 1920u);
+	height = j.value("height", 1080u);
+	half_precision = j.value("half_precision", false);
+	path_length = j.value("path_length", 6);
+	frames.clear();
+	std::map<std::string, double> settings;
+	for (const json& f : j["frames"]) {
+		Frame& frame = frames.emplace_back();
+		// Stored as float bits, so that a replay starts from exactly the same transforms
+		for (int i = 0; i < 3; i++) {
+			frame.position[i] = std::bit_cast<float>(uint32_t(f["position"][i]));
+			frame.rotation[i] = std::bit_cast<float>(uint32_t(f["rotation"][i]));
+		}
+		frame.integrator = f.value("integrator", "path");
+		frame.reset = f.value("reset", false);
+		frame.render_scale = std::bit_cast<float>(f.value("render_scale", std::bit_cast<uint32_t>(1.0f)));
+		frame.animate = f.value("animate", false);
+		frame.anim_time = std::bit_cast<double>(f.value("anim_time", uint64_t(0)));
+		if (f.count("settings")) {
+			settings = f["settings"].get<std::map<std::string, double>>();
+		}
+		frame.settings = settings;
+	}
+	LUMEN_TRACE("Loaded camera path {} with {} frames", path, frames.size());
+	return !frames.empty();
+}
+
+bool CameraPath::save(const std::string& path) const {
+	json j;
+	j["scene"] = scene;
+	j["seed"] = seed;
+	j["width"] = width;
+	j["height"] = height;
+	j["half_precision"] = half_precision;
+	j["path_length"] = path_length;
+	json frames_json = json::array();
+	const std::map<std::string, double>* prev_settings = nullptr;
+	for (const Frame& frame : frames) {
+		json f;
+		f["position"] = json::array();
+		f["rotation"] = json::array();
+		for (int i = 0; i < 3; i++) {
+			f["position"].push_back(std::bit_cast<uint32_t>(frame.position[i]));
+			f["rotation"].push_back(std::bit_cast<uint32_t>(frame.rotation[i]));
+		}
+		f["integrator"] = frame.integrator;
+		f["reset"] = frame.reset;
+		f["render_scale"] = std::bit_cast<uint32_t>(frame.render_scale);
+		f["animate"] = frame.animate;
+		f["anim_time"] = std::bit_cast<uint64_t>(frame.anim_time);
+		if (!prev_settings || *prev_settings != frame.settings) {
+			f["settings"] = frame.settings;
+		}
+		prev_settings = &frame.settings;
+		frames_json.push_back(std::move(f));
+	}
+	j["frames"] = std::move(frames_json);
+	std::ofstream out(path);
+	out << j.dump(1);
+	if (!out) {
+		LUMEN_WARN("Could not write the camera path {}", path);
+		return false;
+	}
+	LUMEN_TRACE("Saved camera path with {} frames. [ {} ]", frames.size(), path);
+	return true;
+}
+
+uint64_t CameraPath::hash(const float* data, size_t count) {
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < count * sizeof(float); i++) {
+		h = (h ^ bytes[i]) * 1099511628211ull;
+	}
+	return h;
+}
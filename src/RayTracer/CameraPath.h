@@ -0,0 +1,34 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Camera transforms and settings of every frame of an interactive session, so that the same frames can be rendered
+// again by another build. Recorded with --record-camera <path.json> and written on exit, replayed with
+// --replay-camera <path.json> in a hidden window at the recorded size and with the recorded seed, see RayTracer
+struct CameraPath {
+	struct Frame {
+		glm::vec3 position{};
+		glm::vec3 rotation{};
+		// The integrator rendering the frame, as a scene config name
+		std::string integrator;
+		// Whether the accumulation restarts after the frame, from camera movement or changed settings
+		bool reset = false;
+		float render_scale = 1.0f;
+		bool animate = false;
+		double anim_time = 0.0;
+		// Integrator settings the frame was rendered with, see Integrator::get_settings. Only written when they
+		// change from the previous frame
+		std::map<std::string, double> settings;
+	};
+	std::string scene;
+	int64_t seed = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	bool half_precision = false;
+	int path_length = 6;
+	std::vector<Frame> frames;
+
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+	// FNV-1a of the bytes of an image, to compare the outputs of two replays
+	static uint64_t hash(const float* data, size_t count);
+};
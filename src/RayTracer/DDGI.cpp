@@ -178,18 +178,13 @@ void DDGI::init() {
 	});
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
+	lumen_scene->fill_scene_desc(desc);
 	// DDGI
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
 	desc.direct_lighting_addr = direct_lighting_buffer->get_device_address();
 	desc.probe_offsets_addr = probe_offsets_buffer->get_device_address();
 	desc.g_buffer_addr = g_buffer->get_device_address();
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, direct_lighting_addr, direct_lighting_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, probe_offsets_addr, probe_offsets_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, g_buffer_addr, g_buffer, vk::render_graph());
@@ -263,6 +258,7 @@ void DDGI::render() {
 								 {"src/shaders/ray_shadow.rmiss"},
 								 {"src/shaders/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
+					 .macros = {{"SCENE_TEX_IDX", 9}},
 					 .specialization_data = {1},
 					 .dims = {(uint32_t)rays_per_probe, grid_size},
 				 })
@@ -326,6 +322,8 @@ void DDGI::render() {
 									 {"src/shaders/integrators/ddgi/probe_vis.rchit"},
 									 {"src/shaders/ray.rahit"}},
 						 .dims = {Window::width(), Window::height()},
+						 // Only traces the probe spheres, whose binding 2 is not the scene description
+						 .alpha_masking = false,
 					 })
 			.push_constants(&pc_ray)
 			.bind({output_tex, scene_ubo_buffer, sphere_desc_buffer, lumen_scene->mesh_lights_buffer})
@@ -361,10 +359,7 @@ bool DDGI::gui() {
 	result |= ImGui::SliderFloat("Hysteresis", &hysteresis, 0.0f, 1.0f);
 	bool rpp_changed = ImGui::SliderInt("Rays per probe", (int*)&rays_per_probe, 1, 4096);
 	if (rpp_changed && (rays_per_probe > 0)) {
-		vkDeviceWaitIdle(vk::context().device);
-		prm::remove(rt.radiance_tex);
-		prm::remove(rt.dir_depth_tex);
-		create_radiance_textures();
+		recreate_radiance_textures();
 	}
 	result |= rpp_changed;
 	result |= ImGui::SliderFloat("Ray max distance", &tmax, 0.0f, 1000.0f);
@@ -401,6 +396,13 @@ void DDGI::update_ddgi_uniforms() {
 	vk::write_buffer(ddgi_ubo_buffer, &ddgi_ubo, sizeof(ddgi_ubo));
 }
 
+void DDGI::recreate_radiance_textures() {
+	vkDeviceWaitIdle(vk::context().device);
+	prm::remove(rt.radiance_tex);
+	prm::remove(rt.dir_depth_tex);
+	create_radiance_textures();
+}
+
 void DDGI::create_radiance_textures() {
 	uint32_t num_probes = probe_counts.x * probe_counts.y * probe_counts.z;
 	rt.radiance_tex = prm::get_texture({
@@ -427,7 +429,8 @@ void DDGI::create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases) {
 	VkDeviceAddress vertex_address = lumen_scene->vertex_buffer->get_device_address();
 	VkDeviceAddress idx_address = lumen_scene->index_buffer->get_device_address();
 	for (auto& prim_mesh : lumen_scene->prim_meshes) {
-		vk::BlasInput geo = vk::to_vk_geometry(prim_mesh, vertex_address, idx_address);
+		vk::BlasInput geo =
+			vk::to_vk_geometry(prim_mesh, vertex_address, idx_address, lumen_scene->is_alpha_masked(prim_mesh));
 		blas_inputs.push_back({geo});
 	}
 
@@ -472,7 +475,7 @@ void DDGI::create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases) {
 		ray_inst.accelerationStructureReference = blases[pm.prim_idx].get_blas_device_address();
 		ray_inst.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
 		ray_inst.mask = 0x1;
-		ray_inst.instanceShaderBindingTableRecordOffset = 0;
+		ray_inst.instanceShaderBindingTableRecordOffset = lumen_scene->is_alpha_masked(pm) ? vk::MASKED_HIT_GROUP_OFFSET : 0;
 		tlas_instances.emplace_back(ray_inst);
 	}
 
@@ -494,7 +497,11 @@ void DDGI::create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases) {
 			tlas_instances.emplace_back(sphere_inst);
 		}
 	}
-	vk::build_tlas(tlas, tlas_instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+	VkBuildAccelerationStructureFlagsKHR tlas_flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+	if (lumen_scene->has_animations()) {
+		tlas_flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+	}
+	vk::build_tlas(tlas, tlas_instances, tlas_flags);
 }
 
 glm::vec3 DDGI::probe_location(uint32_t index) {
@@ -547,3 +554,22 @@ void DDGI::destroy() {
 		prm::remove(depth_tex);
 	}
 }
+
+void DDGI::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("hysteresis", hysteresis);
+	visitor("rays_per_probe", rays_per_probe);
+	visitor("tmax", tmax);
+	visitor("tmin", tmin);
+	visitor("normal_bias", normal_bias);
+	visitor("infinite_bounces", infinite_bounces);
+	visitor("direct_lighting", direct_lighting);
+	visitor("visualize_probes", visualize_probes);
+}
+
+void DDGI::settings_changed(const Settings& prev) {
+	// Before init there are no textures to resize yet
+	if (rt.radiance_tex && rays_per_probe > 0 && prev.at("rays_per_probe") != rays_per_probe) {
+		recreate_radiance_textures();
+	}
+}
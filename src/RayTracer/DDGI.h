@@ -9,11 +9,14 @@ class DDGI final : public Integrator {
 	virtual void render() override;
 	virtual bool update() override;
 	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
+	virtual void settings_changed(const Settings& prev) override;
 	virtual void destroy() override;
 	virtual void create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases) override;
    private:
 	void update_ddgi_uniforms();
 	void create_radiance_textures();
+	void recreate_radiance_textures();
 
 	glm::vec3 probe_location(uint32_t index);
 	glm::ivec3 probe_index_to_grid_coord(uint32_t index);
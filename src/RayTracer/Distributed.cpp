@@ -0,0 +1,370 @@
+#include "LumenPCH.h"
+#include "Distributed.h"
+#include "TiledRenderer.h"
+#include "Framework/ImageUtils.h"
+
+namespace Distributed {
+
+// Consecutive failures after which a worker slot is no longer used, e.g. for a GPU that keeps losing its device
+static constexpr uint32_t MAX_SLOT_FAILURES = 2;
+
+struct Settings {
+	// Executable, followed by the scene for rendering workers
+	std::string worker_cmd;
+	std::string worker_args;
+	uint32_t workers = 2;
+	bool sample_jobs = false;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	VkExtent2D tile_extent = {960, 540};
+	uint32_t spp = 64;
+	uint32_t job_size = 0;
+	uint32_t retries = 2;
+	std::string output_path = "out.exr";
+};
+
+// Tiles [first, first + count), or samples [first, first + count) of every tile
+struct Job {
+	uint32_t idx = 0;
+	uint32_t first = 0;
+	uint32_t count = 0;
+	uint32_t attempts = 0;
+};
+
+static std::string quote(const std::string& s) { return "\"" + s + "\""; }
+
+static VkRect2D tile_rect(const Settings& settings, uint32_t tile_idx) {
+	const uint32_t tiles_x = (settings.width + settings.tile_extent.width - 1) / settings.tile_extent.width;
+	const uint32_t x = (tile_idx % tiles_x) * settings.tile_extent.width;
+	const uint32_t y = (tile_idx / tiles_x) * settings.tile_extent.height;
+	return {{int32_t(x), int32_t(y)},
+			{std::min(settings.tile_extent.width, settings.width - x),
+			 std::min(settings.tile_extent.height, settings.height - y)}};
+}
+
+// The tiles of every job share one directory, the sample jobs cover every tile and need their own
+static std::string job_dir(const Settings& settings, const std::filesystem::path& jobs_dir, const Job& job) {
+	return settings.sample_jobs ? (jobs_dir / ("samples_" + std::to_string(job.idx))).string() : jobs_dir.string();
+}
+
+static std::string job_command(const Settings& settings, const std::string& dir, const Job& job, uint32_t slot) {
+	const uint32_t num_tiles = TiledRenderer::num_tiles(settings.width, settings.height, settings.tile_extent);
+	std::string cmd = settings.worker_cmd + fmt::format(" --tiled {} {} --tile-size {} {} --output {} --device {}",
+														settings.width, settings.height, settings.tile_extent.width,
+														settings.tile_extent.height, quote(dir), slot);
+	if (settings.sample_jobs) {
+		cmd += fmt::format(" --tiles 0 {} --spp {} --sample-offset {} --seed {}", num_tiles, job.count, job.first,
+						   job.first + 1);
+	} else {
+		cmd += fmt::format(" --tiles {} {} --spp {}", job.first, job.count, settings.spp);
+	}
+	return cmd + settings.worker_args;
+}
+
+// RGBA32F pixels of a tile a worker left, nullptr if it is missing or does not have the size of the tile
+static float* load_tile(const std::string& path, const VkRect2D& rect) {
+	int width = 0, height = 0;
+	float* pixels = nullptr;
+	try {
+		pixels = std::filesystem::exists(path) ? ImageUtils::load_exr(path.c_str(), width, height) : nullptr;
+	} catch (const std::exception&) {
+		pixels = nullptr;
+	}
+	if (pixels && (uint32_t(width) != rect.extent.width || uint32_t(height) != rect.extent.height)) {
+		free(pixels);
+		pixels = nullptr;
+	}
+	return pixels;
+}
+
+static bool coordinate(const Settings& settings) {
+	const auto start = std::chrono::high_resolution_clock::now();
+	const uint32_t num_tiles = TiledRenderer::num_tiles(settings.width, settings.height, settings.tile_extent);
+	const std::filesystem::path jobs_dir = settings.output_path + ".jobs";
+	std::filesystem::remove_all(jobs_dir);
+	std::filesystem::create_directories(jobs_dir);
+
+	std::deque<Job> queue;
+	const uint32_t total = settings.sample_jobs ? settings.spp : num_tiles;
+	const uint32_t job_size =
+		settings.job_size > 0 ? settings.job_size : std::max(1u, total / (4 * std::max(1u, settings.workers)));
+	for (uint32_t first = 0; first < total; first += job_size) {
+		queue.push_back({uint32_t(queue.size()), first, std::min(job_size, total - first)});
+	}
+	const size_t num_jobs = queue.size();
+	LUMEN_TRACE("Distributed render of {}x{} in {} {} jobs on {} workers", settings.width, settings.height, num_jobs,
+				settings.sample_jobs ? "sample" : "tile", settings.workers);
+
+	ImageUtils::ExrTileWriter output(settings.output_path.c_str(), int(settings.width), int(settings.height));
+	std::mutex output_mutex;
+	// Tile jobs go straight into the output. Sample jobs only check that every tile came back, they are merged once
+	// all of them are done
+	auto collect = [&](const Job& job, const std::string& dir) {
+		const uint32_t first = settings.sample_jobs ? 0 : job.first;
+		const uint32_t count = settings.sample_jobs ? num_tiles : job.count;
+		for (uint32_t tile_idx = first; tile_idx < first + count; tile_idx++) {
+			const std::string path = TiledRenderer::tile_path(dir, tile_idx);
+			const VkRect2D rect = tile_rect(settings, tile_idx);
+			float* pixels = load_tile(path, rect);
+			if (!pixels) {
+				return false;
+			}
+			if (!settings.sample_jobs) {
+				std::lock_guard lock(output_mutex);
+				output.write(pixels, rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height,
+							 rect.extent.width);
+				std::filesystem::remove(path);
+			}
+			free(pixels);
+		}
+		return true;
+	};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<Job> sample_jobs;
+	uint32_t in_flight = 0;
+	uint32_t active_slots = settings.workers;
+	uint32_t reassigned = 0;
+	bool aborted = false;
+	auto slot_loop = [&](uint32_t slot) {
+		uint32_t consecutive_failures = 0;
+		while (true) {
+			Job job;
+			{
+				std::unique_lock lock(mutex);
+				// A job that is still running may fail and come back
+				cv.wait(lock, [&] { return aborted || !queue.empty() || in_flight == 0; });
+				if (aborted || queue.empty()) {
+					return;
+				}
+				job = queue.front();
+				queue.pop_front();
+				in_flight++;
+			}
+			const std::string dir = job_dir(settings, jobs_dir, job);
+			std::filesystem::create_directories(dir);
+			const std::string cmd = job_command(settings, dir, job, slot);
+			LUMEN_TRACE("Worker {}: {}", slot, cmd);
+			const int exit_code = std::system(cmd.c_str());
+			const bool completed = exit_code == 0 && collect(job, dir);
+
+			std::lock_guard lock(mutex);
+			in_flight--;
+			if (completed) {
+				consecutive_failures = 0;
+				if (settings.sample_jobs) {
+					sample_jobs.push_back(job);
+				}
+			} else if (++job.attempts > settings.retries) {
+				LUMEN_WARN("Job {} failed {} times, giving up", job.idx, job.attempts);
+				aborted = true;
+			} else {
+				LUMEN_WARN("Worker {} failed job {} ({}), reassigning it", slot, job.idx,
+						   exit_code == 0 ? "incomplete result" : fmt::format("exit status {}", exit_code));
+				queue.push_back(job);
+				reassigned++;
+			}
+			if (!completed && ++consecutive_failures == MAX_SLOT_FAILURES) {
+				LUMEN_WARN("Worker {} failed {} jobs in a row and is retired", slot, consecutive_failures);
+				active_slots--;
+				aborted |= active_slots == 0 && !queue.empty();
+				cv.notify_all();
+				return;
+			}
+			cv.notify_all();
+		}
+	};
+	std::vector<std::thread> slots;
+	for (uint32_t slot = 0; slot < settings.workers; slot++) {
+		slots.emplace_back(slot_loop, slot);
+	}
+	for (std::thread& slot : slots) {
+		slot.join();
+	}
+	if (aborted) {
+		LUMEN_WARN("Distributed render failed, the job results are kept in {}", jobs_dir.string());
+		return false;
+	}
+
+	if (settings.sample_jobs) {
+		// Every job returns the mean of its samples
+		for (uint32_t tile_idx = 0; tile_idx < num_tiles; tile_idx++) {
+			const VkRect2D rect = tile_rect(settings, tile_idx);
+			std::vector<float> merged(size_t(rect.extent.width) * rect.extent.height * 4, 0.0f);
+			for (const Job& job : sample_jobs) {
+				float* pixels = load_tile(TiledRenderer::tile_path(job_dir(settings, jobs_dir, job), tile_idx), rect);
+				if (!pixels) {
+					LUMEN_WARN("Tile {} of job {} disappeared", tile_idx, job.idx);
+					return false;
+				}
+				const float weight = float(job.count) / settings.spp;
+				for (size_t i = 0; i < merged.size(); i++) {
+					merged[i] += weight * pixels[i];
+				}
+				free(pixels);
+			}
+			output.write(merged.data(), rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height,
+						 rect.extent.width);
+		}
+	}
+	if (!output.good()) {
+		LUMEN_WARN("Could not write {}", settings.output_path);
+		return false;
+	}
+	std::filesystem::remove_all(jobs_dir);
+	const double elapsed_s =
+		std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	LUMEN_TRACE("Distributed render of {} jobs finished in {:.1f} s, {} reassigned. [ {} ]", num_jobs, elapsed_s,
+				reassigned, settings.output_path);
+	return true;
+}
+
+int run(int argc, char* argv[]) {
+	Settings settings;
+	settings.worker_cmd = quote(argv[0]) + " " + quote(argv[2]);
+	for (int i = 3; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg == "--workers" && i + 1 < argc) {
+			settings.workers = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--jobs" && i + 1 < argc) {
+			settings.sample_jobs = std::string(argv[++i]) == "samples";
+		} else if (arg == "--size" && i + 2 < argc) {
+			settings.width = std::stoi(argv[++i]);
+			settings.height = std::stoi(argv[++i]);
+		} else if (arg == "--tile-size" && i + 2 < argc) {
+			settings.tile_extent.width = std::stoi(argv[++i]);
+			settings.tile_extent.height = std::stoi(argv[++i]);
+		} else if (arg == "--spp" && i + 1 < argc) {
+			settings.spp = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--job-size" && i + 1 < argc) {
+			settings.job_size = std::stoi(argv[++i]);
+		} else if (arg == "--retries" && i + 1 < argc) {
+			settings.retries = std::stoi(argv[++i]);
+		} else if (arg == "--output" && i + 1 < argc) {
+			settings.output_path = argv[++i];
+		} else {
+			settings.worker_args += " " + quote(arg);
+		}
+	}
+	return coordinate(settings) ? 0 : 1;
+}
+
+// Contents of the synthetic workers. The red and green channels identify the pixel, the blue one is the mean of a
+// value that differs per sample, so that a wrong sample weighting shows up in the merged image
+static float sample_value(uint32_t x, uint32_t y, uint32_t sample) { return float((x + 2 * y + sample) % 7); }
+
+static glm::vec3 synthetic_pixel(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t first_sample,
+								 uint32_t num_samples) {
+	float sum = 0.0f;
+	for (uint32_t s = first_sample; s < first_sample + num_samples; s++) {
+		sum += sample_value(x, y, s);
+	}
+	return glm::vec3(float(x) / width, float(y) / height, sum / num_samples);
+}
+
+int synthetic_worker(int argc, char* argv[]) {
+	Settings settings;
+	uint32_t first_tile = 0, tile_count = 1, sample_offset = 0;
+	std::string dir;
+	for (int i = 2; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg == "--tiled" && i + 2 < argc) {
+			settings.width = std::stoi(argv[++i]);
+			settings.height = std::stoi(argv[++i]);
+		} else if (arg == "--tile-size" && i + 2 < argc) {
+			settings.tile_extent.width = std::stoi(argv[++i]);
+			settings.tile_extent.height = std::stoi(argv[++i]);
+		} else if (arg == "--tiles" && i + 2 < argc) {
+			first_tile = std::stoi(argv[++i]);
+			tile_count = std::stoi(argv[++i]);
+		} else if (arg == "--spp" && i + 1 < argc) {
+			settings.spp = std::stoi(argv[++i]);
+		} else if (arg == "--sample-offset" && i + 1 < argc) {
+			sample_offset = std::stoi(argv[++i]);
+		} else if (arg == "--output" && i + 1 < argc) {
+			dir = argv[++i];
+		}
+	}
+	// On their first attempt, every fourth job crashes after its first tile and the one after it exits normally
+	// without its last tile
+	const uint32_t job = first_tile / tile_count + sample_offset / settings.spp;
+	const std::filesystem::path attempted =
+		std::filesystem::path(dir) / fmt::format("attempted_{}_{}", first_tile, sample_offset);
+	const bool first_attempt = !std::filesystem::exists(attempted);
+	std::ofstream(attempted).close();
+	for (uint32_t tile_idx = first_tile; tile_idx < first_tile + tile_count; tile_idx++) {
+		if (first_attempt && job % 4 == 1 && tile_idx + 1 == first_tile + tile_count) {
+			return 0;
+		}
+		const VkRect2D rect = tile_rect(settings, tile_idx);
+		std::vector<float> pixels(size_t(rect.extent.width) * rect.extent.height * 4, 1.0f);
+		for (uint32_t y = 0; y < rect.extent.height; y++) {
+			for (uint32_t x = 0; x < rect.extent.width; x++) {
+				const glm::vec3 p = synthetic_pixel(rect.offset.x + x, rect.offset.y + y, settings.width,
+													settings.height, sample_offset, settings.spp);
+				std::copy(&p.x, &p.x + 3, &pixels[(size_t(y) * rect.extent.width + x) * 4]);
+			}
+		}
+		const std::string path = TiledRenderer::tile_path(dir, tile_idx);
+		ImageUtils::ExrTileWriter(path.c_str(), rect.extent.width, rect.extent.height, true)
+			.write(pixels.data(), 0, 0, rect.extent.width, rect.extent.height, rect.extent.width);
+		if (first_attempt && job % 4 == 3) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int check(int argc, char* argv[]) {
+	const uint32_t workers = argc > 2 ? std::max(1, std::stoi(argv[2])) : 3;
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "lumen_distributed_check";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+	bool valid = true;
+	for (const bool sample_jobs : {false, true}) {
+		Settings settings;
+		settings.worker_cmd = quote(argv[0]) + " --synthetic-worker";
+		settings.workers = workers;
+		settings.sample_jobs = sample_jobs;
+		// Edge tiles smaller than the tile size and uneven job sizes
+		settings.width = 301;
+		settings.height = 197;
+		settings.tile_extent = {64, 48};
+		settings.spp = 37;
+		settings.job_size = sample_jobs ? 5 : 3;
+		settings.output_path = (dir / (sample_jobs ? "samples.exr" : "tiles.exr")).string();
+		const char* name = sample_jobs ? "Sample jobs" : "Tile jobs";
+		if (!coordinate(settings)) {
+			LUMEN_WARN("{}: coordinator failed", name);
+			valid = false;
+			continue;
+		}
+		int width = 0, height = 0;
+		float* merged = ImageUtils::load_exr(settings.output_path.c_str(), width, height);
+		if (!merged || uint32_t(width) != settings.width || uint32_t(height) != settings.height) {
+			LUMEN_WARN("{}: output missing or of the wrong size", name);
+			free(merged);
+			valid = false;
+			continue;
+		}
+		// The output is stored in half precision
+		float max_error = 0.0f;
+		for (uint32_t y = 0; y < settings.height; y++) {
+			for (uint32_t x = 0; x < settings.width; x++) {
+				const glm::vec3 expected = synthetic_pixel(x, y, settings.width, settings.height, 0, settings.spp);
+				const float* p = &merged[(size_t(y) * width + x) * 4];
+				for (int c = 0; c < 3; c++) {
+					max_error = std::max(max_error, std::abs(p[c] - expected[c]) / std::max(1.0f, expected[c]));
+				}
+			}
+		}
+		free(merged);
+		LUMEN_TRACE("{}: max relative error {}", name, max_error);
+		valid &= max_error <= 1e-3f;
+	}
+	std::filesystem::remove_all(dir);
+	LUMEN_TRACE("Distributed rendering {}", valid ? "passed" : "failed");
+	return valid ? 0 : 1;
+}
+}  // namespace Distributed
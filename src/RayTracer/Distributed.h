@@ -0,0 +1,22 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Renders one frame with several renderer processes, e.g. one per GPU of a node:
+//   --distributed <scene> [--workers 2] [--jobs tiles|samples] [--size 1920 1080] [--tile-size 960 540] [--spp 64]
+//                 [--job-size 0] [--retries 2] [--output out.exr] [renderer arguments]
+// The coordinator splits the frame into jobs and keeps every worker slot busy with a renderer process per job, started
+// with --device <slot> so that the slots spread over the GPUs. A job is either a range of tiles, or every tile with a
+// range of samples (--sample-offset) and its own seed. Workers render through TiledRenderer and leave one full
+// precision .exr per tile in the job directory next to the output. Tile jobs are assembled into the output as they
+// come back, sample jobs are merged tile by tile once all of them are done, weighted by their sample counts, so the
+// coordinator never holds more than a tile either. --job-size is in tiles or samples, 0 for about four jobs per worker.
+// A job whose process fails or leaves an incomplete result is reassigned up to --retries times, and a slot that fails
+// twice in a row is retired. Arguments that are not listed above are forwarded to the workers
+namespace Distributed {
+int run(int argc, char* argv[]);
+// --distributed-check [workers]: both job types with synthetic workers, some of which crash or leave incomplete
+// results, against the known merged image. No GPU needed
+int check(int argc, char* argv[]);
+// --synthetic-worker: writes the tiles of a job like a renderer would, with known contents
+int synthetic_worker(int argc, char* argv[]);
+}  // namespace Distributed
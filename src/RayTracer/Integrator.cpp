@@ -4,38 +4,15 @@
 #include <Framework/Window.h>
 #include <stb_image/stb_image.h>
 #include "Framework/VkUtils.h"
+#include "Framework/MemoryBudget.h"
 
 void Integrator::init() {
-	lumen::Camera* cam_ptr = lumen_scene->camera.get();
-	Window::add_mouse_click_callback(
-		[this](MouseAction button, KeyAction action, double x, double y) {
-			if (ImGui::GetIO().WantCaptureMouse) {
-				return;
-			}
-			if (updated && Window::is_mouse_up(MouseAction::LEFT)) {
-				updated = true;
-			}
-			if (updated && Window::is_mouse_down(MouseAction::LEFT)) {
-				updated = true;
-			}
-		});
-	Window::add_mouse_move_callback(
-		[cam_ptr, this](double delta_x, double delta_y, double x, double y) {
-			if (ImGui::GetIO().WantCaptureMouse) {
-				return;
-			}
-			if (Window::is_mouse_held(MouseAction::LEFT) && !Window::is_key_held(KeyInput::KEY_TAB)) {
-				cam_ptr->rotate(0.05f * (float)delta_y, -0.05f * (float)delta_x, 0.0f);
-				updated = true;
-			}
-		});
-
 	output_tex = prm::get_texture({
 		.name = "Color Output",
 		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
 				 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
 		.dimensions = {Window::width(), Window::height() , 1},
-		.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+		.format = output_format,
 		.initial_layout = VK_IMAGE_LAYOUT_GENERAL,
 	});
 
@@ -46,6 +23,51 @@ void Integrator::init() {
 		.size = sizeof(SceneUBO),
 	});
 
+	if (supports_adaptive_sampling()) {
+		const uint32_t max_tiles = ((Window::width() + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE) *
+								   ((Window::height() + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+		adaptive_pixels_buffer =
+			prm::get_buffer({.name = "Adaptive Pixels",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = Window::width() * Window::height() * sizeof(AdaptivePixel)});
+		// Compacted list of the active tiles followed by a flag per tile
+		adaptive_tiles_buffer =
+			prm::get_buffer({.name = "Adaptive Tiles",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = 2 * max_tiles * sizeof(uint32_t)});
+		adaptive_counters_buffer =
+			prm::get_buffer({.name = "Adaptive Counters",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+									  VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = sizeof(AdaptiveCounters)});
+		for (AdaptiveReadback& readback : adaptive_readbacks) {
+			readback.buffer = prm::get_buffer({.name = "Adaptive Counters Readback",
+											   .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+											   .memory_type = vk::BufferType::GPU_TO_CPU,
+											   .size = sizeof(AdaptiveCounters)});
+			readback.age = -1;
+		}
+		adaptive_readback_idx = 0;
+	}
+
+	const VkDeviceSize aov_size =
+		std::popcount(enabled_aovs()) * VkDeviceSize(Window::width()) * Window::height() * sizeof(glm::vec4);
+	// AOVs are optional, they are dropped rather than going over the memory budget
+	if (aov_size && !MemoryBudget::fits(aov_size)) {
+		LUMEN_WARN("Skipping {:.1f} MB of AOVs, {:.1f} MB left", aov_size * 1e-6, MemoryBudget::available() * 1e-6);
+		aovs = 0;
+	} else if (aov_size) {
+		aov_buffer = prm::get_buffer({.name = "AOVs",
+									  .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+											   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+											   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+									  .memory_type = vk::BufferType::GPU,
+									  .size = aov_size});
+	}
+
 	update_uniform_buffers();
 }
 
@@ -57,6 +79,199 @@ bool Integrator::gui() {
 	return false;
 }
 
+Integrator::Settings Integrator::get_settings() {
+	Settings settings;
+	SettingsVisitor visitor{settings};
+	visit_settings(visitor);
+	return settings;
+}
+
+bool Integrator::set_settings(const Settings& settings) {
+	const Settings prev = get_settings();
+	Settings values = settings;
+	SettingsVisitor visitor{values, true};
+	visit_settings(visitor);
+	if (get_settings() == prev) {
+		return false;
+	}
+	settings_changed(prev);
+	return true;
+}
+
+void Integrator::visit_settings(SettingsVisitor& visitor) {
+	visitor("config.path_length", lumen_scene->config->path_length);
+	visitor("sampler", sampler_type);
+	visitor("splat_mode", splat_mode);
+	visitor("adaptive.enabled", adaptive.enabled);
+	visitor("adaptive.threshold", adaptive.threshold);
+	visitor("adaptive.min_samples", adaptive.min_samples);
+	visitor("adaptive.max_samples", adaptive.max_samples);
+}
+
+VkExtent2D Integrator::render_extent() const {
+	if (!supports_render_scale() || render_scale >= 1.0f) {
+		return {Window::width(), Window::height()};
+	}
+	return {std::max(1u, uint32_t(Window::width() * render_scale)),
+			std::max(1u, uint32_t(Window::height() * render_scale))};
+}
+
+std::vector<vk::ShaderMacro> Integrator::sampler_macros() const {
+	if (sampler_type == SAMPLER_PCG) {
+		return {};
+	}
+	return {vk::ShaderMacro("SAMPLER_TYPE", int(sampler_type))};
+}
+
+bool Integrator::sampler_gui() {
+	const char* samplers[] = {"PCG (white noise)", "Sobol (Owen scrambled)", "Sobol (blue noise dithered)"};
+	int idx = int(sampler_type);
+	if (ImGui::Combo("Sampler", &idx, samplers, IM_ARRAYSIZE(samplers))) {
+		sampler_type = uint32_t(idx);
+		return true;
+	}
+	return false;
+}
+
+std::vector<vk::ShaderMacro> Integrator::splat_macros() const {
+	uint32_t mode = splat_mode;
+	if (mode == SPLAT_SUBGROUP) {
+		const VkPhysicalDeviceSubgroupProperties& props = vk::context().subgroup_props;
+		const VkSubgroupFeatureFlags ops =
+			VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+		const bool raygen = props.supportedStages & VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+		if (!raygen || (props.supportedOperations & ops) != ops) {
+			mode = SPLAT_ATOMIC;
+		}
+	}
+	return {vk::ShaderMacro("SPLAT_MODE", int(mode))};
+}
+
+bool Integrator::splat_gui() {
+	const char* modes[] = {"Racy", "Atomic", "Subgroup atomic"};
+	int idx = int(splat_mode);
+	if (ImGui::Combo("Splat accumulation", &idx, modes, IM_ARRAYSIZE(modes))) {
+		splat_mode = uint32_t(idx);
+		return true;
+	}
+	return false;
+}
+
+void Integrator::set_adaptive_addrs(SceneDesc& desc) {
+	if (!supports_adaptive_sampling()) {
+		desc.adaptive_pixels_addr = desc.adaptive_tiles_addr = desc.adaptive_counters_addr = 0;
+		return;
+	}
+	desc.adaptive_pixels_addr = adaptive_pixels_buffer->get_device_address();
+	desc.adaptive_tiles_addr = adaptive_tiles_buffer->get_device_address();
+	desc.adaptive_counters_addr = adaptive_counters_buffer->get_device_address();
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, adaptive_pixels_addr, adaptive_pixels_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, adaptive_tiles_addr, adaptive_tiles_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, adaptive_counters_addr, adaptive_counters_buffer,
+								 vk::render_graph());
+}
+
+void Integrator::set_aov_addrs(SceneDesc& desc) {
+	if (!aov_buffer) {
+		desc.aov_addr = 0;
+		return;
+	}
+	desc.aov_addr = aov_buffer->get_device_address();
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, aov_addr, aov_buffer, vk::render_graph());
+}
+
+std::vector<vk::ShaderMacro> Integrator::aov_macros() const {
+	if (!enabled_aovs()) {
+		return {};
+	}
+	return {vk::ShaderMacro("AOVS", int(enabled_aovs()))};
+}
+
+void Integrator::add_adaptive_mask_pass(VkExtent2D extent) {
+	AdaptivePC pc{
+		.size_x = extent.width,
+		.size_y = extent.height,
+		.frame_num = frame_num,
+		.min_samples = std::max(adaptive.min_samples, 1u),
+		.max_samples = adaptive.max_samples,
+		.threshold = adaptive.threshold,
+	};
+	vk::render_graph()
+		->add_compute("Adaptive Sampling Mask",
+					  {.shader = vk::Shader("src/shaders/adaptive/update_mask.comp"),
+					   .dims = {(extent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE,
+								(extent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE, 1}})
+		.push_constants(&pc)
+		.bind(lumen_scene->scene_desc_buffer)
+		.zero(adaptive_counters_buffer);
+}
+
+uint32_t Integrator::adaptive_launch_tiles(VkExtent2D extent, bool exact) {
+	const uint32_t num_tiles = ((extent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE) *
+							   ((extent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+	if (frame_num == 0) {
+		adaptive_converged = false;
+		adaptive_idle_readbacks = 0;
+		adaptive_counters = {num_tiles, extent.width * extent.height};
+		// Copies still in flight count the tiles of the previous accumulation
+		for (AdaptiveReadback& readback : adaptive_readbacks) {
+			readback.age = -1;
+		}
+	}
+	if (adaptive_converged) {
+		return 0;
+	}
+	for (AdaptiveReadback& readback : adaptive_readbacks) {
+		readback.age += readback.age >= 0;
+	}
+	// The oldest slot, complete once prepare_frame waited on the fence of the frame that copied into it
+	AdaptiveReadback& readback = adaptive_readbacks[adaptive_readback_idx];
+	if (readback.age >= vk::MAX_FRAMES_IN_FLIGHT) {
+		readback.age = -1;
+		adaptive_counters = *(AdaptiveCounters*)vk::map_buffer(readback.buffer);
+		vk::unmap_buffer(readback.buffer);
+		adaptive_idle_readbacks = adaptive_counters.num_active_tiles == 0 ? adaptive_idle_readbacks + 1 : 0;
+	}
+	if (frame_num < std::max(adaptive.min_samples, 1u)) {
+		return num_tiles;
+	}
+	// A single reading without active tiles is not trusted to end the accumulation
+	constexpr uint32_t converged_readbacks = 3;
+	if (adaptive_idle_readbacks >= converged_readbacks) {
+		LUMEN_TRACE("Adaptive sampling converged after {} frames", frame_num);
+		adaptive_converged = true;
+		return 0;
+	}
+	if (adaptive_counters.num_active_tiles == 0) {
+		return num_tiles;
+	}
+	return exact ? num_tiles : std::min(adaptive_counters.num_active_tiles, num_tiles);
+}
+
+void Integrator::queue_adaptive_readback() {
+	AdaptiveReadback& readback = adaptive_readbacks[adaptive_readback_idx];
+	vk::render_graph()->current_pass().copy(adaptive_counters_buffer, readback.buffer);
+	readback.age = 0;
+	adaptive_readback_idx = (adaptive_readback_idx + 1) % vk::MAX_FRAMES_IN_FLIGHT;
+}
+
+bool Integrator::adaptive_gui() {
+	bool result = ImGui::Checkbox("Adaptive sampling", &adaptive.enabled);
+	if (!adaptive.enabled) {
+		return result;
+	}
+	result |= ImGui::SliderFloat("Error threshold", &adaptive.threshold, 0.001f, 0.2f, "%.3f",
+								 ImGuiSliderFlags_Logarithmic);
+	result |= ImGui::InputScalar("Min samples", ImGuiDataType_U32, &adaptive.min_samples);
+	result |= ImGui::InputScalar("Max samples", ImGuiDataType_U32, &adaptive.max_samples);
+	const VkExtent2D extent = render_extent();
+	const uint32_t num_tiles = ((extent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE) *
+							   ((extent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+	ImGui::Text("Active tiles: %.1f%%%s", 100.0f * adaptive_counters.num_active_tiles / num_tiles,
+				adaptive_converged ? " (converged)" : "");
+	return result;
+}
+
 void Integrator::update_uniform_buffers() {
 	lumen_scene->camera->update_view_matrix();
 	scene_ubo.prev_view = scene_ubo.view;
@@ -125,11 +340,55 @@ bool Integrator::update() {
 }
 
 
+void Integrator::capture_state(const std::unordered_map<std::string, vk::Buffer*>& prev_registrations) {
+	scene_desc_buffer = lumen_scene->scene_desc_buffer;
+	registered_buffers.clear();
+	for (const auto& [key, buffer] : vk::render_graph()->registered_buffer_pointers) {
+		auto it = prev_registrations.find(key);
+		if (it == prev_registrations.end() || it->second != buffer) {
+			registered_buffers[key] = buffer;
+		}
+	}
+}
+
+void Integrator::activate() {
+	lumen_scene->scene_desc_buffer = scene_desc_buffer;
+	for (const auto& [key, buffer] : registered_buffers) {
+		vk::render_graph()->registered_buffer_pointers[key] = buffer;
+	}
+	updated = true;
+}
+
+void Integrator::deactivate() {
+	auto& registered = vk::render_graph()->registered_buffer_pointers;
+	for (const auto& [key, buffer] : registered_buffers) {
+		if (auto it = registered.find(key); it != registered.end() && it->second == buffer) {
+			registered.erase(it);
+		}
+	}
+}
+
 void Integrator::destroy() {
-	auto buffer_list = {scene_ubo_buffer, lumen_scene->scene_desc_buffer};
+	deactivate();
+	if (lumen_scene->scene_desc_buffer == scene_desc_buffer) {
+		lumen_scene->scene_desc_buffer = nullptr;
+	}
+	auto buffer_list = {scene_ubo_buffer, scene_desc_buffer};
 	for (vk::Buffer* b : buffer_list) {
 		prm::remove(b);
 	}
+	if (supports_adaptive_sampling()) {
+		for (vk::Buffer* b : {adaptive_pixels_buffer, adaptive_tiles_buffer, adaptive_counters_buffer}) {
+			prm::remove(b);
+		}
+		for (AdaptiveReadback& readback : adaptive_readbacks) {
+			prm::remove(readback.buffer);
+		}
+	}
+	if (aov_buffer) {
+		prm::remove(aov_buffer);
+		aov_buffer = nullptr;
+	}
 	prm::remove(output_tex);
 
 }
@@ -140,7 +399,8 @@ void Integrator::create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases) {
 	VkDeviceAddress vertex_address = lumen_scene->vertex_buffer->get_device_address();
 	VkDeviceAddress idx_address = lumen_scene->index_buffer->get_device_address();
 	for (auto& prim_mesh : lumen_scene->prim_meshes) {
-		vk::BlasInput geo = vk::to_vk_geometry(prim_mesh, vertex_address, idx_address);
+		vk::BlasInput geo =
+			vk::to_vk_geometry(prim_mesh, vertex_address, idx_address, lumen_scene->is_alpha_masked(prim_mesh));
 		blas_inputs.push_back({geo});
 	}
 	vk::build_blas(blases, blas_inputs, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
@@ -153,8 +413,14 @@ void Integrator::create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases) {
 		ray_inst.accelerationStructureReference = blases[pm.prim_idx].get_blas_device_address();
 		ray_inst.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
 		ray_inst.mask = 0xFF;
-		ray_inst.instanceShaderBindingTableRecordOffset = 0;  // We will use the same hit group for all objects
+		// Alpha masked instances use the hit groups appended after the regular ones
+		ray_inst.instanceShaderBindingTableRecordOffset = lumen_scene->is_alpha_masked(pm) ? vk::MASKED_HIT_GROUP_OFFSET : 0;
 		tlas_instances.emplace_back(ray_inst);
 	}
-	vk::build_tlas(tlas, tlas_instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+	// Animated scenes refit the TLAS every frame, see RayTracer::update_animations
+	VkBuildAccelerationStructureFlagsKHR tlas_flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+	if (lumen_scene->has_animations()) {
+		tlas_flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+	}
+	vk::build_tlas(tlas, tlas_instances, tlas_flags);
 }
@@ -7,6 +7,8 @@
 #include "Framework/Window.h"
 #include "Framework/Texture.h"
 #include "shaders/commons.h"
+#include "shaders/sampling.h"
+#include "shaders/integrators/splat_commons.h"
 #include "LumenScene.h"
 #include "Framework/RenderGraph.h"
 #include "Framework/DynamicResourceManager.h"
@@ -20,14 +22,115 @@ class Integrator {
 	virtual bool update();
 	virtual void destroy();
 	virtual void create_accel(vk::BVH& tlas, std::vector<vk::BVH>& blases);
+	// Integrators stay resident while another one renders, see RayTracer::switch_integrator. capture_state records
+	// what init() left in the scene and the render graph, given the buffer registrations from before init()
+	void capture_state(const std::unordered_map<std::string, vk::Buffer*>& prev_registrations);
+	// Points the scene and the render graph to the buffers of this integrator again
+	void activate();
+	// Unregisters the buffers of this integrator, they stay allocated until destroy()
+	void deactivate();
+	// Integrators that can trace at a reduced internal resolution. They render into the top-left
+	// render_extent() region of output_tex, which is always allocated at the full window size
+	virtual bool supports_render_scale() const { return false; }
+	VkExtent2D render_extent() const;
+	// Integrators whose ray generation shaders accumulate through adaptive_commons.glsl
+	virtual bool supports_adaptive_sampling() const { return false; }
+	// Stops sampling the pixels of a tile once the relative standard error of their mean drops below threshold
+	struct AdaptiveSettings {
+		bool enabled = false;
+		float threshold = 0.01f;
+		uint32_t min_samples = 16;
+		// 0 for no limit
+		uint32_t max_samples = 0;
+	} adaptive;
+	// Accumulation of the light tracing splats and photon deposits, see splat_commons.glsl
+	uint32_t splat_mode = SPLAT_SUBGROUP;
+	// Every tile reached the threshold, nothing is traced until the next reset
+	bool converged() const { return adaptive_converged; }
+	// AOV_* bits that the ray generation shaders can write through aov_commons.glsl
+	virtual uint32_t supported_aovs() const { return 0; }
+	// Requested AOV_* bits, set before init()
+	uint32_t aovs = 0;
+	uint32_t enabled_aovs() const { return aovs & supported_aovs(); }
+	// One layer of a vec4 per pixel for every enabled AOV, in the order of the bits. Allocated at the full window size
+	// like output_tex, null without enabled AOVs
+	vk::Buffer* aov_buffer = nullptr;
+	// GUI settings and scene config parameters by name, recorded with camera paths so that replays render with the
+	// same settings
+	using Settings = std::map<std::string, double>;
+	Settings get_settings();
+	// Settings missing from the map are kept. Returns whether a setting changed
+	bool set_settings(const Settings& settings);
 	vk::Texture* output_tex;
 	bool updated = false;
 	uint frame_num = 0;
+	float render_scale = 1.0f;
+	// Accumulation format of output_tex, see ImageUtils::OutputPrecision
+	VkFormat output_format = VK_FORMAT_R32G32B32A32_SFLOAT;
 
    protected:
+	// Reads the settings into values, or writes values into the settings with restore
+	struct SettingsVisitor {
+		Settings& values;
+		bool restore = false;
+		template <typename T>
+		void operator()(const std::string& name, T& setting) {
+			using Number =
+				typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::type_identity<T>>::type;
+			if (!restore) {
+				values[name] = double(Number(setting));
+			} else if (auto it = values.find(name); it != values.end()) {
+				setting = T(Number(it->second));
+			}
+		}
+	};
+	// Derived integrators visit the settings of the base class and then their own
+	virtual void visit_settings(SettingsVisitor& visitor);
+	// Called by set_settings after settings changed, for the resources that depend on them
+	virtual void settings_changed(const Settings& prev) {}
 	void update_uniform_buffers();
+	// Sampler selection for the integrators that support it, passed to their ray generation shaders as SAMPLER_TYPE
+	std::vector<vk::ShaderMacro> sampler_macros() const;
+	bool sampler_gui();
+	// SPLAT_MODE for the integrators that splat, SPLAT_SUBGROUP falls back to SPLAT_ATOMIC on devices without
+	// subgroup arithmetic in ray generation shaders
+	std::vector<vk::ShaderMacro> splat_macros() const;
+	bool splat_gui();
+	// Points the scene description to the adaptive sampling buffers
+	void set_adaptive_addrs(SceneDesc& desc);
+	// Updates the list of active tiles before the ray generation pass
+	void add_adaptive_mask_pass(VkExtent2D extent);
+	// Rows of tiles to launch, 0 once the image converged. With exact the launch covers every tile and the excess rows
+	// exit, otherwise it follows the last count read back and may trail it by the frames in flight
+	uint32_t adaptive_launch_tiles(VkExtent2D extent, bool exact = false);
+	// Copies the counters of the mask pass into the readback slot of the frame, recorded in the pass after it
+	void queue_adaptive_readback();
+	bool adaptive_gui();
+	// Points the scene description to aov_buffer
+	void set_aov_addrs(SceneDesc& desc);
+	// AOVS for the ray generation shaders of the integrators that support AOVs
+	std::vector<vk::ShaderMacro> aov_macros() const;
+	uint32_t sampler_type = SAMPLER_PCG;
 	SceneUBO scene_ubo{};
 	LumenScene* lumen_scene = nullptr;
 	vk::Buffer* scene_ubo_buffer = nullptr;
+	// Scene description and buffer registrations of init(), restored by activate()
+	vk::Buffer* scene_desc_buffer = nullptr;
+	std::unordered_map<std::string, vk::Buffer*> registered_buffers;
+	vk::Buffer* adaptive_pixels_buffer = nullptr;
+	vk::Buffer* adaptive_tiles_buffer = nullptr;
+	vk::Buffer* adaptive_counters_buffer = nullptr;
+	// The counters are read on the host from a slot per frame in flight, once the fence of their frame was waited on
+	struct AdaptiveReadback {
+		vk::Buffer* buffer = nullptr;
+		// Frames since the copy was recorded, -1 for a slot without a copy of the current accumulation
+		int32_t age = -1;
+	};
+	AdaptiveReadback adaptive_readbacks[vk::MAX_FRAMES_IN_FLIGHT];
+	uint32_t adaptive_readback_idx = 0;
+	AdaptiveCounters adaptive_counters{};
+	// Consecutive readbacks without active tiles
+	uint32_t adaptive_idle_readbacks = 0;
+	bool adaptive_converged = false;
 	const vk::BVH& tlas;
 };
@@ -1,7 +1,9 @@
 #include <LumenPCH.h>
 #include "Framework/VkUtils.h"
 #include "Framework/BBox.h"
+#include "Framework/MemoryBudget.h"
 #include "LumenScene.h"
+#include "shaders/vertex_packing.h"
 #pragma warning(push, 0)
 #include <tinygltf/json.hpp>
 #pragma warning(pop)
@@ -25,6 +27,11 @@
 #include "shaders/commons.h"
 #include <cctype>
 #include "Framework/PersistentResourceManager.h"
+#include "Framework/ImageUtils.h"
+#include "Framework/EnvMapDistribution.h"
+#include "Framework/CommandBuffer.h"
+#include "Framework/ThreadPool.h"
+#include "Framework/MeshLoader.h"
 
 static bool ends_with(const std::string& str, const std::string& end) {
 	if (end.size() > str.size()) return false;
@@ -49,14 +56,7 @@ static void reflectance_to_conductor_eta_k(const glm::vec3& reflectance, glm::ve
 	k = 2.0f * glm::sqrt(reflectance) / glm::sqrt(glm::max(glm::vec3(1.0f) - reflectance, 0.001f));
 };
 
-void LumenScene::load_scene(const std::string& path) {
-	if (ends_with(path, ".json")) {
-		load_lumen_scene(path);
-	} else if (ends_with(path, ".xml")) {
-		load_mitsuba_scene(path);
-	}
-
-	const float aspect_ratio = (float)Window::width() / Window::height();
+void LumenScene::create_camera(float aspect_ratio) {
 	if (config->cam_settings.pos != vec3(0)) {
 		camera = std::unique_ptr<lumen::PerspectiveCamera>(
 			new lumen::PerspectiveCamera(config->cam_settings.fov, 0.01f, 1000.0f, aspect_ratio,
@@ -66,6 +66,20 @@ void LumenScene::load_scene(const std::string& path) {
 		camera = std::unique_ptr<lumen::PerspectiveCamera>(new lumen::PerspectiveCamera(
 			config->cam_settings.fov, config->cam_settings.cam_matrix, 0.01f, 1000.0f, aspect_ratio));
 	}
+}
+
+void LumenScene::load_scene(const std::string& path, bool host_only) {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::Scene);
+	if (ends_with(path, ".json")) {
+		load_lumen_scene(path);
+	} else if (ends_with(path, ".xml")) {
+		load_mitsuba_scene(path);
+	}
+
+	// Host only loads have no window, the caller creates the camera for its own resolution
+	if (!host_only) {
+		create_camera((float)Window::width() / Window::height());
+	}
 
 	total_light_triangle_cnt = 0;
 	total_light_area = 0;
@@ -78,7 +92,8 @@ void LumenScene::load_scene(const std::string& path) {
 		m_info.material_index = pm.material_idx;
 		m_info.min_pos = glm::vec4(pm.min_pos, 0);
 		m_info.max_pos = glm::vec4(pm.max_pos, 0);
-		m_info.material_index = pm.material_idx;
+		m_info.uv_range = uv_range(pm);
+		m_info.full_precision_uvs = !VertexPacking::uv_fits_unorm16(m_info.uv_range);
 		prim_lookup.emplace_back(m_info);
 		auto& mef = materials[pm.material_idx].emissive_factor;
 		if (mef.x > 0 || mef.y > 0 || mef.z > 0) {
@@ -103,6 +118,15 @@ void LumenScene::load_scene(const std::string& path) {
 		light.light_flags = l.light_flags;
 		light.pos = l.pos;
 		light.to = l.to;
+		if ((l.light_flags & 0x7) == LIGHT_ENVIRONMENT) {
+			if (env_light_idx != -1) {
+				LUMEN_WARN("Only one environment light is supported, ignoring {}", l.env_map);
+				continue;
+			}
+			env_light_idx = (uint32_t)gpu_lights.size();
+			// Slot of the environment texture, appended after the material textures
+			light.prim_mesh_idx = std::max<uint32_t>((uint32_t)textures.size(), 1);
+		}
 		total_light_triangle_cnt++;
 		light.world_radius = m_dimensions.radius;
 		light.world_center = 0.5f * (m_dimensions.max + m_dimensions.min);
@@ -131,18 +155,44 @@ void LumenScene::load_scene(const std::string& path) {
 			}
 		}
 	}
+	total_light_area += total_light_triangle_area;
+	for (uint32_t i = 0; i < gpu_lights.size(); i++) {
+		if ((gpu_lights[i].light_flags & 0x7) != LIGHT_AREA) {
+			continue;
+		}
+		for (const auto& anim : animations) {
+			if (anim.prim_mesh_idx == gpu_lights[i].prim_mesh_idx) {
+				animated_lights.push_back(i);
+				break;
+			}
+		}
+	}
+	build_light_bvh();
+	compute_tangents();
+	if (host_only) {
+		return;
+	}
+	gpu_resources_created = true;
+	if (!light_bvh.empty()) {
+		std::vector<uint32_t> light_bvh_data = light_bvh.gpu_data();
+		light_bvh_buffer =
+			prm::get_buffer({.name = "Light BVH Buffer",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = light_bvh_data.size() * sizeof(uint32_t),
+							 .data = light_bvh_data.data()});
+	}
 	if (gpu_lights.size()) {
 		// mesh_lights_buffer.create("Mesh Lights Buffer", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		// 						  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gpu_lights.size() * sizeof(Light),
 		// 						  gpu_lights.data(), true);
 
 		mesh_lights_buffer = prm::get_buffer({.name = "Mesh Lights Buffer",
-											  .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+											  .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 											  .memory_type = vk::BufferType::GPU,
 											  .size = gpu_lights.size() * sizeof(Light),
 											  .data = gpu_lights.data()});
 	}
-	total_light_area += total_light_triangle_area;
 	vertex_buffer = prm::get_buffer({.name = "Vertex Buffer",
 									 .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
 											  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
@@ -172,22 +222,46 @@ void LumenScene::load_scene(const std::string& path) {
 						 .memory_type = vk::BufferType::GPU,
 						 .size = prim_lookup.size() * sizeof(PrimMeshInfo),
 						 .data = prim_lookup.data()});
+	// Registered once for all integrators, their scene descriptions point to it through fill_scene_desc
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, prim_lookup_buffer, vk::render_graph());
 
-	std::vector<Vertex> vertices;
-	vertices.reserve(positions.size());
-	for (auto i = 0; i < positions.size(); i++) {
-		Vertex v;
-		v.pos = positions[i];
-		v.normal = normals[i];
-		v.uv0 = texcoords0[i];
-		vertices.push_back(v);
-	}
-	compact_vertices_buffer =
-		prm::get_buffer({.name = "Compact Vertices Buffer",
-						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-						 .memory_type = vk::BufferType::GPU,
-						 .size = vertices.size() * sizeof(vertices[0]),
-						 .data = vertices.data()});
+	if (quantize_vertices) {
+		std::vector<glm::vec2> full_precision_uvs;
+		std::vector<PackedVertex> vertices = pack_vertices(full_precision_uvs);
+		compact_vertices_buffer =
+			prm::get_buffer({.name = "Compact Vertices Buffer",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = vertices.size() * sizeof(vertices[0]),
+							 .data = vertices.data()});
+		if (!full_precision_uvs.empty()) {
+			full_precision_uv_buffer = prm::get_buffer(
+				{.name = "Full Precision UV Buffer",
+				 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+				 .memory_type = vk::BufferType::GPU,
+				 .size = full_precision_uvs.size() * sizeof(glm::vec2),
+				 .data = full_precision_uvs.data()});
+			REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, full_precision_uv_addr, full_precision_uv_buffer,
+										 vk::render_graph());
+		}
+	} else {
+		std::vector<Vertex> vertices;
+		vertices.reserve(positions.size());
+		for (auto i = 0; i < positions.size(); i++) {
+			Vertex v;
+			v.pos = positions[i];
+			v.normal = normals[i];
+			v.uv0 = texcoords0[i];
+			v.tangent = tangents[i];
+			vertices.push_back(v);
+		}
+		compact_vertices_buffer =
+			prm::get_buffer({.name = "Compact Vertices Buffer",
+							 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+							 .memory_type = vk::BufferType::GPU,
+							 .size = vertices.size() * sizeof(vertices[0]),
+							 .data = vertices.data()});
+	}
 
 	// Create a sampler for textures
 	VkSamplerCreateInfo sampler_ci = vk::sampler();
@@ -201,19 +275,54 @@ void LumenScene::load_scene(const std::string& path) {
 		add_default_texture();
 	} else {
 		scene_textures.resize(textures.size());
-		int i = 0;
-		for (const auto& texture_path : textures) {
-			int x, y, n;
-			unsigned char* data = stbi_load(texture_path.c_str(), &x, &y, &n, 4);
+		const bool compress = texture_settings.compress && vk::context().supported_features.textureCompressionBC;
+		for (uint32_t i = 0; i < textures.size(); i++) {
+			TextureCompression::CompressedTexture compressed;
+			if (compress && load_compressed_texture(i, compressed)) {
+				// Only the mip tail is uploaded now, the finer levels are streamed in by stream_textures
+				uint32_t first_mip = 0;
+				while (texture_settings.resident_size && first_mip + 1 < compressed.num_mips() &&
+					   std::max(compressed.width, compressed.height) >> first_mip > texture_settings.resident_size) {
+					first_mip++;
+				}
+				const VkDeviceSize tail_offset = compressed.mip_offsets[first_mip];
+				std::vector<VkDeviceSize> tail_offsets;
+				for (uint32_t mip = first_mip; mip < compressed.num_mips(); mip++) {
+					tail_offsets.push_back(compressed.mip_offsets[mip] - tail_offset);
+				}
+				scene_textures[i] = prm::get_texture(
+					{.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+					 .dimensions = {compressed.width, compressed.height, 1},
+					 .format = TextureCompression::vk_format(compressed.format, compressed.srgb),
+					 .data = {.data = compressed.data.data() + tail_offset,
+							  .size = compressed.data.size() - tail_offset,
+							  .mip_offsets = tail_offsets,
+							  .first_mip = first_mip},
+					 .num_mips = compressed.num_mips(),
+					 .sampler = texture_sampler});
+				if (first_mip > 0) {
+					vkDestroyImageView(vk::context().device, scene_textures[i]->view, nullptr);
+					scene_textures[i]->view = vk::create_texture_view(scene_textures[i], first_mip);
+					streamed_textures.push_back({i, first_mip, std::move(compressed)});
+				}
+				continue;
+			}
+			int x, y;
+			unsigned char* data = load_texture_pixels(i, x, y);
+			const bool linear = texture_usages[i] == TextureUsage::Normal || texture_usages[i] == TextureUsage::Packed;
 			scene_textures[i] = prm::get_texture({.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
 												  .dimensions = {(uint32_t)x, (uint32_t)y, 1},
-												  .format = VK_FORMAT_R8G8B8A8_SRGB,
+												  .format = linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB,
 												  .data = {.data = data, .size = size_t(x * y * 4)},
 												  .sampler = texture_sampler});
 			stbi_image_free(data);
-			i++;
 		}
 	}
+	if (env_light_idx != -1) {
+		create_env_map();
+	}
+	vk::render_graph()->settings.alpha_masked_geometry =
+		std::any_of(materials.begin(), materials.end(), [](const Material& m) { return m.alpha_texture_id > -1; });
 	vk::render_graph()->global_macro_defines.push_back(
 		vk::ShaderMacro("ENABLE_DIFFUSE", has_bsdf_type(BSDF_TYPE_DIFFUSE), /* visible = */ false));
 	vk::render_graph()->global_macro_defines.push_back(
@@ -226,6 +335,7 @@ void LumenScene::load_scene(const std::string& path) {
 		vk::ShaderMacro("ENABLE_CONDUCTOR", has_bsdf_type(BSDF_TYPE_CONDUCTOR), /* visible = */ false));
 	vk::render_graph()->global_macro_defines.push_back(
 		vk::ShaderMacro("ENABLE_PRINCIPLED", has_bsdf_type(BSDF_TYPE_PRINCIPLED), /* visible = */ false));
+	vk::render_graph()->global_macro_defines.push_back(vk::ShaderMacro("QUANTIZED_VERTICES", quantize_vertices));
 }
 
 void LumenScene::load_lumen_scene(const std::string& path) {
@@ -266,6 +376,10 @@ void LumenScene::load_lumen_scene(const std::string& path) {
 		((VCMMLTConfig*)curr_config)->enable_vm = integrator["enable_vm"] == 1;
 		((VCMMLTConfig*)curr_config)->alternate = integrator["alternate"] == 1;
 		((VCMMLTConfig*)curr_config)->light_first = integrator["light_first"] == 1;
+	} else if (integrator["type"] == "wavefrontpath") {
+		if (!integrator["queue_capacity"].is_null()) {
+			((WavefrontPathConfig*)curr_config)->queue_capacity = integrator["queue_capacity"];
+		}
 	}
 	// Load obj file
 	const std::string mesh_file = root + std::string(j["mesh_file"]);
@@ -352,11 +466,48 @@ void LumenScene::load_lumen_scene(const std::string& path) {
 	int light_idx = 0;
 	for (auto& bsdf : bsdfs_arr) {
 		materials[bsdf_idx].texture_id = -1;
+		materials[bsdf_idx].alpha_texture_id = -1;
+		materials[bsdf_idx].alpha_cutoff = 0.5f;
+		materials[bsdf_idx].normal_texture_id = -1;
+		materials[bsdf_idx].normal_scale = 1.0f;
+		materials[bsdf_idx].orm_texture_id = -1;
+		materials[bsdf_idx].emission_texture_id = -1;
 		auto& refs = bsdf["refs"];
+		auto texture_path = [&](const char* prop) {
+			return bsdf[prop].is_null() ? std::string() : root + (std::string)bsdf[prop];
+		};
 
 		if (!bsdf["texture"].is_null()) {
-			textures.push_back(root + (std::string)bsdf["texture"]);
-			materials[bsdf_idx].texture_id = (int)textures.size() - 1;
+			materials[bsdf_idx].texture_id = add_texture(texture_path("texture"), TextureUsage::Color);
+		}
+		if (!bsdf["normal_map"].is_null()) {
+			materials[bsdf_idx].normal_texture_id = add_texture(texture_path("normal_map"), TextureUsage::Normal);
+			materials[bsdf_idx].normal_scale = get_or_default_f(bsdf, "normal_scale", 1.0f);
+		}
+		// Either a glTF style ORM texture or separate roughness and metallic images packed on load
+		if (!bsdf["orm_texture"].is_null()) {
+			materials[bsdf_idx].orm_texture_id = add_texture(texture_path("orm_texture"), TextureUsage::Packed);
+		} else {
+			materials[bsdf_idx].orm_texture_id =
+				add_packed_texture(texture_path("roughness_texture"), texture_path("metallic_texture"));
+		}
+		if (materials[bsdf_idx].orm_texture_id > -1) {
+			// The factors scale the texture, as in glTF
+			if (bsdf["roughness"].is_null()) {
+				bsdf["roughness"] = 1.0f;
+			}
+			if (bsdf["metallic"].is_null()) {
+				bsdf["metallic"] = 1.0f;
+			}
+		}
+		// Either a dedicated mask texture or the alpha channel of the albedo texture
+		if (!bsdf["alpha_mask"].is_null()) {
+			materials[bsdf_idx].alpha_texture_id = add_texture(texture_path("alpha_mask"), TextureUsage::AlphaMask);
+		} else if (!bsdf["alpha_mode"].is_null() && bsdf["alpha_mode"] == "mask") {
+			materials[bsdf_idx].alpha_texture_id = materials[bsdf_idx].texture_id;
+		}
+		if (!bsdf["alpha_cutoff"].is_null()) {
+			materials[bsdf_idx].alpha_cutoff = bsdf["alpha_cutoff"];
 		}
 		if (!bsdf["albedo"].is_null()) {
 			const auto& f = bsdf["albedo"];
@@ -368,6 +519,12 @@ void LumenScene::load_lumen_scene(const std::string& path) {
 			const auto& f = bsdf["emissive_factor"];
 			materials[bsdf_idx].emissive_factor = glm::vec3({f[0], f[1], f[2]});
 		}
+		if (!bsdf["emission_texture"].is_null()) {
+			materials[bsdf_idx].emission_texture_id = add_texture(texture_path("emission_texture"), TextureUsage::Color);
+			if (bsdf["emissive_factor"].is_null()) {
+				materials[bsdf_idx].emissive_factor = glm::vec3(1.0f);
+			}
+		}
 
 		if (bsdf["type"] == "diffuse") {
 			bsdf_types |= BSDF_TYPE_DIFFUSE;
@@ -484,6 +641,26 @@ void LumenScene::load_lumen_scene(const std::string& path) {
 		bsdf_idx++;
 	}
 
+	for (auto& anim : j["animations"]) {
+		const std::string mesh_name = anim["mesh"];
+		auto it = std::find_if(prim_meshes.begin(), prim_meshes.end(),
+							   [&](const LumenPrimMesh& pm) { return pm.name == mesh_name; });
+		if (it == prim_meshes.end()) {
+			LUMEN_WARN("Animation refers to unknown mesh {}", mesh_name);
+			continue;
+		}
+		LumenAnimation& a = animations.emplace_back();
+		a.prim_mesh_idx = uint32_t(it - prim_meshes.begin());
+		a.base_matrix = it->world_matrix;
+		// Rotate around the center of the mesh by default
+		const glm::vec3 center = a.base_matrix * glm::vec4(0.5f * (it->min_pos + it->max_pos), 1.0f);
+		a.pivot = get_or_default_v(anim, "pivot", center);
+		a.axis = glm::normalize(get_or_default_v(anim, "axis", a.axis));
+		a.angular_velocity = glm::radians(get_or_default_f(anim, "degrees_per_second", 0.0f));
+		a.translation = get_or_default_v(anim, "translation", a.translation);
+		a.frequency = get_or_default_f(anim, "frequency", 0.0f);
+	}
+
 	curr_config->cam_settings.fov = j["camera"]["fov"];
 	const auto& p = j["camera"]["position"];
 	const auto& d = j["camera"]["dir"];
@@ -491,6 +668,13 @@ void LumenScene::load_lumen_scene(const std::string& path) {
 	curr_config->cam_settings.dir = {d[0], d[1], d[2]};
 	compute_scene_dimensions();
 	for (auto& light : lights_arr) {
+		if (light["type"] == "environment") {
+			lights[light_idx].env_map = root + (std::string)light["file"];
+			lights[light_idx].L = get_or_default_v(light, "L", glm::vec3(1.0f));
+			lights[light_idx].light_flags = LIGHT_ENVIRONMENT;
+			light_idx++;
+			continue;
+		}
 		const auto& pos = light["pos"];
 		const auto& dir = light["dir"];
 		const auto& L = light["L"];
@@ -531,71 +715,34 @@ void LumenScene::load_mitsuba_scene(const std::string& path) {
 	// Camera
 	curr_config->cam_settings.fov = mitsuba_parser.camera.fov / 2;
 	curr_config->cam_settings.cam_matrix = mitsuba_parser.camera.cam_matrix;
-	prim_meshes.resize(mitsuba_parser.meshes.size());
-	// Load objs
-	int i = 0;
+	// Shapes are independent of each other, load them in parallel and append them in scene order
+	std::vector<std::future<MeshData>> futures;
 	for (const auto& mesh : mitsuba_parser.meshes) {
-		if (mesh.file == "") {
-			continue;
-		}
-		const std::string mesh_file = root + mesh.file;
-		tinyobj::ObjReaderConfig reader_config;
-
-		tinyobj::ObjReader reader;
-		if (!reader.ParseFromFile(mesh_file, reader_config)) {
-			if (!reader.Error().empty()) {
-				std::cerr << "TinyObjReader: " << reader.Error();
-			}
-			exit(1);
-		}
-
-		if (!reader.Warning().empty()) {
-			std::cout << "TinyObjReader: " << reader.Warning();
-		}
-
-		auto& attrib = reader.GetAttrib();
-		auto& shapes = reader.GetShapes();
-		assert(shapes.size() == 1);
-		prim_meshes[i].first_idx = (uint32_t)indices.size();
-		prim_meshes[i].vtx_offset = (uint32_t)positions.size();
-		prim_meshes[i].name = shapes[0].name;
-		prim_meshes[i].idx_count = (uint32_t)shapes[0].mesh.indices.size();
-		prim_meshes[i].vtx_count = (uint32_t)shapes[0].mesh.num_face_vertices.size();
-		prim_meshes[i].prim_idx = i;
-		glm::vec3 min_vtx = glm::vec3(FLT_MAX);
-		glm::vec3 max_vtx = glm::vec3(-FLT_MAX);
-		uint32_t index_offset = 0;
-		uint32_t idx_val = 0;
-		for (uint32_t f = 0; f < shapes[0].mesh.num_face_vertices.size(); f++) {
-			for (uint32_t v = 0; v < 3; v++) {
-				tinyobj::index_t idx = shapes[0].mesh.indices[index_offset + v];
-				indices.push_back(idx_val++);
-				tinyobj::real_t vx = attrib.vertices[3 * uint32_t(idx.vertex_index) + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * uint32_t(idx.vertex_index) + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * uint32_t(idx.vertex_index) + 2];
-				positions.emplace_back(vx, vy, vz);
-				min_vtx = glm::min(positions[positions.size() - 1], min_vtx);
-				max_vtx = glm::max(positions[positions.size() - 1], max_vtx);
-				if (idx.normal_index >= 0) {
-					tinyobj::real_t nx = attrib.normals[3 * uint32_t(idx.normal_index) + 0];
-					tinyobj::real_t ny = attrib.normals[3 * uint32_t(idx.normal_index) + 1];
-					tinyobj::real_t nz = attrib.normals[3 * uint32_t(idx.normal_index) + 2];
-					normals.emplace_back(nx, ny, nz);
-				}
-				if (idx.texcoord_index >= 0) {
-					tinyobj::real_t tx = attrib.texcoords[2 * uint32_t(idx.texcoord_index) + 0];
-					tinyobj::real_t ty = attrib.texcoords[2 * uint32_t(idx.texcoord_index) + 1];
-					texcoords0.emplace_back(tx, ty);
-				}
-			}
-
-			index_offset += 3;
+		futures.push_back(lumen::ThreadPool::submit(MeshLoader::load_mitsuba_shape, std::cref(mesh), std::cref(root)));
+	}
+	prim_meshes.resize(mitsuba_parser.meshes.size());
+	for (uint32_t i = 0; i < futures.size(); i++) {
+		const MeshData mesh_data = futures[i].get();
+		const auto& mesh = mitsuba_parser.meshes[i];
+		LumenPrimMesh& pm = prim_meshes[i];
+		pm.name = mesh.file.empty() ? "shape_" + std::to_string(i) : mesh.file;
+		pm.first_idx = (uint32_t)indices.size();
+		pm.vtx_offset = (uint32_t)positions.size();
+		pm.idx_count = (uint32_t)mesh_data.indices.size();
+		pm.vtx_count = (uint32_t)mesh_data.positions.size();
+		pm.prim_idx = i;
+		pm.min_pos = glm::vec3(FLT_MAX);
+		pm.max_pos = glm::vec3(-FLT_MAX);
+		for (const glm::vec3& p : mesh_data.positions) {
+			pm.min_pos = glm::min(pm.min_pos, p);
+			pm.max_pos = glm::max(pm.max_pos, p);
 		}
-		prim_meshes[i].min_pos = min_vtx;
-		prim_meshes[i].max_pos = max_vtx;
-		prim_meshes[i].world_matrix = mesh.transform;
-		prim_meshes[i].material_idx = mesh.bsdf_idx;
-		i++;
+		pm.world_matrix = mesh.transform;
+		pm.material_idx = mesh.bsdf_idx;
+		indices.insert(indices.end(), mesh_data.indices.begin(), mesh_data.indices.end());
+		positions.insert(positions.end(), mesh_data.positions.begin(), mesh_data.positions.end());
+		normals.insert(normals.end(), mesh_data.normals.begin(), mesh_data.normals.end());
+		texcoords0.insert(texcoords0.end(), mesh_data.texcoords0.begin(), mesh_data.texcoords0.end());
 	}
 
 	auto make_default_principled = [](Material& m) {
@@ -608,19 +755,32 @@ void LumenScene::load_mitsuba_scene(const std::string& path) {
 		m.sheen = 0;
 		m.thin = 0;
 	};
-	i = 0;
+	int i = 0;
 	materials.resize(mitsuba_parser.bsdfs.size());
 	for (const auto& m_bsdf : mitsuba_parser.bsdfs) {
 		if (m_bsdf.texture != "") {
-			textures.push_back(root + m_bsdf.texture);
-			materials[i].texture_id = (int)textures.size() - 1;
+			materials[i].texture_id = add_texture(root + m_bsdf.texture, TextureUsage::Color);
 		} else {
 			materials[i].texture_id = -1;
 		}
+		if (m_bsdf.alpha_mask != "") {
+			materials[i].alpha_texture_id = add_texture(root + m_bsdf.alpha_mask, TextureUsage::AlphaMask);
+		} else {
+			materials[i].alpha_texture_id = -1;
+		}
+		materials[i].alpha_cutoff = 0.5f;
+		materials[i].normal_texture_id =
+			m_bsdf.normal_map != "" ? add_texture(root + m_bsdf.normal_map, TextureUsage::Normal) : -1;
+		materials[i].normal_scale = 1.0f;
+		materials[i].orm_texture_id =
+			add_packed_texture(m_bsdf.roughness_texture != "" ? root + m_bsdf.roughness_texture : "",
+							   m_bsdf.metallic_texture != "" ? root + m_bsdf.metallic_texture : "");
+		materials[i].emission_texture_id = -1;
 		Material& mat = materials[i];
 		make_default_principled(mat);
 		mat.albedo = m_bsdf.albedo;
-		mat.roughness = m_bsdf.roughness;
+		// Mitsuba textures replace the scalar values instead of scaling them
+		mat.roughness = m_bsdf.roughness_texture != "" ? 1.0f : m_bsdf.roughness;
 		// Assume Principled for other materials for now
 		if (m_bsdf.type == "diffuse") {
 			bsdf_types |= BSDF_TYPE_DIFFUSE;
@@ -653,6 +813,9 @@ void LumenScene::load_mitsuba_scene(const std::string& path) {
 				mat.spec_trans = 0.5;
 				mat.thin = 1;
 			}
+			if (m_bsdf.metallic_texture != "") {
+				mat.metallic = 1.0f;
+			}
 
 		} else if (m_bsdf.type == "conductor" || m_bsdf.type == "roughconductor") {
 			bsdf_types |= BSDF_TYPE_CONDUCTOR;
@@ -672,6 +835,40 @@ void LumenScene::load_mitsuba_scene(const std::string& path) {
 		}
 		i++;
 	}
+	// Shapes without a BSDF are diffuse, area emitters get a copy of their material with the emission
+	int default_material = -1;
+	for (uint32_t m = 0; m < prim_meshes.size(); m++) {
+		const auto& mesh = mitsuba_parser.meshes[m];
+		LumenPrimMesh& pm = prim_meshes[m];
+		const bool emissive = mesh.emission.x > 0 || mesh.emission.y > 0 || mesh.emission.z > 0;
+		if (mesh.bsdf_idx >= 0 && !emissive) {
+			continue;
+		}
+		if (mesh.bsdf_idx < 0 && (emissive || default_material < 0)) {
+			Material mat{};
+			mat.albedo = glm::vec3(0.5f);
+			mat.bsdf_type = BSDF_TYPE_DIFFUSE;
+			mat.bsdf_props = BSDF_FLAG_DIFFUSE_REFLECTION;
+			mat.texture_id = -1;
+			mat.alpha_texture_id = -1;
+			mat.normal_texture_id = -1;
+			mat.orm_texture_id = -1;
+			mat.emission_texture_id = -1;
+			bsdf_types |= BSDF_TYPE_DIFFUSE;
+			materials.push_back(mat);
+			if (!emissive) {
+				default_material = (int)materials.size() - 1;
+			}
+		} else if (emissive) {
+			materials.push_back(materials[mesh.bsdf_idx]);
+		}
+		if (emissive) {
+			materials.back().emissive_factor = mesh.emission;
+			pm.material_idx = (uint32_t)materials.size() - 1;
+		} else {
+			pm.material_idx = default_material;
+		}
+	}
 	compute_scene_dimensions();
 	// Light
 	i = 0;
@@ -684,11 +881,157 @@ void LumenScene::load_mitsuba_scene(const std::string& path) {
 			lights[i].light_flags = LIGHT_DIRECTIONAL;
 			// Is delta
 			lights[i].light_flags |= 1 << 5;
+		} else if (light.type == "envmap") {
+			lights[i].L = light.L;
+			lights[i].env_map = root + light.env_map;
+			lights[i].light_flags = LIGHT_ENVIRONMENT;
 		}
 		i++;
 	}
 }
 
+int LumenScene::add_texture(const std::string& path, TextureUsage usage) {
+	for (uint32_t i = 0; i < textures.size(); i++) {
+		if (textures[i] == path && texture_usages[i] == usage) {
+			return (int)i;
+		}
+	}
+	textures.push_back(path);
+	texture_usages.push_back(usage);
+	return (int)textures.size() - 1;
+}
+
+int LumenScene::add_packed_texture(const std::string& roughness, const std::string& metallic) {
+	if (roughness.empty() && metallic.empty()) {
+		return -1;
+	}
+	// Unique name for the pair, the sources themselves are kept in packed_sources
+	const int idx = add_texture(roughness + "|" + metallic, TextureUsage::Packed);
+	packed_sources[idx] = {roughness, metallic};
+	return idx;
+}
+
+unsigned char* LumenScene::load_texture_pixels(uint32_t texture_idx, int& width, int& height) {
+	const auto packed = packed_sources.find(texture_idx);
+	if (packed == packed_sources.end()) {
+		int n;
+		unsigned char* data = stbi_load(textures[texture_idx].c_str(), &width, &height, &n, 4);
+		if (data && texture_usages[texture_idx] == TextureUsage::AlphaMask && (n == 1 || n == 3)) {
+			// Masks without an alpha channel store the coverage in their first channel
+			for (size_t p = 0; p < size_t(width) * height; p++) {
+				data[4 * p + 3] = data[4 * p];
+			}
+		}
+		return data;
+	}
+	// Roughness goes to G and metallic to B, missing channels keep the factors unscaled
+	int n;
+	int size[2][2] = {};
+	unsigned char* channels[2] = {};
+	const std::string* sources[2] = {&packed->second.first, &packed->second.second};
+	for (int c = 0; c < 2; c++) {
+		if (!sources[c]->empty()) {
+			channels[c] = stbi_load(sources[c]->c_str(), &size[c][0], &size[c][1], &n, 1);
+		}
+	}
+	if (!channels[0] && !channels[1]) {
+		return nullptr;
+	}
+	// Images of different sizes are resampled to the larger one
+	width = std::max(size[0][0], size[1][0]);
+	height = std::max(size[0][1], size[1][1]);
+	// Allocated like stb_image results so that the callers free every texture with stbi_image_free
+	unsigned char* data = (unsigned char*)STBI_MALLOC(size_t(width) * height * 4);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned char* texel = &data[4 * (size_t(y) * width + x)];
+			texel[0] = texel[3] = 255;
+			for (int c = 0; c < 2; c++) {
+				const int cx = x * size[c][0] / width;
+				const int cy = y * size[c][1] / height;
+				texel[1 + c] = channels[c] ? channels[c][size_t(cy) * size[c][0] + cx] : 255;
+			}
+		}
+	}
+	stbi_image_free(channels[0]);
+	stbi_image_free(channels[1]);
+	return data;
+}
+
+bool LumenScene::load_compressed_texture(uint32_t texture_idx, TextureCompression::CompressedTexture& compressed) {
+	const TextureUsage usage = texture_usages[texture_idx];
+	// Packed textures are cached next to their first source
+	const auto packed = packed_sources.find(texture_idx);
+	std::string path = textures[texture_idx];
+	std::string variant = "";
+	if (packed != packed_sources.end()) {
+		path = packed->second.first.empty() ? packed->second.second : packed->second.first;
+		variant = packed->second.first.empty() || packed->second.second.empty()
+					  ? ".orm"
+					  : ".orm" + std::to_string(std::hash<std::string>{}(packed->second.second) & 0xffff);
+	} else if (usage == TextureUsage::AlphaMask) {
+		variant = ".mask";
+	} else if (usage == TextureUsage::Normal) {
+		variant = ".normal";
+	} else if (usage == TextureUsage::Packed) {
+		variant = ".orm";
+	}
+	if (TextureCompression::load_cache(path, compressed, variant)) {
+		return true;
+	}
+	int x, y;
+	unsigned char* data = load_texture_pixels(texture_idx, x, y);
+	if (!data) {
+		LUMEN_WARN("Could not load texture {}", textures[texture_idx]);
+		return false;
+	}
+	const auto t_begin = std::chrono::high_resolution_clock::now();
+	// Normal maps keep two channels at full precision, the other data textures are stored linearly
+	const bool linear = usage == TextureUsage::Normal || usage == TextureUsage::Packed;
+	const TextureCompression::Format format =
+		usage == TextureUsage::Normal ? TextureCompression::Format::BC5 : TextureCompression::pick_format(data, x, y);
+	compressed = TextureCompression::compress(data, x, y, format, !linear);
+	const auto t_end = std::chrono::high_resolution_clock::now();
+	stbi_image_free(data);
+	TextureCompression::save_cache(path, compressed, variant);
+	LUMEN_TRACE("Transcoded {} ({}x{}) to {} in {:.1f} ms", textures[texture_idx], x, y,
+				TextureCompression::format_name(format),
+				std::chrono::duration<double, std::milli>(t_end - t_begin).count());
+	return true;
+}
+
+bool LumenScene::stream_textures() {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::Scene);
+	stream_cnt++;
+	// The frames in flight have finished with a view after MAX_FRAMES_IN_FLIGHT more frames
+	std::erase_if(retired_views, [this](const std::pair<VkImageView, uint32_t>& retired) {
+		if (retired.second > stream_cnt) {
+			return false;
+		}
+		vkDestroyImageView(vk::context().device, retired.first, nullptr);
+		return true;
+	});
+	bool streamed = false;
+	VkDeviceSize budget = texture_settings.stream_budget;
+	for (StreamedTexture& st : streamed_textures) {
+		// Coarse to fine, one level per texture and call so that every texture sharpens evenly
+		const uint32_t mip = st.resident_mip - 1;
+		const VkDeviceSize size = st.compressed.mip_size(mip);
+		if (size > budget && streamed) {
+			break;
+		}
+		vk::Texture* tex = scene_textures[st.texture_idx];
+		vk::upload_texture_mip(tex, mip, st.compressed.data.data() + st.compressed.mip_offsets[mip], size);
+		retired_views.push_back({tex->view, stream_cnt + MAX_FRAMES_IN_FLIGHT + 1});
+		tex->view = vk::create_texture_view(tex, mip);
+		st.resident_mip = mip;
+		budget -= std::min(budget, size);
+		streamed = true;
+	}
+	std::erase_if(streamed_textures, [](const StreamedTexture& st) { return st.resident_mip == 0; });
+	return streamed;
+}
+
 void LumenScene::add_default_texture() {
 	std::array<uint8_t, 4> nil = {0, 0, 0, 0};
 	scene_textures.resize(1);
@@ -699,6 +1042,36 @@ void LumenScene::add_default_texture() {
 										  .sampler = texture_sampler});
 }
 
+void LumenScene::create_env_map() {
+	const auto env_light = std::find_if(lights.begin(), lights.end(), [](const LumenLight& l) {
+		return (l.light_flags & 0x7) == LIGHT_ENVIRONMENT;
+	});
+	int width, height;
+	float* pixels = ImageUtils::load_hdr(env_light->env_map.c_str(), width, height);
+	if (!pixels) {
+		LUMEN_ERROR("Environment map could not be loaded");
+	}
+	lumen::EnvMapDistribution distribution;
+	distribution.build(pixels, width, height);
+	std::vector<float> distribution_data = distribution.gpu_data(env_light_idx);
+	env_distribution_buffer =
+		prm::get_buffer({.name = "Env Map Distribution Buffer",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = distribution_data.size() * sizeof(float),
+						 .data = distribution_data.data()});
+	LUMEN_ASSERT(scene_textures.size() == gpu_lights[env_light_idx].prim_mesh_idx,
+				 "Environment map texture slot doesn't follow the material textures");
+	scene_textures.push_back(
+		prm::get_texture({.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+						  .dimensions = {(uint32_t)width, (uint32_t)height, 1},
+						  .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+						  .data = {.data = pixels, .size = size_t(width) * height * 4 * sizeof(float)},
+						  .sampler = texture_sampler}));
+	free(pixels);
+	LUMEN_TRACE("Environment map {}: {}x{}", env_light->env_map, width, height);
+}
+
 void LumenScene::create_scene_config(const std::string& integrator_name) {
 	std::string name = integrator_name;
 	std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
@@ -724,11 +1097,56 @@ void LumenScene::create_scene_config(const std::string& integrator_name) {
 		config = std::make_unique<ReSTIRPTConfig>();
 	} else if (name == "ddgi") {
 		config = std::make_unique<DDGIConfig>();
+	} else if (name == "wavefrontpath") {
+		config = std::make_unique<WavefrontPathConfig>();
 	} else {
 		config = std::make_unique<PathConfig>();
 	}
 }
 
+void LumenScene::animate(float time) {
+	for (const auto& anim : animations) {
+		const float offset = std::sin(glm::two_pi<float>() * anim.frequency * time);
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), anim.translation * offset + anim.pivot);
+		m = glm::rotate(m, anim.angular_velocity * time, anim.axis);
+		m = glm::translate(m, -anim.pivot);
+		prim_meshes[anim.prim_mesh_idx].world_matrix = m * anim.base_matrix;
+	}
+	// Rigid motion preserves the triangle areas, so the light sampling pdfs stay valid
+	for (uint32_t light_idx : animated_lights) {
+		gpu_lights[light_idx].world_matrix = prim_meshes[gpu_lights[light_idx].prim_mesh_idx].world_matrix;
+	}
+}
+
+void LumenScene::fill_scene_desc(SceneDesc& desc, bool light_bvh) const {
+	desc.index_addr = index_buffer->get_device_address();
+	desc.material_addr = materials_buffer->get_device_address();
+	desc.prim_info_addr = prim_lookup_buffer->get_device_address();
+	desc.env_distribution_addr = env_distribution_addr();
+	desc.light_bvh_addr = light_bvh ? light_bvh_addr() : 0;
+	desc.compact_vertices_addr = compact_vertices_buffer->get_device_address();
+	desc.vertex_addr = vertex_buffer->get_device_address();
+	desc.full_precision_uv_addr = full_precision_uv_addr();
+}
+
+void LumenScene::upload_light_transforms() {
+	if (animated_lights.empty()) {
+		return;
+	}
+	vk::CommandBuffer cmd(true);
+	// Wait for the frames in flight that still read the previous transforms
+	VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+						 0, nullptr, 0, nullptr);
+	for (uint32_t light_idx : animated_lights) {
+		vkCmdUpdateBuffer(cmd.handle, mesh_lights_buffer->handle,
+						  light_idx * sizeof(Light) + offsetof(Light, world_matrix), sizeof(glm::mat4),
+						  &gpu_lights[light_idx].world_matrix);
+	}
+	cmd.submit();
+}
+
 void LumenScene::compute_scene_dimensions() {
 	Bbox scene_bbox;
 	for (const auto& pm : prim_meshes) {
@@ -750,17 +1168,257 @@ void LumenScene::compute_scene_dimensions() {
 	m_dimensions.radius = scene_bbox.radius();
 }
 
+void LumenScene::compute_tangents() {
+	tangents.assign(positions.size(), glm::vec4(0));
+	if (normals.size() != positions.size() || texcoords0.size() != positions.size()) {
+		return;
+	}
+	// Corners are welded on their exact attributes and the orientation of their triangle in texture space, so that
+	// mirrored charts don't cancel out
+	struct CornerKey {
+		std::array<float, 8> attribs;
+		bool flipped;
+		bool operator==(const CornerKey& other) const {
+			return attribs == other.attribs && flipped == other.flipped;
+		}
+	};
+	struct CornerKeyHash {
+		size_t operator()(const CornerKey& key) const {
+			size_t h = std::hash<bool>{}(key.flipped);
+			for (float f : key.attribs) {
+				h ^= std::hash<float>{}(f) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			}
+			return h;
+		}
+	};
+	auto compute_mesh_tangents = [this](const LumenPrimMesh& pm) {
+		std::unordered_map<CornerKey, uint32_t, CornerKeyHash> groups;
+		std::vector<uint32_t> corner_group(pm.idx_count);
+		std::vector<glm::vec3> group_t;
+		std::vector<glm::vec3> group_b;
+		for (uint32_t f = 0; f + 2 < pm.idx_count; f += 3) {
+			uint32_t vtx[3];
+			for (uint32_t c = 0; c < 3; c++) {
+				vtx[c] = pm.vtx_offset + indices[pm.first_idx + f + c];
+			}
+			const glm::vec3 e1 = positions[vtx[1]] - positions[vtx[0]];
+			const glm::vec3 e2 = positions[vtx[2]] - positions[vtx[0]];
+			const glm::vec2 duv1 = texcoords0[vtx[1]] - texcoords0[vtx[0]];
+			const glm::vec2 duv2 = texcoords0[vtx[2]] - texcoords0[vtx[0]];
+			const float det = duv1.x * duv2.y - duv2.x * duv1.y;
+			glm::vec3 t = glm::vec3(0);
+			glm::vec3 b = glm::vec3(0);
+			if (std::abs(det) > 1e-12f) {
+				t = (e1 * duv2.y - e2 * duv1.y) / det;
+				b = (e2 * duv1.x - e1 * duv2.x) / det;
+			}
+			for (uint32_t c = 0; c < 3; c++) {
+				const uint32_t v = vtx[c];
+				CornerKey key{{positions[v].x, positions[v].y, positions[v].z, normals[v].x, normals[v].y, normals[v].z,
+							   texcoords0[v].x, texcoords0[v].y},
+							  det < 0.0f};
+				auto [it, inserted] = groups.try_emplace(key, (uint32_t)group_t.size());
+				if (inserted) {
+					group_t.push_back(glm::vec3(0));
+					group_b.push_back(glm::vec3(0));
+				}
+				corner_group[f + c] = it->second;
+				// Project onto the tangent plane of the corner and weight by the angle of the corner
+				const glm::vec3& n = normals[v];
+				const glm::vec3 ct = t - n * glm::dot(n, t);
+				const glm::vec3 cb = b - n * glm::dot(n, b);
+				const glm::vec3 a = positions[vtx[(c + 1) % 3]] - positions[v];
+				const glm::vec3 d = positions[vtx[(c + 2) % 3]] - positions[v];
+				const float len = glm::length(a) * glm::length(d);
+				const float angle = len > 0.0f ? std::acos(std::clamp(glm::dot(a, d) / len, -1.0f, 1.0f)) : 0.0f;
+				if (glm::dot(ct, ct) > 0.0f) {
+					group_t[it->second] += angle * glm::normalize(ct);
+				}
+				if (glm::dot(cb, cb) > 0.0f) {
+					group_b[it->second] += angle * glm::normalize(cb);
+				}
+			}
+		}
+		for (uint32_t i = 0; i < pm.idx_count; i++) {
+			const uint32_t v = pm.vtx_offset + indices[pm.first_idx + i];
+			const glm::vec3& n = normals[v];
+			glm::vec3 t = group_t[corner_group[i]];
+			t -= n * glm::dot(n, t);
+			if (glm::dot(t, t) < 1e-12f) {
+				// No usable texture space derivatives, any orthogonal direction will do
+				t = std::abs(n.x) > 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+				t -= n * glm::dot(n, t);
+			}
+			t = glm::normalize(t);
+			const float sign = glm::dot(glm::cross(n, t), group_b[corner_group[i]]) < 0.0f ? -1.0f : 1.0f;
+			tangents[v] = glm::vec4(t, sign);
+		}
+	};
+	std::vector<std::future<void>> futures;
+	for (const LumenPrimMesh& pm : prim_meshes) {
+		if (pm.material_idx < materials.size() && materials[pm.material_idx].normal_texture_id > -1) {
+			futures.push_back(lumen::ThreadPool::submit(compute_mesh_tangents, std::cref(pm)));
+		}
+	}
+	for (auto& f : futures) {
+		f.wait();
+	}
+}
+
+glm::vec4 LumenScene::uv_range(const LumenPrimMesh& pm) const {
+	if (texcoords0.size() != positions.size() || pm.vtx_count == 0) {
+		return glm::vec4(0);
+	}
+	glm::vec2 uv_min(FLT_MAX);
+	glm::vec2 uv_max(-FLT_MAX);
+	for (uint32_t i = pm.vtx_offset; i < pm.vtx_offset + pm.vtx_count; i++) {
+		uv_min = glm::min(uv_min, texcoords0[i]);
+		uv_max = glm::max(uv_max, texcoords0[i]);
+	}
+	return glm::vec4(uv_min, uv_max - uv_min);
+}
+
+std::vector<PackedVertex> LumenScene::pack_vertices(std::vector<glm::vec2>& full_precision_uvs) const {
+	std::vector<PackedVertex> packed(positions.size(), PackedVertex{0, 0, 0});
+	const bool has_uvs = texcoords0.size() == positions.size();
+	// Meshes instanced from the same primitive share their vertices and therefore their range
+	std::unordered_set<uint32_t> packed_offsets;
+	for (const auto& pm : prim_meshes) {
+		if (!packed_offsets.insert(pm.vtx_offset).second) {
+			continue;
+		}
+		const glm::vec4 range = uv_range(pm);
+		const bool fits = VertexPacking::uv_fits_unorm16(range);
+		for (uint32_t i = pm.vtx_offset; i < pm.vtx_offset + pm.vtx_count; i++) {
+			const glm::vec3 n = glm::length(normals[i]) > 0.0f ? glm::normalize(normals[i]) : glm::vec3(0, 0, 1);
+			packed[i].normal = VertexPacking::pack_normal(n);
+			packed[i].tangent = VertexPacking::pack_tangent(tangents[i]);
+			if (!has_uvs) {
+				packed[i].uv = 0;
+			} else if (fits) {
+				packed[i].uv = VertexPacking::pack_uv(texcoords0[i], range);
+			} else {
+				packed[i].uv = (uint32_t)full_precision_uvs.size();
+				full_precision_uvs.push_back(texcoords0[i]);
+			}
+		}
+	}
+	return packed;
+}
+
+bool LumenScene::validate_vertex_packing() const {
+	std::vector<glm::vec2> full_precision_uvs;
+	const std::vector<PackedVertex> packed = pack_vertices(full_precision_uvs);
+	float max_normal_error = 0.0f;
+	float max_tangent_error = 0.0f;
+	// In absolute UV units, so that meshes with a large UV range can't hide their error
+	float max_uv_error = 0.0f;
+	uint32_t sign_errors = 0;
+	uint32_t full_precision_meshes = 0;
+	for (const auto& pm : prim_meshes) {
+		const glm::vec4 range = uv_range(pm);
+		const bool fits = VertexPacking::uv_fits_unorm16(range);
+		full_precision_meshes += !fits;
+		for (uint32_t i = pm.vtx_offset; i < pm.vtx_offset + pm.vtx_count; i++) {
+			if (glm::length(normals[i]) > 0.0f) {
+				const glm::vec3 n = glm::normalize(normals[i]);
+				const glm::vec3 decoded = VertexPacking::unpack_normal(packed[i].normal);
+				max_normal_error = std::max(max_normal_error, std::atan2(glm::length(glm::cross(n, decoded)),
+																		 glm::dot(n, decoded)));
+			}
+			if (tangents[i] != glm::vec4(0)) {
+				const glm::vec4 decoded = VertexPacking::unpack_tangent(packed[i].tangent);
+				const glm::vec3 t = glm::vec3(tangents[i]);
+				const glm::vec3 decoded_t = glm::vec3(decoded);
+				const float angle = std::atan2(glm::length(glm::cross(t, decoded_t)), glm::dot(t, decoded_t));
+				max_tangent_error = std::max(max_tangent_error, angle);
+				sign_errors += (decoded.w < 0.0f) != (tangents[i].w < 0.0f);
+			}
+			if (texcoords0.size() == positions.size()) {
+				const glm::vec2 decoded = fits ? VertexPacking::unpack_uv(packed[i].uv, range)
+											   : full_precision_uvs[packed[i].uv];
+				const glm::vec2 error = glm::abs(decoded - texcoords0[i]);
+				for (int c = 0; c < 2; c++) {
+					// Float rounding of the decoded value on top of the quantization
+					const float slack = 1e-6f * std::max(std::abs(texcoords0[i][c]), 1.0f);
+					max_uv_error = std::max(max_uv_error, error[c] - slack);
+				}
+			}
+		}
+	}
+	const size_t full_size = positions.size() * (sizeof(glm::vec3) + sizeof(Vertex));
+	const size_t quantized_size = positions.size() * (sizeof(glm::vec3) + sizeof(PackedVertex)) +
+								  full_precision_uvs.size() * sizeof(glm::vec2);
+	LUMEN_TRACE("Packed vertices: max normal error {:.4f} deg, max tangent error {:.4f} deg, {} flipped bitangents, "
+				"max uv error {:.3f} texels at 8k, {} meshes with fp32 uvs, {:.2f} MB instead of {:.2f} MB",
+				glm::degrees(max_normal_error), glm::degrees(max_tangent_error), sign_errors,
+				max_uv_error / MAX_UV_STEP, full_precision_meshes, quantized_size / 1e6, full_size / 1e6);
+	// Rounding to the nearest step is off by at most half of it
+	return glm::degrees(max_normal_error) < 0.01f && glm::degrees(max_tangent_error) < 0.01f && sign_errors == 0 &&
+		   max_uv_error <= 0.5f * MAX_UV_STEP;
+}
+
+void LumenScene::build_light_bvh() {
+	if (!use_light_bvh || gpu_lights.empty()) {
+		return;
+	}
+	if (!animated_lights.empty()) {
+		// The bounds would have to be refit every frame
+		LUMEN_WARN("Animated area lights are picked uniformly, skipping the light BVH");
+		return;
+	}
+	std::vector<lumen::LightBVH::Emitter> emitters;
+	emitters.reserve(total_light_triangle_cnt);
+	for (uint32_t light_idx = 0; light_idx < gpu_lights.size(); light_idx++) {
+		const Light& l = gpu_lights[light_idx];
+		const uint32_t light_type = l.light_flags & 0x7;
+		if (light_type == LIGHT_SPOT) {
+			emitters.push_back(lumen::LightBVH::spot_emitter(light_idx, l.pos, l.to, l.L));
+		} else if (light_type == LIGHT_AREA) {
+			const auto& pm = prim_meshes[l.prim_mesh_idx];
+			for (uint32_t i = 0; i < l.num_triangles; i++) {
+				const uint32_t idx_offset = pm.first_idx + 3 * i;
+				const glm::vec3 v0 = pm.world_matrix * glm::vec4(positions[pm.vtx_offset + indices[idx_offset]], 1.0);
+				const glm::vec3 v1 =
+					pm.world_matrix * glm::vec4(positions[pm.vtx_offset + indices[idx_offset + 1]], 1.0);
+				const glm::vec3 v2 =
+					pm.world_matrix * glm::vec4(positions[pm.vtx_offset + indices[idx_offset + 2]], 1.0);
+				emitters.push_back(lumen::LightBVH::triangle_emitter(light_idx, i, v0, v1, v2,
+																	 materials[pm.material_idx].emissive_factor));
+			}
+		}
+	}
+	light_bvh.build(std::move(emitters), gpu_lights, (uint32_t)prim_meshes.size());
+	LUMEN_TRACE("Light BVH: {} nodes over {} emitters", light_bvh.node_count(), light_bvh.emitter_count());
+}
+
 void LumenScene::destroy() {
+	if (!gpu_resources_created) {
+		return;
+	}
 	std::vector<vk::Buffer*> buffer_list = {index_buffer, vertex_buffer, compact_vertices_buffer, materials_buffer,
 											prim_lookup_buffer};
 	if (gpu_lights.size()) {
 		buffer_list.push_back(mesh_lights_buffer);
 	}
+	if (env_distribution_buffer) {
+		buffer_list.push_back(env_distribution_buffer);
+	}
+	if (light_bvh_buffer) {
+		buffer_list.push_back(light_bvh_buffer);
+	}
+	if (full_precision_uv_buffer) {
+		buffer_list.push_back(full_precision_uv_buffer);
+	}
 	for (vk::Buffer* b : buffer_list) {
 		prm::remove(b);
 	}
+	full_precision_uv_buffer = nullptr;
 	for (vk::Texture* tex : scene_textures) {
 		prm::remove(tex);
 	}
+	for (const auto& [view, _] : retired_views) {
+		vkDestroyImageView(vk::context().device, view, nullptr);
+	}
 	vkDestroySampler(vk::context().device, texture_sampler, nullptr);
 }
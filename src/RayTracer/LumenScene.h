@@ -7,20 +7,13 @@
 
 #include "shaders/commons.h"
 #include "Framework/MitsubaParser.h"
+#include "Framework/MeshLoader.h"
 #include "SceneConfig.h"
 #include "Framework/Buffer.h"
 #include "Framework/Texture.h"
 #include "Framework/Camera.h"
-
-struct MeshData {
-	std::vector<glm::vec3> positions;
-	std::vector<uint32_t> indices;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::vec3> tangents;
-	std::vector<glm::vec2> texcoords0;
-	std::vector<glm::vec2> texcoords1;
-	std::vector<glm::vec4> colors0;
-};
+#include "Framework/TextureCompression.h"
+#include "Framework/LightBVH.h"
 
 struct LumenPrimMesh {
 	std::string name;
@@ -42,17 +35,36 @@ struct LumenLight {
 	uint32_t light_flags;
 	float world_radius;
 	bool enabled = true;
+	// Equirectangular HDR image of an environment light
+	std::string env_map = "";
+};
+
+// Scripted rigid motion of a mesh, applied on top of its world matrix at load time: a rotation around pivot followed
+// by a sinusoidal translation
+struct LumenAnimation {
+	uint32_t prim_mesh_idx;
+	glm::vec3 pivot;
+	glm::vec3 axis = glm::vec3(0, 1, 0);
+	// Radians per second
+	float angular_velocity = 0.0f;
+	glm::vec3 translation = glm::vec3(0);
+	// Hz of the translation
+	float frequency = 0.0f;
+	glm::mat4 base_matrix;
 };
 
 class LumenScene {
    public:
    LumenScene() = default;
-	void load_scene(const std::string& path);
+	// host_only skips the camera and every Vulkan resource, which is what the CPU backend consumes
+	void load_scene(const std::string& path, bool host_only = false);
+	void create_camera(float aspect_ratio);
 	void destroy();
 	std::vector<glm::vec3> positions;
 	std::vector<uint32_t> indices;
 	std::vector<glm::vec3> normals;
-	std::vector<glm::vec3> tangents;
+	// Only generated for the meshes with a normal mapped material, zero elsewhere
+	std::vector<glm::vec4> tangents;
 	std::vector<glm::vec2> texcoords0;
 	std::vector<glm::vec2> texcoords1;
 	std::vector<glm::vec4> colors0;
@@ -60,16 +72,31 @@ class LumenScene {
 	std::vector<LumenPrimMesh> prim_meshes;
 	std::vector<Material> materials;
 	std::vector<std::string> textures;
+	// How each texture is sampled, which decides its format
+	enum class TextureUsage { Color, AlphaMask, Normal, Packed };
+	std::vector<TextureUsage> texture_usages;
 	std::vector<LumenLight> lights;
+	std::vector<LumenAnimation> animations;
 
 	std::vector<Light> gpu_lights;
 	vk::Buffer* index_buffer;
 	vk::Buffer* vertex_buffer;
 	vk::Buffer* compact_vertices_buffer;
+	// fp32 UVs of the meshes whose UVs don't fit in PackedVertex, see VertexPacking::uv_fits_unorm16
+	vk::Buffer* full_precision_uv_buffer = nullptr;
 	vk::Buffer* materials_buffer;
 	vk::Buffer* prim_lookup_buffer;
 	vk::Buffer* scene_desc_buffer;
 	vk::Buffer* mesh_lights_buffer;
+	// Importance sampling tables of the environment light, see EnvMapDistribution
+	vk::Buffer* env_distribution_buffer = nullptr;
+	// Light BVH for next event estimation, see LightBVH
+	vk::Buffer* light_bvh_buffer = nullptr;
+	lumen::LightBVH light_bvh;
+	// Build the light BVH on load, otherwise the shaders pick the lights uniformly
+	bool use_light_bvh = true;
+	// Store the shading attributes as PackedVertex and read the positions from vertex_buffer, see vertex_packing.h
+	bool quantize_vertices = true;
 	std::vector<vk::Texture*> scene_textures;
 	std::unique_ptr<lumen::Camera> camera;
 
@@ -86,14 +113,81 @@ class LumenScene {
 	std::unique_ptr<SceneConfig> config;
 
 	uint32_t dir_light_idx = -1;
+	// Index into gpu_lights, -1 without an environment light
+	uint32_t env_light_idx = -1;
+	// Device address for SceneDesc::env_distribution_addr, 0 without an environment light
+	inline uint64_t env_distribution_addr() const {
+		return env_distribution_buffer ? env_distribution_buffer->get_device_address() : 0;
+	}
+	// Device address for SceneDesc::full_precision_uv_addr, 0 when every mesh has packed UVs
+	inline uint64_t full_precision_uv_addr() const {
+		return full_precision_uv_buffer ? full_precision_uv_buffer->get_device_address() : 0;
+	}
+	// Device address for SceneDesc::light_bvh_addr, 0 without a light BVH
+	inline uint64_t light_bvh_addr() const { return light_bvh_buffer ? light_bvh_buffer->get_device_address() : 0; }
+	// Scene geometry, materials and lights of SceneDesc, identical for every integrator. Without light_bvh the
+	// shaders pick the lights uniformly
+	void fill_scene_desc(SceneDesc& desc, bool light_bvh = true) const;
+	inline bool has_animations() const { return !animations.empty(); }
+	// Evaluates the animations at time (in seconds), updating the world matrices of the meshes and their lights
+	void animate(float time);
+	// Copies the world matrices of the animated mesh lights to mesh_lights_buffer
+	void upload_light_transforms();
 	void create_scene_config(const std::string& integrator_name);
+	// Uploads pending mip levels of streamed textures within texture_settings.stream_budget. Returns true when a
+	// texture gained detail, which invalidates the accumulated image
+	bool stream_textures();
+	// Compares the attributes decoded from the packed vertices against the full precision ones
+	bool validate_vertex_packing() const;
+
+	struct TextureSettings {
+		// Transcode the material textures to BC1/BC7 with a full mip chain, cached next to the sources
+		bool compress = true;
+		// Mips larger than this many texels on a side are streamed in after load, 0 keeps every mip resident
+		uint32_t resident_size = 0;
+		VkDeviceSize stream_budget = 16 << 20;
+	} texture_settings;
 	inline bool has_bsdf_type(uint32_t flag) { return (bsdf_types & flag) != 0; }
+	inline bool is_alpha_masked(const LumenPrimMesh& pm) const {
+		return materials[pm.material_idx].alpha_texture_id > -1;
+	}
 
    private:
 	uint32_t bsdf_types = 0;
+	// Returns the index of the texture, shared between the materials that use the same file the same way
+	int add_texture(const std::string& path, TextureUsage usage);
+	// ORM texture assembled from separate roughness and metallic images, either may be empty
+	int add_packed_texture(const std::string& roughness, const std::string& metallic);
+	// Sources of the textures assembled by add_packed_texture
+	std::unordered_map<uint32_t, std::pair<std::string, std::string>> packed_sources;
+	// RGBA8 pixels of a texture, with the channels its usage expects. Free with stbi_image_free
+	unsigned char* load_texture_pixels(uint32_t texture_idx, int& width, int& height);
+	// Indices into gpu_lights of the area lights whose mesh is animated
+	std::vector<uint32_t> animated_lights;
+	bool gpu_resources_created = false;
+	struct StreamedTexture {
+		uint32_t texture_idx;
+		// Finest mip visible through the view of the texture
+		uint32_t resident_mip;
+		TextureCompression::CompressedTexture compressed;
+	};
+	std::vector<StreamedTexture> streamed_textures;
+	// Views replaced by streaming and the stream_textures call after which no frame in flight uses them
+	std::vector<std::pair<VkImageView, uint32_t>> retired_views;
+	uint32_t stream_cnt = 0;
+	bool load_compressed_texture(uint32_t texture_idx, TextureCompression::CompressedTexture& compressed);
 	void compute_scene_dimensions();
+	// Per vertex tangents of the normal mapped meshes, accumulated over the corners sharing a position, normal and
+	// texture coordinate as MikkTSpace does
+	void compute_tangents();
+	// Bounds of the texture coordinates of a mesh, see PrimMeshInfo::uv_range
+	glm::vec4 uv_range(const LumenPrimMesh& pm) const;
+	// The UVs of the meshes over MAX_UV_STEP go to full_precision_uvs, indexed by PackedVertex::uv
+	std::vector<PackedVertex> pack_vertices(std::vector<glm::vec2>& full_precision_uvs) const;
 	void load_lumen_scene(const std::string& path);
 	void load_mitsuba_scene(const std::string& path);
 	void add_default_texture();
+	void create_env_map();
+	void build_light_bvh();
 	VkSampler texture_sampler;
 };
@@ -0,0 +1,205 @@
+#include "LumenPCH.h"
+#include "MeshLoadBenchmark.h"
+#include "Framework/MeshLoader.h"
+#include "Framework/ThreadPool.h"
+#include <miniz.h>
+
+namespace MeshLoadBenchmark {
+
+// Best of the repetitions, the first one also pays for the page cache
+static constexpr int REPETITIONS = 3;
+
+// Height field over [-1, 1]^2 so that the normals vary per vertex
+static MeshData generate_mesh(uint64_t triangles) {
+	const uint32_t res = (uint32_t)std::ceil(std::sqrt(double(triangles) / 2.0)) + 1;
+	MeshData mesh;
+	mesh.positions.reserve(size_t(res) * res);
+	mesh.texcoords0.reserve(size_t(res) * res);
+	for (uint32_t y = 0; y < res; y++) {
+		for (uint32_t x = 0; x < res; x++) {
+			const glm::vec2 uv(float(x) / (res - 1), float(y) / (res - 1));
+			const glm::vec2 p = 2.0f * uv - 1.0f;
+			mesh.positions.emplace_back(p.x, 0.1f * std::sin(8.0f * p.x) * std::cos(8.0f * p.y), p.y);
+			mesh.texcoords0.push_back(uv);
+		}
+	}
+	mesh.indices.reserve(6 * size_t(res - 1) * (res - 1));
+	for (uint32_t y = 0; y + 1 < res; y++) {
+		for (uint32_t x = 0; x + 1 < res; x++) {
+			const uint32_t i = y * res + x;
+			mesh.indices.insert(mesh.indices.end(), {i, i + res, i + 1, i + 1, i + res, i + res + 1});
+		}
+	}
+	MeshLoader::compute_normals(mesh);
+	return mesh;
+}
+
+static void write_obj(const MeshData& mesh, const std::string& path) {
+	std::ofstream out(path);
+	out << std::setprecision(9);
+	for (const glm::vec3& p : mesh.positions) {
+		out << "v " << p.x << " " << p.y << " " << p.z << "\n";
+	}
+	for (const glm::vec2& t : mesh.texcoords0) {
+		out << "vt " << t.x << " " << t.y << "\n";
+	}
+	for (const glm::vec3& n : mesh.normals) {
+		out << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+	}
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+		out << "f";
+		for (size_t k = 0; k < 3; k++) {
+			const uint32_t idx = mesh.indices[i + k] + 1;
+			out << " " << idx << "/" << idx << "/" << idx;
+		}
+		out << "\n";
+	}
+}
+
+static void write_ply(const MeshData& mesh, const std::string& path, bool ascii) {
+	std::ofstream out(path, std::ios::binary);
+	out << "ply\nformat " << (ascii ? "ascii" : "binary_little_endian") << " 1.0\n";
+	out << "element vertex " << mesh.positions.size() << "\n";
+	for (const char* name : {"x", "y", "z", "nx", "ny", "nz", "u", "v"}) {
+		out << "property float " << name << "\n";
+	}
+	out << "element face " << mesh.indices.size() / 3 << "\n";
+	out << "property list uchar int vertex_indices\nend_header\n";
+	out << std::setprecision(9);
+	for (size_t i = 0; i < mesh.positions.size(); i++) {
+		const float v[8] = {mesh.positions[i].x, mesh.positions[i].y, mesh.positions[i].z, mesh.normals[i].x,
+							mesh.normals[i].y,	 mesh.normals[i].z,	  mesh.texcoords0[i].x, mesh.texcoords0[i].y};
+		if (ascii) {
+			out << v[0] << " " << v[1] << " " << v[2] << " " << v[3] << " " << v[4] << " " << v[5] << " " << v[6]
+				<< " " << v[7] << "\n";
+		} else {
+			out.write((const char*)v, sizeof(v));
+		}
+	}
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+		if (ascii) {
+			out << "3 " << mesh.indices[i] << " " << mesh.indices[i + 1] << " " << mesh.indices[i + 2] << "\n";
+		} else {
+			const uint8_t count = 3;
+			out.write((const char*)&count, 1);
+			out.write((const char*)&mesh.indices[i], 3 * sizeof(uint32_t));
+		}
+	}
+}
+
+// Version 4 file with a single single precision shape
+static void write_serialized(const MeshData& mesh, const std::string& path) {
+	std::vector<uint8_t> stream;
+	const auto append = [&](const void* src, size_t bytes) {
+		stream.insert(stream.end(), (const uint8_t*)src, (const uint8_t*)src + bytes);
+	};
+	// Normals, texture coordinates and single precision
+	const uint32_t flags = 0x0001 | 0x0002 | 0x1000;
+	const uint64_t num_vertices = mesh.positions.size();
+	const uint64_t num_triangles = mesh.indices.size() / 3;
+	append(&flags, 4);
+	append("benchmark", 10);
+	append(&num_vertices, 8);
+	append(&num_triangles, 8);
+	append(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+	append(mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3));
+	append(mesh.texcoords0.data(), mesh.texcoords0.size() * sizeof(glm::vec2));
+	append(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	mz_ulong compressed_size = mz_compressBound((mz_ulong)stream.size());
+	std::vector<uint8_t> compressed(compressed_size);
+	if (mz_compress2(compressed.data(), &compressed_size, stream.data(), (mz_ulong)stream.size(), MZ_BEST_SPEED) !=
+		MZ_OK) {
+		LUMEN_ERROR("Could not compress " + path);
+	}
+	std::ofstream out(path, std::ios::binary);
+	const uint16_t header[2] = {0x041C, 4};
+	const uint64_t offset = 0;
+	const uint32_t count = 1;
+	out.write((const char*)header, sizeof(header));
+	out.write((const char*)compressed.data(), compressed_size);
+	out.write((const char*)&offset, sizeof(offset));
+	out.write((const char*)&count, sizeof(count));
+}
+
+// Corner positions of every triangle, which also holds for the unwelded OBJ
+static bool matches(const MeshData& expected, const MeshData& loaded, float& max_error) {
+	max_error = 0.0f;
+	if (loaded.indices.size() != expected.indices.size() || loaded.normals.size() != loaded.positions.size() ||
+		loaded.texcoords0.size() != loaded.positions.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < expected.indices.size(); i++) {
+		const glm::vec3 d = glm::abs(loaded.positions[loaded.indices[i]] - expected.positions[expected.indices[i]]);
+		max_error = std::max(max_error, std::max(d.x, std::max(d.y, d.z)));
+	}
+	return max_error <= 1e-5f;
+}
+
+int run(int argc, char* argv[]) {
+	const uint64_t triangles = argc > 2 ? std::stoull(argv[2]) : 4'000'000;
+	const MeshData mesh = generate_mesh(triangles);
+	LUMEN_TRACE("Synthetic mesh: {} vertices, {} triangles", mesh.positions.size(), mesh.indices.size() / 3);
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "lumen_mesh_benchmark";
+	std::filesystem::create_directories(dir);
+
+	struct Format {
+		const char* name;
+		std::string path;
+		std::function<void(const std::string&, MeshData&)> load;
+	};
+	const std::vector<Format> formats = {
+		{"obj", (dir / "mesh.obj").string(), MeshLoader::load_obj},
+		{"ply ascii", (dir / "mesh_ascii.ply").string(), MeshLoader::load_ply},
+		{"ply binary", (dir / "mesh.ply").string(), MeshLoader::load_ply},
+		{"serialized", (dir / "mesh.serialized").string(),
+		 [](const std::string& path, MeshData& m) { MeshLoader::load_serialized(path, 0, m); }},
+	};
+	write_obj(mesh, formats[0].path);
+	write_ply(mesh, formats[1].path, true);
+	write_ply(mesh, formats[2].path, false);
+	write_serialized(mesh, formats[3].path);
+
+	bool valid = true;
+	double sequential_ms = 0.0;
+	LUMEN_TRACE("{:<12} {:>10} {:>10} {:>10} {:>12}", "format", "size MB", "ms", "MB/s", "Mtris/s");
+	for (const Format& format : formats) {
+		const double size_mb = std::filesystem::file_size(format.path) * 1e-6;
+		double best_ms = DBL_MAX;
+		for (int r = 0; r < REPETITIONS; r++) {
+			MeshData loaded;
+			const auto start = std::chrono::high_resolution_clock::now();
+			format.load(format.path, loaded);
+			const auto end = std::chrono::high_resolution_clock::now();
+			best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(end - start).count());
+			float max_error;
+			if (r == 0 && !matches(mesh, loaded, max_error)) {
+				LUMEN_WARN("{} does not match the generated mesh, max position error {}", format.name, max_error);
+				valid = false;
+			}
+		}
+		sequential_ms += best_ms;
+		LUMEN_TRACE("{:<12} {:>10.1f} {:>10.1f} {:>10.1f} {:>12.2f}", format.name, size_mb, best_ms,
+					size_mb / (best_ms * 1e-3), mesh.indices.size() / 3 * 1e-6 / (best_ms * 1e-3));
+	}
+	// The scene loaders load independent shapes on the thread pool
+	const auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::future<MeshData>> futures;
+	for (const Format& format : formats) {
+		futures.push_back(lumen::ThreadPool::submit([&format]() {
+			MeshData loaded;
+			format.load(format.path, loaded);
+			return loaded;
+		}));
+	}
+	for (auto& f : futures) {
+		f.get();
+	}
+	const double parallel_ms =
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	LUMEN_TRACE("All formats: {:.1f} ms sequential, {:.1f} ms on the thread pool", sequential_ms, parallel_ms);
+
+	std::filesystem::remove_all(dir);
+	LUMEN_TRACE("Mesh loading {}", valid ? "passed" : "failed");
+	return valid ? 0 : 1;
+}
+}  // namespace MeshLoadBenchmark
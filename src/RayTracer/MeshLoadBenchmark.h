@@ -0,0 +1,9 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Load times of the mesh formats of the scene loaders on a synthetic mesh, written once as OBJ, ASCII and binary PLY
+// and Mitsuba .serialized. Every loaded mesh is checked against the generated one. Needs no GPU
+namespace MeshLoadBenchmark {
+// Handles --mesh-benchmark [triangles]
+int run(int argc, char* argv[]);
+}  // namespace MeshLoadBenchmark
@@ -146,11 +146,8 @@ void PSSMLT::init() {
 	} while (arr_size > 1);
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	// The MLT path pdfs assume uniform light picking
+	lumen_scene->fill_scene_desc(desc, /* light_bvh = */ false);
 	// PSSMLT
 	desc.bootstrap_addr = bootstrap_buffer->get_device_address();
 	desc.cdf_addr = cdf_buffer->get_device_address();
@@ -168,8 +165,6 @@ void PSSMLT::init() {
 	desc.camera_path_addr = camera_path_buffer->get_device_address();
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer,
-								 vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, bootstrap_addr, bootstrap_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, cdf_addr, cdf_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, cdf_sum_addr, cdf_sum_buffer, vk::render_graph());
@@ -481,4 +476,11 @@ void PSSMLT::destroy() {
 	if (cdf_cpu->size) {
 		prm::remove(cdf_cpu);
 	}
-}
\ No newline at end of file
+}
+
+void PSSMLT::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("config.mutations_per_pixel", config->mutations_per_pixel);
+	visitor("config.num_mlt_threads", config->num_mlt_threads);
+	visitor("config.num_bootstrap_samples", config->num_bootstrap_samples);
+}
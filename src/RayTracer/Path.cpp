@@ -4,11 +4,9 @@
 void Path::init() {
 	Integrator::init();
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	lumen_scene->fill_scene_desc(desc);
+	set_adaptive_addrs(desc);
+	set_aov_addrs(desc);
 	lumen_scene->scene_desc_buffer =
 		prm::get_buffer({.name = "Scene Desc",
 						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
@@ -19,14 +17,13 @@ void Path::init() {
 	frame_num = 0;
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	// For shader resource dependency inference, use this macro to register a buffer address to the rendergraph
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer, vk::render_graph());
 	path_length = config->path_length;
 }
 
 void Path::render() {
-	pc_ray.size_x = Window::width();
-	pc_ray.size_y = Window::height();
+	const VkExtent2D extent = render_extent();
+	pc_ray.size_x = extent.width;
+	pc_ray.size_y = extent.height;
 	pc_ray.num_lights = (int)lumen_scene->gpu_lights.size();
 	pc_ray.time = rand() % UINT_MAX;
 	pc_ray.max_depth = path_length;
@@ -36,6 +33,20 @@ void Path::render() {
 	pc_ray.dir_light_idx = lumen_scene->dir_light_idx;
 	pc_ray.frame_num = frame_num;
 	pc_ray.direct_lighting = direct_lighting;
+	pc_ray.adaptive = adaptive.enabled;
+	uint32_t dims[2] = {extent.width, extent.height};
+	std::vector<vk::ShaderMacro> macros = sampler_macros();
+	std::vector<vk::ShaderMacro> aov = aov_macros();
+	macros.insert(macros.end(), aov.begin(), aov.end());
+	if (adaptive.enabled) {
+		const uint32_t launch_tiles = adaptive_launch_tiles(extent);
+		if (launch_tiles == 0) {
+			return;
+		}
+		add_adaptive_mask_pass(extent);
+		dims[0] = ADAPTIVE_TILE_SIZE * ADAPTIVE_TILE_SIZE;
+		dims[1] = launch_tiles;
+	}
 	vk::render_graph()
 		->add_rt("Path",
 				 {
@@ -44,7 +55,8 @@ void Path::render() {
 								 {"src/shaders/ray_shadow.rmiss"},
 								 {"src/shaders/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
-					 .dims = {Window::width(), Window::height()},
+					 .macros = macros,
+					 .dims = {dims[0], dims[1]},
 				 })
 		.push_constants(&pc_ray)
 		.bind({
@@ -56,6 +68,9 @@ void Path::render() {
 		.bind_texture_array(lumen_scene->scene_textures)
 		//.write(output_tex) // Needed if the automatic shader inference is disabled
 		.bind_tlas(tlas);
+	if (adaptive.enabled) {
+		queue_adaptive_readback();
+	}
 }
 
 bool Path::update() {
@@ -73,5 +88,13 @@ bool Path::gui() {
 	bool result = Integrator::gui();
 	result |= ImGui::SliderInt("Path length", (int*)&path_length, 0, 12);
 	result |= ImGui::Checkbox("Direct lighting", &direct_lighting);
+	result |= sampler_gui();
+	result |= adaptive_gui();
 	return result;
 }
+
+void Path::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("path_length", path_length);
+	visitor("direct_lighting", direct_lighting);
+}
@@ -10,6 +10,10 @@ class Path final : public Integrator {
 	virtual bool update() override;
 	virtual void destroy() override;
 	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
+	virtual bool supports_render_scale() const override { return true; }
+	virtual bool supports_adaptive_sampling() const override { return true; }
+	virtual uint32_t supported_aovs() const override { return (1u << AOV_COUNT) - 1; }
 
    private:
 	PCPath pc_ray{};
@@ -0,0 +1,157 @@
+#include "LumenPCH.h"
+#include "PathVertexCheck.h"
+#include "SceneConfig.h"
+#include "shaders/integrators/path_vertex_packing.h"
+
+namespace PathVertexCheck {
+
+// 16 bit octahedral directions are within ~0.004 degrees
+static constexpr float MAX_DIRECTION_ERROR = 1e-4f;
+// fp16 rounding of the components relative to the largest one
+static constexpr float MAX_THROUGHPUT_ERROR = 1e-3f;
+
+static float angle(const glm::vec3& a, const glm::vec3& b) {
+	return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+// Relative to the largest component, which is what the scale preserves
+static float throughput_error(const glm::vec3& expected, const glm::vec3& decoded) {
+	const float scale = std::max(expected.x, std::max(expected.y, expected.z));
+	if (scale <= 0.0f) {
+		return decoded == glm::vec3(0) ? 0.0f : 1.0f;
+	}
+	const glm::vec3 error = glm::abs(decoded - expected) / scale;
+	return std::max(error.x, std::max(error.y, error.z));
+}
+
+struct Errors {
+	float direction = 0.0f;
+	float throughput = 0.0f;
+	uint32_t mismatches = 0;
+};
+
+static void check_path_vertex(const PathVertex& v, Errors& errors) {
+	const PathVertex d = PathVertexPacking::unpack_path_vertex(PathVertexPacking::pack_path_vertex(v));
+	errors.direction = std::max(errors.direction, std::max(angle(v.dir, d.dir), angle(v.n_s, d.n_s)));
+	errors.throughput = std::max(errors.throughput, throughput_error(v.throughput, d.throughput));
+	errors.mismatches += d.pos != v.pos || d.uv != v.uv || d.light_flags != v.light_flags ||
+						 d.light_idx != v.light_idx || d.material_idx != v.material_idx || d.delta != v.delta ||
+						 d.side != v.side || d.mode != v.mode || d.area != v.area || d.pdf_fwd != v.pdf_fwd ||
+						 d.pdf_rev != v.pdf_rev;
+}
+
+static void check_vcm_vertex(const VCMVertex& v, Errors& errors) {
+	const VCMVertex d = PathVertexPacking::unpack_vcm_vertex(PathVertexPacking::pack_vcm_vertex(v));
+	errors.direction =
+		std::max(errors.direction, std::max(angle(v.wi, d.wi), std::max(angle(v.wo, d.wo), angle(v.n_s, d.n_s))));
+	errors.throughput = std::max(errors.throughput, throughput_error(v.throughput, d.throughput));
+	errors.mismatches += d.pos != v.pos || d.uv != v.uv || d.material_idx != v.material_idx ||
+						 d.path_len != v.path_len || d.area != v.area || d.d_vcm != v.d_vcm || d.d_vc != v.d_vc ||
+						 d.d_vm != v.d_vm || d.side != v.side || d.coords != v.coords;
+}
+
+static bool validate(uint32_t num_samples) {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	const auto direction = [&]() {
+		const float z = 1.0f - 2.0f * uniform(rng);
+		const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		const float phi = 2.0f * glm::pi<float>() * uniform(rng);
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	};
+	// Light subpath throughputs span many orders of magnitude, also between the channels of a vertex
+	const auto throughput = [&]() {
+		return glm::vec3(std::pow(10.0f, -6.0f + 14.0f * uniform(rng)), std::pow(10.0f, -6.0f + 14.0f * uniform(rng)),
+						 std::pow(10.0f, -6.0f + 14.0f * uniform(rng)));
+	};
+	Errors path_errors;
+	Errors vcm_errors;
+	for (uint32_t i = 0; i < num_samples; i++) {
+		PathVertex v;
+		v.dir = direction();
+		v.n_s = direction();
+		v.pos = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 1e3f;
+		v.uv = glm::vec2(uniform(rng), uniform(rng));
+		v.throughput = i % 16 == 0 ? glm::vec3(0) : throughput();
+		v.light_flags = rng() % 64;
+		v.light_idx = rng();
+		// Escaped camera vertices
+		v.material_idx = i % 8 == 0 ? ~0u : rng();
+		v.delta = rng() % 2;
+		v.side = rng() % 2;
+		v.mode = rng() % 2;
+		v.area = uniform(rng);
+		v.pdf_fwd = uniform(rng) * 1e4f;
+		v.pdf_rev = uniform(rng) * 1e4f;
+		check_path_vertex(v, path_errors);
+
+		VCMVertex c;
+		c.wi = direction();
+		c.wo = direction();
+		c.n_s = direction();
+		c.pos = v.pos;
+		c.uv = v.uv;
+		c.throughput = v.throughput;
+		c.material_idx = v.material_idx;
+		c.path_len = rng() % 32;
+		c.area = v.area;
+		c.d_vcm = uniform(rng) * 1e6f;
+		c.d_vc = uniform(rng);
+		c.d_vm = uniform(rng) * 1e3f;
+		c.side = v.side;
+		c.coords = rng();
+		check_vcm_vertex(c, vcm_errors);
+	}
+	// The normal of an escaped vertex is never written
+	PathVertex escaped{};
+	escaped.dir = glm::vec3(0, 0, 1);
+	escaped.material_idx = ~0u;
+	const PathVertex decoded = PathVertexPacking::unpack_path_vertex(PathVertexPacking::pack_path_vertex(escaped));
+	const bool escaped_valid = !glm::any(glm::isnan(decoded.n_s)) && decoded.material_idx == ~0u;
+
+	LUMEN_TRACE("PathVertex: max direction error {:.5f} deg, max throughput error {:.2e}, {} mismatching fields",
+				glm::degrees(path_errors.direction), path_errors.throughput, path_errors.mismatches);
+	LUMEN_TRACE("VCMVertex: max direction error {:.5f} deg, max throughput error {:.2e}, {} mismatching fields",
+				glm::degrees(vcm_errors.direction), vcm_errors.throughput, vcm_errors.mismatches);
+	bool valid = escaped_valid;
+	for (const Errors& errors : {path_errors, vcm_errors}) {
+		valid &= errors.direction <= MAX_DIRECTION_ERROR && errors.throughput <= MAX_THROUGHPUT_ERROR &&
+				 errors.mismatches == 0;
+	}
+	return valid;
+}
+
+static void memory_report(uint64_t width, uint64_t height, uint64_t path_length) {
+	const auto mb = [](uint64_t bytes) { return double(bytes) / (1024.0 * 1024.0); };
+	const auto report = [&](const char* name, uint64_t before, uint64_t after) {
+		LUMEN_TRACE("{:<6} {:>10.2f} MB -> {:>10.2f} MB ({:.1f}%)", name, mb(before), mb(after),
+					100.0 * double(after) / double(before));
+	};
+	const uint64_t vertices = width * height * (path_length + 1);
+	// Light and camera subpaths in memory before, the camera subpath stays in the invocation now
+	report("BDPT", 2 * vertices * sizeof(PathVertex), vertices * sizeof(PackedPathVertex));
+	report("VCM", vertices * sizeof(VCMVertex), vertices * sizeof(PackedVCMVertex));
+	const SMLTConfig smlt;
+	const uint64_t smlt_vertices =
+		uint64_t(std::max(smlt.num_mlt_threads, smlt.num_bootstrap_samples)) * (path_length + 1);
+	report("SMLT", smlt_vertices * sizeof(VCMVertex), smlt_vertices * sizeof(PackedVCMVertex));
+}
+
+int run(int argc, char* argv[]) {
+	uint64_t width = 1920;
+	uint64_t height = 1080;
+	uint64_t path_length = SceneConfig().path_length;
+	if (argc > 4) {
+		width = std::stoull(argv[2]);
+		height = std::stoull(argv[3]);
+		path_length = std::stoull(argv[4]);
+	}
+	LUMEN_TRACE("Vertex sizes: PathVertex {} -> {} bytes, VCMVertex {} -> {} bytes", sizeof(PathVertex),
+				sizeof(PackedPathVertex), sizeof(VCMVertex), sizeof(PackedVCMVertex));
+	LUMEN_TRACE("Subpath memory at {}x{}, path length {}:", width, height, path_length);
+	memory_report(width, height, path_length);
+	const bool valid = validate(1 << 20);
+	LUMEN_TRACE("Path vertex packing {}", valid ? "passed" : "failed");
+	return valid ? 0 : 1;
+}
+}  // namespace PathVertexCheck
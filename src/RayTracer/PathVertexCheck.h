@@ -0,0 +1,9 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Round trip of the packed BDPT and VCM subpath vertices on the CPU, and the subpath memory of BDPT, VCM and SMLT
+// before and after packing. Needs no GPU
+namespace PathVertexCheck {
+// Handles --path-vertex-check [width height path_length]
+int run(int argc, char* argv[]);
+}  // namespace PathVertexCheck
@@ -3,8 +3,10 @@
 #include "PostFX.h"
 #include "Framework/PersistentResourceManager.h"
 #include "Framework/DynamicResourceManager.h"
+#include "Framework/MemoryBudget.h"
 
-void PostFX::init() {
+void PostFX::init(VkFormat output_format) {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::PostFX);
 	VkSamplerCreateInfo sampler_ci = vk::sampler();
 	sampler_ci.minFilter = VK_FILTER_NEAREST;
 	sampler_ci.magFilter = VK_FILTER_NEAREST;
@@ -14,6 +16,22 @@ void PostFX::init() {
 	sampler_ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
 	sampler_ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
 	vk::check(vkCreateSampler(vk::context().device, &sampler_ci, nullptr, &img_sampler));
+	sampler_ci.minFilter = VK_FILTER_LINEAR;
+	sampler_ci.magFilter = VK_FILTER_LINEAR;
+	sampler_ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	vk::check(vkCreateSampler(vk::context().device, &sampler_ci, nullptr, &linear_sampler));
+	auto history_tex_desc = vk::TextureDesc{
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		.dimensions = {Window::width(), Window::height(), 1},
+		.format = output_format,
+		.initial_layout = VK_IMAGE_LAYOUT_GENERAL,
+		.sampler = linear_sampler};
+	for (int i = 0; i < 2; i++) {
+		history_tex_desc.name = i == 0 ? "Upsample History 0" : "Upsample History 1";
+		upsample_history[i] = prm::get_texture(history_tex_desc);
+	}
+	upsample_frames = 0;
 	// Load the kernel
 	const char* img_name_kernel = "assets/kernels/Octagonal512.exr";
 	int width, height;
@@ -39,9 +57,12 @@ void PostFX::init() {
 										  .format = VK_FORMAT_R32G32B32A32_SFLOAT,
 										  .initial_layout = VK_IMAGE_LAYOUT_GENERAL,
 										  .sampler = img_sampler};
-	fft_ping_padded = prm::get_texture(empty_tex_desc);
-	empty_tex_desc.name = "FFT - Pong";
-	fft_pong_padded = prm::get_texture(empty_tex_desc);
+	for (int i = 0; i < 2; i++) {
+		empty_tex_desc.name = i == 0 ? "FFT - Ping 0" : "FFT - Ping 1";
+		fft_ping_padded[i] = prm::get_texture(empty_tex_desc);
+		empty_tex_desc.name = i == 0 ? "FFT - Pong 0" : "FFT - Pong 1";
+		fft_pong_padded[i] = prm::get_texture(empty_tex_desc);
+	}
 	empty_tex_desc.name = "Kernel - Pong";
 	vk::Texture* kernel_ping = drm::get(empty_tex_desc);
 	kernel_pong = prm::get_texture(empty_tex_desc);
@@ -58,14 +79,15 @@ void PostFX::init() {
 		.bind_texture_with_sampler(kernel_org, img_sampler)
 		.bind(kernel_ping);
 
-	uint32_t wg_size_x = fft_ping_padded->extent.width;
-	uint32_t wg_size_y = fft_ping_padded->extent.height;
-	auto dim_y = (uint32_t)(fft_ping_padded->extent.width * fft_ping_padded->extent.height + wg_size_x - 1) / wg_size_x;
-	auto dim_x = (uint32_t)(fft_ping_padded->extent.width * fft_ping_padded->extent.height + wg_size_y - 1) / wg_size_y;
+	const VkExtent3D& padded_extent = fft_ping_padded[0]->extent;
+	uint32_t wg_size_x = padded_extent.width;
+	uint32_t wg_size_y = padded_extent.height;
+	auto dim_y = (uint32_t)(padded_extent.width * padded_extent.height + wg_size_x - 1) / wg_size_x;
+	auto dim_x = (uint32_t)(padded_extent.width * padded_extent.height + wg_size_y - 1) / wg_size_y;
 	bool vertical = false;
 
-	const int RADIX_X = (31 - std::countl_zero(fft_ping_padded->extent.width)) % 2 ? 2 : 4;
-	const int RADIX_Y = (31 - std::countl_zero(fft_ping_padded->extent.height)) % 2 ? 2 : 4;
+	const int RADIX_X = (31 - std::countl_zero(padded_extent.width)) % 2 ? 2 : 4;
+	const int RADIX_Y = (31 - std::countl_zero(padded_extent.height)) % 2 ? 2 : 4;
 	const std::vector<vk::ShaderMacro> macros_x =
 		RADIX_X == 2 ? std::vector<vk::ShaderMacro>{{"KERNEL_GENERATION"}}
 					 : std::vector<vk::ShaderMacro>{{"KERNEL_GENERATION"}, {"RADIX", RADIX_X}};
@@ -90,26 +112,59 @@ void PostFX::init() {
 	drm::destroy(kernel_ping);
 }
 
+vk::Texture* PostFX::upsample(vk::Texture* input, float render_scale, const glm::mat4& reprojection) {
+	vk::Texture* history = upsample_history[upsample_set];
+	vk::Texture* output = upsample_history[upsample_set ^ 1];
+	pc_upsample.reprojection = reprojection;
+	pc_upsample.render_scale = glm::vec2(render_scale);
+	pc_upsample.history_valid = upsample_frames > 0;
+	pc_upsample.blend_factor = upsample_blend_factor;
+	const uint32_t wg_x = (output->extent.width + 31) / 32;
+	const uint32_t wg_y = (output->extent.height + 31) / 32;
+	vk::render_graph()
+		->add_compute("Temporal Upsample",
+					  {.shader = vk::Shader("src/shaders/upsample/temporal_upsample.comp"), .dims = {wg_x, wg_y, 1}})
+		.push_constants(&pc_upsample)
+		.bind_texture_with_sampler(input, linear_sampler)
+		.bind_texture_with_sampler(history, linear_sampler)
+		.bind(output);
+	upsample_set ^= 1;
+	upsample_frames++;
+	upsampled = true;
+	return output;
+}
+
 void PostFX::render(vk::Texture* input, vk::Texture* output) {
 	lumen::RenderGraph* rg = vk::render_graph();
+	// The upsampling history is stale once a frame has been rendered at full resolution
+	if (!upsampled) {
+		upsample_frames = 0;
+	}
+	upsampled = false;
+	// The FFT passes run on the async compute queue when available, overlapping the next frame's ray tracing. The
+	// Post FX pass then composites the bloom of the previous frame
+	const bool async_bloom = rg->async_compute_enabled();
+	const uint32_t write_set = fft_set;
+	const uint32_t read_set = async_bloom ? fft_set ^ 1 : fft_set;
+	const bool bloom_ready = !async_bloom || bloom_frames > 0;
+	vk::Texture* fft_ping = fft_ping_padded[write_set];
+	vk::Texture* fft_pong = fft_pong_padded[write_set];
 	// Copy the original image to the padded texture
 	if (enable_bloom) {
-		uint32_t pad_width = (fft_ping_padded->extent.width + 31) / 32;
-		uint32_t pad_height = (fft_ping_padded->extent.height + 31) / 32;
+		uint32_t pad_width = (fft_ping->extent.width + 31) / 32;
+		uint32_t pad_height = (fft_ping->extent.height + 31) / 32;
 
 		rg->add_compute("Pad Image",
 						{.shader = vk::Shader("src/shaders/bloom/pad.comp"), .dims = {pad_width, pad_height, 1}})
 			.bind_texture_with_sampler(input, img_sampler)
-			.bind(fft_ping_padded);
-		uint32_t wg_size_x = fft_ping_padded->extent.width;
-		uint32_t wg_size_y = fft_ping_padded->extent.height;
-		auto dim_y =
-			(uint32_t)(fft_ping_padded->extent.width * fft_ping_padded->extent.height + wg_size_x - 1) / wg_size_x;
-		auto dim_x =
-			(uint32_t)(fft_ping_padded->extent.width * fft_ping_padded->extent.height + wg_size_y - 1) / wg_size_y;
+			.bind(fft_ping);
+		uint32_t wg_size_x = fft_ping->extent.width;
+		uint32_t wg_size_y = fft_ping->extent.height;
+		auto dim_y = (uint32_t)(fft_ping->extent.width * fft_ping->extent.height + wg_size_x - 1) / wg_size_x;
+		auto dim_x = (uint32_t)(fft_ping->extent.width * fft_ping->extent.height + wg_size_y - 1) / wg_size_y;
 		bool vertical = false;
-		const int RADIX_X = (31 - std::countl_zero(fft_ping_padded->extent.width)) % 2 ? 2 : 4;
-		const int RADIX_Y = (31 - std::countl_zero(fft_ping_padded->extent.height)) % 2 ? 2 : 4;
+		const int RADIX_X = (31 - std::countl_zero(fft_ping->extent.width)) % 2 ? 2 : 4;
+		const int RADIX_Y = (31 - std::countl_zero(fft_ping->extent.height)) % 2 ? 2 : 4;
 		const std::vector<vk::ShaderMacro> macros_x =
 			RADIX_X == 2 ? std::vector<vk::ShaderMacro>{} : std::vector<vk::ShaderMacro>{{"RADIX", RADIX_X}};
 		const std::vector<vk::ShaderMacro> macros_y =
@@ -118,38 +173,46 @@ void PostFX::render(vk::Texture* input, vk::Texture* output) {
 											 .macros = macros_x,
 											 .specialization_data = {wg_size_x / RADIX_X, uint32_t(vertical), 0},
 											 .dims = {dim_y, 1, 1}})
-			.bind_texture_with_sampler(fft_ping_padded, img_sampler)
-			.bind(fft_pong_padded)
-			.bind_texture_with_sampler(kernel_pong, img_sampler);
+			.bind_texture_with_sampler(fft_ping, img_sampler)
+			.bind(fft_pong)
+			.bind_texture_with_sampler(kernel_pong, img_sampler)
+			.async_compute();
 		vertical = true;
 		rg->add_compute("FFT - Vertical", {.shader = vk::Shader("src/shaders/bloom/fft.comp"),
 										   .macros = macros_y,
 										   .specialization_data = {wg_size_y / RADIX_Y, uint32_t(vertical), 0},
 										   .dims = {dim_x, 1, 1}})
-			.bind_texture_with_sampler(fft_ping_padded, img_sampler)
-			.bind(fft_pong_padded)
-			.bind_texture_with_sampler(kernel_pong, img_sampler);
+			.bind_texture_with_sampler(fft_ping, img_sampler)
+			.bind(fft_pong)
+			.bind_texture_with_sampler(kernel_pong, img_sampler)
+			.async_compute();
 		rg->add_compute("FFT - Vertical - Inverse",
 						{.shader = vk::Shader("src/shaders/bloom/fft.comp"),
 						 .macros = macros_y,
 						 .specialization_data = {wg_size_y / RADIX_Y, uint32_t(vertical), 1},
 						 .dims = {dim_x, 1, 1}})
-			.bind_texture_with_sampler(fft_ping_padded, img_sampler)
-			.bind(fft_pong_padded)
-			.bind_texture_with_sampler(kernel_pong, img_sampler);
+			.bind_texture_with_sampler(fft_ping, img_sampler)
+			.bind(fft_pong)
+			.bind_texture_with_sampler(kernel_pong, img_sampler)
+			.async_compute();
 		vertical = false;
 		rg->add_compute("FFT - Horizontal - Inverse",
 						{.shader = vk::Shader("src/shaders/bloom/fft.comp"),
 						 .macros = macros_x,
 						 .specialization_data = {wg_size_x / RADIX_X, uint32_t(vertical), 1},
 						 .dims = {dim_y, 1, 1}})
-			.bind_texture_with_sampler(fft_ping_padded, img_sampler)
-			.bind(fft_pong_padded)
-			.bind_texture_with_sampler(kernel_pong, img_sampler);
+			.bind_texture_with_sampler(fft_ping, img_sampler)
+			.bind(fft_pong)
+			.bind_texture_with_sampler(kernel_pong, img_sampler)
+			.async_compute();
+		fft_set ^= 1;
+		bloom_frames++;
+	} else {
+		bloom_frames = 0;
 	}
 
 	pc_post_settings.enable_tonemapping = enable_tonemapping;
-	pc_post_settings.enable_bloom = enable_bloom;
+	pc_post_settings.enable_bloom = enable_bloom && bloom_ready;
 	pc_post_settings.bloom_amount = bloom_amount;
 	pc_post_settings.bloom_exposure = bloom_exposure;
 	pc_post_settings.width = output->extent.width;
@@ -170,7 +233,7 @@ void PostFX::render(vk::Texture* input, vk::Texture* output) {
 									ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
 								}})
 		.push_constants(&pc_post_settings)
-		.bind_texture_with_sampler(fft_pong_padded, img_sampler)
+		.bind_texture_with_sampler(fft_pong_padded[read_set], img_sampler)
 		.bind_texture_with_sampler(input, img_sampler);
 }
 
@@ -186,13 +249,17 @@ bool PostFX::gui() {
 	ImGui::SliderFloat("Bloom exposure", &exposure, -20.0f, 0.0f, "%.2f");
 	bloom_exposure = powf(10.0f, exposure);
 	ImGui::SliderFloat("Bloom amount", &bloom_amount, 0.0f, 1.0f, "%.2f");
+	ImGui::SliderFloat("Upsample blend factor", &upsample_blend_factor, 0.01f, 1.0f, "%.2f");
 	return updated;
 }
 
 void PostFX::destroy() {
-	std::vector<vk::Texture*> tex_list = {kernel_pong, fft_ping_padded, fft_pong_padded};
+	std::vector<vk::Texture*> tex_list = {kernel_pong,		  fft_ping_padded[0],	fft_ping_padded[1],
+										  fft_pong_padded[0], fft_pong_padded[1],	upsample_history[0],
+										  upsample_history[1]};
 	for (auto t : tex_list) {
 		prm::remove(t);
 	}
 	vkDestroySampler(vk::context().device, img_sampler, 0);
+	vkDestroySampler(vk::context().device, linear_sampler, 0);
 }
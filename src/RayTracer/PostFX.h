@@ -8,20 +8,33 @@
 
 class PostFX {
    public:
-	void init();
+	void init(VkFormat output_format = VK_FORMAT_R32G32B32A32_SFLOAT);
 	void render(vk::Texture* input, vk::Texture* output);
+	// Reconstructs a full resolution image from the top-left render_scale region of the input
+	vk::Texture* upsample(vk::Texture* input, float render_scale, const glm::mat4& reprojection);
 	bool gui();
 	void destroy();
 
    private:
 	vk::Texture* kernel_pong;
-	vk::Texture* fft_ping_padded;
-	vk::Texture* fft_pong_padded;
+	// Double buffered: With async compute, the bloom of a frame is composited by the next one
+	vk::Texture* fft_ping_padded[2];
+	vk::Texture* fft_pong_padded[2];
+	uint32_t fft_set = 0;
+	uint32_t bloom_frames = 0;
 	VkSampler img_sampler;
+	VkSampler linear_sampler;
+	// Temporal upsampling history, ping-ponged every frame
+	vk::Texture* upsample_history[2];
+	uint32_t upsample_set = 0;
+	uint32_t upsample_frames = 0;
+	bool upsampled = false;
+	PCUpsample pc_upsample;
 
 	PCPost pc_post_settings;
 	bool enable_tonemapping = false;
 	bool enable_bloom = false;
 	float bloom_exposure = 1e-5f;
 	float bloom_amount = 0.26f;
+	float upsample_blend_factor = 0.1f;
 };
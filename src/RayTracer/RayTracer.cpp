@@ -10,6 +10,62 @@ using namespace lumen;
 RayTracer* RayTracer::instance = nullptr;
 bool load_reference = false;
 bool calc_rmse = false;
+static constexpr uint32_t DEFAULT_TILE_SPP = 64;
+// In the order of IntegratorType
+static const char* INTEGRATOR_NAMES[] = {"Path",	"BDPT",	  "SPPM",	   "VCM",		"PSSMLT", "SMLT",
+										 "VCMMLT", "ReSTIR", "ReSTIR GI", "ReSTIR PT", "DDGI",	  "Wavefront Path"};
+
+// Name of the scene config of an integrator, e.g. "restirgi"
+static std::string integrator_config_name(int integrator_idx) {
+	std::string name = INTEGRATOR_NAMES[integrator_idx];
+	name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+	return name;
+}
+
+static int integrator_index(const std::string& config_name) {
+	for (int i = 0; i < IM_ARRAYSIZE(INTEGRATOR_NAMES); i++) {
+		if (integrator_config_name(i) == config_name) {
+			return i;
+		}
+	}
+	return int(IntegratorType::Path);
+}
+
+// EXR layers of the AOV_* bits, in bit order. The noisy lighting layers compress better with PIZ
+struct AOVLayer {
+	const char* name;
+	std::vector<std::string> channels;
+	bool half;
+	ImageUtils::ExrCompression compression;
+};
+static const AOVLayer AOV_LAYERS[AOV_COUNT] = {
+	{"albedo", {"R", "G", "B"}, true, ImageUtils::ExrCompression::ZIP},
+	{"normal", {"X", "Y", "Z"}, true, ImageUtils::ExrCompression::ZIP},
+	{"depth", {"Z"}, false, ImageUtils::ExrCompression::ZIP},
+	{"samples", {"Y"}, false, ImageUtils::ExrCompression::ZIP},
+	{"direct", {"R", "G", "B"}, true, ImageUtils::ExrCompression::PIZ},
+	{"indirect", {"R", "G", "B"}, true, ImageUtils::ExrCompression::PIZ},
+};
+
+// AOV_* bits of a comma separated list of layer names
+static uint32_t parse_aovs(const std::string& list) {
+	uint32_t mask = 0;
+	std::stringstream ss(list);
+	std::string name;
+	while (std::getline(ss, name, ',')) {
+		uint32_t i = 0;
+		while (i < AOV_COUNT && name != AOV_LAYERS[i].name) {
+			i++;
+		}
+		if (i == AOV_COUNT) {
+			LUMEN_WARN("Unknown AOV {}", name);
+			continue;
+		}
+		mask |= 1u << i;
+	}
+	return mask;
+}
 
 RayTracer::RayTracer(bool debug, int argc, char* argv[]) : debug(debug) {
 	instance = this;
@@ -17,16 +73,21 @@ RayTracer::RayTracer(bool debug, int argc, char* argv[]) : debug(debug) {
 }
 
 void RayTracer::init() {
-	srand((uint32_t)time(NULL));
+	// Recordings keep the seed, so that their replays draw the same random numbers
+	if (seed < 0) {
+		seed = time(NULL);
+	}
+	srand(uint32_t(seed));
 	Window::add_key_callback([this](KeyInput key, KeyAction action) {
 		if (Window::is_key_down(KeyInput::KEY_F1)) {
 			show_ui = !show_ui;
 		}
-		if (Window::is_key_down(KeyInput::KEY_F10)) {
+		if (Window::is_key_down(KeyInput::KEY_F10) && !tiled_renderer.active()) {
 			write_exr = true;
 		} else if (Window::is_key_down(KeyInput::KEY_F11)) {
 			comparison_mode ^= true;
 		} else if (Window::is_key_down(KeyInput::KEY_F5)) {
+			vk::render_graph()->cancel_prewarm();
 			vk::render_graph()->reload_shaders = true;
 			vk::render_graph()->shader_cache.clear();
 			integrator->updated = true;
@@ -41,6 +102,16 @@ void RayTracer::init() {
 		}
 	});
 
+	Window::add_mouse_move_callback([this](double delta_x, double delta_y, double x, double y) {
+		if (ImGui::GetIO().WantCaptureMouse || !integrator) {
+			return;
+		}
+		if (Window::is_mouse_held(MouseAction::LEFT) && !Window::is_key_held(KeyInput::KEY_TAB)) {
+			scene.camera->rotate(0.05f * (float)delta_y, -0.05f * (float)delta_x, 0.0f);
+			integrator->updated = true;
+		}
+	});
+
 	// Init with ray tracing extensions
 	vk::add_device_extension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
 	vk::add_device_extension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
@@ -56,19 +127,57 @@ void RayTracer::init() {
 	vk::render_graph()->settings.shader_inference = enable_shader_inference;
 	// Event based synchronization instead of barriers
 	vk::render_graph()->settings.use_events = use_events;
+	// Passes marked as async compute run on a separate compute queue (if the device has one)
+	vk::render_graph()->settings.async_compute = use_async_compute;
+	update_output_precision_macro();
+	if (sample_offset > 0) {
+		vk::render_graph()->global_macro_defines.emplace_back("SAMPLE_OFFSET", int(sample_offset));
+	}
 
 	scene.load_scene(scene_name);
+	if (!integrator_override.empty()) {
+		const SceneConfig prev_scene_config = *scene.config;
+		scene.create_scene_config(integrator_override);
+		scene.config->cam_settings = prev_scene_config.cam_settings;
+		scene.config->sky_col = prev_scene_config.sky_col;
+		scene.config->path_length = prev_scene_config.path_length;
+	}
+	if (run_limited()) {
+		// Keep the accumulation going for the whole run
+		animate = false;
+		show_ui = false;
+	}
+	if (replaying()) {
+		scene.config->path_length = camera_path.path_length;
+		show_ui = false;
+		dynamic_resolution = false;
+	}
+	if (tiled_width > 0) {
+		tiled_renderer.init(tiled_width, tiled_height, {Window::width(), Window::height()}, *scene.camera,
+							output_path, first_tile, tile_count);
+		tiled_renderer.apply(*scene.camera);
+	}
 	create_integrator(int(scene.config->integrator_type));
-	integrator->init();
+	init_integrator();
 	if (!tlas.accel) {
+		MemoryBudget::Scope memory_scope(MemoryBudget::Category::Scene);
 		integrator->create_accel(tlas, blases);
 	}
-	post_fx.init();
+	post_fx.init(integrator->output_format);
 	init_resources();
+	if (replaying()) {
+		begin_replay_frame();
+	}
+	if (watch_shaders && !run_limited() && !replaying() && memory_report_path.empty()) {
+		shader_watcher.init("src/shaders");
+	}
 	LUMEN_TRACE("Memory usage {} MB", vk::get_memory_usage(vk::context().physical_device) * 1e-6);
 }
 
 void RayTracer::init_resources() {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::Output);
+	// A pending RMSE was written to the previous buffers
+	rmse_age = -1;
 	uint32_t viewport_size = Window::width() * Window::height();
 	output_img_buffer =
 		prm::get_buffer({.name = "Output Image Buffer",
@@ -107,7 +216,7 @@ void RayTracer::init_resources() {
 										.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
 												 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
 										.dimensions = {Window::width(), Window::height(), 1},
-										.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+										.format = integrator->output_format,
 										.initial_layout = VK_IMAGE_LAYOUT_GENERAL};
 	reference_tex = prm::get_texture(texture_desc);
 	texture_desc.name = "Target Texture";
@@ -150,6 +259,16 @@ void RayTracer::init_resources() {
 }
 
 void RayTracer::cleanup_resources() {
+	collect_readbacks(true);
+	for (Readback& readback : readbacks) {
+		if (readback.color) {
+			prm::remove(readback.color);
+		}
+		if (readback.aovs) {
+			prm::remove(readback.aovs);
+		}
+		readback.color = readback.aovs = nullptr;
+	}
 	std::vector<vk::Buffer*> buffer_list = {output_img_buffer, output_img_buffer_cpu, residual_buffer,
 											counter_buffer,	   rmse_val_buffer,		  rt_utils_desc_buffer};
 	std::vector<vk::Texture*> tex_list = {reference_tex, target_tex};
@@ -166,9 +285,35 @@ void RayTracer::cleanup_resources() {
 
 void RayTracer::update() {
 	float frame_time = draw_frame();
+	// After the first frame, which compiled the shaders of the initial integrator
+	if (prewarm_shaders) {
+		prewarm_shaders = false;
+		vk::render_graph()->prewarm_shaders();
+	}
 	cpu_avg_time = (1.0f - 1.0f / (cnt)) * cpu_avg_time + frame_time / (float)cnt;
 	cpu_avg_time = 0.95f * cpu_avg_time + 0.05f * frame_time;
+	if (replaying() && replay_frame < camera_path.frames.size()) {
+		// The state after the frame, in which the integrator uploads the camera of the next one
+		const CameraPath::Frame& frame = camera_path.frames[replay_frame];
+		scene.camera->position = frame.position;
+		scene.camera->rotation = frame.rotation;
+		render_scale = frame.render_scale;
+		integrator->updated |= frame.reset;
+	}
+	update_render_scale();
 	integrator->update();
+	if (output_precision == ImageUtils::OutputPrecision::FP16 && integrator->frame_num == HALF_PRECISION_MAX_SAMPLES) {
+		LUMEN_WARN("Half precision outputs stop accumulating after {} samples, use full precision for more",
+				   HALF_PRECISION_MAX_SAMPLES);
+	}
+	if (!record_path.empty()) {
+		camera_path.frames.push_back({scene.camera->position, scene.camera->rotation,
+									  integrator_config_name(int(scene.config->integrator_type)), integrator->updated,
+									  render_scale, animate, anim_time, integrator->get_settings()});
+	}
+	if (replaying() && ++replay_frame < camera_path.frames.size()) {
+		begin_replay_frame();
+	}
 	integrator->updated = false;
 #if 0
 	char* stats = nullptr;
@@ -178,32 +323,153 @@ void RayTracer::update() {
 #endif
 }
 
+void RayTracer::begin_replay_frame() {
+	const CameraPath::Frame& frame = camera_path.frames[replay_frame];
+	if (frame.integrator != integrator_config_name(int(scene.config->integrator_type))) {
+		switch_integrator(integrator_index(frame.integrator), frame.integrator);
+	}
+	// Resets come from the recorded reset flag, like with the GUI
+	integrator->set_settings(frame.settings);
+	animate = frame.animate;
+	anim_time = frame.anim_time;
+	// The output is copied along with the last frame
+	if (replay_frame + 1 == camera_path.frames.size()) {
+		write_exr = true;
+		exit_requested = true;
+	}
+}
+
+void RayTracer::update_render_scale() {
+	if (dynamic_resolution && integrator->supports_render_scale()) {
+		// Graphics queue span of the last collected frame
+		auto& query_results = GPUQueryManager::get();
+		uint64_t gpu_start = UINT64_MAX;
+		uint64_t gpu_end = 0;
+		for (size_t i = 0; i < query_results.size; i += 2) {
+			if (!query_results.async[i >> 1]) {
+				gpu_start = std::min(gpu_start, query_results.timestamps[i]);
+				gpu_end = std::max(gpu_end, query_results.timestamps[i + 1]);
+			}
+		}
+		if (gpu_end > gpu_start) {
+			// Pixel count scales quadratically with the render scale. Only react outside of a 10% band around the
+			// budget so that accumulation is not restarted every frame
+			const float frame_time_gpu = float((gpu_end - gpu_start) * 1e-6);
+			const float ratio = target_frame_time / frame_time_gpu;
+			if (ratio < 0.9f || (ratio > 1.1f && render_scale < 1.0f)) {
+				const float new_scale = render_scale * std::sqrt(ratio);
+				render_scale = std::clamp(std::round(new_scale * 20.0f) / 20.0f, min_render_scale, 1.0f);
+			}
+		}
+	}
+	if (integrator->render_scale != render_scale) {
+		integrator->render_scale = render_scale;
+		integrator->updated = true;
+	}
+}
+
+void RayTracer::update_animations() {
+	if (!scene.has_animations() || !tlas.instance_buffer) {
+		return;
+	}
+	collect_tlas_timings();
+	const double now = glfwGetTime();
+	if (prev_anim_update >= 0.0 && animate && !replaying()) {
+		anim_time += now - prev_anim_update;
+	}
+	prev_anim_update = now;
+	if (!animate) {
+		return;
+	}
+	scene.animate(float(anim_time));
+	// The instances of the scene meshes come first in the TLAS, in the order of prim_meshes
+	std::vector<glm::vec3> centers(scene.prim_meshes.size());
+	for (size_t i = 0; i < scene.prim_meshes.size(); i++) {
+		const LumenPrimMesh& pm = scene.prim_meshes[i];
+		tlas.instances[i].transform = vk::to_vk_matrix(pm.world_matrix);
+		centers[i] = pm.world_matrix * glm::vec4(0.5f * (pm.min_pos + pm.max_pos), 1.0f);
+	}
+	const bool refit = !force_tlas_rebuild && !tlas_heuristic.should_rebuild(centers, scene.m_dimensions.radius);
+	tlas_update_pending = true;
+	tlas_update_refit = refit;
+	tlas_heuristic.on_update(centers, refit);
+	scene.upload_light_transforms();
+	integrator->updated = true;
+}
+
+void RayTracer::collect_tlas_timings() {
+	const auto& query_results = GPUQueryManager::get();
+	for (size_t i = 0; i + 1 < query_results.size; i += 2) {
+		const std::string& name = query_results.names[i >> 1];
+		const bool refit = name == vk::TLAS_REFIT_TIMESTAMP;
+		if (!refit && name != vk::TLAS_REBUILD_TIMESTAMP) {
+			continue;
+		}
+		TlasUpdateStats& stats = refit ? tlas_refit_stats : tlas_rebuild_stats;
+		stats.cnt++;
+		const double ms = (query_results.timestamps[i + 1] - query_results.timestamps[i]) * 1e-6;
+		stats.avg_ms += (ms - stats.avg_ms) / stats.cnt;
+	}
+}
+
 void RayTracer::render(uint32_t i) {
-	integrator->render();
+	{
+		MemoryBudget::Scope memory_scope(MemoryBudget::Category::Integrator);
+		integrator->render();
+	}
+	vk::Texture* rendered_tex = integrator->output_tex;
+	// The camera only moves by rotation between two frames in the common case. Without a depth buffer, the history
+	// is reprojected along view directions and the neighborhood clamp in the upsampler handles the rest
+	const glm::mat4 view_rotation = glm::mat4(glm::mat3(scene.camera->view));
+	const glm::mat4& projection = scene.camera->projection;
+	if (integrator->render_extent().width != Window::width()) {
+		const glm::mat4 reprojection =
+			prev_projection * prev_view_rotation * glm::transpose(view_rotation) * glm::inverse(projection);
+		rendered_tex = post_fx.upsample(integrator->output_tex, integrator->render_scale, reprojection);
+	}
+	prev_view_rotation = view_rotation;
+	prev_projection = projection;
 	vk::Texture* input_tex = nullptr;
 	if (comparison_mode && img_captured) {
 		input_tex = comparison_img_toggle ? target_tex : reference_tex;
 	} else {
-		input_tex = integrator->output_tex;
+		input_tex = rendered_tex;
 	}
 	post_fx.render(input_tex, vk::swapchain_images()[i]);
-	render_debug_utils();
+	render_debug_utils(rendered_tex);
 
 	auto cmdbuf = vk::context().command_buffers[i];
 	VkCommandBufferBeginInfo begin_info = vk::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 	vk::check(vkBeginCommandBuffer(cmdbuf, &begin_info));
-	vk::render_graph()->run(cmdbuf);
+	// The TLAS may have been recreated without ALLOW_UPDATE since, e.g. by an integrator with its own accel
+	if (tlas_update_pending && tlas.instance_buffer) {
+		tlas_update_pending = false;
+		vk::update_tlas(tlas, cmdbuf, tlas_update_refit);
+	}
+	if (vk::render_graph()->async_compute_enabled()) {
+		VkCommandBuffer compute_cmdbuf = vk::compute_command_buffer();
+		VkCommandBuffer handoff_cmdbuf = vk::handoff_command_buffer();
+		vk::check(vkBeginCommandBuffer(compute_cmdbuf, &begin_info));
+		vk::check(vkBeginCommandBuffer(handoff_cmdbuf, &begin_info));
+		vk::render_graph()->run(cmdbuf, compute_cmdbuf, handoff_cmdbuf);
+		vk::check(vkEndCommandBuffer(compute_cmdbuf));
+		vk::check(vkEndCommandBuffer(handoff_cmdbuf));
+	} else {
+		vk::render_graph()->run(cmdbuf);
+	}
 	vk::check(vkEndCommandBuffer(cmdbuf));
 }
 
-void RayTracer::render_debug_utils() {
-	if (write_exr) {
-		vk::render_graph()->current_pass().copy(integrator->output_tex, output_img_buffer_cpu);
+void RayTracer::render_debug_utils(vk::Texture* rendered_tex) {
+	if (write_exr && tile_complete) {
+		vk::render_graph()->current_pass().copy(rendered_tex, output_img_buffer_cpu);
+	} else if (write_exr) {
+		queue_readback(rendered_tex);
 	} else if (capture_ref_img) {
-		vk::render_graph()->current_pass().copy(integrator->output_tex, reference_tex);
+		vk::render_graph()->current_pass().copy(rendered_tex, reference_tex);
 
 	} else if (capture_target_img) {
-		vk::render_graph()->current_pass().copy(integrator->output_tex, target_tex);
+		vk::render_graph()->current_pass().copy(rendered_tex, target_tex);
 	}
 
 	if (capture_ref_img || capture_target_img) {
@@ -212,7 +478,9 @@ void RayTracer::render_debug_utils() {
 		capture_target_img = false;
 	}
 
-	if (calc_rmse && has_gt) {
+	// The buffers are only reached through rt_utils_desc_buffer, so the chain stays on the graphics queue with the
+	// copy of the output. A new RMSE waits until the last one was read back
+	if (calc_rmse && has_gt && rmse_age < 0) {
 		auto op_reduce = [&](const std::string& op_name, const std::string& op_shader_name,
 							 const std::string& reduce_name, const std::string& reduce_shader_name) {
 			uint32_t num_wgs = uint32_t((Window::width() * Window::height() + 1023) / 1024);
@@ -229,7 +497,7 @@ void RayTracer::render_debug_utils() {
 				num_wgs = (num_wgs + 1023) / 1024;
 			}
 		};
-		vk::render_graph()->current_pass().copy(integrator->output_tex, output_img_buffer);
+		vk::render_graph()->current_pass().copy(rendered_tex, output_img_buffer);
 		// Calculate RMSE
 		op_reduce("OpReduce: RMSE", "src/shaders/rmse/calc_rmse.comp", "OpReduce: Reduce RMSE",
 				  "src/shaders/rmse/reduce_rmse.comp");
@@ -238,6 +506,89 @@ void RayTracer::render_debug_utils() {
 						  {.shader = vk::Shader("src/shaders/rmse/output_rmse.comp"), .dims = {1, 1, 1}})
 			.push_constants(&rt_utils_pc)
 			.bind(rt_utils_desc_buffer);
+		rmse_age = 0;
+	}
+}
+
+void RayTracer::queue_readback(vk::Texture* rendered_tex) {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::Output);
+	auto free_slot = [this]() {
+		return std::find_if(std::begin(readbacks), std::end(readbacks), [](const Readback& r) { return r.age < 0; });
+	};
+	Readback* readback = free_slot();
+	if (readback == std::end(readbacks)) {
+		// Every slot is still in flight, only happens when writes are requested every frame
+		vkDeviceWaitIdle(vk::context().device);
+		collect_readbacks(true);
+		readback = free_slot();
+	}
+	readback->width = Window::width();
+	readback->height = Window::height();
+	const VkDeviceSize color_size = VkDeviceSize(readback->width) * readback->height * 4 * sizeof(float);
+	if (!readback->color || readback->color->size != color_size) {
+		if (readback->color) {
+			prm::remove(readback->color);
+		}
+		readback->color = prm::get_buffer({.name = "Readback Color",
+										   .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+										   .memory_type = vk::BufferType::GPU_TO_CPU,
+										   .size = color_size});
+	}
+	vk::render_graph()->current_pass().copy(rendered_tex, readback->color);
+	readback->aov_mask = 0;
+	if (integrator->aov_buffer && integrator->render_extent().width != Window::width()) {
+		LUMEN_WARN("AOVs are only written at a render scale of 1");
+	} else if (integrator->aov_buffer) {
+		if (!readback->aovs || readback->aovs->size != integrator->aov_buffer->size) {
+			if (readback->aovs) {
+				prm::remove(readback->aovs);
+			}
+			readback->aovs = prm::get_buffer({.name = "Readback AOVs",
+											  .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+											  .memory_type = vk::BufferType::GPU_TO_CPU,
+											  .size = integrator->aov_buffer->size});
+		}
+		vk::render_graph()->current_pass().copy(integrator->aov_buffer, readback->aovs);
+		readback->aov_mask = integrator->enabled_aovs();
+	}
+	readback->precision = output_precision;
+	readback->path = output_path;
+	readback->age = 0;
+}
+
+void RayTracer::collect_readbacks(bool finish) {
+	for (Readback& readback : readbacks) {
+		// Complete once prepare_frame waited on the fence of its frame again
+		if (readback.age < 0 || (!finish && ++readback.age <= vk::MAX_FRAMES_IN_FLIGHT)) {
+			continue;
+		}
+		readback.age = -1;
+		const size_t num_pixels = size_t(readback.width) * readback.height;
+		std::vector<ImageUtils::ExrLayer> layers;
+		ImageUtils::ExrLayer& beauty = layers.emplace_back();
+		beauty.name = "rgba";
+		beauty.channels = {"R", "G", "B"};
+		beauty.pixels.resize(num_pixels * 4);
+		ImageUtils::decode(vk::map_buffer(readback.color), readback.precision, num_pixels, beauty.pixels.data());
+		vk::unmap_buffer(readback.color);
+		if (replaying()) {
+			LUMEN_TRACE("Replayed {} frames, output hash {:016x}", camera_path.frames.size(),
+						CameraPath::hash(beauty.pixels.data(), beauty.pixels.size()));
+		}
+		if (readback.aov_mask) {
+			const float* aovs = (const float*)vk::map_buffer(readback.aovs);
+			for (uint32_t i = 0; i < AOV_COUNT; i++) {
+				if (!(readback.aov_mask & (1u << i))) {
+					continue;
+				}
+				const float* src = aovs + (layers.size() - 1) * num_pixels * 4;
+				layers.push_back({AOV_LAYERS[i].name, AOV_LAYERS[i].channels,
+								  std::vector<float>(src, src + num_pixels * 4), AOV_LAYERS[i].half,
+								  AOV_LAYERS[i].compression});
+			}
+			vk::unmap_buffer(readback.aovs);
+		}
+		exr_writer.submit(readback.path, int(readback.width), int(readback.height), std::move(layers));
 	}
 }
 
@@ -276,9 +627,96 @@ void RayTracer::create_integrator(int integrator_idx) {
 		case int(IntegratorType::DDGI):
 			integrator = std::make_unique<DDGI>(&scene, tlas);
 			break;
+		case int(IntegratorType::WavefrontPath):
+			integrator = std::make_unique<WavefrontPath>(&scene, tlas);
+			break;
 		default:
 			break;
 	}
+	integrator->output_format = ImageUtils::output_format(output_precision);
+	if (integrator->supports_adaptive_sampling()) {
+		integrator->adaptive = adaptive_settings;
+	}
+	integrator->splat_mode = splat_mode;
+	integrator->aovs = aov_mask;
+	if (aov_mask & ~integrator->supported_aovs()) {
+		LUMEN_WARN("The integrator does not write every requested AOV");
+	}
+	// Before init, for the settings that size its buffers
+	if (replaying() && replay_frame < camera_path.frames.size()) {
+		integrator->set_settings(camera_path.frames[replay_frame].settings);
+	}
+}
+
+void RayTracer::init_integrator() {
+	MemoryBudget::Scope memory_scope(MemoryBudget::Category::Integrator);
+	const auto prev_registrations = vk::render_graph()->registered_buffer_pointers;
+	integrator->init();
+	integrator->capture_state(prev_registrations);
+}
+
+void RayTracer::switch_integrator(int integrator_idx, const std::string& config_name) {
+	vkDeviceWaitIdle(vk::context().device);
+	const bool was_custom_accel = typeid(*integrator) == typeid(DDGI);
+	const SceneConfig prev_scene_config = *scene.config;
+	if (keep_integrators_resident) {
+		integrator->deactivate();
+		const int prev_idx = int(prev_scene_config.integrator_type);
+		resident_integrators[prev_idx] = {std::move(integrator), std::move(scene.config)};
+	} else {
+		integrator->destroy();
+	}
+	auto resident_it = resident_integrators.find(integrator_idx);
+	const bool resident = resident_it != resident_integrators.end();
+	if (resident) {
+		integrator = std::move(resident_it->second.integrator);
+		scene.config = std::move(resident_it->second.config);
+		resident_integrators.erase(resident_it);
+	} else {
+		scene.create_scene_config(config_name);
+	}
+	scene.config->cam_settings = prev_scene_config.cam_settings;
+	scene.config->sky_col = prev_scene_config.sky_col;
+	scene.config->path_length = prev_scene_config.path_length;
+	if (resident) {
+		integrator->activate();
+	} else {
+		// Resident integrators are optional memory. Without room for another integrator as large as all of them
+		// together, they are released before the new one is initialized
+		const VkDeviceSize integrator_memory = MemoryBudget::usage(MemoryBudget::Category::Integrator);
+		if (!resident_integrators.empty() && !MemoryBudget::fits(integrator_memory)) {
+			LUMEN_WARN("Releasing {} resident integrators, {:.1f} MB left for {:.1f} MB of integrators",
+					   resident_integrators.size(), MemoryBudget::available() * 1e-6, integrator_memory * 1e-6);
+			release_resident_integrators();
+		}
+		create_integrator(integrator_idx);
+		init_integrator();
+	}
+	const bool is_custom_accel = typeid(*integrator) == typeid(DDGI);
+	if (was_custom_accel || is_custom_accel) {
+		MemoryBudget::Scope memory_scope(MemoryBudget::Category::Scene);
+		destroy_accel();
+		integrator->create_accel(tlas, blases);
+	}
+	LUMEN_TRACE("Switched to {} ({}), {} integrators resident", config_name, resident ? "resident" : "initialized",
+				resident_integrators.size());
+}
+
+void RayTracer::release_resident_integrators() {
+	for (auto& [idx, resident] : resident_integrators) {
+		resident.integrator->destroy();
+	}
+	resident_integrators.clear();
+}
+
+void RayTracer::update_output_precision_macro() {
+	// The prewarm threads read the global macros
+	vk::render_graph()->cancel_prewarm();
+	auto& macros = vk::render_graph()->global_macro_defines;
+	std::erase_if(macros, [](const vk::ShaderMacro& macro) { return macro.name == "HALF_PRECISION_OUTPUT"; });
+	if (output_precision == ImageUtils::OutputPrecision::FP16) {
+		macros.push_back(vk::ShaderMacro("HALF_PRECISION_OUTPUT"));
+	}
 }
 
 bool RayTracer::gui() {
@@ -299,10 +737,30 @@ bool RayTracer::gui() {
 			auto begin = query_results.timestamps[i];
 			auto end = query_results.timestamps[i + 1];
 			double diff = (end - begin) * 1e-6;
-			ImGui::Text("%.3f ms: %s", diff, query_results.names[i >> 1].c_str());
+			ImGui::Text("%.3f ms: %s%s", diff, query_results.names[i >> 1].c_str(),
+						query_results.async[i >> 1] ? " (async)" : "");
+		}
+		if (vk::render_graph()->async_compute_enabled() && query_results.gfx_busy_time > 0) {
+			double overlap = query_results.async_overlap_time * 1e-6;
+			ImGui::Text("Async compute overlap: %.3f ms (%.1f%% of frame)", overlap,
+						100.0 * query_results.async_overlap_time / query_results.gfx_busy_time);
 		}
 	}
 	ImGui::Text("Memory Usage: %.2f MB", vk::get_memory_usage(vk::context().physical_device) * 1e-6);
+	if (ImGui::TreeNode("Memory breakdown")) {
+		for (int c = 0; c < int(MemoryBudget::Category::Count); c++) {
+			const MemoryBudget::Category category = MemoryBudget::Category(c);
+			ImGui::Text("%s: %.2f MB", MemoryBudget::category_name(category), MemoryBudget::usage(category) * 1e-6);
+		}
+		if (MemoryBudget::budget()) {
+			ImGui::Text("Budget: %.2f MB, %.2f MB left", MemoryBudget::budget() * 1e-6,
+						MemoryBudget::available() * 1e-6);
+		}
+		if (ImGui::Button("Log allocations")) {
+			MemoryBudget::log_report();
+		}
+		ImGui::TreePop();
+	}
 	bool updated = false;
 	ImGui::Checkbox("Show camera statistics", &show_cam_stats);
 	if (show_cam_stats) {
@@ -313,10 +771,34 @@ bool RayTracer::gui() {
 		ImGui::DragFloat4("", glm::value_ptr(scene.camera->camera[3]), 0.05f);
 	}
 	if (ImGui::Button("Reload shaders (F5)")) {
+		vk::render_graph()->cancel_prewarm();
 		vk::render_graph()->reload_shaders = true;
 		vk::render_graph()->shader_cache.clear();
 		updated |= true;
 	}
+	if (integrator->supports_render_scale()) {
+		ImGui::Checkbox("Dynamic resolution", &dynamic_resolution);
+		if (dynamic_resolution) {
+			ImGui::SliderFloat("Target frame time (ms)", &target_frame_time, 1.0f, 100.0f, "%.1f");
+			ImGui::SliderFloat("Min render scale", &min_render_scale, 0.25f, 1.0f, "%.2f");
+			ImGui::Text("Render scale: %.2f", render_scale);
+		} else {
+			ImGui::SliderFloat("Render scale", &render_scale, 0.25f, 1.0f, "%.2f");
+		}
+	}
+	// E5B9G9R9 is not a storage image format on current GPUs, it is only evaluated by --precision-report
+	const char* precisions[] = {"RGBA32F", "RGBA16F"};
+	int precision_idx = int(output_precision);
+	if (ImGui::Combo("Output precision", &precision_idx, precisions, IM_ARRAYSIZE(precisions))) {
+		output_precision = ImageUtils::OutputPrecision(precision_idx);
+		output_precision_changed = true;
+	}
+	if (scene.has_animations()) {
+		ImGui::Checkbox("Animate", &animate);
+		ImGui::Checkbox("Force TLAS rebuilds", &force_tlas_rebuild);
+		ImGui::Text("TLAS refit: %.3f ms (%u), rebuild: %.3f ms (%u)", tlas_refit_stats.avg_ms, tlas_refit_stats.cnt,
+					tlas_rebuild_stats.avg_ms, tlas_rebuild_stats.cnt);
+	}
 	ImGui::Checkbox("Comparison mode (F11)", &comparison_mode);
 	if (comparison_mode && img_captured) {
 		ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(0, 255, 0, 255));
@@ -331,14 +813,11 @@ bool RayTracer::gui() {
 		capture_target_img = true;
 	}
 
-	const char* settings[] = {"Path",	"BDPT",	  "SPPM",	   "VCM",		"PSSMLT", "SMLT",
-							  "VCMMLT", "ReSTIR", "ReSTIR GI", "ReSTIR PT", "DDGI"};
-
 	static int curr_integrator_idx = int(scene.config->integrator_type);
-	if (ImGui::BeginCombo("Select Integrator", settings[curr_integrator_idx])) {
-		for (int n = 0; n < IM_ARRAYSIZE(settings); n++) {
+	if (ImGui::BeginCombo("Select Integrator", INTEGRATOR_NAMES[curr_integrator_idx])) {
+		for (int n = 0; n < IM_ARRAYSIZE(INTEGRATOR_NAMES); n++) {
 			const bool selected = curr_integrator_idx == n;
-			if (ImGui::Selectable(settings[n], selected)) {
+			if (ImGui::Selectable(INTEGRATOR_NAMES[n], selected)) {
 				curr_integrator_idx = n;
 			}
 
@@ -352,30 +831,14 @@ bool RayTracer::gui() {
 
 	if (curr_integrator_idx != int(scene.config->integrator_type)) {
 		updated = true;
+		switch_integrator(curr_integrator_idx, integrator_config_name(curr_integrator_idx));
+	}
+	if (ImGui::Checkbox("Keep integrators resident", &keep_integrators_resident) && !keep_integrators_resident) {
 		vkDeviceWaitIdle(vk::context().device);
-		bool was_custom_accel = typeid(*integrator) == typeid(DDGI);
-		integrator->destroy();
-		RenderGraph* rg = vk::render_graph();
-		REGISTER_BUFFER_WITH_ADDRESS(RTUtilsDesc, desc, out_img_addr, output_img_buffer, rg);
-		REGISTER_BUFFER_WITH_ADDRESS(RTUtilsDesc, desc, residual_addr, residual_buffer, rg);
-		REGISTER_BUFFER_WITH_ADDRESS(RTUtilsDesc, desc, counter_addr, counter_buffer, rg);
-		REGISTER_BUFFER_WITH_ADDRESS(RTUtilsDesc, desc, rmse_val_addr, rmse_val_buffer, rg);
-		SceneConfig prev_scene_config = *scene.config;
-		auto integrator_str = std::string(settings[curr_integrator_idx]);
-		integrator_str.erase(std::remove_if(integrator_str.begin(), integrator_str.end(), ::isspace),
-							 integrator_str.end());
-		std::transform(integrator_str.begin(), integrator_str.end(), integrator_str.begin(), ::tolower);
-		scene.create_scene_config(integrator_str);
-		scene.config->cam_settings = prev_scene_config.cam_settings;
-		scene.config->sky_col = prev_scene_config.sky_col;
-		scene.config->path_length = prev_scene_config.path_length;
-		create_integrator(curr_integrator_idx);
-		bool is_custom_accel = typeid(*integrator) == typeid(DDGI);
-		integrator->init();
-		if (was_custom_accel || is_custom_accel) {
-			destroy_accel();
-			integrator->create_accel(tlas, blases);
-		}
+		release_resident_integrators();
+	}
+	if (!resident_integrators.empty()) {
+		ImGui::Text("Resident integrators: %zu", resident_integrators.size());
 	}
 	return updated;
 }
@@ -400,6 +863,26 @@ float RayTracer::draw_frame() {
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
 
+	update_animations();
+	if (run_limited() && !exit_requested) {
+		if (run_start_time < 0.0) {
+			run_start_time = glfwGetTime();
+		}
+		// The output copy is recorded with this frame, which adds sample run_spp
+		const bool spp_reached = run_spp > 0 && integrator->frame_num + 1 >= run_spp;
+		const bool time_reached = run_time_budget > 0.0f && glfwGetTime() - run_start_time >= run_time_budget;
+		if (spp_reached || time_reached) {
+			write_exr = true;
+			// Tiled renders go on with the next tile after the readback
+			tile_complete = tiled_renderer.active();
+			exit_requested = !tile_complete || tiled_renderer.last_tile();
+		}
+	}
+	updated |= scene.stream_textures();
+	if (watch_shaders) {
+		const std::vector<std::string> changed = shader_watcher.poll();
+		updated |= !changed.empty() && vk::render_graph()->invalidate_shaders(changed) > 0;
+	}
 	integrator->updated |= updated;
 	if (show_ui) {
 		ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Once);
@@ -418,9 +901,18 @@ float RayTracer::draw_frame() {
 		integrator->updated |= gui_updated;
 	}
 
+	if (replaying() && run_start_time < 0.0) {
+		run_start_time = glfwGetTime();
+	}
 	render(image_idx);
 	VkResult result = vk::submit_frame(image_idx);
 	vk::render_graph()->reset();
+	if (run_limited() || replaying()) {
+		run_stats.frames++;
+		run_stats.add_frame(GPUQueryManager::get());
+		run_stats.peak_memory =
+			std::max<uint64_t>(run_stats.peak_memory, vk::get_memory_usage(vk::context().physical_device));
+	}
 	if (result != VK_SUCCESS) {
 		Window::update_window_size();
 		const float aspect_ratio = (float)Window::width() / Window::height();
@@ -429,13 +921,18 @@ float RayTracer::draw_frame() {
 		scene.camera = std::unique_ptr<lumen::PerspectiveCamera>(new lumen::PerspectiveCamera(
 			old_cam->fov, 0.01f, 1000.0f, aspect_ratio, old_cam->direction, old_cam->position));
 		scene.camera->rotation = old_rotation;
+		if (tiled_renderer.active()) {
+			tiled_renderer.apply(*scene.camera);
+		}
 		cleanup_resources();
+		release_resident_integrators();
 		integrator->destroy();
 		post_fx.destroy();
 		vk::destroy_imgui();
+		vk::render_graph()->reset_queue_ownership();
 
-		integrator->init();
-		post_fx.init();
+		init_integrator();
+		post_fx.init(integrator->output_format);
 		init_resources();
 		vk::init_imgui();
 		integrator->updated = true;
@@ -446,18 +943,69 @@ float RayTracer::draw_frame() {
 
 	if (write_exr) {
 		write_exr = false;
-		ImageUtils::save_exr((float*)vk::map_buffer(output_img_buffer_cpu), Window::width(), Window::height(),
-							 "out.exr");
-		vk::unmap_buffer(output_img_buffer_cpu);
+		if (tile_complete) {
+			tile_complete = false;
+			std::vector<float> pixels(size_t(Window::width()) * Window::height() * 4);
+			ImageUtils::decode(vk::map_buffer(output_img_buffer_cpu), output_precision, pixels.size() / 4,
+							   pixels.data());
+			vk::unmap_buffer(output_img_buffer_cpu);
+			tiled_renderer.store(pixels.data());
+			if (!exit_requested) {
+				tiled_renderer.apply(*scene.camera);
+				integrator->updated = true;
+				run_start_time = -1.0;
+			} else {
+				LUMEN_TRACE("Peak memory usage {} MB", run_stats.peak_memory * 1e-6);
+			}
+		}
+		if (exit_requested && !stats_path.empty()) {
+			run_stats.elapsed_s = glfwGetTime() - run_start_time;
+			Benchmark::write_run_stats(run_stats, stats_path);
+		}
+		if (exit_requested) {
+			glfwSetWindowShouldClose(Window::get()->window_handle, GLFW_TRUE);
+		}
+	} else if (exit_on_convergence && !exit_requested && integrator->converged()) {
+		// The readback is recorded with the next frame
+		write_exr = true;
+		exit_requested = true;
+	}
+	collect_readbacks(false);
+	if (!memory_report_path.empty()) {
+		MemoryBudget::log_report();
+		MemoryBudget::write_report(memory_report_path);
+		memory_report_path.clear();
+		glfwSetWindowShouldClose(Window::get()->window_handle, GLFW_TRUE);
+	}
+	// Recreate the outputs after the readback above, which still uses the previous precision
+	if (output_precision_changed) {
+		output_precision_changed = false;
+		vkDeviceWaitIdle(vk::context().device);
+		cleanup_resources();
+		release_resident_integrators();
+		integrator->destroy();
+		post_fx.destroy();
+		vk::render_graph()->reset_queue_ownership();
+		update_output_precision_macro();
+		integrator->output_format = ImageUtils::output_format(output_precision);
+		init_integrator();
+		post_fx.init(integrator->output_format);
+		init_resources();
+		img_captured = false;
+		integrator->updated = true;
 	}
 	bool time_limit = (abs(diff / CLOCKS_PER_SEC - 5)) < 0.1;
 	calc_rmse = time_limit;
 
 	if (calc_rmse && has_gt) {
+		start = now;
+	}
+	// Complete once prepare_frame waited on the fence of its frame again, like the readbacks
+	if (rmse_age >= 0 && ++rmse_age > vk::MAX_FRAMES_IN_FLIGHT) {
+		rmse_age = -1;
 		float rmse = *(float*)vk::map_buffer(rmse_val_buffer);
 		vk::unmap_buffer(rmse_val_buffer);
 		LUMEN_TRACE("RMSE {}", rmse * 1e6);
-		start = now;
 	}
 	auto t_end = glfwGetTime() * 1000;
 	auto t_diff = t_end - t_begin;
@@ -471,14 +1019,88 @@ void RayTracer::parse_args(int argc, char* argv[]) {
 	for (int i = 0; i < argc; i++) {
 		if (std::regex_match(argv[i], fn)) {
 			scene_name = argv[i];
+		} else if (std::string(argv[i]) == "--half-precision") {
+			output_precision = ImageUtils::OutputPrecision::FP16;
+		} else if (std::string(argv[i]) == "--uncompressed-textures") {
+			scene.texture_settings.compress = false;
+		} else if (std::string(argv[i]) == "--full-precision-vertices") {
+			scene.quantize_vertices = false;
+		} else if (std::string(argv[i]) == "--uniform-light-sampling") {
+			scene.use_light_bvh = false;
+		} else if (std::string(argv[i]) == "--stream-textures" && i + 1 < argc) {
+			scene.texture_settings.resident_size = std::stoi(argv[++i]);
+		} else if (std::string(argv[i]) == "--adaptive" && i + 1 < argc) {
+			adaptive_settings.enabled = true;
+			adaptive_settings.threshold = std::stof(argv[++i]);
+		} else if (std::string(argv[i]) == "--prewarm-shaders") {
+			prewarm_shaders = true;
+		} else if (std::string(argv[i]) == "--exit-on-convergence") {
+			exit_on_convergence = true;
+		} else if (std::string(argv[i]) == "--integrator" && i + 1 < argc) {
+			integrator_override = argv[++i];
+		} else if (std::string(argv[i]) == "--spp" && i + 1 < argc) {
+			run_spp = std::max(1, std::stoi(argv[++i]));
+		} else if (std::string(argv[i]) == "--time-budget" && i + 1 < argc) {
+			run_time_budget = std::stof(argv[++i]);
+		} else if (std::string(argv[i]) == "--tiled" && i + 2 < argc) {
+			tiled_width = std::stoi(argv[++i]);
+			tiled_height = std::stoi(argv[++i]);
+		} else if (std::string(argv[i]) == "--tiles" && i + 2 < argc) {
+			first_tile = std::stoi(argv[++i]);
+			tile_count = std::max(1, std::stoi(argv[++i]));
+		} else if (std::string(argv[i]) == "--aovs" && i + 1 < argc) {
+			aov_mask = parse_aovs(argv[++i]);
+		} else if (std::string(argv[i]) == "--seed" && i + 1 < argc) {
+			seed = std::stoll(argv[++i]);
+		} else if (std::string(argv[i]) == "--sample-offset" && i + 1 < argc) {
+			sample_offset = std::stoi(argv[++i]);
+		} else if (std::string(argv[i]) == "--device" && i + 1 < argc) {
+			vk::set_device_index(std::stoi(argv[++i]));
+		} else if (std::string(argv[i]) == "--output" && i + 1 < argc) {
+			output_path = argv[++i];
+		} else if (std::string(argv[i]) == "--record-camera" && i + 1 < argc) {
+			record_path = argv[++i];
+		} else if (std::string(argv[i]) == "--replay-camera" && i + 1 < argc) {
+			replay_path = argv[++i];
+		} else if (std::string(argv[i]) == "--memory-budget" && i + 1 < argc) {
+			MemoryBudget::set_budget(VkDeviceSize(std::stoull(argv[++i])) << 20);
+		} else if (std::string(argv[i]) == "--memory-report" && i + 1 < argc) {
+			memory_report_path = argv[++i];
+		} else if (std::string(argv[i]) == "--no-shader-watch") {
+			watch_shaders = false;
+		} else if (std::string(argv[i]) == "--stats" && i + 1 < argc) {
+			stats_path = argv[++i];
+		} else if (std::string(argv[i]) == "--splat-mode" && i + 1 < argc) {
+			const std::string mode = argv[++i];
+			if (mode == "racy") {
+				splat_mode = SPLAT_RACY;
+			} else if (mode == "atomic") {
+				splat_mode = SPLAT_ATOMIC;
+			} else if (mode == "subgroup") {
+				splat_mode = SPLAT_SUBGROUP;
+			} else {
+				LUMEN_WARN("Unknown splat mode {}, expected racy, atomic or subgroup", mode);
+			}
+		}
+	}
+	if (replaying()) {
+		if (!camera_path.load(replay_path)) {
+			LUMEN_ERROR("Could not replay " + replay_path);
 		}
+		scene_name = camera_path.scene;
+		seed = camera_path.seed;
+		integrator_override = camera_path.frames[0].integrator;
+		output_precision =
+			camera_path.half_precision ? ImageUtils::OutputPrecision::FP16 : ImageUtils::OutputPrecision::FP32;
+	}
+	if (tiled_width > 0 && !run_limited()) {
+		LUMEN_WARN("--tiled without --spp or --time-budget, tracing {} samples per tile", DEFAULT_TILE_SPP);
+		run_spp = DEFAULT_TILE_SPP;
 	}
 }
 void RayTracer::destroy_accel() {
-	if (tlas.accel) {
-		prm::remove(tlas.buffer);
-		vkDestroyAccelerationStructureKHR(vk::context().device, tlas.accel, nullptr);
-	}
+	vk::destroy_bvh(tlas);
+	tlas_heuristic = {};
 	if (!blases.empty()) {
 		for (auto& b : blases) {
 			prm::remove(b.buffer);
@@ -490,8 +1112,24 @@ void RayTracer::destroy_accel() {
 
 void RayTracer::cleanup() {
 	vkDeviceWaitIdle(vk::context().device);
+	if (!record_path.empty()) {
+		camera_path.scene = scene_name;
+		camera_path.seed = seed;
+		camera_path.width = Window::width();
+		camera_path.height = Window::height();
+		camera_path.half_precision = output_precision == ImageUtils::OutputPrecision::FP16;
+		camera_path.path_length = scene.config->path_length;
+		camera_path.save(record_path);
+	}
+	if (tlas_refit_stats.cnt || tlas_rebuild_stats.cnt) {
+		LUMEN_TRACE("TLAS updates: {} refits averaging {:.3f} ms, {} rebuilds averaging {:.3f} ms", tlas_refit_stats.cnt,
+					tlas_refit_stats.avg_ms, tlas_rebuild_stats.cnt, tlas_rebuild_stats.avg_ms);
+	}
 	if (initialized) {
+		shader_watcher.destroy();
 		cleanup_resources();
+		exr_writer.flush();
+		release_resident_integrators();
 		integrator->destroy();
 		post_fx.destroy();
 		scene.destroy();
@@ -1,6 +1,8 @@
 #pragma once
 #include "LumenPCH.h"
 #include "Framework/ImageUtils.h"
+#include "Framework/MemoryBudget.h"
+#include "Framework/ShaderWatcher.h"
 #include "Path.h"
 #include "BDPT.h"
 #include "SPPM.h"
@@ -12,7 +14,11 @@
 #include "ReSTIRGI.h"
 #include "ReSTIRPT.h"
 #include "DDGI.h"
+#include "WavefrontPath.h"
 #include "PostFX.h"
+#include "Benchmark.h"
+#include "TiledRenderer.h"
+#include "CameraPath.h"
 #include "Framework/Window.h"
 
 class RayTracer {
@@ -21,6 +27,10 @@ class RayTracer {
 	void init();
 	void update();
 	void cleanup();
+	// The camera path loaded for --replay-camera, nullptr otherwise
+	const CameraPath* replay_camera_path() const { return replaying() ? &camera_path : nullptr; }
+	// Replays and memory reports run in a hidden window
+	bool headless() const { return replaying() || !memory_report_path.empty(); }
 	static RayTracer* instance;
 	inline static RayTracer* get() { return instance; }
 	bool resized = false;
@@ -31,14 +41,44 @@ class RayTracer {
 	void parse_args(int argc, char* argv[]);
 	float draw_frame();
 	void render(uint32_t idx);
-	void render_debug_utils();
+	void render_debug_utils(vk::Texture* rendered_tex);
+	// Records the copy of the output and the AOVs of the integrator into a free readback slot
+	void queue_readback(vk::Texture* rendered_tex);
+	// Hands the readbacks whose frames completed to exr_writer. With finish every pending readback is collected, the
+	// device has to be idle
+	void collect_readbacks(bool finish);
+	void update_render_scale();
+	// Switches to the integrator and animation time of the next replayed frame, before it is rendered
+	void begin_replay_frame();
+	void update_animations();
+	void collect_tlas_timings();
+	void update_output_precision_macro();
 	void create_integrator(int integrator_idx);
+	// Initializes the current integrator and records its state so that it can stay resident
+	void init_integrator();
+	// Swaps in a resident integrator if there is one, otherwise creates it with a new scene config
+	void switch_integrator(int integrator_idx, const std::string& config_name);
+	// Destroys the inactive integrators, for changes that invalidate their outputs
+	void release_resident_integrators();
+	// Whether the run stops on its own after run_spp frames or run_time_budget seconds
+	bool run_limited() const { return run_spp > 0 || run_time_budget > 0.0f; }
+	bool replaying() const { return !replay_path.empty(); }
 	bool gui();
 	void destroy_accel();
 	bool initialized = false;
 	float cpu_avg_time = 0;
 	int cnt = 0;
 	std::unique_ptr<Integrator> integrator;
+	// Integrators that were switched away from, keyed by IntegratorType. They keep their buffers, outputs and scene
+	// configs so that switching back skips their initialization
+	struct ResidentIntegrator {
+		std::unique_ptr<Integrator> integrator;
+		std::unique_ptr<SceneConfig> config;
+	};
+	std::unordered_map<int, ResidentIntegrator> resident_integrators;
+	bool keep_integrators_resident = true;
+	// Compile the shader variants of earlier runs in the background after the first frame, --prewarm-shaders
+	bool prewarm_shaders = false;
 	PostFX post_fx;
 
 	RTUtilsPC rt_utils_pc;
@@ -49,6 +89,8 @@ class RayTracer {
 	vk::Buffer* residual_buffer;
 	vk::Buffer* counter_buffer;
 	vk::Buffer* rmse_val_buffer;
+	// Frames submitted since the RMSE passes were recorded, -1 when no RMSE is pending
+	int32_t rmse_age = -1;
 	vk::Buffer* rt_utils_desc_buffer;
 
 	vk::Texture* reference_tex;
@@ -70,8 +112,98 @@ class RayTracer {
 	bool img_captured = false;
 	bool show_ui = true;
 
+	// Render scale of the integrator, either fixed or driven by the frame time budget
+	float render_scale = 1.0f;
+	bool dynamic_resolution = false;
+	float target_frame_time = 16.6f;
+	float min_render_scale = 0.5f;
+	glm::mat4 prev_view_rotation = glm::mat4(1.0f);
+	glm::mat4 prev_projection = glm::mat4(1.0f);
+
+	// Accumulation precision of the integrator outputs
+	ImageUtils::OutputPrecision output_precision = ImageUtils::OutputPrecision::FP32;
+	bool output_precision_changed = false;
+
+	// Applied to every integrator that supports adaptive sampling. With exit_on_convergence the image is written to
+	// out.exr and the application closes once every pixel converged
+	Integrator::AdaptiveSettings adaptive_settings;
+	bool exit_on_convergence = false;
+	bool exit_requested = false;
+	// Initial splat accumulation of the integrators, --splat-mode racy|atomic|subgroup
+	uint32_t splat_mode = SPLAT_SUBGROUP;
+	// Runs of the benchmark harness: the integrator replaces the one of the scene file, the image is written to
+	// output_path once the run limit is reached and the GPU timings to stats_path
+	std::string integrator_override;
+	uint32_t run_spp = 0;
+	float run_time_budget = 0.0f;
+	double run_start_time = -1.0;
+	std::string output_path = "out.exr";
+	std::string stats_path;
+	Benchmark::RunStats run_stats;
+	// --tiled <width> <height>: the run limit applies to every tile, which is written to output_path once reached.
+	// --tiles <first> <count> restricts the render to a range of tiles, for the workers of Distributed.h
+	uint32_t tiled_width = 0;
+	uint32_t tiled_height = 0;
+	uint32_t first_tile = 0;
+	uint32_t tile_count = 0;
+	// Distributed sample jobs: --seed for the host side random numbers, --sample-offset for the sample index of the
+	// first frame, see SAMPLE_OFFSET. -1 seeds with the time
+	int64_t seed = -1;
+	uint32_t sample_offset = 0;
+	TiledRenderer tiled_renderer;
+	bool tile_complete = false;
+	// --aovs albedo,normal,depth,samples,direct,indirect: AOV_* bits requested from every integrator, written as
+	// layers of output_path next to the color
+	uint32_t aov_mask = 0;
+	// Output writes go through a small ring of host visible copies, decoded once the frames in flight after the copy
+	// completed and written on the thread of exr_writer, so that writing an image never waits on the GPU or the disk.
+	// Tiles are still read back right after their frame
+	struct Readback {
+		vk::Buffer* color = nullptr;
+		vk::Buffer* aovs = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		ImageUtils::OutputPrecision precision = ImageUtils::OutputPrecision::FP32;
+		uint32_t aov_mask = 0;
+		std::string path;
+		// Frames submitted since the copy was recorded, -1 for a free slot
+		int32_t age = -1;
+	};
+	Readback readbacks[2];
+	ImageUtils::AsyncExrWriter exr_writer;
+	// --memory-report <path.json>: the memory breakdown after the first frame is logged and written to
+	// memory_report_path, then the application closes. Budgets are set with --memory-budget <MB>, see MemoryBudget.h
+	std::string memory_report_path;
+	// Saved shader sources recompile the shaders that include them and rebuild only their pipelines, F5 still reloads
+	// every shader. Off for runs without a window to edit in and with --no-shader-watch
+	lumen::ShaderWatcher shader_watcher;
+	bool watch_shaders = true;
+	// --record-camera <path>: the frames of the session are written to record_path on exit. --replay-camera <path>
+	// renders the frames of a recording again with its scene, seed and settings, then writes output_path and, with
+	// --stats, the per pass GPU timings
+	std::string record_path;
+	std::string replay_path;
+	CameraPath camera_path;
+	size_t replay_frame = 0;
+
+	// Scripted instance animations. The TLAS is refit every frame and rebuilt when tlas_heuristic says so
+	bool animate = true;
+	bool force_tlas_rebuild = false;
+	double anim_time = 0.0;
+	double prev_anim_update = -1.0;
+	vk::TlasRefitHeuristic tlas_heuristic;
+	// Set by update_animations, the update is recorded at the start of the command buffer of the frame
+	bool tlas_update_pending = false;
+	bool tlas_update_refit = false;
+	// Running averages of the GPU time of the TLAS updates, from the timestamps of the completed frames
+	struct TlasUpdateStats {
+		double avg_ms = 0.0;
+		uint32_t cnt = 0;
+	} tlas_refit_stats, tlas_rebuild_stats;
+
 	const bool enable_shader_inference = true;
 	const bool use_events = true;
+	const bool use_async_compute = true;
 	vk::BVH tlas;
 	std::vector<vk::BVH> blases;
 };
@@ -39,11 +39,7 @@ void ReSTIR::init() {
 						 .size = Window::width() * Window::height()  * sizeof(float) * 3});
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	lumen_scene->fill_scene_desc(desc);
 	// ReSTIR
 	desc.g_buffer_addr = g_buffer->get_device_address();
 	desc.temporal_reservoir_addr = temporal_reservoir_buffer->get_device_address();
@@ -64,7 +60,6 @@ void ReSTIR::init() {
 
 	lumen::RenderGraph* rg = vk::render_graph();
 	assert(rg->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, g_buffer_addr, g_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, temporal_reservoir_addr, temporal_reservoir_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, spatial_reservoir_addr, spatial_reservoir_buffer, rg);
@@ -102,6 +97,7 @@ void ReSTIR::render() {
 							   {"src/shaders/ray_shadow.rmiss"},
 							   {"src/shaders/ray.rchit"},
 							   {"src/shaders/ray.rahit"}},
+				   .macros = sampler_macros(),
 				   .dims = {Window::width(), Window::height() },
 			   })
 		.push_constants(&pc_ray)
@@ -120,6 +116,7 @@ void ReSTIR::render() {
 							   {"src/shaders/ray_shadow.rmiss"},
 							   {"src/shaders/ray.rchit"},
 							   {"src/shaders/ray.rahit"}},
+				   .macros = sampler_macros(),
 				   .dims = {Window::width(), Window::height() },
 			   })
 		.push_constants(&pc_ray)
@@ -136,6 +133,7 @@ void ReSTIR::render() {
 							   {"src/shaders/ray_shadow.rmiss"},
 							   {"src/shaders/ray.rchit"},
 							   {"src/shaders/ray.rahit"}},
+				   .macros = sampler_macros(),
 				   .dims = {Window::width(), Window::height() },
 			   })
 		.push_constants(&pc_ray)
@@ -161,6 +159,7 @@ bool ReSTIR::update() {
 bool ReSTIR::gui() {
 	bool result = false;
 	result |= ImGui::Checkbox("Enable accumulation", &enable_accumulation);
+	result |= sampler_gui();
 	return result;
 }
 
@@ -173,3 +172,8 @@ void ReSTIR::destroy() {
 		prm::remove(b);
 	}
 }
+
+void ReSTIR::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("enable_accumulation", enable_accumulation);
+}
@@ -9,6 +9,7 @@ class ReSTIR final: public Integrator {
 	virtual void render() override;
 	virtual bool update() override;
 	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
 	virtual void destroy() override;
 
    private:
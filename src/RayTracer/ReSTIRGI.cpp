@@ -44,11 +44,7 @@ void ReSTIRGI::init() {
 	});
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	lumen_scene->fill_scene_desc(desc);
 	// ReSTIR GI
 	desc.restir_samples_addr = restir_samples_buffer->get_device_address();
 	desc.restir_samples_old_addr = restir_samples_old_buffer->get_device_address();
@@ -70,7 +66,6 @@ void ReSTIRGI::init() {
 	pc_ray.world_radius = lumen_scene->m_dimensions.radius;
 	assert(vk::render_graph()->settings.shader_inference == true);
 	lumen::RenderGraph* rg = vk::render_graph();
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, restir_samples_addr, restir_samples_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, restir_samples_old_addr, restir_samples_old_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, temporal_reservoir_addr, temporal_reservoir_buffer, rg);
@@ -186,4 +181,9 @@ void ReSTIRGI::destroy() {
 	for (vk::Buffer* b : buffer_list) {
 		prm::remove(b);
 	}
-}
\ No newline at end of file
+}
+
+void ReSTIRGI::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("enable_accumulation", enable_accumulation);
+}
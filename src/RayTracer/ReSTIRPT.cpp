@@ -54,11 +54,7 @@ void ReSTIRPT::init() {
 								  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 						 .memory_type = vk::BufferType::GPU,
 						 .size = Window::width() * Window::height() * sizeof(uint32_t)});
-	reconnection_buffer = prm::get_buffer(
-		{.name = "Reservoir Connection",
-		 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		 .memory_type = vk::BufferType::GPU,
-		 .size = Window::width() * Window::height() * sizeof(ReconnectionData) * (num_spatial_samples + 1)});
+	create_reconnection_buffer();
 
 	transformations_buffer = prm::get_buffer({
 		.name = "Transformations Buffer",
@@ -69,12 +65,8 @@ void ReSTIRPT::init() {
 	});
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	// The reconnection pdfs assume uniform light picking
+	lumen_scene->fill_scene_desc(desc, /* light_bvh = */ false);
 	// ReSTIR PT (GRIS)
 	desc.transformations_addr = transformations_buffer->get_device_address();
 	desc.prefix_contributions_addr = prefix_contribution_buffer->get_device_address();
@@ -103,10 +95,10 @@ void ReSTIRPT::init() {
 	pc_ray.buffer_idx = 0;
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, gris_reservoir_addr, gris_reservoir_ping_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, compact_vertices_addr, lumen_scene->compact_vertices_buffer,
 								 vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, vertex_addr, lumen_scene->vertex_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, debug_vis_addr, debug_vis_buffer, vk::render_graph());
 
 	path_length = config->path_length;
@@ -167,7 +159,8 @@ void ReSTIRPT::render() {
 								 {"src/shaders/integrators/restir/gris/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
 					 .macros = {{"STREAMING_MODE", int(streaming_method)},
-								vk::ShaderMacro("ENABLE_ATMOSPHERE", enable_atmosphere)},
+								vk::ShaderMacro("ENABLE_ATMOSPHERE", enable_atmosphere),
+								{"SCENE_TEX_IDX", 8}},
 					 .dims = {Window::width(), Window::height()},
 				 })
 		.push_constants(&pc_ray)
@@ -191,6 +184,7 @@ void ReSTIRPT::render() {
 									 {"src/shaders/ray_shadow.rmiss"},
 									 {"src/shaders/integrators/restir/gris/ray.rchit"},
 									 {"src/shaders/ray.rahit"}},
+						 .macros = {{"SCENE_TEX_IDX", 9}},
 						 .dims = {Window::width(), Window::height()},
 					 })
 			.push_constants(&pc_ray)
@@ -214,6 +208,7 @@ void ReSTIRPT::render() {
 											 {"src/shaders/ray_shadow.rmiss"},
 											 {"src/shaders/integrators/restir/gris/ray.rchit"},
 											 {"src/shaders/ray.rahit"}},
+								 .macros = {{"SCENE_TEX_IDX", 9}},
 								 .dims = {Window::width(), Window::height()},
 							 })
 					.push_constants(&pc_ray)
@@ -235,6 +230,7 @@ void ReSTIRPT::render() {
 											 {"src/shaders/ray_shadow.rmiss"},
 											 {"src/shaders/integrators/restir/gris/ray.rchit"},
 											 {"src/shaders/ray.rahit"}},
+								 .macros = {{"SCENE_TEX_IDX", 7}},
 								 .dims = {Window::width(), Window::height()},
 							 })
 					.push_constants(&pc_ray)
@@ -253,6 +249,7 @@ void ReSTIRPT::render() {
 											 {"src/shaders/ray_shadow.rmiss"},
 											 {"src/shaders/integrators/restir/gris/ray.rchit"},
 											 {"src/shaders/ray.rahit"}},
+								 .macros = {{"SCENE_TEX_IDX", 7}},
 								 .dims = {Window::width(), Window::height()},
 							 })
 					.push_constants(&pc_ray)
@@ -273,7 +270,8 @@ void ReSTIRPT::render() {
 										{"src/shaders/ray_shadow.rmiss"},
 										{"src/shaders/integrators/restir/gris/ray.rchit"},
 										{"src/shaders/ray.rahit"}},
-							.macros = {vk::ShaderMacro("ENABLE_DEFENSIVE_PAIRWISE_MIS", enable_defensive_formulation)},
+							.macros = {vk::ShaderMacro("ENABLE_DEFENSIVE_PAIRWISE_MIS", enable_defensive_formulation),
+									   {"SCENE_TEX_IDX", 10}},
 							.dims = {Window::width(), Window::height()},
 						})
 					.push_constants(&pc_ray)
@@ -382,12 +380,53 @@ bool ReSTIRPT::gui() {
 	if (spatial_samples_changed && num_spatial_samples > 0) {
 		vkDeviceWaitIdle(vk::context().device);
 		prm::remove(reconnection_buffer);
-		reconnection_buffer = prm::get_buffer(
-			{.name = "Reservoir Connection",
-			 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-					  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			 .memory_type = vk::BufferType::GPU,
-			 .size = Window::width() * Window::height() * sizeof(ReconnectionData) * (num_spatial_samples + 1)});
+		create_reconnection_buffer();
 	}
 	return result;
 }
+
+void ReSTIRPT::create_reconnection_buffer() {
+	reconnection_buffer = prm::get_buffer(
+		{.name = "Reservoir Connection",
+		 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+				  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		 .memory_type = vk::BufferType::GPU,
+		 .size = Window::width() * Window::height() * sizeof(ReconnectionData) * (num_spatial_samples + 1)});
+}
+
+void ReSTIRPT::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("direct_lighting", direct_lighting);
+	visitor("enable_atmosphere", enable_atmosphere);
+	visitor("enable_rr", enable_rr);
+	visitor("enable_accumulation", enable_accumulation);
+	visitor("enable_gris", enable_gris);
+	visitor("path_length", path_length);
+	visitor("canonical_only", canonical_only);
+	visitor("streaming_method", streaming_method);
+	visitor("gris_separator", gris_separator);
+	visitor("enable_occlusion", enable_occlusion);
+	visitor("enable_temporal_jitter", enable_temporal_jitter);
+	visitor("pixel_debug", pixel_debug);
+	visitor("enable_defensive_formulation", enable_defensive_formulation);
+	visitor("enable_permutation_sampling", enable_permutation_sampling);
+	visitor("enable_spatial_reuse", enable_spatial_reuse);
+	visitor("hide_reconnection_radiance", hide_reconnection_radiance);
+	visitor("mis_method", mis_method);
+	visitor("enable_temporal_reuse", enable_temporal_reuse);
+	visitor("num_spatial_samples", num_spatial_samples);
+	visitor("spatial_reuse_radius", spatial_reuse_radius);
+	visitor("min_vertex_distance_ratio", min_vertex_distance_ratio);
+}
+
+void ReSTIRPT::settings_changed(const Settings& prev) {
+	if (prev.at("enable_gris") != enable_gris) {
+		pc_ray.total_frame_num = 0;
+	}
+	// Before init there is no buffer to resize yet
+	if (reconnection_buffer && num_spatial_samples > 0 && prev.at("num_spatial_samples") != num_spatial_samples) {
+		vkDeviceWaitIdle(vk::context().device);
+		prm::remove(reconnection_buffer);
+		create_reconnection_buffer();
+	}
+}
@@ -12,8 +12,11 @@ class ReSTIRPT final : public Integrator {
 	virtual bool update() override;
 	virtual void destroy() override;
 	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
+	virtual void settings_changed(const Settings& prev) override;
 
    private:
+	void create_reconnection_buffer();
 	enum class StreamingMethod { INDIVIDUAL_CONTRIBUTIONS, SPLITTING_AT_RECONNECTION };
 
 	enum class MISMethod { TALBOT, PAIRWISE };
@@ -22,7 +25,7 @@ class ReSTIRPT final : public Integrator {
 	vk::Buffer* gris_reservoir_ping_buffer;
 	vk::Buffer* gris_reservoir_pong_buffer;
 	vk::Buffer* prefix_contribution_buffer;
-	vk::Buffer* reconnection_buffer;
+	vk::Buffer* reconnection_buffer = nullptr;
 	vk::Buffer* transformations_buffer;
 	vk::Buffer* debug_vis_buffer;
 	vk::Texture* canonical_contributions_texture;
@@ -103,7 +103,7 @@ void SMLT::init() {
 		prm::get_buffer({.name = "Light Path Buffer",
 						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 						 .memory_type = vk::BufferType::GPU,
-						 .size = path_size * (config->path_length + 1) * sizeof(VCMVertex)});
+						 .size = path_size * (config->path_length + 1) * sizeof(PackedVCMVertex)});
 
 	connected_lights_buffer =
 		prm::get_buffer({.name = "Connected Lights Buffer",
@@ -175,11 +175,8 @@ void SMLT::init() {
 	} while (arr_size > 1);
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	// The MLT path pdfs assume uniform light picking
+	lumen_scene->fill_scene_desc(desc, /* light_bvh = */ false);
 	// SMLT
 	desc.bootstrap_addr = bootstrap_buffer->get_device_address();
 	desc.cdf_addr = cdf_buffer->get_device_address();
@@ -203,7 +200,6 @@ void SMLT::init() {
 
 	lumen::RenderGraph* rg = vk::render_graph();
 	assert(rg->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, bootstrap_addr, bootstrap_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, cdf_addr, cdf_buffer, rg);
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, cdf_sum_addr, cdf_sum_buffer, rg);
@@ -558,3 +554,10 @@ void SMLT::destroy() {
 		prm::remove(cdf_cpu);
 	}
 }
+
+void SMLT::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("config.mutations_per_pixel", config->mutations_per_pixel);
+	visitor("config.num_mlt_threads", config->num_mlt_threads);
+	visitor("config.num_bootstrap_samples", config->num_bootstrap_samples);
+}
@@ -9,6 +9,7 @@ class SMLT final : public Integrator {
 	virtual void render() override;
 	virtual bool update() override;
 	virtual void destroy() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
 
    private:
 	void prefix_scan(int level, int num_elems, int& counter, lumen::RenderGraph* rg);
@@ -40,11 +40,8 @@ void SPPM::init() {
 						 .size = sizeof(int)});
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	// Photons and eye paths pick the lights uniformly
+	lumen_scene->fill_scene_desc(desc, /* light_bvh = */ false);
 	// SPPM
 	desc.sppm_data_addr = sppm_data_buffer->get_device_address();
 	desc.atomic_data_addr = atomic_data_buffer->get_device_address();
@@ -62,8 +59,6 @@ void SPPM::init() {
 
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer,
-								 vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, sppm_data_addr, sppm_data_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, atomic_data_addr, atomic_data_buffer,
 								 vk::render_graph());
@@ -153,6 +148,7 @@ void SPPM::render() {
 								 {"src/shaders/ray_shadow.rmiss"},
 								 {"src/shaders/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
+					 .macros = splat_macros(),
 					 .dims = {Window::width(), Window::height() },
 				 })
 		.push_constants(&pc_ray)
@@ -177,6 +173,12 @@ void SPPM::render() {
 		.bind({output_tex, lumen_scene->scene_desc_buffer});
 }
 
+bool SPPM::gui() {
+	bool result = Integrator::gui();
+	result |= splat_gui();
+	return result;
+}
+
 bool SPPM::update() {
 	frame_num++;
 	bool updated = Integrator::update();
@@ -197,3 +199,8 @@ void SPPM::destroy() {
 	if (desc_set_layout) vkDestroyDescriptorSetLayout(vk::context().device, desc_set_layout, nullptr);
 	if (desc_pool) vkDestroyDescriptorPool(vk::context().device, desc_pool, nullptr);
 }
+
+void SPPM::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("config.base_radius", config->base_radius);
+}
@@ -0,0 +1,122 @@
+#include "LumenPCH.h"
+#include "SamplerCheck.h"
+#include "shaders/sampling.h"
+
+namespace SamplerCheck {
+
+// Pixels and dimension pairs whose sequences are checked, each one is scrambled with its own seed
+static const glm::uvec2 PIXELS[] = {{0, 0}, {17, 3}, {640, 360}, {1919, 1079}};
+static constexpr uint32_t NUM_PAIRS = 4;
+
+// The first 2^m points of every sequence form a (0,m,2)-net in base 2
+static bool stratified(const std::vector<glm::vec2>& points, uint32_t m) {
+	std::vector<uint32_t> counts(points.size());
+	for (uint32_t k = 0; k <= m; k++) {
+		std::fill(counts.begin(), counts.end(), 0);
+		for (const glm::vec2& p : points) {
+			const uint32_t cx = std::min(uint32_t(p.x * float(1u << k)), (1u << k) - 1);
+			const uint32_t cy = std::min(uint32_t(p.y * float(1u << (m - k))), (1u << (m - k)) - 1);
+			counts[(cx << (m - k)) + cy]++;
+		}
+		if (std::any_of(counts.begin(), counts.end(), [](uint32_t c) { return c != 1; })) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Exact star discrepancy, the extreme boxes [0, x) x [0, y) have their corners on the coordinates of the points
+static double star_discrepancy(std::vector<glm::vec2> points) {
+	const size_t n = points.size();
+	std::sort(points.begin(), points.end(), [](const glm::vec2& a, const glm::vec2& b) { return a.x < b.x; });
+	std::vector<double> corners_y;
+	corners_y.reserve(n + 1);
+	for (const glm::vec2& p : points) {
+		corners_y.push_back(p.y);
+	}
+	corners_y.push_back(1.0);
+	std::sort(corners_y.begin(), corners_y.end());
+	// y of the points left of the current corner, sorted
+	std::vector<double> left;
+	left.reserve(n);
+	double discrepancy = 0.0;
+	for (size_t i = 0; i <= n; i++) {
+		const double x = i < n ? points[i].x : 1.0;
+		for (const double y : corners_y) {
+			const size_t open = std::lower_bound(left.begin(), left.end(), y) - left.begin();
+			const size_t closed = std::upper_bound(left.begin(), left.end(), y) - left.begin() +
+								  size_t(i < n && points[i].y <= y);
+			discrepancy = std::max(discrepancy, std::max(x * y - double(open) / n, double(closed) / n - x * y));
+		}
+		if (i < n) {
+			left.insert(std::upper_bound(left.begin(), left.end(), double(points[i].y)), double(points[i].y));
+		}
+	}
+	return discrepancy;
+}
+
+static std::vector<glm::vec2> sobol_points(glm::uvec2 pixel, uint32_t pair, uint32_t num_points) {
+	std::vector<glm::vec2> points(num_points);
+	for (uint32_t i = 0; i < num_points; i++) {
+		glm::uvec4 state(pixel.x, pixel.y, i, 2 * pair);
+		points[i].x = sample_ld(state, SAMPLER_SOBOL);
+		points[i].y = sample_ld(state, SAMPLER_SOBOL);
+	}
+	return points;
+}
+
+static std::vector<glm::vec2> random_points(std::mt19937& rng, uint32_t num_points) {
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<glm::vec2> points(num_points);
+	for (glm::vec2& p : points) {
+		p = glm::vec2(uniform(rng), uniform(rng));
+	}
+	return points;
+}
+
+static bool validate(uint32_t max_m) {
+	std::mt19937 rng(7);
+	bool valid = true;
+	for (uint32_t m = 1; m <= max_m; m++) {
+		const uint32_t n = 1u << m;
+		// Niederreiter's bound on N * D* of (0,m,2)-nets in base 2
+		const double max_sobol_discrepancy = (m / 2.0 + 1.5) / n;
+		uint32_t sobol_stratified = 0;
+		uint32_t random_stratified = 0;
+		double sobol_discrepancy = 0.0;
+		double max_discrepancy = 0.0;
+		double random_discrepancy = 0.0;
+		uint32_t num_sets = 0;
+		for (const glm::uvec2& pixel : PIXELS) {
+			for (uint32_t pair = 0; pair < NUM_PAIRS; pair++) {
+				const std::vector<glm::vec2> sobol = sobol_points(pixel, pair, n);
+				const std::vector<glm::vec2> random = random_points(rng, n);
+				sobol_stratified += stratified(sobol, m);
+				random_stratified += stratified(random, m);
+				const double d = star_discrepancy(sobol);
+				sobol_discrepancy += d;
+				max_discrepancy = std::max(max_discrepancy, d);
+				random_discrepancy += star_discrepancy(random);
+				num_sets++;
+			}
+		}
+		sobol_discrepancy /= num_sets;
+		random_discrepancy /= num_sets;
+		LUMEN_TRACE("{:>5} points: stratified sets {}/{} Sobol, {}/{} random, mean star discrepancy {:.5f} Sobol "
+					"(max {:.5f}, bound {:.5f}), {:.5f} random",
+					n, sobol_stratified, num_sets, random_stratified, num_sets, sobol_discrepancy, max_discrepancy,
+					max_sobol_discrepancy, random_discrepancy);
+		valid &= sobol_stratified == num_sets && max_discrepancy <= max_sobol_discrepancy;
+		// Below 16 points random sets can be as uniform by chance
+		valid &= m < 4 || sobol_discrepancy < random_discrepancy;
+	}
+	return valid;
+}
+
+int run(int argc, char* argv[]) {
+	const uint32_t max_m = argc > 2 ? std::clamp(std::stoi(argv[2]), 1, 14) : 10;
+	const bool valid = validate(max_m);
+	LUMEN_TRACE("Sampler stratification and discrepancy {}", valid ? "passed" : "failed");
+	return valid ? 0 : 1;
+}
+}  // namespace SamplerCheck
@@ -0,0 +1,9 @@
+#pragma once
+#include "../LumenPCH.h"
+
+// Stratification and star discrepancy of the Owen scrambled Sobol sampler of sampling.h on the CPU, compared to
+// uniform random points. Needs no GPU
+namespace SamplerCheck {
+// Handles --sampler-check [log2 of the max point count]
+int run(int argc, char* argv[]);
+}  // namespace SamplerCheck
@@ -10,7 +10,7 @@ struct CameraSettings {
 	glm::mat4 cam_matrix = glm::mat4();
 };
 
-enum class IntegratorType { Path, BDPT, SPPM, VCM, PSSMLT, SMLT, VCMMLT, ReSTIR, ReSTIRGI, ReSTIRPT, DDGI };
+enum class IntegratorType { Path, BDPT, SPPM, VCM, PSSMLT, SMLT, VCMMLT, ReSTIR, ReSTIRGI, ReSTIRPT, DDGI, WavefrontPath };
 
 struct SceneConfig {
 	int path_length = 6;
@@ -81,3 +81,9 @@ struct DDGIConfig : SceneConfig {
 struct ReSTIRPTConfig : SceneConfig {
 	ReSTIRPTConfig() : SceneConfig("ReSTIR PT", IntegratorType::ReSTIRPT) {}
 };
+
+struct WavefrontPathConfig : SceneConfig {
+	// Paths in flight per wave, 0 traces the whole image at once
+	uint32_t queue_capacity = 0;
+	WavefrontPathConfig() : SceneConfig("Wavefront Path", IntegratorType::WavefrontPath) {}
+};
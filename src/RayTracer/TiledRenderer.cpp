@@ -0,0 +1,66 @@
+#include "LumenPCH.h"
+#include "TiledRenderer.h"
+
+void TiledRenderer::init(uint32_t width, uint32_t height, VkExtent2D tile_extent, const lumen::Camera& camera,
+						 const std::string& output_path, uint32_t first_tile, uint32_t tile_count) {
+	this->width = width;
+	this->height = height;
+	this->tile_extent = tile_extent;
+	this->output_path = output_path;
+	tiles_x = (width + tile_extent.width - 1) / tile_extent.width;
+	tiles_y = (height + tile_extent.height - 1) / tile_extent.height;
+	tile_idx = std::min(first_tile, num_tiles());
+	end_tile = tile_count > 0 ? std::min(tile_idx + tile_count, num_tiles()) : num_tiles();
+	// The camera projection has the aspect ratio of a tile
+	projection = camera.projection;
+	projection[0][0] *= (float(tile_extent.width) / tile_extent.height) / (float(width) / height);
+	if (tile_count > 0) {
+		std::filesystem::create_directories(output_path);
+	} else {
+		writer = std::make_unique<ImageUtils::ExrTileWriter>(output_path.c_str(), int(width), int(height));
+	}
+	start_time = glfwGetTime();
+	LUMEN_TRACE("Tiled render of {}x{}, tiles {} to {} of {} with {}x{} pixels", width, height, tile_idx, end_tile,
+				num_tiles(), tile_extent.width, tile_extent.height);
+}
+
+void TiledRenderer::apply(lumen::Camera& camera) const {
+	// Maps the NDC range of the tile to [-1, 1]. Tiles on the right and bottom edges extend past the image, the
+	// pixels outside of it are traced but never stored
+	const uint32_t x = (tile_idx % tiles_x) * tile_extent.width;
+	const uint32_t y = (tile_idx / tiles_x) * tile_extent.height;
+	const glm::vec2 scale(float(width) / tile_extent.width, float(height) / tile_extent.height);
+	const glm::vec2 center(-1.0f + float(2 * x + tile_extent.width) / width,
+						   -1.0f + float(2 * y + tile_extent.height) / height);
+	glm::mat4 tile(1.0f);
+	tile[0][0] = scale.x;
+	tile[1][1] = scale.y;
+	tile[3][0] = -scale.x * center.x;
+	tile[3][1] = -scale.y * center.y;
+	camera.projection = tile * projection;
+}
+
+void TiledRenderer::store(const float* rgba) {
+	const uint32_t x = (tile_idx % tiles_x) * tile_extent.width;
+	const uint32_t y = (tile_idx / tiles_x) * tile_extent.height;
+	if (writer) {
+		writer->write(rgba, int(x), int(y), int(tile_extent.width), int(tile_extent.height), int(tile_extent.width));
+		if (!writer->good()) {
+			LUMEN_ERROR("Could not write tile " + std::to_string(tile_idx) + " to " + output_path);
+		}
+	} else {
+		const std::string path = tile_path(output_path, tile_idx);
+		ImageUtils::ExrTileWriter tile_writer(path.c_str(), int(std::min(tile_extent.width, width - x)),
+											  int(std::min(tile_extent.height, height - y)), true);
+		tile_writer.write(rgba, 0, 0, int(tile_extent.width), int(tile_extent.height), int(tile_extent.width));
+		if (!tile_writer.good()) {
+			LUMEN_ERROR("Could not write " + path);
+		}
+	}
+	tile_idx++;
+	LUMEN_TRACE("Tile {}/{} done after {:.1f} s", tile_idx, end_tile, glfwGetTime() - start_time);
+	if (tile_idx == end_tile && writer) {
+		writer.reset();
+		LUMEN_TRACE("Saved exr file. [ {} ]", output_path);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "../LumenPCH.h"
+#include "Framework/Camera.h"
+#include "Framework/ImageUtils.h"
+
+// Renders an image larger than the window as a grid of window sized tiles, --tiled <width> <height>. The integrator
+// keeps its window sized working set and traces one tile at a time through an off-center projection of the full image,
+// so peak memory scales with the tile size. Light tracing splats that land outside of the current tile are dropped:
+// the light subpaths traced for the tile they land in account for them, as a pixel only receives the splats of its
+// own tile. Finished tiles are streamed to an uncompressed .exr
+class TiledRenderer {
+   public:
+	// With tile_count, only the tiles [first_tile, first_tile + tile_count) are rendered and each is written to its
+	// own full precision <output_path>/tile_<index>.exr, see Distributed.h
+	void init(uint32_t width, uint32_t height, VkExtent2D tile_extent, const lumen::Camera& camera,
+			  const std::string& output_path, uint32_t first_tile = 0, uint32_t tile_count = 0);
+	// Points the camera to the current tile
+	void apply(lumen::Camera& camera) const;
+	// Writes the RGBA32F pixels of the current tile and moves on to the next one
+	void store(const float* rgba);
+	bool active() const { return tile_idx < end_tile; }
+	bool last_tile() const { return tile_idx + 1 == end_tile; }
+	uint32_t num_tiles() const { return tiles_x * tiles_y; }
+	static uint32_t num_tiles(uint32_t width, uint32_t height, VkExtent2D tile_extent) {
+		return ((width + tile_extent.width - 1) / tile_extent.width) *
+			   ((height + tile_extent.height - 1) / tile_extent.height);
+	}
+	static std::string tile_path(const std::string& dir, uint32_t tile_idx) {
+		return (std::filesystem::path(dir) / ("tile_" + std::to_string(tile_idx) + ".exr")).string();
+	}
+
+   private:
+	uint32_t width = 0;
+	uint32_t height = 0;
+	VkExtent2D tile_extent{};
+	uint32_t tiles_x = 0;
+	uint32_t tiles_y = 0;
+	uint32_t tile_idx = 0;
+	uint32_t end_tile = 0;
+	// Projection of the full image, with the vertical field of view of the camera
+	glm::mat4 projection{1.0f};
+	std::string output_path;
+	// Only for whole images
+	std::unique_ptr<ImageUtils::ExrTileWriter> writer;
+	double start_time = 0.0;
+};
@@ -20,7 +20,8 @@ void VCM::init() {
 						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 								  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 						 .memory_type = vk::BufferType::GPU,
-						 .size = Window::width() * Window::height()  * (config->path_length + 1) * sizeof(VCMVertex)});
+						 .size = Window::width() * Window::height() * (config->path_length + 1) *
+								 sizeof(PackedVCMVertex)});
 
 	light_path_cnt_buffer =
 		prm::get_buffer({.name = "Light Path Count",
@@ -76,11 +77,8 @@ void VCM::init() {
 								  .size = sizeof(AvgStruct)});
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	// The vertex merging pdfs assume uniform light picking
+	lumen_scene->fill_scene_desc(desc, /* light_bvh = */ false);
 	// VCM
 	desc.photon_addr = photon_buffer->get_device_address();
 	desc.vcm_vertices_addr = vcm_light_vertices_buffer->get_device_address();
@@ -106,8 +104,6 @@ void VCM::init() {
 
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer,
-								 vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, photon_addr, photon_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, vcm_vertices_addr, vcm_light_vertices_buffer,
 								 vk::render_graph());
@@ -225,6 +221,7 @@ void VCM::render() {
 								 {"src/shaders/ray_shadow.rmiss"},
 								 {"src/shaders/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
+					 .macros = splat_macros(),
 					 .dims = {Window::width(), Window::height() },
 				 })
 		.push_constants(&pc_ray)
@@ -256,6 +253,7 @@ void VCM::render() {
 								 {"src/shaders/ray_shadow.rmiss"},
 								 {"src/shaders/ray.rchit"},
 								 {"src/shaders/ray.rahit"}},
+					 .macros = splat_macros(),
 					 .dims = {Window::width(), Window::height() },
 				 })
 		.push_constants(&pc_ray)
@@ -270,6 +268,12 @@ void VCM::render() {
 	pc_ray.total_frame_num++;
 }
 
+bool VCM::gui() {
+	bool result = Integrator::gui();
+	result |= splat_gui();
+	return result;
+}
+
 bool VCM::update() {
 	frame_num++;
 	bool updated = Integrator::update();
@@ -291,3 +295,9 @@ void VCM::destroy() {
 	if (desc_set_layout) vkDestroyDescriptorSetLayout(vk::context().device, desc_set_layout, nullptr);
 	if (desc_pool) vkDestroyDescriptorPool(vk::context().device, desc_pool, nullptr);
 }
+
+void VCM::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("config.radius_factor", config->radius_factor);
+	visitor("config.enable_vm", config->enable_vm);
+}
@@ -8,6 +8,8 @@ class VCM final : public Integrator {
 	virtual void init() override;
 	virtual void render() override;
 	virtual bool update() override;
+	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
 	virtual void destroy() override;
 
    private:
@@ -85,7 +85,8 @@ void VCMMLT::init() {
 		prm::get_buffer({.name = "Light Path Buffer",
 						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 						 .memory_type = vk::BufferType::GPU,
-						 .size = Window::width() * Window::height()  * (config->path_length + 1) * sizeof(VCMVertex)});
+						 .size = Window::width() * Window::height() * (config->path_length + 1) *
+								 sizeof(PackedVCMVertex)});
 
 	light_path_cnt_buffer =
 		prm::get_buffer({.name = "Light Path Cnt Buffer",
@@ -153,11 +154,8 @@ void VCMMLT::init() {
 	} while (arr_size > 1);
 
 	SceneDesc desc;
-	desc.index_addr = lumen_scene->index_buffer->get_device_address();
-
-	desc.material_addr = lumen_scene->materials_buffer->get_device_address();
-	desc.prim_info_addr = lumen_scene->prim_lookup_buffer->get_device_address();
-	desc.compact_vertices_addr = lumen_scene->compact_vertices_buffer->get_device_address();
+	// The vertex merging pdfs assume uniform light picking
+	lumen_scene->fill_scene_desc(desc, /* light_bvh = */ false);
 	// VCMMLT
 	desc.bootstrap_addr = bootstrap_buffer->get_device_address();
 	desc.cdf_addr = cdf_buffer->get_device_address();
@@ -181,8 +179,6 @@ void VCMMLT::init() {
 	desc.counter_addr = counter_buffer->get_device_address();
 
 	assert(vk::render_graph()->settings.shader_inference == true);
-	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, prim_info_addr, lumen_scene->prim_lookup_buffer,
-								 vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, bootstrap_addr, bootstrap_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, cdf_addr, cdf_buffer, vk::render_graph());
 	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, cdf_sum_addr, cdf_sum_buffer, vk::render_graph());
@@ -306,6 +302,7 @@ void VCMMLT::render() {
 							   {"src/shaders/ray_shadow.rmiss"},
 							   {"src/shaders/ray.rchit"},
 							   {"src/shaders/ray.rahit"}},
+				   .macros = splat_macros(),
 				   .specialization_data = spec_consts,
 				   .dims = {Window::width() * Window::height() },
 			   })
@@ -325,6 +322,7 @@ void VCMMLT::render() {
 							   {"src/shaders/ray_shadow.rmiss"},
 							   {"src/shaders/ray.rchit"},
 							   {"src/shaders/ray.rahit"}},
+				   .macros = splat_macros(),
 				   .specialization_data = spec_consts,
 				   .dims = {(uint32_t)config->num_bootstrap_samples},
 			   })
@@ -357,6 +355,7 @@ void VCMMLT::render() {
 								   {"src/shaders/ray_shadow.rmiss"},
 								   {"src/shaders/ray.rchit"},
 								   {"src/shaders/ray.rahit"}},
+					   .macros = splat_macros(),
 					   .specialization_data = spec_consts,
 					   .dims = {(uint32_t)config->num_mlt_threads},
 				   })
@@ -388,6 +387,7 @@ void VCMMLT::render() {
 									   {"src/shaders/ray_shadow.rmiss"},
 									   {"src/shaders/ray.rchit"},
 									   {"src/shaders/ray.rahit"}},
+						   .macros = splat_macros(),
 						   .dims = {(uint32_t)config->num_mlt_threads},
 					   })
 				.push_constants(&pc_ray)
@@ -535,3 +535,14 @@ void VCMMLT::destroy() {
 		prm::remove(b);
 	}
 }
+
+void VCMMLT::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("config.mutations_per_pixel", config->mutations_per_pixel);
+	visitor("config.num_mlt_threads", config->num_mlt_threads);
+	visitor("config.num_bootstrap_samples", config->num_bootstrap_samples);
+	visitor("config.radius_factor", config->radius_factor);
+	visitor("config.enable_vm", config->enable_vm);
+	visitor("config.alternate", config->alternate);
+	visitor("config.light_first", config->light_first);
+}
@@ -8,6 +8,7 @@ class VCMMLT final : public Integrator {
 	virtual void init() override;
 	virtual void render() override;
 	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
 	virtual bool update() override;
 	virtual void destroy() override;
 
@@ -0,0 +1,232 @@
+#include "LumenPCH.h"
+#include "WavefrontPath.h"
+#include "Framework/GPUQueryManager.h"
+
+static constexpr const char* WAVEFRONT_PASS_PREFIX = "Wavefront: ";
+static constexpr const char* SHADE_PASS_NAMES[] = {"Wavefront: Shade Diffuse",	  "Wavefront: Shade Mirror",
+												   "Wavefront: Shade Glass",	  "Wavefront: Shade Dielectric",
+												   "Wavefront: Shade Conductor", "Wavefront: Shade Principled"};
+
+void WavefrontPath::init() {
+	Integrator::init();
+	const uint32_t pixel_count = Window::width() * Window::height();
+	capacity = config->queue_capacity == 0 ? pixel_count : std::min(config->queue_capacity, pixel_count);
+
+	paths_buffer =
+		prm::get_buffer({.name = "Wavefront Paths",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = capacity * sizeof(WavefrontPathState)});
+	queues_buffer =
+		prm::get_buffer({.name = "Wavefront Queues",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = 2 * capacity * sizeof(uint32_t)});
+	hits_buffer =
+		prm::get_buffer({.name = "Wavefront Hits",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = capacity * sizeof(WavefrontHit)});
+	sorted_buffer =
+		prm::get_buffer({.name = "Wavefront Sorted Hits",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = capacity * sizeof(uint32_t)});
+	// Up to a light sample and a BSDF sample per shaded path
+	shadow_buffer =
+		prm::get_buffer({.name = "Wavefront Shadow Rays",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = 2 * capacity * sizeof(WavefrontShadowRay)});
+	counters_buffer =
+		prm::get_buffer({.name = "Wavefront Counters",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+								  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = sizeof(WavefrontCounters)});
+
+	SceneDesc desc;
+	lumen_scene->fill_scene_desc(desc);
+	// Wavefront
+	desc.wavefront_paths_addr = paths_buffer->get_device_address();
+	desc.wavefront_queues_addr = queues_buffer->get_device_address();
+	desc.wavefront_hits_addr = hits_buffer->get_device_address();
+	desc.wavefront_sorted_addr = sorted_buffer->get_device_address();
+	desc.wavefront_shadow_addr = shadow_buffer->get_device_address();
+	desc.wavefront_counters_addr = counters_buffer->get_device_address();
+	lumen_scene->scene_desc_buffer =
+		prm::get_buffer({.name = "Scene Desc",
+						 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+						 .memory_type = vk::BufferType::GPU,
+						 .size = sizeof(SceneDesc),
+						 .data = &desc});
+
+	frame_num = 0;
+
+	assert(vk::render_graph()->settings.shader_inference == true);
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, wavefront_paths_addr, paths_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, wavefront_queues_addr, queues_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, wavefront_hits_addr, hits_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, wavefront_sorted_addr, sorted_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, wavefront_shadow_addr, shadow_buffer, vk::render_graph());
+	REGISTER_BUFFER_WITH_ADDRESS(SceneDesc, desc, wavefront_counters_addr, counters_buffer, vk::render_graph());
+	path_length = config->path_length;
+	LUMEN_TRACE("Wavefront path queue capacity: {} paths ({} waves per frame)", capacity,
+				(pixel_count + capacity - 1) / capacity);
+}
+
+void WavefrontPath::render() {
+	collect_stage_timings();
+	pc_ray.size_x = Window::width();
+	pc_ray.size_y = Window::height();
+	pc_ray.num_lights = (int)lumen_scene->gpu_lights.size();
+	pc_ray.time = rand() % UINT_MAX;
+	pc_ray.max_depth = path_length;
+	pc_ray.sky_col = config->sky_col;
+	pc_ray.total_light_area = lumen_scene->total_light_area;
+	pc_ray.light_triangle_count = lumen_scene->total_light_triangle_cnt;
+	pc_ray.dir_light_idx = lumen_scene->dir_light_idx;
+	pc_ray.frame_num = frame_num;
+	pc_ray.direct_lighting = direct_lighting;
+	pc_ray.capacity = capacity;
+
+	const auto add_stage = [&](const char* name, const char* rgen, std::vector<vk::ShaderMacro> macros,
+							   uint32_t dim) -> lumen::RenderPass& {
+		return vk::render_graph()
+			->add_rt(name,
+					 {
+						 .shaders = {{rgen},
+									 {"src/shaders/ray.rmiss"},
+									 {"src/shaders/ray_shadow.rmiss"},
+									 {"src/shaders/ray.rchit"},
+									 {"src/shaders/ray.rahit"}},
+						 .macros = macros,
+						 .dims = {dim, 1},
+					 })
+			.push_constants(&pc_ray)
+			.bind({
+				output_tex,
+				scene_ubo_buffer,
+				lumen_scene->scene_desc_buffer,
+			})
+			.bind(lumen_scene->mesh_lights_buffer)
+			.bind_texture_array(lumen_scene->scene_textures)
+			.bind_tlas(tlas);
+	};
+	// Stages are launched at queue capacity and the threads past the GPU side counts exit, the render graph has no
+	// indirect dispatch
+	const uint32_t groups = (capacity + WAVEFRONT_WG_SIZE - 1) / WAVEFRONT_WG_SIZE;
+	const uint32_t pixel_count = pc_ray.size_x * pc_ray.size_y;
+	const uint32_t max_depth = std::max(path_length, 1u);
+	for (uint32_t first_pixel = 0; first_pixel < pixel_count; first_pixel += capacity) {
+		pc_ray.first_pixel = first_pixel;
+		pc_ray.path_count = std::min(capacity, pixel_count - first_pixel);
+		pc_ray.depth = 0;
+		add_stage("Wavefront: Generate", "src/shaders/integrators/wavefront/generate.rgen", sampler_macros(),
+				  pc_ray.path_count)
+			.zero(counters_buffer);
+		for (uint32_t depth = 0; depth < max_depth; depth++) {
+			pc_ray.depth = depth;
+			add_stage("Wavefront: Trace", "src/shaders/integrators/wavefront/trace.rgen", {}, capacity);
+			vk::render_graph()
+				->add_compute("Wavefront: Bin", {.shader = vk::Shader("src/shaders/integrators/wavefront/bin.comp"),
+												 .dims = {groups, 1, 1}})
+				.push_constants(&pc_ray)
+				.bind(lumen_scene->scene_desc_buffer);
+			pc_ray.bin = WAVEFRONT_MISS_BIN;
+			add_stage("Wavefront: Miss", "src/shaders/integrators/wavefront/miss.rgen", {}, capacity);
+			// One pass per BSDF type of the scene, each compiled for that type only
+			for (uint32_t bin = 0; bin < WAVEFRONT_MISS_BIN; bin++) {
+				if (!lumen_scene->has_bsdf_type(1u << bin)) {
+					continue;
+				}
+				pc_ray.bin = bin;
+				std::vector<vk::ShaderMacro> macros = sampler_macros();
+				macros.emplace_back("WAVEFRONT_BSDF_TYPE", int(1u << bin));
+				add_stage(SHADE_PASS_NAMES[bin], "src/shaders/integrators/wavefront/shade.rgen", macros, capacity);
+			}
+			add_stage("Wavefront: Shadow", "src/shaders/integrators/wavefront/shadow.rgen", {}, 2 * capacity);
+		}
+		vk::render_graph()
+			->add_compute("Wavefront: Accumulate",
+						  {.shader = vk::Shader("src/shaders/integrators/wavefront/accumulate.comp"),
+						   .dims = {(pc_ray.path_count + WAVEFRONT_WG_SIZE - 1) / WAVEFRONT_WG_SIZE, 1, 1}})
+			.push_constants(&pc_ray)
+			.bind({output_tex, lumen_scene->scene_desc_buffer});
+	}
+}
+
+void WavefrontPath::collect_stage_timings() {
+	const auto& query_results = GPUQueryManager::get();
+	const size_t prefix_len = strlen(WAVEFRONT_PASS_PREFIX);
+	bool collected = false;
+	for (size_t i = 0; i < query_results.size; i += 2) {
+		const std::string& name = query_results.names[i >> 1];
+		if (name.compare(0, prefix_len, WAVEFRONT_PASS_PREFIX) != 0) {
+			continue;
+		}
+		// Every wave and bounce adds a pass with the same name
+		const std::string stage = name.substr(prefix_len);
+		auto it = std::find_if(stage_timings.begin(), stage_timings.end(),
+							   [&](const StageTiming& timing) { return timing.name == stage; });
+		if (it == stage_timings.end()) {
+			it = stage_timings.insert(stage_timings.end(), StageTiming{stage});
+		}
+		it->total_ms += (query_results.timestamps[i + 1] - query_results.timestamps[i]) * 1e-6;
+		collected = true;
+	}
+	if (collected) {
+		timed_frames++;
+	}
+}
+
+bool WavefrontPath::update() {
+	frame_num++;
+	bool updated = Integrator::update();
+	if (updated) {
+		frame_num = 0;
+	}
+	return updated;
+}
+
+void WavefrontPath::destroy() {
+	if (timed_frames > 0) {
+		LUMEN_TRACE("Wavefront stage timings over {} frames:", timed_frames);
+		for (const StageTiming& timing : stage_timings) {
+			LUMEN_TRACE("  {}: {:.3f} ms", timing.name, timing.total_ms / timed_frames);
+		}
+	}
+	Integrator::destroy();
+	auto buffer_list = {paths_buffer, queues_buffer, hits_buffer, sorted_buffer, shadow_buffer, counters_buffer};
+	for (vk::Buffer* b : buffer_list) {
+		prm::remove(b);
+	}
+}
+
+bool WavefrontPath::gui() {
+	bool result = Integrator::gui();
+	result |= ImGui::SliderInt("Path length", (int*)&path_length, 0, 12);
+	result |= ImGui::Checkbox("Direct lighting", &direct_lighting);
+	result |= sampler_gui();
+	if (timed_frames > 0) {
+		ImGui::Text("Average stage timings (%u frames):", timed_frames);
+		double total_ms = 0.0;
+		for (const StageTiming& timing : stage_timings) {
+			ImGui::Text("  %s: %.3f ms", timing.name.c_str(), timing.total_ms / timed_frames);
+			total_ms += timing.total_ms;
+		}
+		ImGui::Text("  Total: %.3f ms", total_ms / timed_frames);
+		if (ImGui::Button("Reset stage timings")) {
+			stage_timings.clear();
+			timed_frames = 0;
+		}
+	}
+	return result;
+}
+
+void WavefrontPath::visit_settings(SettingsVisitor& visitor) {
+	Integrator::visit_settings(visitor);
+	visitor("config.queue_capacity", config->queue_capacity);
+	visitor("path_length", path_length);
+	visitor("direct_lighting", direct_lighting);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "Integrator.h"
+#include "shaders/integrators/wavefront/wavefront_commons.h"
+// Path tracer split into render graph stages per bounce: trace, bin by material, miss, shade per material type and
+// shadow rays. The pixels are traced in waves of queue capacity paths
+class WavefrontPath final : public Integrator {
+   public:
+	WavefrontPath(LumenScene* lumen_scene, const vk::BVH& tlas)
+		: Integrator(lumen_scene, tlas), config(CAST_CONFIG(lumen_scene->config.get(), WavefrontPathConfig)) {}
+	virtual void init() override;
+	virtual void render() override;
+	virtual bool update() override;
+	virtual void destroy() override;
+	virtual bool gui() override;
+	virtual void visit_settings(SettingsVisitor& visitor) override;
+
+   private:
+	// Adds the timings of the last collected frame to the per stage averages
+	void collect_stage_timings();
+	PCWavefront pc_ray{};
+	WavefrontPathConfig* config;
+	uint32_t path_length = 0;
+	uint32_t capacity = 0;
+	bool direct_lighting = true;
+
+	vk::Buffer* paths_buffer;
+	vk::Buffer* queues_buffer;
+	vk::Buffer* hits_buffer;
+	vk::Buffer* sorted_buffer;
+	vk::Buffer* shadow_buffer;
+	vk::Buffer* counters_buffer;
+
+	struct StageTiming {
+		std::string name;
+		double total_ms = 0.0;
+	};
+	std::vector<StageTiming> stage_timings;
+	uint32_t timed_frames = 0;
+};
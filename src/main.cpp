@@ -1,6 +1,14 @@
 #include "LumenPCH.h"
 #include "Framework/Window.h"
 #include "RayTracer/RayTracer.h"
+#include "RayTracer/CPUPathTracer.h"
+#include "RayTracer/Benchmark.h"
+#include "RayTracer/Distributed.h"
+#include "RayTracer/PathVertexCheck.h"
+#include "RayTracer/SamplerCheck.h"
+#include "RayTracer/MeshLoadBenchmark.h"
+#include "Framework/EnvMapDistribution.h"
+#include "Framework/TextureCompression.h"
 
 void window_size_callback(GLFWwindow* window, int width, int height) {}
 
@@ -14,10 +22,105 @@ int main(int argc, char* argv[]) {
 	int width = 1920;
 	int height = 1080;
 	Logger::init();
+	// CPU error analysis of reduced precision outputs, no GPU needed
+	if (argc > 2 && std::string(argv[1]) == "--precision-report") {
+		ImageUtils::precision_report(argv[2], argc > 3 ? argv[3] : nullptr);
+		return 0;
+	}
+	// Validates the importance sampling distribution of an environment map
+	if (argc > 2 && std::string(argv[1]) == "--env-check") {
+		int env_width, env_height;
+		float* pixels = ImageUtils::load_hdr(argv[2], env_width, env_height);
+		if (!pixels) {
+			return 1;
+		}
+		lumen::EnvMapDistribution distribution;
+		distribution.build(pixels, env_width, env_height);
+		free(pixels);
+		const bool valid = distribution.validate(1 << 22);
+		LUMEN_TRACE("Environment map distribution {}", valid ? "passed" : "failed");
+		return valid ? 0 : 1;
+	}
+	// Round trip of the packed subpath vertices and their memory savings
+	if (argc > 1 && std::string(argv[1]) == "--path-vertex-check") {
+		return PathVertexCheck::run(argc, argv);
+	}
+	// Stratification and star discrepancy of the Sobol sampler against random points
+	if (argc > 1 && std::string(argv[1]) == "--sampler-check") {
+		return SamplerCheck::run(argc, argv);
+	}
+	// Scene x integrator matrix, every run is a child renderer process
+	if (argc > 2 && std::string(argv[1]) == "--benchmark") {
+		return Benchmark::run(argc, argv);
+	}
+	// One frame over several renderer processes, and its coordinator with synthetic workers
+	if (argc > 2 && std::string(argv[1]) == "--distributed") {
+		return Distributed::run(argc, argv);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--distributed-check") {
+		return Distributed::check(argc, argv);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--synthetic-worker") {
+		return Distributed::synthetic_worker(argc, argv);
+	}
 	lumen::ThreadPool::init();
-	Window::init(width, height, fullscreen);
+	// Quality and size of the block compressed formats for a texture
+	if (argc > 2 && std::string(argv[1]) == "--texture-report") {
+		TextureCompression::compression_report(argv[2]);
+		lumen::ThreadPool::destroy();
+		return 0;
+	}
+	// Load times of the mesh formats on a synthetic mesh
+	if (argc > 1 && std::string(argv[1]) == "--mesh-benchmark") {
+		const int result = MeshLoadBenchmark::run(argc, argv);
+		lumen::ThreadPool::destroy();
+		return result;
+	}
+	// Validates the light BVH of a scene against uniform light picking
+	if (argc > 2 && std::string(argv[1]) == "--light-bvh-check") {
+		LumenScene scene;
+		scene.load_scene(argv[2], true);
+		// Scenes without a light BVH have nothing to validate, which must not pass as a valid BVH
+		if (scene.light_bvh.empty()) {
+			LUMEN_WARN("No light BVH built for {}", argv[2]);
+			lumen::ThreadPool::destroy();
+			return 2;
+		}
+		const bool valid = scene.light_bvh.validate(scene.m_dimensions.min, scene.m_dimensions.max, 8, 1 << 18);
+		LUMEN_TRACE("Light BVH {}", valid ? "passed" : "failed");
+		lumen::ThreadPool::destroy();
+		return valid ? 0 : 1;
+	}
+	// Quantization error of the packed vertex stream of a scene
+	if (argc > 2 && std::string(argv[1]) == "--vertex-packing-check") {
+		LumenScene scene;
+		scene.load_scene(argv[2], true);
+		const bool valid = scene.validate_vertex_packing();
+		LUMEN_TRACE("Vertex packing {}", valid ? "passed" : "failed");
+		lumen::ThreadPool::destroy();
+		return valid ? 0 : 1;
+	}
+	// CPU backend and its ray throughput benchmark, no window or GPU needed
+	if (argc > 1 && (std::string(argv[1]) == "--cpu" || std::string(argv[1]) == "--cpu-benchmark")) {
+		const int result = CPUPathTracer::run(argc, argv);
+		lumen::ThreadPool::destroy();
+		return result;
+	}
+	// Tiled renders (--tiled) trace tiles of the window size
+	for (int i = 1; i + 2 < argc; i++) {
+		if (std::string(argv[i]) == "--tile-size") {
+			width = std::stoi(argv[i + 1]);
+			height = std::stoi(argv[i + 2]);
+		}
+	}
 	{
 		RayTracer app(enable_debug, argc, argv);
+		// Replays render at the recorded size, without input. Memory reports only need the first frame
+		if (const CameraPath* camera_path = app.replay_camera_path()) {
+			width = camera_path->width;
+			height = camera_path->height;
+		}
+		Window::init(width, height, fullscreen, !app.headless());
 		app.init();
 		while (!Window::should_close()) {
 			Window::poll();
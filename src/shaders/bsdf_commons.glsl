@@ -18,6 +18,18 @@ Material load_material(const uint material_idx, const vec2 uv) {
 	if (m.texture_id > -1) {
 		m.albedo *= texture(scene_textures[m.texture_id], uv).xyz;
 	}
+	if (m.orm_texture_id > -1) {
+		const vec3 orm = texture(scene_textures[m.orm_texture_id], uv).xyz;
+		m.roughness *= orm.y;
+		m.metallic *= orm.z;
+		// The loaders flag a material glossy from its roughness factor, keep textured values on that side
+		if (is_glossy(m)) {
+			m.roughness = max(m.roughness, 0.08);
+		}
+	}
+	if (m.emission_texture_id > -1) {
+		m.emissive_factor *= texture(scene_textures[m.emission_texture_id], uv).xyz;
+	}
 	return m;
 }
 
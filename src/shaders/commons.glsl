@@ -8,7 +8,7 @@
 #define SCENE_TEX_IDX 4
 #endif
 
-layout(binding = 0, rgba32f) uniform image2D image;
+layout(binding = 0, OUTPUT_IMAGE_FORMAT) uniform image2D image;
 layout(binding = 1) uniform SceneUBOBuffer { SceneUBO ubo; };
 layout(binding = 2) buffer SceneDesc_ { SceneDesc scene_desc; };
 layout(binding = 3, scalar) readonly buffer Lights { Light lights[]; };
@@ -18,13 +18,21 @@ layout(set = 1, binding = 0) uniform accelerationStructureEXT tlas;
 layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer InstanceInfo { PrimMeshInfo d[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer Materials { Material m[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer Indices { uint i[]; };
-layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer CompactVertices { Vertex d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer EnvDistribution {
+	EnvMapHeader header;
+	float d[];
+};
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer LightBVH {
+	LightBVHHeader header;
+	LightBVHNode nodes[];
+};
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer LightBVHTables { uint d[]; };
 
 Indices indices = Indices(scene_desc.index_addr);
 Materials materials = Materials(scene_desc.material_addr);
 InstanceInfo prim_infos = InstanceInfo(scene_desc.prim_info_addr);
-CompactVertices compact_vertices = CompactVertices(scene_desc.compact_vertices_addr);
 
+#include "vertex_fetch.glsl"
 #include "bsdf_commons.glsl"
 
 vec4 sample_camera(in vec2 d) {
@@ -32,6 +40,14 @@ vec4 sample_camera(in vec2 d) {
 	return ubo.inv_view * vec4(normalize(target.xyz), 0);  // direction
 }
 
+// Area of a pixel on the image plane. Measured from the projected origin, since the projection of a tile is off-center
+float camera_pixel_area(vec2 size) {
+	vec4 p0 = ubo.inv_projection * vec4(0, 0, 0, 1);
+	vec4 p1 = ubo.inv_projection * vec4(2. / size.x, 2. / size.y, 0, 1);
+	const vec2 extent = p1.xy / p1.w - p0.xy / p0.w;
+	return abs(extent.x * extent.y);
+}
+
 vec4 sample_prev_camera(in vec2 d) {
 	vec4 target = inverse(ubo.prev_projection) * vec4(d.x, d.y, 1, 1);
 	return inverse(ubo.prev_view) * vec4(normalize(target.xyz), 0);	 // direction
@@ -45,6 +61,240 @@ bool is_light_delta(uint light_props) { return ((light_props >> 5) & 0x1) != 0;
 
 uint get_light_type(uint light_props) { return uint(light_props & 0x7); }
 
+/*
+	Environment map
+*/
+bool has_env_map() { return scene_desc.env_distribution_addr != 0; }
+
+// Equirectangular mapping with +y up, mirrors EnvMapDistribution on the host
+vec2 env_dir_to_uv(const vec3 dir) {
+	const float u = atan(dir.z, dir.x) / TWO_PI;
+	return vec2(u < 0 ? u + 1 : u, acos(clamp(dir.y, -1, 1)) * INV_PI);
+}
+
+vec3 env_uv_to_dir(const vec2 uv) {
+	const float phi = uv.x * TWO_PI;
+	const float theta = uv.y * PI;
+	const float sin_theta = sin(theta);
+	return vec3(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+}
+
+// Largest i < count with d[offset + i] <= xi, over a CDF of count + 1 entries
+uint env_find_interval(const EnvDistribution env, const uint offset, const uint count, const float xi) {
+	uint lo = 0;
+	uint hi = count;
+	while (lo + 1 < hi) {
+		const uint mid = (lo + hi) / 2;
+		if (env.d[offset + mid] <= xi) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+float env_texel_pdf_w(const EnvDistribution env, const uint x, const uint y, const float sin_theta) {
+	const uint w = env.header.width;
+	const uint h = env.header.height;
+	if (sin_theta <= 0) {
+		return 0;
+	}
+	const float pdf_uv = env.d[h + 1 + h * (w + 1) + y * w + x] / env.header.integral;
+	return pdf_uv / (2 * PI * PI * sin_theta);
+}
+
+// Samples a direction towards the environment, pdf_w is the solid angle pdf
+vec3 sample_env_map(const vec2 rands, out float pdf_w) {
+	EnvDistribution env = EnvDistribution(scene_desc.env_distribution_addr);
+	const uint w = env.header.width;
+	const uint h = env.header.height;
+	const uint y = env_find_interval(env, 0, h, rands.y);
+	float dy = rands.y - env.d[y];
+	if (env.d[y + 1] > env.d[y]) {
+		dy /= env.d[y + 1] - env.d[y];
+	}
+	const uint row_offset = h + 1 + y * (w + 1);
+	const uint x = env_find_interval(env, row_offset, w, rands.x);
+	float dx = rands.x - env.d[row_offset + x];
+	if (env.d[row_offset + x + 1] > env.d[row_offset + x]) {
+		dx /= env.d[row_offset + x + 1] - env.d[row_offset + x];
+	}
+	const vec2 uv = vec2((x + dx) / float(w), (y + dy) / float(h));
+	pdf_w = env_texel_pdf_w(env, x, y, sin(uv.y * PI));
+	return env_uv_to_dir(uv);
+}
+
+float env_map_pdf(const vec3 dir) {
+	EnvDistribution env = EnvDistribution(scene_desc.env_distribution_addr);
+	const uint w = env.header.width;
+	const uint h = env.header.height;
+	const vec2 uv = env_dir_to_uv(dir);
+	const uint x = min(uint(uv.x * w), w - 1);
+	const uint y = min(uint(uv.y * h), h - 1);
+	return env_texel_pdf_w(env, x, y, sin(uv.y * PI));
+}
+
+// Area density of the points the environment light emits from, a disk of the scene radius
+float env_map_pdf_pos() {
+	EnvDistribution env = EnvDistribution(scene_desc.env_distribution_addr);
+	const float radius = lights[env.header.light_idx].world_radius;
+	return INV_PI / (radius * radius);
+}
+
+vec3 eval_env_map(const vec3 dir) {
+	EnvDistribution env = EnvDistribution(scene_desc.env_distribution_addr);
+	const Light light = lights[env.header.light_idx];
+	return light.L * textureLod(scene_textures[nonuniformEXT(light.prim_mesh_idx)], env_dir_to_uv(dir), 0).rgb;
+}
+
+// Radiance of a ray leaving the scene
+vec3 eval_sky(const vec3 sky_col, const vec3 dir) { return has_env_map() ? eval_env_map(dir) : sky_col; }
+
+/*
+	Light BVH
+*/
+#ifndef LIGHT_BVH_SPATIAL
+// Next event estimation picks the lights by their estimated contribution to the shading point, 0 by power alone
+#define LIGHT_BVH_SPATIAL 1
+#endif
+
+const float ONE_MINUS_EPSILON = 0.99999994;
+
+bool has_light_bvh() { return scene_desc.light_bvh_addr != 0; }
+
+// Mirrors LightBounds::importance on the host
+float light_bvh_importance(const LightBVHNode node, const vec3 p, const bool spatial) {
+	if (!spatial) {
+		return node.phi;
+	}
+	const vec3 center = 0.5 * (node.bounds_min + node.bounds_max);
+	const vec3 to_p = p - center;
+	const float dist_sqr = dot(to_p, to_p);
+	const float d2 = max(dist_sqr, 0.5 * length(node.bounds_max - node.bounds_min));
+	const float radius_sqr = dot(node.bounds_max - center, node.bounds_max - center);
+	if (dist_sqr <= radius_sqr) {
+		return node.cos_theta_e < 1 ? node.phi / d2 : 0;
+	}
+	float cos_theta_w = dot(node.axis, to_p / sqrt(dist_sqr));
+	if ((node.flags & LIGHT_BVH_TWO_SIDED) != 0) {
+		cos_theta_w = abs(cos_theta_w);
+	}
+	const float sin_theta_w = sqrt(max(1 - cos_theta_w * cos_theta_w, 0));
+	const float cos_theta_b = sqrt(max(1 - radius_sqr / dist_sqr, 0));
+	const float sin_theta_b = sqrt(max(1 - cos_theta_b * cos_theta_b, 0));
+	const float sin_theta_o = sqrt(max(1 - node.cos_theta_o * node.cos_theta_o, 0));
+	// theta_x = max(0, theta_w - theta_o) and theta_p = max(0, theta_x - theta_b)
+	const bool clamp_x = cos_theta_w > node.cos_theta_o;
+	const float cos_theta_x = clamp_x ? 1 : cos_theta_w * node.cos_theta_o + sin_theta_w * sin_theta_o;
+	const float sin_theta_x = clamp_x ? 0 : sin_theta_w * node.cos_theta_o - cos_theta_w * sin_theta_o;
+	const float cos_theta_p =
+		cos_theta_x > cos_theta_b ? 1 : cos_theta_x * cos_theta_b + sin_theta_x * sin_theta_b;
+	return cos_theta_p > node.cos_theta_e ? node.phi * cos_theta_p / d2 : 0;
+}
+
+float light_bvh_infinite_prob(const LightBVH bvh) {
+	const uint num_infinite = bvh.header.num_infinite;
+	return num_infinite == 0 ? 0 : float(num_infinite) / float(num_infinite + min(bvh.header.num_nodes, 1u));
+}
+
+// Returns the probability of the picked light, 0 when no light reaches p
+float light_bvh_pick(float u, const vec3 p, const bool spatial, out uint light_idx, out uint triangle_idx) {
+	LightBVH bvh = LightBVH(scene_desc.light_bvh_addr);
+	const float p_infinite = light_bvh_infinite_prob(bvh);
+	light_idx = 0;
+	triangle_idx = 0;
+	if (u < p_infinite) {
+		const uint num_infinite = bvh.header.num_infinite;
+		const uint idx = min(uint(u / p_infinite * num_infinite), num_infinite - 1);
+		light_idx = LightBVHTables(scene_desc.light_bvh_addr).d[bvh.header.infinite_offset + idx];
+		return p_infinite / num_infinite;
+	}
+	if (bvh.header.num_nodes == 0) {
+		return 0;
+	}
+	LightBVHNode node = bvh.nodes[0];
+	if (light_bvh_importance(node, p, spatial) == 0) {
+		return 0;
+	}
+	u = min((u - p_infinite) / (1 - p_infinite), ONE_MINUS_EPSILON);
+	float pdf = 1 - p_infinite;
+	uint node_idx = 0;
+	while ((node.flags & LIGHT_BVH_LEAF) == 0) {
+		const LightBVHNode child_0 = bvh.nodes[node_idx + 1];
+		const LightBVHNode child_1 = bvh.nodes[node.child_or_light];
+		const float importance_0 = light_bvh_importance(child_0, p, spatial);
+		const float importance_1 = light_bvh_importance(child_1, p, spatial);
+		if (importance_0 == 0 && importance_1 == 0) {
+			return 0;
+		}
+		const float p_0 = importance_0 / (importance_0 + importance_1);
+		if (u < p_0) {
+			node_idx = node_idx + 1;
+			node = child_0;
+			u = min(u / p_0, ONE_MINUS_EPSILON);
+			pdf *= p_0;
+		} else {
+			node_idx = node.child_or_light;
+			node = child_1;
+			u = min((u - p_0) / (1 - p_0), ONE_MINUS_EPSILON);
+			pdf *= 1 - p_0;
+		}
+	}
+	light_idx = node.child_or_light;
+	triangle_idx = node.triangle_idx;
+	return pdf;
+}
+
+// Leaf of an emitter, -1 for infinite lights and emitters without power
+uint light_bvh_leaf(const uint light_idx, const uint triangle_idx) {
+	LightBVH bvh = LightBVH(scene_desc.light_bvh_addr);
+	LightBVHTables tables = LightBVHTables(scene_desc.light_bvh_addr);
+	const uint first = tables.d[bvh.header.light_leaves_offset + light_idx];
+	return first == -1 ? -1 : tables.d[bvh.header.leaves_offset + first + triangle_idx];
+}
+
+// Leaf of a triangle hit on a mesh, -1 when the mesh doesn't emit
+uint light_bvh_mesh_leaf(const uint prim_mesh_idx, const uint triangle_idx) {
+	LightBVH bvh = LightBVH(scene_desc.light_bvh_addr);
+	const uint light_idx = LightBVHTables(scene_desc.light_bvh_addr).d[bvh.header.mesh_lights_offset + prim_mesh_idx];
+	return light_idx == -1 ? -1 : light_bvh_leaf(light_idx, triangle_idx);
+}
+
+// Probability of light_bvh_pick reaching a leaf, the product of the choices from the root
+float light_bvh_leaf_pdf(const uint leaf_idx, const vec3 p, const bool spatial) {
+	LightBVH bvh = LightBVH(scene_desc.light_bvh_addr);
+	if (leaf_idx == -1 || light_bvh_importance(bvh.nodes[0], p, spatial) == 0) {
+		return 0;
+	}
+	float pdf = 1 - light_bvh_infinite_prob(bvh);
+	uint node_idx = leaf_idx;
+	while (node_idx != 0) {
+		const uint parent = bvh.nodes[node_idx].parent;
+		const float importance_0 = light_bvh_importance(bvh.nodes[parent + 1], p, spatial);
+		const float importance_1 = light_bvh_importance(bvh.nodes[bvh.nodes[parent].child_or_light], p, spatial);
+		if (importance_0 == 0 && importance_1 == 0) {
+			return 0;
+		}
+		pdf *= (node_idx == parent + 1 ? importance_0 : importance_1) / (importance_0 + importance_1);
+		node_idx = parent;
+	}
+	return pdf;
+}
+
+float light_bvh_pdf(const uint light_idx, const uint triangle_idx, const vec3 p, const bool spatial) {
+	if (!is_light_finite(lights[light_idx].light_flags)) {
+		LightBVH bvh = LightBVH(scene_desc.light_bvh_addr);
+		return light_bvh_infinite_prob(bvh) / bvh.header.num_infinite;
+	}
+	return light_bvh_leaf_pdf(light_bvh_leaf(light_idx, triangle_idx), p, spatial);
+}
+
+// Probability of having picked the light of a sample, uniform over every emitter without a light BVH
+float light_pick_pdf(const LightRecord record, const int light_triangle_count) {
+	return has_light_bvh() ? record.pick_pdf : 1. / light_triangle_count;
+}
+
 float light_pdf(const Light light, const vec3 n_s, const vec3 wi) {
 	const float cos_width = cos(30 * PI / 180);
 	uint light_type = get_light_type(light.light_flags);
@@ -58,6 +308,9 @@ float light_pdf(const Light light, const vec3 n_s, const vec3 wi) {
 		case LIGHT_DIRECTIONAL: {
 			return 0;
 		} break;
+		case LIGHT_ENVIRONMENT: {
+			return env_map_pdf(-wi);
+		} break;
 	}
 }
 
@@ -65,7 +318,8 @@ float light_pdf_a_to_w(const uint light_flags, const float pdf_a, const vec3 n_s
 					   const float cos_from_light) {
 	uint light_type = get_light_type(light_flags);
 	switch (light_type) {
-		case LIGHT_AREA: {
+		case LIGHT_AREA:
+		case LIGHT_ENVIRONMENT: {
 			return pdf_a * wi_len_sqr / cos_from_light;
 		} break;
 		case LIGHT_SPOT: {
@@ -91,6 +345,9 @@ float light_pdf(uint light_flags, const vec3 n_s, const vec3 wi) {
 		case LIGHT_DIRECTIONAL: {
 			return 0;
 		}
+		case LIGHT_ENVIRONMENT: {
+			return env_map_pdf(-wi);
+		}
 	}
 }
 
@@ -106,6 +363,9 @@ float light_pdf_Le(uint light_flags, const vec3 n_s, const vec3 wi) {
 		case LIGHT_DIRECTIONAL: {
 			return 1;
 		}
+		case LIGHT_ENVIRONMENT: {
+			return env_map_pdf(-wi);
+		}
 	}
 }
 
@@ -116,9 +376,9 @@ TriangleRecord sample_triangle(PrimMeshInfo pinfo, vec2 rands, uint triangle_idx
 	ivec3 ind = ivec3(indices.i[index_offset + 0], indices.i[index_offset + 1], indices.i[index_offset + 2]);
 	ind += ivec3(vertex_offset);
 	Vertex vtx[3];
-	vtx[0] = compact_vertices.d[ind.x];
-	vtx[1] = compact_vertices.d[ind.y];
-	vtx[2] = compact_vertices.d[ind.z];
+	vtx[0] = fetch_vertex(ind.x, pinfo);
+	vtx[1] = fetch_vertex(ind.y, pinfo);
+	vtx[2] = fetch_vertex(ind.z, pinfo);
 	const vec3 v0 = vtx[0].pos;
 	const vec3 v1 = vtx[1].pos;
 	const vec3 v2 = vtx[2].pos;
@@ -186,11 +446,11 @@ TriangleRecord sample_area_light(const vec4 rands, const int num_lights, const L
 	return sample_triangle(pinfo, rands.zw, triangle_idx, light.world_matrix, uv);
 }
 
-TriangleRecord sample_area_light_with_idx(const vec4 rands, const int num_lights, const Light light,
-										  const uint triangle_idx, out uint material_idx) {
+TriangleRecord sample_area_light_with_idx(const vec4 rands, const Light light, const uint triangle_idx,
+										  out uint material_idx, out vec2 uv) {
 	PrimMeshInfo pinfo = prim_infos.d[light.prim_mesh_idx];
 	material_idx = pinfo.material_index;
-	return sample_triangle(pinfo, rands.zw, triangle_idx, light.world_matrix);
+	return sample_triangle(pinfo, rands.zw, triangle_idx, light.world_matrix, uv);
 }
 
 TriangleRecord sample_area_light(const vec4 rands, const Light light, out uint material_idx, out uint triangle_idx,
@@ -224,22 +484,43 @@ vec3 uniform_sample_cone(vec2 uv, float cos_max) {
 vec3 sample_light_Li(const vec4 rands_pos, const vec3 p, const int num_lights, out float pdf_pos_w, out vec3 wi,
 					 out float wi_len, out float pdf_pos_a, out float cos_from_light, out LightRecord light_record,
 					 out vec3 n, out vec3 pos, out float pdf_pos_dir_w) {
-	light_record.light_idx = uint(rands_pos.x * num_lights);
-	Light light = lights[light_record.light_idx];
-	uint light_type = get_light_type(light.light_flags);
-	vec3 L = vec3(0);
-	light_record.flags = light.light_flags;
 	pdf_pos_w = 0;
 	wi = vec3(0);
 	wi_len = 0;
 	pdf_pos_a = 0;
 	cos_from_light = 0;
+	uint triangle_idx;
+	if (has_light_bvh()) {
+		light_record.pick_pdf = light_bvh_pick(rands_pos.x, p, LIGHT_BVH_SPATIAL == 1, light_record.light_idx,
+											   triangle_idx);
+		if (light_record.pick_pdf == 0) {
+			// No light reaches p
+			light_record.flags = 0;
+			n = vec3(0);
+			pos = p;
+			pdf_pos_dir_w = 0;
+			return vec3(0);
+		}
+	} else {
+		light_record.light_idx = uint(rands_pos.x * num_lights);
+		light_record.pick_pdf = 0;
+	}
+	Light light = lights[light_record.light_idx];
+	uint light_type = get_light_type(light.light_flags);
+	vec3 L = vec3(0);
+	light_record.flags = light.light_flags;
 
 	switch (light_type) {
 		case LIGHT_AREA: {
 			uint material_idx;
-			TriangleRecord record =
-				sample_area_light(rands_pos, light, material_idx, light_record.triangle_idx, light_record.bary);
+			TriangleRecord record;
+			if (has_light_bvh()) {
+				light_record.triangle_idx = triangle_idx;
+				record = sample_area_light_with_idx(rands_pos, light, triangle_idx, material_idx, light_record.bary);
+			} else {
+				record =
+					sample_area_light(rands_pos, light, material_idx, light_record.triangle_idx, light_record.bary);
+			}
 			Material light_mat = load_material(material_idx, light_record.bary);
 			wi = record.pos - p;
 			float wi_len_sqr = dot(wi, wi);
@@ -293,6 +574,17 @@ vec3 sample_light_Li(const vec4 rands_pos, const vec3 p, const int num_lights, o
 			n = -wi;
 			pos = light_p;
 		} break;
+		case LIGHT_ENVIRONMENT: {
+			// The light point is placed outside the scene bounds along the sampled direction
+			wi = sample_env_map(rands_pos.zw, pdf_pos_w);
+			wi_len = 2 * light.world_radius;
+			pos = p + wi * wi_len;
+			pdf_pos_a = pdf_pos_w / (wi_len * wi_len);
+			pdf_pos_dir_w = pdf_pos_w * INV_PI / (light.world_radius * light.world_radius);
+			L = eval_env_map(wi);
+			cos_from_light = 1.;
+			n = -wi;
+		} break;
 		default:
 			break;
 	}
@@ -335,7 +627,15 @@ vec3 sample_light_Li(const vec4 rands_pos, const vec3 p, const int num_lights, o
 vec3 sample_light_Le(vec4 rands_pos, vec2 rands_dir, const int num_lights, const int total_light,
 					 out float cos_from_light, out LightRecord light_record, out vec3 pos, out vec3 wi, out vec3 n,
 					 out float pdf_pos_a, out float pdf_dir_w, out float phi, out TriangleRecord record) {
-	uint light_idx = uint(rands_pos.x * num_lights);
+	uint light_idx;
+	uint triangle_idx;
+	if (has_light_bvh()) {
+		// Emission doesn't depend on a receiver, the lights are picked by power
+		light_record.pick_pdf = light_bvh_pick(rands_pos.x, vec3(0), false, light_idx, triangle_idx);
+	} else {
+		light_idx = uint(rands_pos.x * num_lights);
+		light_record.pick_pdf = 1. / total_light;
+	}
 	Light light = lights[light_idx];
 	vec3 L = vec3(0);
 	uint light_type = get_light_type(light.light_flags);
@@ -348,8 +648,13 @@ vec3 sample_light_Le(vec4 rands_pos, vec2 rands_dir, const int num_lights, const
 	switch (light_type) {
 		case LIGHT_AREA: {
 			uint material_idx;
-			uint triangle_idx;
-			record = sample_area_light(rands_pos, light, material_idx, light_record.triangle_idx, light_record.bary);
+			if (has_light_bvh()) {
+				light_record.triangle_idx = triangle_idx;
+				record = sample_area_light_with_idx(rands_pos, light, triangle_idx, material_idx, light_record.bary);
+			} else {
+				record =
+					sample_area_light(rands_pos, light, material_idx, light_record.triangle_idx, light_record.bary);
+			}
 			Material light_mat = load_material(material_idx, light_record.bary);
 			pos = record.pos;
 			wi = sample_hemisphere(rands_dir, record.n_s, phi);
@@ -357,7 +662,6 @@ vec3 sample_light_Le(vec4 rands_pos, vec2 rands_dir, const int num_lights, const
 			cos_from_light = max(dot(record.n_s, wi), 0);
 			pdf_pos_a = record.triangle_pdf;
 			pdf_dir_w = (dot(wi, record.n_s)) / PI;
-			light_record.triangle_idx = triangle_idx;
 			light_record.light_idx = light_idx;
 			n = record.n_s;
 		} break;
@@ -398,10 +702,24 @@ vec3 sample_light_Le(vec4 rands_pos, vec2 rands_dir, const int num_lights, const
 			cos_from_light = 1;
 			n = wi;
 		} break;
+		case LIGHT_ENVIRONMENT: {
+			float pdf_w;
+			const vec3 dir = sample_env_map(rands_dir, pdf_w);
+			vec3 v1, v2;
+			make_coord_system(dir, v1, v2);
+			vec2 uv = concentric_sample_disk(rands_pos.zw);
+			pos = light.world_center + light.world_radius * (uv.x * v1 + uv.y * v2 + dir);
+			wi = -dir;
+			L = eval_env_map(dir);
+			pdf_pos_a = 1. / (PI * light.world_radius * light.world_radius);
+			pdf_dir_w = pdf_w;
+			cos_from_light = 1;
+			n = wi;
+		} break;
 		default:
 			break;
 	}
-	pdf_pos_a /= total_light;
+	pdf_pos_a *= light_record.pick_pdf;
 	return L;
 }
 
@@ -421,9 +739,9 @@ vec3 sample_light_with_idx(const vec4 rands_pos, const vec3 p, const int num_lig
 	uint light_type = get_light_type(light.light_flags);
 	if (light_type == LIGHT_AREA) {
 		uint material_idx;
-		vec2 uv_unused;
-		TriangleRecord record = sample_area_light_with_idx(rands_pos, num_lights, light, triangle_idx, material_idx);
-		Material light_mat = load_material(material_idx, uv_unused);
+		vec2 uv;
+		TriangleRecord record = sample_area_light_with_idx(rands_pos, light, triangle_idx, material_idx, uv);
+		Material light_mat = load_material(material_idx, uv);
 		L = light_mat.emissive_factor;
 		pos = record.pos;
 		n = record.n_s;
@@ -450,6 +768,12 @@ vec3 sample_light_with_idx(const vec4 rands_pos, const vec3 p, const int num_lig
 		pos = p + dir * (2 * light.world_radius);
 		n = -dir;
 		L = light.L;
+	} else if (light_type == LIGHT_ENVIRONMENT) {
+		float unused_pdf;
+		vec3 dir = sample_env_map(rands_pos.zw, unused_pdf);
+		pos = p + dir * (2 * light.world_radius);
+		n = -dir;
+		L = eval_env_map(dir);
 	}
 	return L;
 }
@@ -36,6 +36,7 @@
 #define LIGHT_SPOT 1
 #define LIGHT_AREA 2
 #define LIGHT_DIRECTIONAL 3
+#define LIGHT_ENVIRONMENT 4
 
 #ifdef __cplusplus
 #include <glm/glm.hpp>
@@ -61,6 +62,23 @@ using uvec2 = glm::uvec2;
 #endif
 
 
+// Half precision outputs stop accumulating after this many samples. Past it a sample moves the running mean by less
+// than half a ulp of the half mean (2^-11 of it) unless it is far from the mean, so the mean stops converging and
+// only picks up rounding bias
+#define HALF_PRECISION_MAX_SAMPLES 1024
+
+#ifndef __cplusplus
+// Storage format of the integrator output image, selected by the host output precision, and the weight of sample
+// frame_num in its running mean
+#ifdef HALF_PRECISION_OUTPUT
+#define OUTPUT_IMAGE_FORMAT rgba16f
+#define ACCUMULATION_WEIGHT(frame_num) ((frame_num) < HALF_PRECISION_MAX_SAMPLES ? 1. / float((frame_num) + 1) : 0.)
+#else
+#define OUTPUT_IMAGE_FORMAT rgba32f
+#define ACCUMULATION_WEIGHT(frame_num) (1. / float((frame_num) + 1))
+#endif
+#endif
+
 // Debug logger for Raygen shaders
 #ifndef __cplusplus
 
@@ -166,6 +184,13 @@ struct PCPost {
 	float bloom_amount;
 };
 
+struct PCUpsample {
+	mat4 reprojection;
+	vec2 render_scale;
+	uint history_valid;
+	float blend_factor;
+};
+
 struct PushConstantCompute {
 	uint num_elems;
 	uint base_idx;
@@ -195,6 +220,15 @@ struct Vertex {
 	vec3 pos;
 	vec3 normal;
 	vec2 uv0;
+	// Tangent along +u and the sign of the bitangent in w, only generated for normal mapped meshes
+	vec4 tangent;
+};
+
+// Shading attributes of a vertex quantized by vertex_packing.h, the positions are read from the BLAS vertex buffer
+struct PackedVertex {
+	uint normal;
+	uint tangent;
+	uint uv;
 };
 
 struct Light {
@@ -231,11 +265,25 @@ struct Material {
 	float flatness;
 	float anisotropy;
 	uint thin;
+	// Texture whose alpha channel cuts out the surface, -1 for opaque materials
+	int alpha_texture_id;
+	float alpha_cutoff;
+	// Tangent space normals in RG, the closest hit shader reconstructs B
+	int normal_texture_id;
+	float normal_scale;
+	// Occlusion, roughness and metallic in RGB as in glTF, scales the roughness and metallic factors
+	int orm_texture_id;
+	// Scales emissive_factor
+	int emission_texture_id;
 };
 
 // Scene buffer addresses
  struct ALIGN16 SceneDesc {
 	uint64_t compact_vertices_addr;
+	// Positions, only read with QUANTIZED_VERTICES
+	uint64_t vertex_addr;
+	// fp32 UVs of the meshes with PrimMeshInfo::full_precision_uvs, only read with QUANTIZED_VERTICES
+	uint64_t full_precision_uv_addr;
 	uint64_t index_addr;
 	uint64_t material_addr;
 	uint64_t prim_info_addr;
@@ -309,6 +357,71 @@ struct Material {
 	uint64_t probe_dir_depth_addr;
 	uint64_t direct_lighting_addr;
 	uint64_t probe_offsets_addr;
+	// Environment map importance sampling, 0 without an environment light
+	uint64_t env_distribution_addr;
+	// Light BVH for next event estimation, 0 picks the lights uniformly
+	uint64_t light_bvh_addr;
+	// Adaptive sampling
+	uint64_t adaptive_pixels_addr;
+	uint64_t adaptive_tiles_addr;
+	uint64_t adaptive_counters_addr;
+	// Arbitrary output variables, see aov_commons.glsl
+	uint64_t aov_addr;
+	// Wavefront path tracing
+	uint64_t wavefront_paths_addr;
+	uint64_t wavefront_queues_addr;
+	uint64_t wavefront_hits_addr;
+	uint64_t wavefront_sorted_addr;
+	uint64_t wavefront_shadow_addr;
+	uint64_t wavefront_counters_addr;
+};
+
+// Header of the environment map distribution buffer, followed by the marginal CDF (height + 1 floats), the
+// conditional CDFs (height * (width + 1) floats) and the texel weights (height * width floats)
+struct EnvMapHeader {
+	uint width;
+	uint height;
+	float integral;
+	uint light_idx;
+};
+
+#define LIGHT_BVH_LEAF 1
+#define LIGHT_BVH_TWO_SIDED 2
+
+// Node of the light BVH, see LightBVH. The first child of an interior node directly follows it
+struct LightBVHNode {
+	vec3 bounds_min;
+	// Emitted power
+	float phi;
+	vec3 bounds_max;
+	// Spread of the emission normals around axis
+	float cos_theta_o;
+	vec3 axis;
+	// Spread of the emission around the normals
+	float cos_theta_e;
+	// Second child of interior nodes, light index of leaves
+	uint child_or_light;
+	// Triangle of the area light of leaves
+	uint triangle_idx;
+	uint parent;
+	uint flags;
+};
+
+// Header of the light BVH buffer, followed by the nodes. The tables are arrays of uints at the given offsets in uints
+// from the start of the buffer
+struct LightBVHHeader {
+	uint num_nodes;
+	uint num_infinite;
+	// Per light, slot of its first emitter in the leaf table, -1 for infinite lights
+	uint light_leaves_offset;
+	// Per prim mesh, index of its area light or -1
+	uint mesh_lights_offset;
+	// Per emitter slot, index of its leaf node
+	uint leaves_offset;
+	// Indices of the directional and environment lights
+	uint infinite_offset;
+	uint pad0;
+	uint pad1;
 };
 
 
@@ -324,6 +437,45 @@ struct RTUtilsPC {
 	uint size;
 };
 
+// Adaptive sampling works on square tiles of the render extent
+#define ADAPTIVE_TILE_SIZE 16
+
+// Running luminance statistics of a pixel
+struct AdaptivePixel {
+	float mean;
+	// Sum of squared differences from the mean
+	float m2;
+	uint num_samples;
+	uint pad;
+};
+
+// Written by the mask pass, read back on the host to size the next launches
+struct AdaptiveCounters {
+	uint num_active_tiles;
+	uint num_active_pixels;
+};
+
+// Arbitrary output variables next to the color, a bit each in the AOVS mask of an integrator. Direct is the light
+// that reaches the camera after at most one bounce, indirect the rest of the color
+#define AOV_ALBEDO 1
+#define AOV_NORMAL 2
+#define AOV_DEPTH 4
+#define AOV_SAMPLE_COUNT 8
+#define AOV_DIRECT 16
+#define AOV_INDIRECT 32
+#define AOV_COUNT 6
+
+struct AdaptivePC {
+	uint size_x;
+	uint size_y;
+	uint frame_num;
+	uint min_samples;
+	// 0 for no limit
+	uint max_samples;
+	// Relative standard error of the pixel means below which a tile stops sampling
+	float threshold;
+};
+
 struct FFTPC {
 	uint idx;
 	uint n;
@@ -334,9 +486,12 @@ struct PrimMeshInfo {
 	uint index_offset;
 	uint vertex_offset;
 	uint material_index;
-	uint pad;
+	// The UVs did not fit in 16 bits over uv_range, see VertexPacking::uv_fits_unorm16
+	uint full_precision_uvs;
 	vec4 min_pos;
 	vec4 max_pos;
+	// Bounds of the texture coordinates of the mesh for their quantization, min in xy and extent in zw
+	vec4 uv_range;
 };
 
 #endif
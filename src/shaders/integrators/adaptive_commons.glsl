@@ -0,0 +1,57 @@
+#ifndef ADAPTIVE_COMMONS
+#define ADAPTIVE_COMMONS
+// Adaptive sampling. The ray generation shaders are launched with ADAPTIVE_TILE_SIZE^2 invocations along x and one
+// active tile per row along y, see update_mask.comp
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer AdaptivePixels { AdaptivePixel d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer AdaptiveTiles { uint d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer AdaptiveCountersRef { AdaptiveCounters c; };
+
+uvec2 adaptive_num_tiles(const uvec2 size) { return (size + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE; }
+
+// Pixel traced by the invocation, -1 when it has none. The host may launch more rows than there are active tiles
+uvec2 adaptive_launch_pixel(const bool adaptive, const uvec2 size) {
+	if (!adaptive) {
+		return gl_LaunchIDEXT.xy;
+	}
+	if (gl_LaunchIDEXT.y >= AdaptiveCountersRef(scene_desc.adaptive_counters_addr).c.num_active_tiles) {
+		return uvec2(-1);
+	}
+	const uint tiles_x = adaptive_num_tiles(size).x;
+	const uint tile = AdaptiveTiles(scene_desc.adaptive_tiles_addr).d[gl_LaunchIDEXT.y];
+	const uvec2 pixel = uvec2(tile % tiles_x, tile / tiles_x) * ADAPTIVE_TILE_SIZE +
+						uvec2(gl_LaunchIDEXT.x % ADAPTIVE_TILE_SIZE, gl_LaunchIDEXT.x / ADAPTIVE_TILE_SIZE);
+	return pixel.x < size.x && pixel.y < size.y ? pixel : uvec2(-1);
+}
+
+// Whether the mask pass of this frame left the tile of a pixel sampling
+bool adaptive_pixel_active(const uvec2 pixel, const uvec2 size) {
+	const uvec2 num_tiles = adaptive_num_tiles(size);
+	const uvec2 tile = pixel / ADAPTIVE_TILE_SIZE;
+	return AdaptiveTiles(scene_desc.adaptive_tiles_addr).d[num_tiles.x * num_tiles.y + tile.y * num_tiles.x + tile.x] !=
+		   0;
+}
+
+// Samples accumulated by a pixel, which replaces the frame number as its sample index
+uint adaptive_sample_count(const uint pixel_idx, const uint frame_num) {
+	return frame_num == 0 ? 0 : AdaptivePixels(scene_desc.adaptive_pixels_addr).d[pixel_idx].num_samples;
+}
+
+// Adds a sample to the running mean of the pixel in image and to its luminance statistics
+void adaptive_accumulate(const uvec2 pixel, const uint pixel_idx, const uint frame_num, const vec3 col) {
+	AdaptivePixels pixels = AdaptivePixels(scene_desc.adaptive_pixels_addr);
+	AdaptivePixel stats = pixels.d[pixel_idx];
+	if (frame_num == 0) {
+		stats.mean = 0;
+		stats.m2 = 0;
+		stats.num_samples = 0;
+	}
+	stats.num_samples++;
+	const float lum = luminance(col);
+	const float delta = lum - stats.mean;
+	stats.mean += delta / stats.num_samples;
+	stats.m2 += delta * (lum - stats.mean);
+	pixels.d[pixel_idx] = stats;
+	const vec3 old_col = stats.num_samples > 1 ? imageLoad(image, ivec2(pixel)).xyz : col;
+	imageStore(image, ivec2(pixel), vec4(mix(old_col, col, ACCUMULATION_WEIGHT(stats.num_samples - 1)), 1.f));
+}
+#endif
@@ -0,0 +1,24 @@
+#ifndef AOV_COMMONS
+#define AOV_COMMONS
+// AOVs enabled by the host, see Integrator::supported_aovs. Every enabled AOV is a layer of one vec4 per pixel of the
+// render extent in the AOV buffer, in the order of the AOV bits
+#ifndef AOVS
+#define AOVS 0
+#endif
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer AOVBuffer { vec4 d[]; };
+
+// Running mean over the samples of a pixel like the color, except for the sample count, which is stored as is
+void aov_store(const uint aov, const uvec2 pixel, const uvec2 size, const uint sample_idx, const vec4 value) {
+	if ((uint(AOVS) & aov) == 0) {
+		return;
+	}
+	const uint layer = uint(bitCount(uint(AOVS) & (aov - 1)));
+	const uint idx = (layer * size.y + pixel.y) * size.x + pixel.x;
+	AOVBuffer aovs = AOVBuffer(scene_desc.aov_addr);
+	if (aov == AOV_SAMPLE_COUNT || sample_idx == 0) {
+		aovs.d[idx] = value;
+	} else {
+		aovs.d[idx] = mix(aovs.d[idx], value, 1. / float(sample_idx + 1));
+	}
+}
+#endif
@@ -1,6 +1,7 @@
 #ifndef BDPT_COMMONS_H
 #define BDPT_COMMONS_H
 #include "../../commons.h"
+#include "../path_vertex_packing.h"
 
 struct PCBDPT {
 	vec3 sky_col;
@@ -13,22 +14,6 @@ struct PCBDPT {
 	float total_light_area;
 	int light_triangle_count;
 	uint dir_light_idx;
-};
-
-struct PathVertex {
-	vec3 dir;
-	vec3 n_s;
-	vec3 pos;
-	vec2 uv;
-	vec3 throughput;
-	uint light_flags;
-	uint light_idx;
-	uint material_idx;
-	uint delta;
-	uint side;
-	uint mode;
-	float area;
-	float pdf_fwd;
-	float pdf_rev;
+	uint adaptive;
 };
 #endif
\ No newline at end of file
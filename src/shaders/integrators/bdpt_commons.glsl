@@ -5,28 +5,81 @@
 #define BDPT_MLT 0
 #endif
 
+// Number of light subpaths traced per frame, light tracing splats are averaged over it
+#ifndef BDPT_LIGHT_PATH_COUNT
+#define BDPT_LIGHT_PATH_COUNT screen_size
+#endif
+
+// Subpath vertices are stored as PackedPathVertex, see path_vertex_packing.h
+// The light subpaths live in memory, BDPT keeps the camera subpath in the invocation while PSSMLT stores it with
+// the pixel it started from
+#if BDPT_MLT == 1
+#define light_vtx(i) light_verts.d[bdpt_path_idx + (i)].v
+#define cam_vtx(i) camera_verts.d[bdpt_path_idx + (i)].v
+#else
+#ifndef BDPT_MAX_PATH_VERTICES
+#define BDPT_MAX_PATH_VERTICES 16
+#endif
+PackedPathVertex camera_path[BDPT_MAX_PATH_VERTICES];
+#define light_vtx(i) light_verts.d[bdpt_path_idx + (i)]
+#define cam_vtx(i) camera_path[i]
+#endif
+
 float light_pdf_pos;
 #if BDPT_MLT == 1
 #include "mlt_commons.glsl"
 #endif
 
+// Vertex with the given geometry and the remaining attributes cleared
+PathVertex bdpt_vertex(vec3 pos, vec3 n_s, vec3 dir, vec3 throughput,
+                       float pdf_fwd) {
+    PathVertex v;
+    v.dir = dir;
+    v.n_s = n_s;
+    v.pos = pos;
+    v.uv = vec2(0);
+    v.throughput = throughput;
+    v.light_flags = 0;
+    v.light_idx = 0;
+    v.material_idx = 0;
+    v.delta = 0;
+    v.side = 1;
+    v.mode = 0;
+    v.area = 0;
+    v.pdf_fwd = pdf_fwd;
+    v.pdf_rev = 0;
+    return v;
+}
+
+// Vertex at the closest hit of the last traced ray
+PathVertex bdpt_hit_vertex(vec3 n_s, bool side, uint mode, bool delta,
+                           vec3 throughput, float pdf_fwd) {
+    PathVertex v =
+        bdpt_vertex(payload.pos, n_s, vec3(0), throughput, pdf_fwd);
+    v.uv = payload.uv;
+    v.material_idx = payload.material_idx;
+    v.area = payload.area;
+    v.delta = uint(delta);
+    v.side = uint(side);
+    v.mode = mode;
+    return v;
+}
+
 int bdpt_random_walk_light(const int max_depth, vec3 throughput,
                            const float pdf) {
-#define vtx(i, prop) light_verts.d[bdpt_path_idx + i + 1].prop
-#define vtx_assign(i, prop, expr)                                              \
-    light_verts.d[bdpt_path_idx + i + 1].prop = (expr)
+#define vtx(i) light_vtx(i + 1)
     if (max_depth == 0)
         return 0;
     int b = 0;
     int prev = 0;
-    const uint flags = gl_RayFlagsOpaqueEXT;
+    const uint flags = gl_RayFlagsNoneEXT;
     const float tmin = 0.001;
     const float tmax = 1e6;
-    vec3 ray_pos = vtx(-1, pos);
+    vec3 ray_pos = vtx(-1).pos;
     float pdf_fwd = pdf;
     float pdf_rev = 0.;
-    vec3 wi = vtx(-1, dir);
-    bool finite_light = is_light_finite(vtx(-1, light_flags));
+    vec3 wi = vertex_dir(vtx(-1));
+    bool finite_light = is_light_finite(vertex_light_flags(vtx(-1)));
     while (true) {
         prev = b - 1;
         traceRayEXT(tlas, flags, 0xFF, 0, 0, 0, ray_pos, tmin, wi, tmax, 0);
@@ -34,7 +87,7 @@ int bdpt_random_walk_light(const int max_depth, vec3 throughput,
             break;
         }
 
-        vec3 wo = vtx(prev, pos) - payload.pos;
+        vec3 wo = vtx(prev).pos - payload.pos;
         float wo_len = length(wo);
         wo /= wo_len;
         vec3 n_s = payload.n_s;
@@ -46,21 +99,14 @@ int bdpt_random_walk_light(const int max_depth, vec3 throughput,
             n_s *= -1;
             side = false;
         }
-        vtx_assign(b, pdf_fwd, pdf_fwd * abs(dot(wo, n_s)) / (wo_len * wo_len));
-        vtx_assign(b, n_s, n_s);
-        vtx_assign(b, area, payload.area);
-        vtx_assign(b, pos, payload.pos);
-        vtx_assign(b, uv, payload.uv);
-        vtx_assign(b, material_idx, payload.material_idx);
-        vtx_assign(b, throughput, throughput);
-        vtx_assign(b, side, uint(side));
-        vtx_assign(b, mode, 0);
         const Material mat = load_material(payload.material_idx, payload.uv);
         const bool mat_specular =
             (mat.bsdf_props & BSDF_FLAG_SPECULAR) == BSDF_FLAG_SPECULAR;
         const bool mat_transmissive =
             (mat.bsdf_props & BSDF_FLAG_TRANSMISSION) == BSDF_FLAG_TRANSMISSION;
-        vtx_assign(b, delta, int(mat_specular));
+        vtx(b) = pack_path_vertex(
+            bdpt_hit_vertex(n_s, side, 0, mat_specular, throughput,
+                            pdf_fwd * abs(dot(wo, n_s)) / (wo_len * wo_len)));
 
         if (++b >= max_depth) {
             break;
@@ -92,44 +138,42 @@ int bdpt_random_walk_light(const int max_depth, vec3 throughput,
             g_term = true;
         }
         if (g_term) {
-            pdf_rev *= abs(dot(vtx(prev, n_s), wo)) / (wo_len * wo_len);
+            pdf_rev *= abs(dot(vertex_n_s(vtx(prev)), wo)) / (wo_len * wo_len);
         }
-        vtx_assign(prev, pdf_rev, pdf_rev);
+        vtx(prev).pdf_rev = pdf_rev;
         ray_pos = offset_ray(payload.pos, n_g);
     }
 #undef vtx
-#undef vtx_assign
     return b;
 }
 
 int bdpt_random_walk_eye(const int max_depth, vec3 throughput,
                          const float pdf) {
-#define vtx(i, prop) camera_verts.d[bdpt_path_idx + i + 1].prop
-#define vtx_assign(i, prop, expr)                                              \
-    camera_verts.d[bdpt_path_idx + i + 1].prop = (expr)
+#define vtx(i) cam_vtx(i + 1)
     if (max_depth == 0)
         return 0;
     int b = 0;
     int prev = 0;
-    const uint flags = gl_RayFlagsOpaqueEXT;
+    const uint flags = gl_RayFlagsNoneEXT;
     const float tmin = 0.001;
     const float tmax = 1e6;
-    vec3 ray_pos = vtx(-1, pos);
+    vec3 ray_pos = vtx(-1).pos;
     float pdf_fwd = pdf;
     float pdf_rev = 0.;
-    vec3 wi = vtx(-1, dir);
-    bool finite_light = is_light_finite(vtx(-1, light_flags));
+    vec3 wi = vertex_dir(vtx(-1));
     while (true) {
         prev = b - 1;
         traceRayEXT(tlas, flags, 0xFF, 0, 0, 0, ray_pos, tmin, wi, tmax, 0);
         if (payload.material_idx == -1) {
-            vtx_assign(b, throughput, throughput);
-            vtx_assign(b, pdf_fwd, pdf_fwd);
+            // Escaped vertex, pdf_fwd stays in solid angle measure
+            PathVertex v = bdpt_vertex(vec3(0), vec3(0), wi, throughput, pdf_fwd);
+            v.material_idx = -1;
+            vtx(b) = pack_path_vertex(v);
             b++;
             break;
         }
 
-        vec3 wo = vtx(prev, pos) - payload.pos;
+        vec3 wo = vtx(prev).pos - payload.pos;
         float wo_len = length(wo);
         wo /= wo_len;
         vec3 n_s = payload.n_s;
@@ -141,21 +185,19 @@ int bdpt_random_walk_eye(const int max_depth, vec3 throughput,
             n_s *= -1;
             side = false;
         }
-        vtx_assign(b, pdf_fwd, pdf_fwd * abs(dot(wo, n_s)) / (wo_len * wo_len));
-        vtx_assign(b, n_s, n_s);
-        vtx_assign(b, area, payload.area);
-        vtx_assign(b, pos, payload.pos);
-        vtx_assign(b, uv, payload.uv);
-        vtx_assign(b, material_idx, payload.material_idx);
-        vtx_assign(b, throughput, throughput);
-        vtx_assign(b, side, uint(side));
-        vtx_assign(b, mode, 1);
         const Material mat = load_material(payload.material_idx, payload.uv);
         const bool mat_specular =
             (mat.bsdf_props & BSDF_FLAG_SPECULAR) == BSDF_FLAG_SPECULAR;
         const bool mat_transmissive =
             (mat.bsdf_props & BSDF_FLAG_TRANSMISSION) == BSDF_FLAG_TRANSMISSION;
-        vtx_assign(b, delta, int(mat_specular));
+        PathVertex v =
+            bdpt_hit_vertex(n_s, side, 1, mat_specular, throughput,
+                            pdf_fwd * abs(dot(wo, n_s)) / (wo_len * wo_len));
+        if (has_light_bvh()) {
+            // Light BVH leaf of the emitter, for the pdf of s == 0 paths
+            v.light_idx = light_bvh_mesh_leaf(payload.instance_idx, payload.triangle_idx);
+        }
+        vtx(b) = pack_path_vertex(v);
 
         if (++b >= max_depth) {
             break;
@@ -186,13 +228,12 @@ int bdpt_random_walk_eye(const int max_depth, vec3 throughput,
         bool g_term = true;
 
         if (g_term) {
-            pdf_rev *= abs(dot(vtx(prev, n_s), wo)) / (wo_len * wo_len);
+            pdf_rev *= abs(dot(vertex_n_s(vtx(prev)), wo)) / (wo_len * wo_len);
         }
-        vtx_assign(prev, pdf_rev, pdf_rev);
+        vtx(prev).pdf_rev = pdf_rev;
         ray_pos = offset_ray(payload.pos, n_g);
     }
 #undef vtx
-#undef vtx_assign
     return b;
 }
 
@@ -220,25 +261,24 @@ int bdpt_generate_light_subpath(int max_depth) {
     }
     light_pdf_pos = pdf_pos;
 
-    light_verts.d[bdpt_path_idx].pos = pos;
-    light_verts.d[bdpt_path_idx].light_flags = light_record.flags;
-    light_verts.d[bdpt_path_idx].delta = 0;
-    light_verts.d[bdpt_path_idx].dir = wi;
-    light_verts.d[bdpt_path_idx].pdf_fwd = pdf_pos;
-    light_verts.d[bdpt_path_idx].n_s = n;
-    light_verts.d[bdpt_path_idx].side = 1;
-    light_verts.d[bdpt_path_idx].mode = 0;
-    vec3 throughput =
-        Le * cos_theta / (pdf_dir * light_verts.d[bdpt_path_idx + 0].pdf_fwd);
-    light_verts.d[bdpt_path_idx + 0].throughput = Le;
+    PathVertex v = bdpt_vertex(pos, n, wi, Le, pdf_pos);
+    v.light_flags = light_record.flags;
+    light_vtx(0) = pack_path_vertex(v);
+    vec3 throughput = Le * cos_theta / (pdf_dir * pdf_pos);
     int num_light_verts =
         bdpt_random_walk_light(max_depth - 1, throughput, pdf_dir) + 1;
-    if (!is_light_finite(light_record.flags)) {
-        light_verts.d[bdpt_path_idx + 1].pdf_fwd =
-            pdf_pos * abs(dot(wi, light_verts.d[bdpt_path_idx + 1].n_s));
+    if (get_light_type(light_record.flags) == LIGHT_ENVIRONMENT) {
+        // The light pick probability goes with the direction, the position
+        // on the disk follows it
+        light_vtx(0).pdf_fwd = pdf_dir * light_record.pick_pdf;
+        light_vtx(1).pdf_fwd =
+            env_map_pdf_pos() * abs(dot(wi, vertex_n_s(light_vtx(1))));
+    } else if (!is_light_finite(light_record.flags)) {
+        light_vtx(1).pdf_fwd =
+            pdf_pos * abs(dot(wi, vertex_n_s(light_vtx(1))));
     }
     if (is_light_delta(light_record.flags)) {
-        light_verts.d[bdpt_path_idx].pdf_fwd = 0;
+        light_vtx(0).pdf_fwd = 0;
     }
     return num_light_verts;
 }
@@ -250,33 +290,29 @@ int bdpt_generate_camera_subpath(vec2 d, const vec3 origin, int max_depth,
             2.0 -
         1.0;
 #endif
-    camera_verts.d[bdpt_path_idx].pos = origin;
-    camera_verts.d[bdpt_path_idx].dir = vec3(sample_camera(d));
-    camera_verts.d[bdpt_path_idx].area = cam_area;
-    camera_verts.d[bdpt_path_idx].throughput = vec3(1.0);
-    camera_verts.d[bdpt_path_idx].delta = 0;
-    camera_verts.d[bdpt_path_idx].n_s = vec3(-ubo.inv_view * vec4(0, 0, 1, 0));
-    camera_verts.d[bdpt_path_idx].side = 1;
-    light_verts.d[bdpt_path_idx].mode = 1;
+    const vec3 dir = vec3(sample_camera(d));
+    const vec3 n_s = vec3(-ubo.inv_view * vec4(0, 0, 1, 0));
+    PathVertex v = bdpt_vertex(origin, n_s, dir, vec3(1.0), 0);
+    v.area = cam_area;
+    v.mode = 1;
+    cam_vtx(0) = pack_path_vertex(v);
 #if BDPT_MLT == 1
     ivec2 coords = ivec2(0.5 * (1 + d) * vec2(pc.size_x, pc.size_y));
     camera_verts.d[bdpt_path_idx].coords = coords.x * pc.size_y + coords.y;
 #endif
-    float cos_theta = dot(camera_verts.d[bdpt_path_idx].dir,
-                          camera_verts.d[bdpt_path_idx].n_s);
+    float cos_theta = dot(dir, n_s);
     float pdf =
         1 / (cam_area * screen_size * cos_theta * cos_theta * cos_theta);
     return bdpt_random_walk_eye(max_depth - 1, vec3(1), pdf) + 1;
 }
 
 float calc_mis_weight(int s, int t, const in PathVertex sampled) {
-#define cam_vtx(i) camera_verts.d[bdpt_path_idx + i]
-#define light_vtx(i) light_verts.d[bdpt_path_idx + i]
 #define remap0(i) (i != 0. ? i : 1.)
     bool s_0_changed = false;
     float s_0_pdf;
     vec3 s_0_pdf_pos;
-    vec3 s_0_pdf_nrm;
+    uint s_0_pdf_nrm;
+    uint s_0_light_flags;
     bool t_0_changed = false;
     uint idx_1 = -1;
     float idx_1_val;
@@ -286,6 +322,7 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
     float idx_3_val;
     uint idx_4 = -1;
     float idx_4_val;
+    // PATH_VERTEX_DELTA bits that were cleared
     uint delta_t_old;
     uint delta_s_old;
     if (s + t == 2) {
@@ -296,9 +333,13 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
         s_0_pdf = light_vtx(0).pdf_fwd;
         s_0_pdf_pos = light_vtx(0).pos;
         s_0_pdf_nrm = light_vtx(0).n_s;
+        s_0_light_flags = light_vtx(0).throughput.y & PATH_VERTEX_LIGHT_FLAGS;
         light_vtx(0).pdf_fwd = sampled.pdf_fwd;
         light_vtx(0).pos = sampled.pos;
-        light_vtx(0).n_s = sampled.n_s;
+        light_vtx(0).n_s = pack_direction(sampled.n_s);
+        light_vtx(0).throughput.y =
+            (light_vtx(0).throughput.y & ~PATH_VERTEX_LIGHT_FLAGS) |
+            (sampled.light_flags << PATH_VERTEX_LIGHT_FLAGS_SHIFT);
         s_0_changed = true;
     }
     if (t == 1) {
@@ -307,16 +348,16 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
         s_0_pdf_nrm = cam_vtx(0).n_s;
         cam_vtx(0).pdf_fwd = sampled.pdf_fwd;
         cam_vtx(0).pos = sampled.pos;
-        cam_vtx(0).n_s = sampled.n_s;
+        cam_vtx(0).n_s = pack_direction(sampled.n_s);
         t_0_changed = true;
     }
     if (t > 0) {
-        delta_t_old = cam_vtx(t - 1).delta;
-        cam_vtx(t - 1).delta = 0;
+        delta_t_old = cam_vtx(t - 1).throughput.y & PATH_VERTEX_DELTA;
+        cam_vtx(t - 1).throughput.y &= ~PATH_VERTEX_DELTA;
     }
     if (s > 0) {
-        delta_s_old = light_vtx(s - 1).delta;
-        light_vtx(s - 1).delta = 0;
+        delta_s_old = light_vtx(s - 1).throughput.y & PATH_VERTEX_DELTA;
+        light_vtx(s - 1).throughput.y &= ~PATH_VERTEX_DELTA;
     }
 
     if (t > 0) {
@@ -333,27 +374,42 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
             float pdf_rev;
             if (s >= 2) {
                 wo = normalize(light_vtx(s - 2).pos - light_vtx(s - 1).pos);
-                pdf_rev = bsdf_pdf(mat, light_vtx(s - 1).n_s, wo, dir, light_vtx(s - 1).side == 1);
+                pdf_rev = bsdf_pdf(mat, vertex_n_s(light_vtx(s - 1)), wo, dir, vertex_side(light_vtx(s - 1)));
                 pdf_rev *=
-                    abs(dot(dir, cam_vtx(t - 1).n_s)) / (dir_len * dir_len);
+                    abs(dot(dir, vertex_n_s(cam_vtx(t - 1)))) / (dir_len * dir_len);
             } else if (s == 1) {
-                if (!is_light_finite(light_vtx(0).light_flags)) {
-                    // Note: All the infinite lights are of directional type
+                if (get_light_type(vertex_light_flags(light_vtx(0))) ==
+                    LIGHT_ENVIRONMENT) {
+                    pdf_rev = env_map_pdf_pos();
+                    pdf_rev *= abs(dot(dir, vertex_n_s(cam_vtx(t - 1))));
+                } else if (!is_light_finite(vertex_light_flags(light_vtx(0)))) {
+                    // Note: All the other infinite lights are of directional type
                     pdf_rev = light_pdf_pos;
-                    pdf_rev *= abs(dot(dir, cam_vtx(t - 1).n_s));
+                    pdf_rev *= abs(dot(dir, vertex_n_s(cam_vtx(t - 1))));
                 } else {
-                    pdf_rev = light_pdf(light_vtx(0).light_flags,
-                                        light_vtx(0).n_s, dir);
+                    pdf_rev = light_pdf(vertex_light_flags(light_vtx(0)),
+                                        vertex_n_s(light_vtx(0)), dir);
                     pdf_rev *=
-                        abs(dot(dir, cam_vtx(t - 1).n_s)) / (dir_len * dir_len);
+                        abs(dot(dir, vertex_n_s(cam_vtx(t - 1)))) / (dir_len * dir_len);
                 }
             }
             cam_vtx(t - 1).pdf_rev = pdf_rev;
+        } else if (cam_vtx(t - 1).material_idx == -1) {
+            // s == 0 and the path escaped to the environment map
+            const float pick_pdf =
+                has_light_bvh()
+                    ? light_bvh_pdf(EnvDistribution(scene_desc.env_distribution_addr).header.light_idx, 0,
+                                    vec3(0), false)
+                    : 1.0 / pc.light_triangle_count;
+            cam_vtx(t - 1).pdf_rev = env_map_pdf(vertex_dir(cam_vtx(t - 1))) * pick_pdf;
         } else {
             // s == 0, i.e the path is on a finite light source
             // cam_vtx(t-1).area gives the area of the emitter that was hit
-            cam_vtx(t - 1).pdf_rev =
-                1.0 / (pc.light_triangle_count * cam_vtx(t - 1).area);
+            const float pick_pdf =
+                has_light_bvh()
+                    ? light_bvh_leaf_pdf(cam_vtx(t - 1).light_idx, vec3(0), false)
+                    : 1.0 / pc.light_triangle_count;
+            cam_vtx(t - 1).pdf_rev = pick_pdf / cam_vtx(t - 1).area;
         }
     }
     if (t > 1) {
@@ -366,15 +422,19 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
             const Material mat =
                 load_material(cam_vtx(t - 1).material_idx, cam_vtx(t - 1).uv);
             vec3 wo = normalize(light_vtx(s - 1).pos - cam_vtx(t - 1).pos);
-            cam_vtx(t - 2).pdf_rev = bsdf_pdf(mat, cam_vtx(t - 1).n_s, wo, dir, cam_vtx(t - 1).side == 1);
+            cam_vtx(t - 2).pdf_rev = bsdf_pdf(mat, vertex_n_s(cam_vtx(t - 1)), wo, dir, vertex_side(cam_vtx(t - 1)));
             if (cam_vtx(t - 2).pdf_rev != 0) {
                 cam_vtx(t - 2).pdf_rev *=
-                    abs(dot(dir, cam_vtx(t - 2).n_s)) / (dir_len * dir_len);
+                    abs(dot(dir, vertex_n_s(cam_vtx(t - 2)))) / (dir_len * dir_len);
             }
+        } else if (cam_vtx(t - 1).material_idx == -1) {
+            cam_vtx(t - 2).pdf_rev =
+                env_map_pdf_pos() *
+                abs(dot(vertex_n_s(cam_vtx(t - 2)), vertex_dir(cam_vtx(t - 1))));
         } else {
-            // Assumption: All lights are finite
-            float cos_x = dot(cam_vtx(t - 1).n_s, dir);
-            float cos_y = dot(cam_vtx(t - 2).n_s, dir);
+            // Assumption: All the other lights are finite
+            float cos_x = dot(vertex_n_s(cam_vtx(t - 1)), dir);
+            float cos_y = dot(vertex_n_s(cam_vtx(t - 2)), dir);
             cam_vtx(t - 2).pdf_rev =
                 abs(cos_x * cos_y) / (PI * dir_len * dir_len);
         }
@@ -389,21 +449,21 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
         dir /= dir_len;
         if (t == 1) {
             // t == 1 implies s > 1
-            float cos_theta = dot(cam_vtx(0).n_s, dir);
+            float cos_theta = dot(vertex_n_s(cam_vtx(0)), dir);
             float pdf = 1.0 / (cam_vtx(0).area * screen_size * cos_theta *
                                cos_theta * cos_theta);
-            pdf *= abs(dot(dir, light_vtx(s - 1).n_s)) / (dir_len * dir_len);
+            pdf *= abs(dot(dir, vertex_n_s(light_vtx(s - 1)))) / (dir_len * dir_len);
             light_vtx(s - 1).pdf_rev = pdf;
         } else {
             vec3 wo = normalize(cam_vtx(t - 2).pos - cam_vtx(t - 1).pos);
             const Material mat =
                 load_material(cam_vtx(t - 1).material_idx, cam_vtx(t - 1).uv);
             light_vtx(s - 1).pdf_rev =
-                bsdf_pdf(mat, cam_vtx(t - 1).n_s, wo, dir, cam_vtx(t - 1).side == 1);
-            if ((s == 1 && is_light_finite(light_vtx(0).light_flags)) ||
+                bsdf_pdf(mat, vertex_n_s(cam_vtx(t - 1)), wo, dir, vertex_side(cam_vtx(t - 1)));
+            if ((s == 1 && is_light_finite(vertex_light_flags(light_vtx(0)))) ||
                 s > 1) {
                 light_vtx(s - 1).pdf_rev *=
-                    abs(dot(dir, light_vtx(s - 1).n_s)) / (dir_len * dir_len);
+                    abs(dot(dir, vertex_n_s(light_vtx(s - 1)))) / (dir_len * dir_len);
             }
         }
     }
@@ -417,11 +477,11 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
         const Material mat =
             load_material(light_vtx(s - 1).material_idx, light_vtx(s - 1).uv);
         // t - 1 -> s-1 -> s-2
-        light_vtx(s - 2).pdf_rev = bsdf_pdf(mat, light_vtx(s - 1).n_s, wo, dir, light_vtx(s - 1).side == 1);
+        light_vtx(s - 2).pdf_rev = bsdf_pdf(mat, vertex_n_s(light_vtx(s - 1)), wo, dir, vertex_side(light_vtx(s - 1)));
         // g = 1 for infinite lights
-        if (s == 2 && is_light_finite(light_vtx(0).light_flags) || s > 2) {
+        if (s == 2 && is_light_finite(vertex_light_flags(light_vtx(0))) || s > 2) {
             light_vtx(s - 2).pdf_rev *=
-                abs(dot(dir, light_vtx(s - 2).n_s)) / (dir_len * dir_len);
+                abs(dot(dir, vertex_n_s(light_vtx(s - 2)))) / (dir_len * dir_len);
         }
     }
 
@@ -429,16 +489,16 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
     float weight = 1.0;
     for (int i = t - 1; i > 0; i--) {
         weight *= remap0(cam_vtx(i).pdf_rev) / remap0(cam_vtx(i).pdf_fwd);
-        if (cam_vtx(i).delta == 0 && cam_vtx(i - 1).delta == 0) {
+        if (!vertex_delta(cam_vtx(i)) && !vertex_delta(cam_vtx(i - 1))) {
             sum_ri += weight;
         }
     }
     weight = 1.0;
     for (int i = s - 1; i >= 0; i--) {
         weight *= remap0(light_vtx(i).pdf_rev) / remap0(light_vtx(i).pdf_fwd);
-        bool delta_prev = i > 0 ? light_vtx(i - 1).delta == 1
-                                : is_light_delta(light_vtx(0).light_flags);
-        if (light_vtx(i).delta == 0 && !delta_prev) {
+        bool delta_prev = i > 0 ? vertex_delta(light_vtx(i - 1))
+                                : is_light_delta(vertex_light_flags(light_vtx(0)));
+        if (!vertex_delta(light_vtx(i)) && !delta_prev) {
             sum_ri += weight;
         }
     }
@@ -447,6 +507,9 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
         light_vtx(0).pdf_fwd = s_0_pdf;
         light_vtx(0).pos = s_0_pdf_pos;
         light_vtx(0).n_s = s_0_pdf_nrm;
+        light_vtx(0).throughput.y =
+            (light_vtx(0).throughput.y & ~PATH_VERTEX_LIGHT_FLAGS) |
+            s_0_light_flags;
     }
     if (t_0_changed) {
         cam_vtx(0).pdf_fwd = s_0_pdf;
@@ -455,34 +518,30 @@ float calc_mis_weight(int s, int t, const in PathVertex sampled) {
     }
     if (idx_1 != -1) {
         cam_vtx(idx_1 - 1).pdf_rev = idx_1_val;
-        cam_vtx(idx_1 - 1).delta = delta_t_old;
+        cam_vtx(idx_1 - 1).throughput.y |= delta_t_old;
     }
     if (idx_2 != -1) {
         cam_vtx(idx_2 - 2).pdf_rev = idx_2_val;
     }
     if (idx_3 != -1) {
         light_vtx(idx_3 - 1).pdf_rev = idx_3_val;
-        light_vtx(idx_3 - 1).delta = delta_s_old;
+        light_vtx(idx_3 - 1).throughput.y |= delta_s_old;
     }
     if (idx_4 != -1) {
         light_vtx(idx_4 - 2).pdf_rev = idx_4_val;
     }
-#undef cam_vtx
-#undef light_vtx
     return 1 / (1 + sum_ri);
 }
 
 vec3 bdpt_connect_cam(int s, out ivec2 coords) {
-#define cam_vtx(i) camera_verts.d[bdpt_path_idx + i]
-#define light_vtx(i) light_verts.d[bdpt_path_idx + i]
     PathVertex sampled;
     vec3 throughput = vec3(1.0);
     vec3 L = vec3(0);
     vec3 dir = cam_vtx(0).pos - light_vtx(s - 1).pos;
     float len = length(dir);
     dir /= len;
-    float cos_y = dot(dir, light_vtx(s - 1).n_s);
-    float cos_theta = dot(cam_vtx(0).n_s, -dir);
+    float cos_y = dot(dir, vertex_n_s(light_vtx(s - 1)));
+    float cos_theta = dot(vertex_n_s(cam_vtx(0)), -dir);
     if (cos_theta <= 0.) {
         return vec3(0);
     }
@@ -490,11 +549,13 @@ vec3 bdpt_connect_cam(int s, out ivec2 coords) {
     const float cam_pdf_ratio =
         abs(cos_y) / (cam_vtx(0).area * cos_3_theta * len * len);
 
-    vec3 ray_origin = offset_ray2(light_vtx(s - 1).pos, light_vtx(s - 1).n_s);
+    vec3 ray_origin = offset_ray2(light_vtx(s - 1).pos, vertex_n_s(light_vtx(s - 1)));
     const Material mat =
         load_material(light_vtx(s - 1).material_idx, light_vtx(s - 1).uv);
     const vec3 wo = normalize(light_vtx(s - 2).pos - light_vtx(s - 1).pos);
-    const vec3 f = eval_bsdf(mat, wo, dir, light_vtx(s - 1).n_s, light_vtx(s - 1).mode, light_vtx(s - 1).side == 1);
+    const vec3 f = eval_bsdf(mat, wo, dir, vertex_n_s(light_vtx(s - 1)),
+                             vertex_mode(light_vtx(s - 1)),
+                             vertex_side(light_vtx(s - 1)));
     if (f == vec3(0)) {
         return L;
     }
@@ -507,9 +568,10 @@ vec3 bdpt_connect_cam(int s, out ivec2 coords) {
 
         if (any_hit_payload.hit == 0) {
             sampled.pos = cam_vtx(0).pos;
-            sampled.n_s = cam_vtx(0).n_s;
+            sampled.n_s = vertex_n_s(cam_vtx(0));
             // We / pdf_we * abs(cos_theta) = cam_pdf_ratio
-            L = light_vtx(s - 1).throughput * cam_pdf_ratio * f / screen_size;
+            L = vertex_throughput(light_vtx(s - 1)) * cam_pdf_ratio * f /
+                BDPT_LIGHT_PATH_COUNT;
         }
     }
     dir = -dir;
@@ -519,7 +581,7 @@ vec3 bdpt_connect_cam(int s, out ivec2 coords) {
     coords =
         ivec2(0.5 * (1 + target.xy) * vec2(pc.size_x, pc.size_y) - 0.5);
     if (coords.x < 0 || coords.x >= pc.size_x || coords.y < 0 ||
-        coords.y >= pc.size_y || dot(dir, cam_vtx(0).n_s) < 0) {
+        coords.y >= pc.size_y || dot(dir, vertex_n_s(cam_vtx(0))) < 0) {
         return vec3(0);
     }
     float mis_weight = 1.0;
@@ -528,23 +590,28 @@ vec3 bdpt_connect_cam(int s, out ivec2 coords) {
     }
 
     return mis_weight * L;
-#undef cam_vtx
-#undef light_vtx
 }
 
 vec3 bdpt_connect(int s, int t) {
-#define cam_vtx(i) camera_verts.d[bdpt_path_idx + i]
-#define light_vtx(i) light_verts.d[bdpt_path_idx + i]
     vec3 L = vec3(0);
     PathVertex sampled;
+    if (s > 0 && cam_vtx(t - 1).material_idx == -1) {
+        // Nothing to connect to from an escaped vertex
+        return L;
+    }
     if (s == 0) {
         // Pure camera path
         uint mat_idx = cam_vtx(t - 1).material_idx;
-        Material mat = materials.m[mat_idx];
         if (mat_idx != -1) {
-            L = mat.emissive_factor * cam_vtx(t - 1).throughput;
+            Material mat = materials.m[mat_idx];
+            L = mat.emissive_factor * vertex_throughput(cam_vtx(t - 1));
         } else {
-            L = vec3(1, 1, 1) * cam_vtx(t - 1).throughput;
+            L = eval_sky(pc.sky_col, vertex_dir(cam_vtx(t - 1))) *
+                vertex_throughput(cam_vtx(t - 1));
+            if (!has_env_map()) {
+                // The constant sky can't be sampled by any other strategy
+                return L;
+            }
         }
     } else if (s == 1) {
         vec3 wi;
@@ -566,38 +633,45 @@ vec3 bdpt_connect(int s, int t) {
             sample_light_Li(rand4(seed), cam_vtx(t - 1).pos, pc.num_lights, wi,
                             wi_len, n, pos, pdf_pos_a, cos_y, record);
 #endif
-        const float cos_x = abs(dot(wi, cam_vtx(t - 1).n_s));
+        const float cos_x = abs(dot(wi, vertex_n_s(cam_vtx(t - 1))));
         const vec3 ray_origin =
-            offset_ray2(cam_vtx(t - 1).pos, cam_vtx(t - 1).n_s);
+            offset_ray2(cam_vtx(t - 1).pos, vertex_n_s(cam_vtx(t - 1)));
         any_hit_payload.hit = 1;
         vec3 wo = normalize(cam_vtx(t - 2).pos - cam_vtx(t - 1).pos);
         // TODO
         const Material mat =
             load_material(cam_vtx(t - 1).material_idx, cam_vtx(t - 1).uv);
-        const vec3 f = eval_bsdf(mat, wo, wi, cam_vtx(t - 1).n_s, cam_vtx(t - 1).mode, cam_vtx(t - 1).side == 1);
+        const vec3 f = eval_bsdf(mat, wo, wi, vertex_n_s(cam_vtx(t - 1)),
+                                 vertex_mode(cam_vtx(t - 1)),
+                                 vertex_side(cam_vtx(t - 1)));
         if (f != vec3(0)) {
             traceRayEXT(tlas,
                         gl_RayFlagsTerminateOnFirstHitEXT |
                             gl_RayFlagsSkipClosestHitShaderEXT,
                         0xFF, 1, 0, 1, ray_origin, 0, wi, wi_len - EPS, 1);
             const bool visible = any_hit_payload.hit == 0;
-            if (visible) {
+            const float pick_pdf =
+                light_pick_pdf(record, pc.light_triangle_count);
+            if (visible && pick_pdf > 0) {
                 const float pdf_light_w =
                     light_pdf_a_to_w(record.flags, pdf_pos_a, n,
-                                     wi_len * wi_len, cos_y) /
-                    pc.light_triangle_count;
-                sampled.pdf_fwd = pdf_pos_a / pc.light_triangle_count;
+                                     wi_len * wi_len, cos_y) *
+                    pick_pdf;
+                sampled.pdf_fwd = is_light_finite(record.flags)
+                                      ? pdf_pos_a * pick_pdf
+                                      : pdf_light_w;
                 sampled.pos = pos;
                 sampled.n_s = n;
+                sampled.light_flags = record.flags;
                 sampled.delta = uint(is_light_delta(record.flags));
-                L = cam_vtx(t - 1).throughput * f * abs(cos_x) * Le /
+                L = vertex_throughput(cam_vtx(t - 1)) * f * abs(cos_x) * Le /
                     pdf_light_w;
             }
         }
     } else {
         // Eval G
-        vec3 n_s = light_vtx(s - 1).n_s;
-        vec3 n_t = cam_vtx(t - 1).n_s;
+        vec3 n_s = vertex_n_s(light_vtx(s - 1));
+        vec3 n_t = vertex_n_s(cam_vtx(t - 1));
         vec3 d = light_vtx(s - 1).pos - cam_vtx(t - 1).pos;
         float len = length(d);
         d /= len;
@@ -610,11 +684,16 @@ vec3 bdpt_connect(int s, int t) {
 
             vec3 wo_1 = normalize(cam_vtx(t - 2).pos - cam_vtx(t - 1).pos);
             vec3 wo_2 = normalize(light_vtx(s - 2).pos - light_vtx(s - 1).pos);
-            const vec3 brdf1 = eval_bsdf(mat_1, wo_1, d, cam_vtx(t - 1).n_s, cam_vtx(t - 1).mode, cam_vtx(t - 1).side == 1);
-            const vec3 brdf2 = eval_bsdf(mat_2, wo_2, -d, light_vtx(s - 1).n_s, light_vtx(s - 1).mode, light_vtx(s - 1).side == 1);
+            const vec3 brdf1 =
+                eval_bsdf(mat_1, wo_1, d, vertex_n_s(cam_vtx(t - 1)),
+                          vertex_mode(cam_vtx(t - 1)), vertex_side(cam_vtx(t - 1)));
+            const vec3 brdf2 =
+                eval_bsdf(mat_2, wo_2, -d, vertex_n_s(light_vtx(s - 1)),
+                          vertex_mode(light_vtx(s - 1)),
+                          vertex_side(light_vtx(s - 1)));
             if (brdf1 != vec3(0) && brdf2 != vec3(0)) {
                 vec3 ray_origin =
-                    offset_ray2(cam_vtx(t - 1).pos, cam_vtx(t - 1).n_s);
+                    offset_ray2(cam_vtx(t - 1).pos, vertex_n_s(cam_vtx(t - 1)));
                 // Check visibility
                 any_hit_payload.hit = 1;
                 traceRayEXT(tlas,
@@ -623,14 +702,12 @@ vec3 bdpt_connect(int s, int t) {
                             0xFF, 1, 0, 1, ray_origin, 0, d, len - EPS, 1);
                 const bool visible = any_hit_payload.hit == 0;
                 if (visible) {
-                    L = light_vtx(s - 1).throughput * G * brdf1 * brdf2 *
-                        cam_vtx(t - 1).throughput;
+                    L = vertex_throughput(light_vtx(s - 1)) * G * brdf1 * brdf2 *
+                        vertex_throughput(cam_vtx(t - 1));
                 }
             }
         }
     }
-#undef cam_vtx
-#undef light_vtx
     float mis_weight = 1.0f;
     if (luminance(L) != 0.) {
         mis_weight = calc_mis_weight(s, t, sampled);
@@ -12,4 +12,5 @@ struct PCPath {
 	int light_triangle_count;
 	uint dir_light_idx;
 	uint direct_lighting;
+	uint adaptive;
 };
\ No newline at end of file
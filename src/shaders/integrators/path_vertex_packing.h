@@ -0,0 +1,202 @@
+#ifndef PATH_VERTEX_PACKING_HOST_DEVICE
+#define PATH_VERTEX_PACKING_HOST_DEVICE
+// Storage format of the BDPT and VCM subpath vertices, shared between the integrators and their shaders
+// Directions and normals: octahedral mapping, 16 bits per axis, see vertex_packing.h
+// Throughput: fp16 relative to its largest component, which stays fp32 since light subpath throughputs easily
+// leave the fp16 range
+// Flags: bit-packed into the upper half of the second throughput word
+#include "../vertex_packing.h"
+#ifdef __cplusplus
+#include <glm/gtc/packing.hpp>
+#endif
+
+#define PATH_VERTEX_DELTA 0x10000u
+#define PATH_VERTEX_SIDE 0x20000u
+#define PATH_VERTEX_MODE 0x40000u
+// Light record flags of the first vertex of a light subpath
+#define PATH_VERTEX_LIGHT_FLAGS_SHIFT 24u
+#define PATH_VERTEX_LIGHT_FLAGS 0xFF000000u
+
+// What the shaders work with, decoded from or encoded to the packed vertices below
+struct PathVertex {
+	vec3 dir;
+	vec3 n_s;
+	vec3 pos;
+	vec2 uv;
+	vec3 throughput;
+	uint light_flags;
+	uint light_idx;
+	uint material_idx;
+	uint delta;
+	uint side;
+	uint mode;
+	float area;
+	float pdf_fwd;
+	float pdf_rev;
+};
+
+struct VCMVertex {
+	vec3 wi;
+	vec3 wo;
+	vec3 n_s;
+	vec3 pos;
+	vec2 uv;
+	vec3 throughput;
+	uint material_idx;
+	uint path_len;
+	float area;
+	float d_vcm;
+	float d_vc;
+	float d_vm;
+	uint side;
+	uint coords;
+};
+
+// The pdfs, positions and indices are written in place by the MIS weight computation and stay fp32
+struct PackedPathVertex {
+	vec3 pos;
+	uint n_s;
+	vec2 uv;
+	uint dir;
+	// Red and green in the first word, blue and the PATH_VERTEX_* flags in the second one
+	uvec2 throughput;
+	float throughput_scale;
+	uint material_idx;
+	uint light_idx;
+	float area;
+	float pdf_fwd;
+	float pdf_rev;
+};
+
+struct PackedVCMVertex {
+	vec3 pos;
+	uint n_s;
+	vec2 uv;
+	uint wi;
+	uint wo;
+	// Red and green in the first word, blue and PATH_VERTEX_SIDE in the second one
+	uvec2 throughput;
+	float throughput_scale;
+	uint material_idx;
+	uint path_len;
+	float area;
+	float d_vcm;
+	float d_vc;
+	float d_vm;
+	uint coords;
+};
+
+NAMESPACE_BEGIN(PathVertexPacking)
+#ifdef __cplusplus
+using namespace VertexPacking;
+using glm::max;
+using glm::packHalf2x16;
+using glm::unpackHalf2x16;
+#endif
+
+PACKING_FN float throughput_scale(vec3 t) { return max(t.x, max(t.y, t.z)); }
+
+// The flags have to be PATH_VERTEX_* bits
+PACKING_FN uvec2 pack_throughput(vec3 t, float scale, uint flags) {
+	const vec3 n = scale > 0.0f ? t / scale : vec3(0.0f);
+	return uvec2(packHalf2x16(vec2(n.x, n.y)), (packHalf2x16(vec2(n.z, 0.0f)) & 0xFFFFu) | flags);
+}
+
+PACKING_FN vec3 unpack_throughput(uvec2 packed, float scale) {
+	const vec2 rg = unpackHalf2x16(packed.x);
+	return vec3(rg.x, rg.y, unpackHalf2x16(packed.y & 0xFFFFu).x) * scale;
+}
+
+// Directions that were never written, e.g. the normal of an escaped vertex, have no octahedral encoding
+PACKING_FN uint pack_direction(vec3 d) {
+	return d.x == 0.0f && d.y == 0.0f && d.z == 0.0f ? pack_normal(vec3(0.0f, 0.0f, 1.0f)) : pack_normal(d);
+}
+
+PACKING_FN PackedPathVertex pack_path_vertex(PathVertex v) {
+	PackedPathVertex p;
+	const uint flags = (v.delta != 0u ? PATH_VERTEX_DELTA : 0u) | (v.side != 0u ? PATH_VERTEX_SIDE : 0u) |
+					   (v.mode != 0u ? PATH_VERTEX_MODE : 0u) | (v.light_flags << PATH_VERTEX_LIGHT_FLAGS_SHIFT);
+	p.pos = v.pos;
+	p.n_s = pack_direction(v.n_s);
+	p.uv = v.uv;
+	p.dir = pack_direction(v.dir);
+	p.throughput_scale = throughput_scale(v.throughput);
+	p.throughput = pack_throughput(v.throughput, p.throughput_scale, flags);
+	p.material_idx = v.material_idx;
+	p.light_idx = v.light_idx;
+	p.area = v.area;
+	p.pdf_fwd = v.pdf_fwd;
+	p.pdf_rev = v.pdf_rev;
+	return p;
+}
+
+PACKING_FN PathVertex unpack_path_vertex(PackedPathVertex p) {
+	PathVertex v;
+	v.dir = unpack_normal(p.dir);
+	v.n_s = unpack_normal(p.n_s);
+	v.pos = p.pos;
+	v.uv = p.uv;
+	v.throughput = unpack_throughput(p.throughput, p.throughput_scale);
+	v.light_flags = p.throughput.y >> PATH_VERTEX_LIGHT_FLAGS_SHIFT;
+	v.light_idx = p.light_idx;
+	v.material_idx = p.material_idx;
+	v.delta = (p.throughput.y & PATH_VERTEX_DELTA) != 0u ? 1u : 0u;
+	v.side = (p.throughput.y & PATH_VERTEX_SIDE) != 0u ? 1u : 0u;
+	v.mode = (p.throughput.y & PATH_VERTEX_MODE) != 0u ? 1u : 0u;
+	v.area = p.area;
+	v.pdf_fwd = p.pdf_fwd;
+	v.pdf_rev = p.pdf_rev;
+	return v;
+}
+
+PACKING_FN PackedVCMVertex pack_vcm_vertex(VCMVertex v) {
+	PackedVCMVertex p;
+	p.pos = v.pos;
+	p.n_s = pack_direction(v.n_s);
+	p.uv = v.uv;
+	p.wi = pack_direction(v.wi);
+	p.wo = pack_direction(v.wo);
+	p.throughput_scale = throughput_scale(v.throughput);
+	p.throughput = pack_throughput(v.throughput, p.throughput_scale, v.side != 0u ? PATH_VERTEX_SIDE : 0u);
+	p.material_idx = v.material_idx;
+	p.path_len = v.path_len;
+	p.area = v.area;
+	p.d_vcm = v.d_vcm;
+	p.d_vc = v.d_vc;
+	p.d_vm = v.d_vm;
+	p.coords = v.coords;
+	return p;
+}
+
+PACKING_FN VCMVertex unpack_vcm_vertex(PackedVCMVertex p) {
+	VCMVertex v;
+	v.wi = unpack_normal(p.wi);
+	v.wo = unpack_normal(p.wo);
+	v.n_s = unpack_normal(p.n_s);
+	v.pos = p.pos;
+	v.uv = p.uv;
+	v.throughput = unpack_throughput(p.throughput, p.throughput_scale);
+	v.material_idx = p.material_idx;
+	v.path_len = p.path_len;
+	v.area = p.area;
+	v.d_vcm = p.d_vcm;
+	v.d_vc = p.d_vc;
+	v.d_vm = p.d_vm;
+	v.side = (p.throughput.y & PATH_VERTEX_SIDE) != 0u ? 1u : 0u;
+	v.coords = p.coords;
+	return v;
+}
+NAMESPACE_END()
+
+#ifndef __cplusplus
+// Single attributes of a PackedPathVertex in a buffer or an array, without decoding the whole vertex
+#define vertex_n_s(v) unpack_normal((v).n_s)
+#define vertex_dir(v) unpack_normal((v).dir)
+#define vertex_throughput(v) unpack_throughput((v).throughput, (v).throughput_scale)
+#define vertex_delta(v) (((v).throughput.y & PATH_VERTEX_DELTA) != 0u)
+#define vertex_side(v) (((v).throughput.y & PATH_VERTEX_SIDE) != 0u)
+#define vertex_mode(v) (((v).throughput.y & PATH_VERTEX_MODE) != 0u ? 1u : 0u)
+#define vertex_light_flags(v) ((v).throughput.y >> PATH_VERTEX_LIGHT_FLAGS_SHIFT)
+#endif
+
+#endif
@@ -32,7 +32,7 @@ PrimarySamples connection_primary_samples =
     PrimarySamples(scene_desc.connection_primary_samples_addr);
 PrimarySamples prim_samples[3] = PrimarySamples[](
     light_primary_samples, cam_primary_samples, connection_primary_samples);
-const uint flags = gl_RayFlagsOpaqueEXT;
+const uint flags = gl_RayFlagsNoneEXT;
 const float tmin = 0.001;
 const float tmax = 10000.0;
 #define RR_MIN_DEPTH 3
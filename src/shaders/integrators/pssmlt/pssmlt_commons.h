@@ -1,20 +1,8 @@
 #include "../mlt_commons.h"
 #include "../bdpt/bdpt_commons.h"
 
+// The BDPT vertex and the pixel of the camera subpath it belongs to
 struct MLTPathVertex {
-	vec3 dir;
-	uint delta;
-	vec3 n_s;
-	float area;
-	vec3 pos;
-	uint light_idx;
-	vec2 uv;
-	uint light_flags;
-	uint material_idx;
-	vec3 throughput;
-	float pdf_rev;
+	PackedPathVertex v;
 	uint coords;
-	float pdf_fwd;
-	uint side;
-	uint mode;
 };
\ No newline at end of file
@@ -12,6 +12,11 @@ vec3 uniform_sample_light(inout uvec4 seed, const Material mat, vec3 pos, const
 	float cos_from_light;
 	const vec3 Le =
 		sample_light_Li(rand4(seed), pos, pc.num_lights, pdf_light_w, wi, wi_len, pdf_light_a, cos_from_light, record);
+	const float pick_pdf = light_pick_pdf(record, pc.light_triangle_count);
+	if (pick_pdf == 0) {
+		visible = false;
+		return res;
+	}
 	const vec3 p = offset_ray2(pos, n_s);
 	float bsdf_pdf;
 	float cos_x = dot(n_s, wi);
@@ -37,8 +42,18 @@ vec3 uniform_sample_light(inout uvec4 seed, const Material mat, vec3 pos, const
 				res += f * mis_weight * abs(cos_x) * Le / bsdf_pdf;
 			}
 		}
+	} else if (get_light_type(record.flags) == LIGHT_ENVIRONMENT) {
+		// Sample BSDF, the environment is only reached through rays leaving the scene
+		f = sample_bsdf(n_s, wo, mat, 1, side, wi, bsdf_pdf, cos_x, seed);
+		if (bsdf_pdf != 0) {
+			traceRayEXT(tlas, flags, 0x1, 0, 0, 0, p, tmin, wi, tmax, 0);
+			if (payload.material_idx == -1) {
+				const float mis_weight = 1. / (1 + env_map_pdf(wi) / bsdf_pdf);
+				res += f * mis_weight * abs(cos_x) * eval_env_map(wi) / bsdf_pdf;
+			}
+		}
 	}
-	return res;
+	return res / pick_pdf;
 }
 
 vec3 uniform_sample_light(inout uvec4 seed, const Material mat, vec3 pos, const bool side, const vec3 n_s,
@@ -7,7 +7,7 @@ layout(buffer_reference, scalar, buffer_reference_align = 4) buffer GBuffer { Re
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer RestirReservoir_ {
     RestirReservoir d[];
 };
-const uint flags = gl_RayFlagsOpaqueEXT;
+const uint flags = gl_RayFlagsNoneEXT;
 const float tmin = 0.001;
 const float tmax = 10000.0;
 #define RR_MIN_DEPTH 3
@@ -28,8 +28,13 @@ uint mat_idx;
 vec3 origin;
 
 uint pixel_idx = (gl_LaunchIDEXT.x * gl_LaunchSizeEXT.y + gl_LaunchIDEXT.y);
+#if defined(SAMPLER_TYPE) && SAMPLER_TYPE != SAMPLER_PCG
+// Low discrepancy samplers need consecutive sample indices
+uvec4 seed = init_rng(gl_LaunchIDEXT.xy, gl_LaunchSizeEXT.xy, pc.frame_num);
+#else
 uvec4 seed = init_rng(gl_LaunchIDEXT.xy, gl_LaunchSizeEXT.xy,
                       pc.frame_num ^ pc.random_num);
+#endif
 
 void load_g_buffer() {
     pos = gbuffer.d[pixel_idx].pos;
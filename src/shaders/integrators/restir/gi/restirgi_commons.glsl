@@ -6,7 +6,7 @@ uint pixel_idx = (gl_LaunchIDEXT.x * gl_LaunchSizeEXT.y + gl_LaunchIDEXT.y);
 uvec4 seed =
     init_rng(gl_LaunchIDEXT.xy, gl_LaunchSizeEXT.xy, pc.total_frame_num);
 
-const uint flags = gl_RayFlagsOpaqueEXT;
+const uint flags = gl_RayFlagsNoneEXT;
 const float tmin = 0.001;
 const float tmax = 10000.0;
 
@@ -9,7 +9,7 @@ layout(buffer_reference, scalar, buffer_reference_align = 4) buffer PrefixContri
 layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer Transformation { mat4 m[]; };
 
 Transformation transforms = Transformation(scene_desc.transformations_addr);
-const uint flags = gl_RayFlagsOpaqueEXT;
+const uint flags = gl_RayFlagsNoneEXT;
 const float tmin = 0.001;
 const float tmax = 10000.0;
 #define RR_MIN_DEPTH 3
@@ -74,9 +74,9 @@ HitData get_hitdata(vec2 attribs, uint instance_idx, uint triangle_idx, out floa
 	HitData gbuffer;
 	Vertex vtx[3];
 
-	vtx[0] = compact_vertices.d[ind.x];
-	vtx[1] = compact_vertices.d[ind.y];
-	vtx[2] = compact_vertices.d[ind.z];
+	vtx[0] = fetch_vertex(ind.x, pinfo);
+	vtx[1] = fetch_vertex(ind.y, pinfo);
+	vtx[2] = fetch_vertex(ind.z, pinfo);
 
 	gbuffer.pos = vec3(to_world * vec4(vtx[0].pos * bary.x + vtx[1].pos * bary.y + vtx[2].pos * bary.z, 1.0));
 	gbuffer.n_s = normalize(
@@ -109,9 +109,9 @@ HitDataWithoutUVAndGeometryNormals get_hitdata_no_ng_uv(vec2 attribs, uint insta
 	HitDataWithoutUVAndGeometryNormals gbuffer;
 	Vertex vtx[3];
 
-	vtx[0] = compact_vertices.d[ind.x];
-	vtx[1] = compact_vertices.d[ind.y];
-	vtx[2] = compact_vertices.d[ind.z];
+	vtx[0] = fetch_vertex(ind.x, pinfo);
+	vtx[1] = fetch_vertex(ind.y, pinfo);
+	vtx[2] = fetch_vertex(ind.z, pinfo);
 	gbuffer.pos = vec3(to_world * vec4(vtx[0].pos * bary.x + vtx[1].pos * bary.y + vtx[2].pos * bary.z, 1.0));
 	gbuffer.n_s =
 		vec3(tsp_inv_to_world * vec4(vtx[0].normal * bary.x + vtx[1].normal * bary.y + vtx[2].normal * bary.z, 1.0));
@@ -130,9 +130,9 @@ HitDataWithoutGeometryNormals get_hitdata_no_ng(vec2 attribs, uint instance_idx,
 	HitDataWithoutGeometryNormals gbuffer;
 	Vertex vtx[3];
 
-	vtx[0] = compact_vertices.d[ind.x];
-	vtx[1] = compact_vertices.d[ind.y];
-	vtx[2] = compact_vertices.d[ind.z];
+	vtx[0] = fetch_vertex(ind.x, pinfo);
+	vtx[1] = fetch_vertex(ind.y, pinfo);
+	vtx[2] = fetch_vertex(ind.z, pinfo);
 	gbuffer.pos = vec3(to_world * vec4(vtx[0].pos * bary.x + vtx[1].pos * bary.y + vtx[2].pos * bary.z, 1.0));
 	gbuffer.n_s =
 		vec3(tsp_inv_to_world * vec4(vtx[0].normal * bary.x + vtx[1].normal * bary.y + vtx[2].normal * bary.z, 1.0));
@@ -152,9 +152,9 @@ vec3 get_hitdata_pos_only(vec2 attribs, uint instance_idx, uint triangle_idx) {
 	HitDataWithoutGeometryNormals gbuffer;
 	Vertex vtx[3];
 
-	vtx[0] = compact_vertices.d[ind.x];
-	vtx[1] = compact_vertices.d[ind.y];
-	vtx[2] = compact_vertices.d[ind.z];
+	vtx[0] = fetch_vertex(ind.x, pinfo);
+	vtx[1] = fetch_vertex(ind.y, pinfo);
+	vtx[2] = fetch_vertex(ind.z, pinfo);
 	return vec3(to_world * vec4(vtx[0].pos * bary.x + vtx[1].pos * bary.y + vtx[2].pos * bary.z, 1.0));
 }
 
@@ -174,7 +174,8 @@ vec3 do_nee(inout uvec4 seed, vec3 pos, Material hit_mat, bool side, vec3 n_s, v
 	traceRayEXT(tlas, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsSkipClosestHitShaderEXT, 0xFF, 1, 0, 1, p, 0, wi,
 				wi_len - EPS, 1);
 	bool visible = any_hit_payload.hit == 0;
-	is_directional_light = get_light_type(record.flags) == LIGHT_DIRECTIONAL;
+	// Lights at infinity (directional and environment) are reconnected through their direction
+	is_directional_light = !is_light_finite(record.flags);
 
 	light_dir_or_pdf = is_directional_light ? wi * wi_len : vec3(pdf_light_a, vec2(0));
 
@@ -431,16 +432,22 @@ bool advance_paths(in HitData dst_gbuffer, in GrisData data, vec3 dst_wi, float
 #endif
 				float pdf_light_w;
 				float mis_weight;
+				vec3 light_L = light.L;
 
 				bool is_emissive_light = !is_light_delta(light.light_flags);
-				if (is_emissive_light) {
+				if (is_emissive_light && is_directional_light) {
+					// Environment light
+					light_L = eval_env_map(dst_postfix_wi);
+					pdf_light_w = env_map_pdf(dst_postfix_wi);
+					mis_weight = 1.0 / (1.0 + dst_postfix_pdf / pdf_light_w);
+				} else if (is_emissive_light) {
 					pdf_light_w = data.rc_Li.x * wi_len_sqr / abs(dot(rc_gbuffer.n_s, dst_postfix_wi));
 					mis_weight = 1.0 / (1.0 + dst_postfix_pdf / pdf_light_w);
 				} else {
 					pdf_light_w = 1.0;
 					mis_weight = 1.0;
 				}
-				reservoir_contribution *= light.L * mis_weight / (light_pick_pdf * pdf_light_w);
+				reservoir_contribution *= light_L * mis_weight / (light_pick_pdf * pdf_light_w);
 				LOG_CLICKED3("NEE: %d - %d = %v3f\n", prefix_depth, (data.path_flags) >> 16, reservoir_contribution);
 				jacobian = 1;
 			} else {
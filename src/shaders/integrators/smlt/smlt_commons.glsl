@@ -12,8 +12,8 @@ layout(buffer_reference, scalar, buffer_reference_align = 4) buffer MLTSamplers
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer MLTColor { vec3 d[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer ChainStats { ChainData d[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer Splats { Splat d[]; };
-layout(buffer_reference, scalar, buffer_reference_align = 4) buffer LightVertices { VCMVertex d[]; };
-layout(buffer_reference, scalar, buffer_reference_align = 4) buffer CameraVertices { VCMVertex d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer LightVertices { PackedVCMVertex d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer CameraVertices { PackedVCMVertex d[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer PathCnt { uint d[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer ConnectedLights { uint d[]; };
 layout(buffer_reference, scalar, buffer_reference_align = 4) buffer TmpSeeds { SeedData d[]; };
@@ -45,7 +45,7 @@ PrimarySamples light_primary_samples =
     PrimarySamples(scene_desc.light_primary_samples_addr);
 PrimarySamples cam_primary_samples =
     PrimarySamples(scene_desc.cam_primary_samples_addr);
-const uint flags = gl_RayFlagsOpaqueEXT;
+const uint flags = gl_RayFlagsNoneEXT;
 const float tmin = 0.001;
 const float tmax = 10000.0;
 #define RR_MIN_DEPTH 3
@@ -94,10 +94,7 @@ float mlt_L_light() {
 
 float mlt_L_eye() {
     vec3 origin = vec3(ubo.inv_view * vec4(0, 0, 0, 1));
-    vec4 area_int = (ubo.inv_projection * vec4(2. / gl_LaunchSizeEXT.x,
-                                               2. / gl_LaunchSizeEXT.y, 0, 1));
-    area_int /= area_int.w;
-    const float cam_area = abs(area_int.x * area_int.y);
+    const float cam_area = camera_pixel_area(vec2(gl_LaunchSizeEXT.xy));
     VCMState camera_state;
     // Generate camera sample
     const vec2 dir_rnd =
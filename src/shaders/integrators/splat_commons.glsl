@@ -0,0 +1,59 @@
+#ifndef SPLAT_COMMONS_GLSL
+#define SPLAT_COMMONS_GLSL
+// Accumulation into vec3 elements that other invocations write to as well: light tracing splats into the image and
+// photon deposits into the hash grid. Ray tracing stages have no shared memory, so the contention of bright pixels
+// and dense cells is reduced within the subgroup instead
+// Shaders that use splat_add or splat_take require GL_EXT_shader_atomic_float, and for SPLAT_SUBGROUP
+// GL_KHR_shader_subgroup_basic, GL_KHR_shader_subgroup_ballot and GL_KHR_shader_subgroup_arithmetic
+#include "splat_commons.h"
+
+#ifndef SPLAT_MODE
+#define SPLAT_MODE SPLAT_SUBGROUP
+#endif
+
+// dst is a vec3 lvalue, the element identified by key. Every invocation that reaches the loop with the same key
+// refers to the same element, so the elected one can add the sum of the group
+#if SPLAT_MODE == SPLAT_SUBGROUP
+#define splat_add(dst, key, col)                                                                                     \
+	{                                                                                                                \
+		const uint splat_key_ = (key);                                                                               \
+		const vec3 splat_col_ = (col);                                                                               \
+		for (;;) {                                                                                                   \
+			if (subgroupBroadcastFirst(splat_key_) == splat_key_) {                                                  \
+				const vec3 splat_sum_ = subgroupAdd(splat_col_);                                                     \
+				if (subgroupElect()) {                                                                               \
+					atomicAdd(dst.x, splat_sum_.x);                                                                  \
+					atomicAdd(dst.y, splat_sum_.y);                                                                  \
+					atomicAdd(dst.z, splat_sum_.z);                                                                  \
+				}                                                                                                    \
+				break;                                                                                               \
+			}                                                                                                        \
+		}                                                                                                            \
+	}
+#elif SPLAT_MODE == SPLAT_ATOMIC
+#define splat_add(dst, key, col)                                                                                     \
+	{                                                                                                                \
+		const vec3 splat_col_ = (col);                                                                               \
+		atomicAdd(dst.x, splat_col_.x);                                                                              \
+		atomicAdd(dst.y, splat_col_.y);                                                                              \
+		atomicAdd(dst.z, splat_col_.z);                                                                              \
+	}
+#else
+#define splat_add(dst, key, col) dst += (col)
+#endif
+
+// Reads and clears an element that splat_add may write to in the same pass. Splats that land after the exchange are
+// kept for the next read
+#if SPLAT_MODE == SPLAT_RACY
+#define splat_take(dst, res)                                                                                         \
+	{                                                                                                                \
+		res = dst;                                                                                                   \
+		dst = vec3(0);                                                                                               \
+	}
+#else
+#define splat_take(dst, res)                                                                                         \
+	{                                                                                                                \
+		res = vec3(atomicExchange(dst.x, 0.0), atomicExchange(dst.y, 0.0), atomicExchange(dst.z, 0.0));              \
+	}
+#endif
+#endif
@@ -0,0 +1,10 @@
+#ifndef SPLAT_COMMONS_HOST_DEVICE
+#define SPLAT_COMMONS_HOST_DEVICE
+// How light tracing splats and photon deposits are accumulated, passed to the shaders as SPLAT_MODE
+// Plain read-modify-write, loses contributions when invocations hit the same element. Kept for comparison
+#define SPLAT_RACY 0
+// A float atomic per invocation and channel
+#define SPLAT_ATOMIC 1
+// Invocations of a subgroup that hit the same element sum their contributions first, a float atomic per element
+#define SPLAT_SUBGROUP 2
+#endif
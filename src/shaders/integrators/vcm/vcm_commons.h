@@ -1,6 +1,7 @@
 #include "../../commons.h"
 #ifndef VCM_COMMONS_H
 #define VCM_COMMONS_H
+#include "../path_vertex_packing.h"
 struct PCVCM {
 	vec3 sky_col;
 	uint frame_num;
@@ -86,23 +87,6 @@ struct SelectedReservoirs {
 	vec3 dir;
 };
 
-struct VCMVertex {
-	vec3 wi;
-	vec3 wo;
-	vec3 n_s;
-	vec3 pos;
-	vec2 uv;
-	vec3 throughput;
-	uint material_idx;
-	uint path_len;
-	float area;
-	float d_vcm;
-	float d_vc;
-	float d_vm;
-	uint side;
-	uint coords;
-};
-
 struct AvgStruct {
 	float avg;
 	uint prev;
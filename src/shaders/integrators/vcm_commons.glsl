@@ -13,6 +13,7 @@
 #elif VCM_MLT == 1
 #include "mlt_commons_vcmmlt.glsl"
 #endif
+#include "splat_commons.glsl"
 
 vec3 normalize_grid(vec3 p, vec3 min_bnds, vec3 max_bnds) { return (p - min_bnds) / (max_bnds - min_bnds); }
 
@@ -99,7 +100,9 @@ bool vcm_generate_light_sample(float eta_vc, out VCMState light_state, out bool
 	}
 
 	float pdf_emit = pdf_pos * pdf_dir;
-	float pdf_direct = pdf_pos;
+	// Lights at infinity are connected to by direction, so the direct pdf is in solid angle measure
+	float pdf_direct =
+		get_light_type(light_record.flags) == LIGHT_ENVIRONMENT ? pdf_dir / pc.light_triangle_count : pdf_pos;
 	light_state.pos = pos;
 	light_state.area = 1.0 / pdf_pos;
 	light_state.wi = wi;
@@ -142,6 +145,23 @@ vec3 vcm_get_light_radiance(in const Material mat, in const VCMState camera_stat
 	return mis_weight * mat.emissive_factor;
 }
 
+vec3 vcm_get_env_radiance(in const VCMState camera_state, int d) {
+	if (!has_env_map()) {
+		return pc.sky_col;
+	}
+	const vec3 L = eval_env_map(camera_state.wi);
+	if (d == 1) {
+		return L;
+	}
+	// The deferred geometry terms of d_vcm don't apply to a vertex at infinity
+	const float pdf_light_dir = env_map_pdf(camera_state.wi) / pc.light_triangle_count;
+	const float w_camera =
+		pdf_light_dir * camera_state.d_vcm +
+		(pc.use_vc == 1 || pc.use_vm == 1 ? (pdf_light_dir * env_map_pdf_pos()) * camera_state.d_vc : 0);
+	const float mis_weight = 1. / (1. + w_camera);
+	return mis_weight * L;
+}
+
 vec3 vcm_connect_light(vec3 n_s, vec3 wo, Material mat, bool side, float eta_vm, VCMState camera_state,
 					   out float pdf_rev, out vec3 f) {
 	vec3 wi;
@@ -203,32 +223,31 @@ vec3 vcm_connect_light_vertices(uint light_path_len, uint light_path_idx, int de
 								bool side, float eta_vm, VCMState camera_state, float pdf_rev) {
 	vec3 res = vec3(0);
 	for (int i = 0; i < light_path_len; i++) {
-		uint s = light_vtx(light_path_idx + i).path_len;
+		const VCMVertex light_vertex = unpack_vcm_vertex(light_vtx(light_path_idx + i));
+		uint s = light_vertex.path_len;
 		uint mdepth = s + depth - 1;
 		if (mdepth >= pc.max_depth) {
 			break;
 		}
-		vec3 dir = light_vtx(light_path_idx + i).pos - payload.pos;
+		vec3 dir = light_vertex.pos - payload.pos;
 		const float len = length(dir);
 		const float len_sqr = len * len;
 		dir /= len;
 		const float cos_cam = dot(n_s, dir);
-		const float cos_light = dot(light_vtx(light_path_idx + i).n_s, -dir);
+		const float cos_light = dot(light_vertex.n_s, -dir);
 		const float G = cos_light * cos_cam / len_sqr;
 		if (G > 0) {
 			float cam_pdf_fwd, light_pdf_fwd, light_pdf_rev;
 			const vec3 f_cam = eval_bsdf(n_s, wo, mat, 1, side, dir, cam_pdf_fwd);
-			const Material light_mat =
-				load_material(light_vtx(light_path_idx + i).material_idx, light_vtx(light_path_idx + i).uv);
+			const Material light_mat = load_material(light_vertex.material_idx, light_vertex.uv);
 			// TODO: what about anisotropic BSDFS?
-			const vec3 f_light =
-				eval_bsdf(light_vtx(light_path_idx + i).n_s, light_vtx(light_path_idx + i).wo, light_mat, 0,
-						  light_vtx(light_path_idx + i).side == 1, -dir, light_pdf_fwd, light_pdf_rev);
+			const vec3 f_light = eval_bsdf(light_vertex.n_s, light_vertex.wo, light_mat, 0, light_vertex.side == 1,
+										   -dir, light_pdf_fwd, light_pdf_rev);
 			if (f_light != vec3(0) && f_cam != vec3(0)) {
 				cam_pdf_fwd *= abs(cos_light) / len_sqr;
 				light_pdf_fwd *= abs(cos_cam) / len_sqr;
-				const float w_light = cam_pdf_fwd * (eta_vm + light_vtx(light_path_idx + i).d_vcm +
-													 light_pdf_rev * light_vtx(light_path_idx + i).d_vc);
+				const float w_light =
+					cam_pdf_fwd * (eta_vm + light_vertex.d_vcm + light_pdf_rev * light_vertex.d_vc);
 				const float w_camera = light_pdf_fwd * (eta_vm + camera_state.d_vcm + pdf_rev * camera_state.d_vc);
 				const float mis_weight = 1. / (1 + w_camera + w_light);
 				const vec3 ray_origin = offset_ray2(payload.pos, n_s);
@@ -237,8 +256,7 @@ vec3 vcm_connect_light_vertices(uint light_path_len, uint light_path_idx, int de
 							ray_origin, 0, dir, len - EPS, 1);
 				const bool visible = any_hit_payload.hit == 0;
 				if (visible) {
-					res = mis_weight * G * camera_state.throughput * light_vtx(light_path_idx + i).throughput * f_cam *
-						  f_light;
+					res = mis_weight * G * camera_state.throughput * light_vertex.throughput * f_cam * f_light;
 				}
 			}
 		}
@@ -284,8 +302,9 @@ vec3 vcm_merge_light_vertices(uint light_path_len, uint light_path_idx, int dept
 							const float w = 1. - sqrt(dist_sqr) / radius;
 							const float w_normalization = 3.;  // 1. / (1 - 2/(3*k)) where k =
 															   // 1
-							res = w * mis_weight * photons.d[h].photon_count * photons.d[h].throughput * f *
-								  camera_state.throughput * normalization_factor * w_normalization;
+							// The throughput is the sum over the photons of the cell
+							res = w * mis_weight * photons.d[h].throughput * f * camera_state.throughput *
+								  normalization_factor * w_normalization;
 						}
 					}
 				}
@@ -307,9 +326,7 @@ void vcm_fill_light(vec3 origin, VCMState vcm_state, bool finite_light,
 	const vec3 cam_nrm = vec3(-ubo.inv_view * vec4(0, 0, 1, 0));
 	const float radius = pc.radius;
 	const float radius_sqr = radius * radius;
-	vec4 area_int = (ubo.inv_projection * vec4(2. / gl_LaunchSizeEXT.x, 2. / gl_LaunchSizeEXT.y, 0, 1));
-	area_int /= (area_int.w);
-	const float cam_area = abs(area_int.x * area_int.y);
+	const float cam_area = camera_pixel_area(vec2(gl_LaunchSizeEXT.xy));
 	int depth;
 	int path_idx = 0;
 	bool specular = false;
@@ -349,19 +366,22 @@ void vcm_fill_light(vec3 origin, VCMState vcm_state, bool finite_light,
 		vcm_state.d_vm /= cos_theta_wo;
 		if ((!mat_specular && (pc.use_vc == 1 || pc.use_vm == 1))) {
 			// Copy to light vertex buffer
-			light_vtx(path_idx).wi = vcm_state.wi;
-			light_vtx(path_idx).wo = wo;  //-vcm_state.wi;
-			light_vtx(path_idx).n_s = n_s;
-			light_vtx(path_idx).pos = payload.pos;
-			light_vtx(path_idx).uv = payload.uv;
-			light_vtx(path_idx).material_idx = payload.material_idx;
-			light_vtx(path_idx).area = payload.area;
-			light_vtx(path_idx).throughput = vcm_state.throughput;
-			light_vtx(path_idx).d_vcm = vcm_state.d_vcm;
-			light_vtx(path_idx).d_vc = vcm_state.d_vc;
-			light_vtx(path_idx).d_vm = vcm_state.d_vm;
-			light_vtx(path_idx).path_len = depth + 1;
-			light_vtx(path_idx).side = uint(side);
+			VCMVertex v;
+			v.wi = vcm_state.wi;
+			v.wo = wo;	//-vcm_state.wi;
+			v.n_s = n_s;
+			v.pos = payload.pos;
+			v.uv = payload.uv;
+			v.material_idx = payload.material_idx;
+			v.area = payload.area;
+			v.throughput = vcm_state.throughput;
+			v.d_vcm = vcm_state.d_vcm;
+			v.d_vc = vcm_state.d_vc;
+			v.d_vm = vcm_state.d_vm;
+			v.path_len = depth + 1;
+			v.side = uint(side);
+			v.coords = 0;
+			light_vtx(path_idx) = pack_vcm_vertex(v);
 			path_idx++;
 		}
 		if (depth >= pc.max_depth) {
@@ -396,12 +416,12 @@ void vcm_fill_light(vec3 origin, VCMState vcm_state, bool finite_light,
 			if (lum > 0) {
 				lum_sum += lum;
 				uint idx = coords.x * pc.size_y + coords.y;
-				tmp_col.d[idx] += splat_col;
+				splat_add(tmp_col.d[idx], idx, splat_col);
 			}
 #else
 								 if (luminance(splat_col) > 0) {
 									 uint idx = coords.x * gl_LaunchSizeEXT.y + coords.y;
-									 tmp_col.d[idx] += splat_col;
+									 splat_add(tmp_col.d[idx], idx, splat_col);
 								 }
 #endif
 		}
@@ -455,15 +475,17 @@ void vcm_fill_light(vec3 origin, VCMState vcm_state, bool finite_light,
 #if VC_MLT == 0
 	if (pc.use_vm == 1) {
 		for (int i = 0; i < path_idx; i++) {
-			ivec3 grid_idx = get_grid_idx(light_vtx(i).pos, pc.min_bounds, pc.max_bounds, pc.grid_res);
+			const VCMVertex v = unpack_vcm_vertex(light_vtx(i));
+			ivec3 grid_idx = get_grid_idx(v.pos, pc.min_bounds, pc.max_bounds, pc.grid_res);
 			uint h = hash(grid_idx, screen_size);
-			photons.d[h].pos = light_vtx(i).pos;
-			photons.d[h].wi = -light_vtx(i).wi;
-			photons.d[h].d_vm = light_vtx(i).d_vm;
-			photons.d[h].d_vcm = light_vtx(i).d_vcm;
-			photons.d[h].throughput = light_vtx(i).throughput;
-			photons.d[h].nrm = light_vtx(i).n_s;
-			photons.d[h].path_len = light_vtx(i).path_len;
+			// A cell keeps the last photon that landed in it, with the throughput of all of them
+			photons.d[h].pos = v.pos;
+			photons.d[h].wi = -v.wi;
+			photons.d[h].d_vm = v.d_vm;
+			photons.d[h].d_vcm = v.d_vcm;
+			splat_add(photons.d[h].throughput, h, v.throughput);
+			photons.d[h].nrm = v.n_s;
+			photons.d[h].path_len = v.path_len;
 			atomicAdd(photons.d[h].photon_count, 1);
 		}
 	}
@@ -527,8 +549,7 @@ vec3 vcm_trace_eye(VCMState camera_state, float eta_vcm, float eta_vc,
 		traceRayEXT(tlas, flags, 0xFF, 0, 0, 0, camera_state.pos, tmin, camera_state.wi, tmax, 0);
 
 		if (payload.material_idx == -1) {
-			// TODO:
-			col += camera_state.throughput * pc.sky_col;
+			col += camera_state.throughput * vcm_get_env_radiance(camera_state, depth);
 			break;
 		}
 		vec3 wo = camera_state.pos - payload.pos;
@@ -635,9 +656,7 @@ float mlt_fill_eye() {
 #define cam_vtx(i) vcm_lights.d[vcm_light_path_idx + i]
 	const float fov = ubo.projection[1][1];
 	vec3 cam_pos = vec3(ubo.inv_view * vec4(0, 0, 0, 1));
-	vec4 area_int = (ubo.inv_projection * vec4(2. / gl_LaunchSizeEXT.x, 2. / gl_LaunchSizeEXT.y, 0, 1));
-	area_int /= area_int.w;
-	const float cam_area = abs(area_int.x * area_int.y);
+	const float cam_area = camera_pixel_area(vec2(gl_LaunchSizeEXT.xy));
 	vec2 dir = vec2(rand(seed), rand(seed)) * 2.0 - 1.0;
 	const vec3 direction = sample_camera(dir).xyz;
 	VCMState camera_state;
@@ -660,7 +679,8 @@ float mlt_fill_eye() {
 		traceRayEXT(tlas, flags, 0xFF, 0, 0, 0, camera_state.pos, tmin, camera_state.wi, tmax, 0);
 
 		if (payload.material_idx == -1) {
-			tmp_col.d[coords_idx] += camera_state.throughput * pc.sky_col;
+			splat_add(tmp_col.d[coords_idx], coords_idx,
+					  camera_state.throughput * vcm_get_env_radiance(camera_state, depth));
 			break;
 		}
 
@@ -690,25 +710,28 @@ float mlt_fill_eye() {
 		// Get the radiance
 		if (luminance(mat.emissive_factor) > 0) {
 			vec3 L = camera_state.throughput * vcm_get_light_radiance(mat, camera_state, depth);
-			tmp_col.d[coords_idx] += L;
+			splat_add(tmp_col.d[coords_idx], coords_idx, L);
 			lum_sum += luminance(L);
 		}
 
 		// Copy to camera vertex buffer
 		if (!mat_specular) {
-			cam_vtx(path_idx).wo = wo;
-			cam_vtx(path_idx).n_s = n_s;
-			cam_vtx(path_idx).pos = offset_ray(payload.pos, n_s);
-			cam_vtx(path_idx).uv = payload.uv;
-			cam_vtx(path_idx).material_idx = payload.material_idx;
-			cam_vtx(path_idx).area = payload.area;
-			cam_vtx(path_idx).throughput = camera_state.throughput;
-			cam_vtx(path_idx).d_vcm = camera_state.d_vcm;
-			cam_vtx(path_idx).d_vc = camera_state.d_vc;
-			cam_vtx(path_idx).d_vm = camera_state.d_vm;
-			cam_vtx(path_idx).path_len = depth + 1;
-			cam_vtx(path_idx).side = uint(side);
-			cam_vtx(path_idx).coords = coords_idx;
+			VCMVertex v;
+			v.wi = camera_state.wi;
+			v.wo = wo;
+			v.n_s = n_s;
+			v.pos = offset_ray(payload.pos, n_s);
+			v.uv = payload.uv;
+			v.material_idx = payload.material_idx;
+			v.area = payload.area;
+			v.throughput = camera_state.throughput;
+			v.d_vcm = camera_state.d_vcm;
+			v.d_vc = camera_state.d_vc;
+			v.d_vm = camera_state.d_vm;
+			v.path_len = depth + 1;
+			v.side = uint(side);
+			v.coords = coords_idx;
+			cam_vtx(path_idx) = pack_vcm_vertex(v);
 			path_idx++;
 		}
 
@@ -717,7 +740,7 @@ float mlt_fill_eye() {
 		vec3 f;
 		if (!mat_specular && depth < pc.max_depth) {
 			const vec3 L = vcm_connect_light(n_s, wo, mat, side, 0, camera_state, pdf_rev, f);
-			tmp_col.d[coords_idx] += L;
+			splat_add(tmp_col.d[coords_idx], coords_idx, L);
 			lum_sum += luminance(L);
 		}
 
@@ -764,9 +787,7 @@ float mlt_fill_eye() {
 float mlt_trace_light() {
 #define splat(i) splat_data.d[splat_idx + chain * depth_factor + i]
 	vec3 cam_pos = vec3(ubo.inv_view * vec4(0, 0, 0, 1));
-	vec4 area_int = (ubo.inv_projection * vec4(2. / gl_LaunchSizeEXT.x, 2. / gl_LaunchSizeEXT.y, 0, 1));
-	area_int /= area_int.w;
-	const float cam_area = abs(area_int.x * area_int.y);
+	const float cam_area = camera_pixel_area(vec2(gl_LaunchSizeEXT.xy));
 	vec3 cam_nrm = vec3(-ubo.inv_view * vec4(0, 0, 1, 0));
 	// Select camera path
 	float luminance_sum = 0;
@@ -844,33 +865,32 @@ float mlt_trace_light() {
 #define cam_vtx(i) vcm_lights.d[i]
 			// Connect to cam vertices
 			for (int i = 0; i < path_len; i++) {
-				uint t = cam_vtx(path_idx + i).path_len;
+				const VCMVertex cam_vertex = unpack_vcm_vertex(cam_vtx(path_idx + i));
+				uint t = cam_vertex.path_len;
 				uint depth = t + d - 1;
 				if (depth >= pc.max_depth) {
 					break;
 				}
-				vec3 dir = hit_pos - cam_vtx(path_idx + i).pos;
+				vec3 dir = hit_pos - cam_vertex.pos;
 				const float len = length(dir);
 				const float len_sqr = len * len;
 				dir /= len;
 				const float cos_light = dot(n_s, -dir);
-				const float cos_cam = dot(cam_vtx(path_idx + i).n_s, dir);
+				const float cos_cam = dot(cam_vertex.n_s, dir);
 				const float G = cos_cam * cos_light / len_sqr;
 				if (G > 0) {
-					float pdf_rev = bsdf_pdf(mat, n_s, -dir, wo, cam_vtx(path_idx + i).side == 1);
+					float pdf_rev = bsdf_pdf(mat, n_s, -dir, wo, cam_vertex.side == 1);
 					vec3 unused;
 					float cam_pdf_fwd, cam_pdf_rev, light_pdf_fwd;
-					const Material cam_mat =
-						load_material(cam_vtx(path_idx + i).material_idx, cam_vtx(path_idx + i).uv);
-					const vec3 f_cam = eval_bsdf(cam_vtx(path_idx + i).n_s, cam_vtx(path_idx + i).wo, cam_mat, 1,
-												 cam_vtx(path_idx + i).side == 1, dir, cam_pdf_fwd, cam_pdf_rev);
+					const Material cam_mat = load_material(cam_vertex.material_idx, cam_vertex.uv);
+					const vec3 f_cam = eval_bsdf(cam_vertex.n_s, cam_vertex.wo, cam_mat, 1, cam_vertex.side == 1, dir,
+												 cam_pdf_fwd, cam_pdf_rev);
 					const vec3 f_light = eval_bsdf(n_s, wo, mat, 0, side, -dir, light_pdf_fwd);
 					if (f_light != vec3(0) && f_cam != vec3(0)) {
 						cam_pdf_fwd *= abs(cos_light) / len_sqr;
 						light_pdf_fwd *= abs(cos_cam) / len_sqr;
 						const float w_light = cam_pdf_fwd * (light_state.d_vcm + pdf_rev * light_state.d_vc);
-						const float w_cam =
-							light_pdf_fwd * (cam_vtx(path_idx + i).d_vcm + cam_pdf_rev * cam_vtx(path_idx + i).d_vc);
+						const float w_cam = light_pdf_fwd * (cam_vertex.d_vcm + cam_pdf_rev * cam_vertex.d_vc);
 						const float mis_weight = 1. / (1 + w_light + w_cam);
 						const vec3 ray_origin = offset_ray(hit_pos, n_s);
 						any_hit_payload.hit = 1;
@@ -878,11 +898,11 @@ float mlt_trace_light() {
 									1, 0, 1, ray_origin, 0, -dir, len - EPS, 1);
 						const bool visible = any_hit_payload.hit == 0;
 						if (visible) {
-							const vec3 L = mis_weight * G * light_state.throughput * cam_vtx(path_idx + i).throughput *
+							const vec3 L = mis_weight * G * light_state.throughput * cam_vertex.throughput *
 										   f_cam * f_light;
 							luminance_sum += luminance(L);
 							if (save_radiance) {
-								const uint idx = cam_vtx(path_idx + i).coords;
+								const uint idx = cam_vertex.coords;
 								const uint splat_cnt = mlt_sampler.splat_cnt;
 								mlt_sampler.splat_cnt++;
 								splat(splat_cnt).idx = idx;
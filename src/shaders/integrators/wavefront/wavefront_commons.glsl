@@ -0,0 +1,42 @@
+#ifndef WAVEFRONT_COMMONS_GLSL
+#define WAVEFRONT_COMMONS_GLSL
+#include "../../commons.glsl"
+#include "wavefront_commons.h"
+
+layout(location = 0) rayPayloadEXT HitPayload payload;
+layout(location = 1) rayPayloadEXT AnyHitPayload any_hit_payload;
+layout(push_constant) uniform _PushConstantRay { PCWavefront pc; };
+
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer WavefrontPaths { WavefrontPathState d[]; };
+// Two ray queues of capacity entries each, pc.depth & 1 is the one traced by the current bounce
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer WavefrontQueues { uint d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer WavefrontHits { WavefrontHit d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer WavefrontSorted { uint d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer WavefrontShadowRays { WavefrontShadowRay d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer WavefrontCountersRef { WavefrontCounters d; };
+
+WavefrontPaths paths = WavefrontPaths(scene_desc.wavefront_paths_addr);
+WavefrontQueues queues = WavefrontQueues(scene_desc.wavefront_queues_addr);
+WavefrontHits hits = WavefrontHits(scene_desc.wavefront_hits_addr);
+WavefrontSorted sorted_hits = WavefrontSorted(scene_desc.wavefront_sorted_addr);
+WavefrontShadowRays shadow_rays = WavefrontShadowRays(scene_desc.wavefront_shadow_addr);
+WavefrontCountersRef counters = WavefrontCountersRef(scene_desc.wavefront_counters_addr);
+
+const uint flags = gl_RayFlagsNoneEXT;
+const float tmin = 0.001;
+const float tmax = 10000.0;
+#define RR_MIN_DEPTH 3
+
+uvec2 image_size = uvec2(pc.size_x, pc.size_y);
+
+uvec2 pixel_coords(uint pixel) { return uvec2(pixel % pc.size_x, pixel / pc.size_x); }
+
+// Index of the first hit of a bin in the sorted list
+uint bin_offset(uint bin) {
+	uint offset = 0;
+	for (uint i = 0; i < bin; i++) {
+		offset += counters.d.bin_count[i];
+	}
+	return offset;
+}
+#endif
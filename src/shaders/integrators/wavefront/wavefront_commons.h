@@ -0,0 +1,79 @@
+#ifndef WAVEFRONT_COMMONS_H
+#define WAVEFRONT_COMMONS_H
+#include "../../commons.h"
+
+// Hits are binned by the index of their BSDF type flag, rays that left the scene go to the last bin
+#define WAVEFRONT_MISS_BIN 6
+#define WAVEFRONT_BIN_COUNT 7
+#define WAVEFRONT_WG_SIZE 256
+
+#define WAVEFRONT_SHADOW_OCCLUSION 0
+// BSDF sample that has to reach the sampled triangle of an area light to contribute
+#define WAVEFRONT_SHADOW_AREA_HIT 1
+
+struct PCWavefront {
+	vec3 sky_col;
+	uint frame_num;
+	uint size_x;
+	uint size_y;
+	int num_lights;
+	uint time;
+	int max_depth;
+	float total_light_area;
+	int light_triangle_count;
+	uint dir_light_idx;
+	uint direct_lighting;
+	// Pixels traced by the current wave, in row major order
+	uint first_pixel;
+	uint path_count;
+	// Queue capacity, every queue holds up to path_count entries
+	uint capacity;
+	uint depth;
+	uint bin;
+};
+
+struct WavefrontPathState {
+	vec3 origin;
+	uint last_specular;
+	vec3 direction;
+	uint pixel;
+	vec3 throughput;
+	// Accumulated by the shading and the shadow stages, written to the image once the wave finishes
+	vec3 radiance;
+	uvec4 seed;
+};
+
+// Closest hit of the ray of a path
+struct WavefrontHit {
+	vec3 pos;
+	uint path_idx;
+	vec3 n_s;
+	uint material_idx;
+	vec3 n_g;
+	uint bin;
+	vec2 uv;
+};
+
+struct WavefrontShadowRay {
+	vec3 origin;
+	uint path_idx;
+	vec3 direction;
+	float t_max;
+	// Added to the radiance of the path when the ray is unoccluded, or reaches its triangle
+	vec3 contribution;
+	uint type;
+	// Area hits only: the expected triangle and the ratio of the light and BSDF solid angle pdfs without the
+	// geometry term, which needs the hit
+	uint triangle_idx;
+	uint instance_idx;
+	float pdf_ratio;
+};
+
+struct WavefrontCounters {
+	// Ping-ponged between bounces
+	uint ray_count[2];
+	uint shadow_count;
+	uint bin_count[WAVEFRONT_BIN_COUNT];
+	uint bin_cursor[WAVEFRONT_BIN_COUNT];
+};
+#endif
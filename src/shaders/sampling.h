@@ -0,0 +1,105 @@
+#ifndef SAMPLING_HOST_DEVICE
+#define SAMPLING_HOST_DEVICE
+// Low discrepancy samplers shared between the host and the shaders
+// Sampler state layout: (pixel.x, pixel.y, sample index, dimension)
+#include "commons.h"
+
+#define SAMPLER_PCG 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_BLUE_NOISE 2
+
+#ifdef __cplusplus
+#define SAMPLING_FN inline
+#define SAMPLING_INOUT(type) type&
+#else
+#define SAMPLING_FN
+#define SAMPLING_INOUT(type) inout type
+#endif
+
+SAMPLING_FN uint reverse_bits(uint x) {
+#ifdef __cplusplus
+	x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+	x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+	x = ((x >> 4u) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4u);
+	x = ((x >> 8u) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8u);
+	return (x >> 16u) | (x << 16u);
+#else
+	return bitfieldReverse(x);
+#endif
+}
+
+SAMPLING_FN uint sampler_hash(uint x) {
+	const uint state = x * 747796405u + 2891336453u;
+	const uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+SAMPLING_FN uint hash_combine(uint seed, uint v) { return seed ^ (v + (seed << 6u) + (seed >> 2u)); }
+
+// First two Sobol dimensions, the first one being the van der Corput sequence
+SAMPLING_FN uint sobol_dim0(uint index) { return reverse_bits(index); }
+
+SAMPLING_FN uint sobol_dim1(uint index) {
+	uint result = 0u;
+	uint v = 1u << 31u;
+	while (index != 0u) {
+		if ((index & 1u) != 0u) {
+			result ^= v;
+		}
+		index >>= 1u;
+		v ^= v >> 1u;
+	}
+	return result;
+}
+
+// Owen scrambling via hashing, see "Practical Hash-based Owen Scrambling" (Burley 2020)
+SAMPLING_FN uint laine_karras_permutation(uint x, uint seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+SAMPLING_FN uint nested_uniform_scramble(uint x, uint seed) {
+	x = reverse_bits(x);
+	x = laine_karras_permutation(x, seed);
+	return reverse_bits(x);
+}
+
+// Shuffled and scrambled 2D Sobol point as 32 bit fixed point values. Higher dimensions are padded with independently
+// shuffled 2D sets, which keeps the stratification of every dimension pair
+SAMPLING_FN uvec2 sobol_owen_2d(uint index, uint seed) {
+	index = nested_uniform_scramble(index, seed);
+	return uvec2(nested_uniform_scramble(sobol_dim0(index), hash_combine(seed, 0u)),
+				 nested_uniform_scramble(sobol_dim1(index), hash_combine(seed, 1u)));
+}
+
+// Per pixel dither offset from the R2 sequence, which has a blue noise like spectrum in screen space
+SAMPLING_FN uint r2_dither(uvec2 pixel, uint dim) {
+	return pixel.x * 3242174889u + pixel.y * 2447445414u + dim * 2654435769u;
+}
+
+SAMPLING_FN float fixed_to_float(uint x) { return float(x >> 8u) * 5.96046448e-8f; }
+
+// Draws the next dimension from the sampler state
+SAMPLING_FN float sample_ld(SAMPLING_INOUT(uvec4) state, uint sampler_type) {
+	const uint dim = state.w++;
+	const uint pair = dim >> 1u;
+	uint seed;
+	if (sampler_type == SAMPLER_BLUE_NOISE) {
+		// Every pixel shares the same sequence, decorrelated by a dithered Cranley-Patterson rotation
+		seed = sampler_hash(pair);
+	} else {
+		seed = sampler_hash(hash_combine(hash_combine(sampler_hash(state.x), state.y), pair));
+	}
+	const uvec2 p = sobol_owen_2d(state.z, seed);
+	uint val = (dim & 1u) == 0u ? p.x : p.y;
+	if (sampler_type == SAMPLER_BLUE_NOISE) {
+		val += r2_dither(uvec2(state.x, state.y), dim);
+	}
+	return fixed_to_float(val);
+}
+
+#endif
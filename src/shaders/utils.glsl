@@ -1,6 +1,7 @@
 #ifndef UTILS_DEVICE
 #define UTILS_DEVICE
 #include "commons.h"
+#include "sampling.h"
 #define PI 3.14159265359
 #define TWO_PI 6.28318530718
 #define INV_PI (1. / PI)
@@ -54,6 +55,8 @@ struct LightRecord {
 	vec2 bary;
 	uint triangle_idx;
 	uint instance_idx;
+	// Probability of picking the light with the light BVH
+	float pick_pdf;
 };
 
 #define pow5(x) (((x) * (x)) * ((x) * (x)) * (x))
@@ -135,16 +138,28 @@ uvec4 pcg4d(uvec4 v) {
 // Returns a float between 0 and 1
 float uint_to_float(uint x) { return uintBitsToFloat(0x3f800000 | (x >> 9)) - 1.0f; }
 
+#ifndef SAMPLE_OFFSET
+// Sample index of the first frame. Distributed sample jobs set it so that they trace disjoint sample ranges
+#define SAMPLE_OFFSET 0
+#endif
+
 uvec4 init_rng(uvec2 pixel_coords, uvec2 resolution, uint frame_num, uint state) {
-	return uvec4(pixel_coords.xy, frame_num, state);
+	return uvec4(pixel_coords.xy, frame_num + SAMPLE_OFFSET, state);
 }
 
-uvec4 init_rng(uvec2 pixel_coords, uvec2 resolution, uint frame_num) { return uvec4(pixel_coords.xy, frame_num, 0); }
+uvec4 init_rng(uvec2 pixel_coords, uvec2 resolution, uint frame_num) {
+	return uvec4(pixel_coords.xy, frame_num + SAMPLE_OFFSET, 0);
+}
 
 // Return random float in (0, 1) range
+// Integrators can switch to a low discrepancy sampler by defining SAMPLER_TYPE, see sampling.h
 float rand(inout uvec4 rng_state) {
+#if defined(SAMPLER_TYPE) && SAMPLER_TYPE != SAMPLER_PCG
+	return sample_ld(rng_state, SAMPLER_TYPE);
+#else
 	rng_state.w++;
 	return uint_to_float(pcg4d(rng_state).x);
+#endif
 }
 
 vec2 rand2(inout uvec4 rng_state) { return vec2(rand(rng_state), rand(rng_state)); }
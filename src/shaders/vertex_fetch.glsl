@@ -0,0 +1,30 @@
+#ifndef VERTEX_FETCH_GLSL
+#define VERTEX_FETCH_GLSL
+// Vertex reads of the hit shaders, expects scene_desc to be declared by the includer
+#include "vertex_packing.h"
+
+#ifdef QUANTIZED_VERTICES
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer CompactVertices { PackedVertex d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer VertexPositions { vec3 d[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer FullPrecisionUVs { vec2 d[]; };
+#else
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer CompactVertices { Vertex d[]; };
+#endif
+
+// The attributes a caller doesn't use are never loaded once this is inlined
+Vertex fetch_vertex(uint idx, PrimMeshInfo pinfo) {
+#ifdef QUANTIZED_VERTICES
+	const PackedVertex packed = CompactVertices(scene_desc.compact_vertices_addr).d[idx];
+	Vertex v;
+	v.pos = VertexPositions(scene_desc.vertex_addr).d[idx];
+	v.normal = unpack_normal(packed.normal);
+	v.uv0 = pinfo.full_precision_uvs != 0 ? FullPrecisionUVs(scene_desc.full_precision_uv_addr).d[packed.uv]
+										  : unpack_uv(packed.uv, pinfo.uv_range);
+	v.tangent = unpack_tangent(packed.tangent);
+	return v;
+#else
+	return CompactVertices(scene_desc.compact_vertices_addr).d[idx];
+#endif
+}
+
+#endif
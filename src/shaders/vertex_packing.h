@@ -0,0 +1,104 @@
+#ifndef VERTEX_PACKING_HOST_DEVICE
+#define VERTEX_PACKING_HOST_DEVICE
+// Quantization of the shading attributes of PackedVertex, shared between the scene loader and the hit shaders
+// Normals: octahedral mapping, 16 bits per axis
+// Tangents: octahedral mapping, 16 + 15 bits and the bitangent sign in the top bit
+// UVs: 16 bits per axis over the range of their mesh, PrimMeshInfo::uv_range (min in xy, extent in zw). Meshes
+// whose step would exceed MAX_UV_STEP keep fp32 UVs, PackedVertex::uv then indexes SceneDesc::full_precision_uv_addr
+#include "commons.h"
+
+// Largest UV quantization step in absolute UV units, a texel of an 8k texture
+#define MAX_UV_STEP (1.0f / 8192.0f)
+
+#ifdef __cplusplus
+#define PACKING_FN inline
+#else
+#define PACKING_FN
+#endif
+
+NAMESPACE_BEGIN(VertexPacking)
+#ifdef __cplusplus
+using glm::abs;
+using glm::clamp;
+using glm::max;
+using glm::normalize;
+using glm::round;
+#endif
+
+PACKING_FN float packing_sign(float x) { return x >= 0.0f ? 1.0f : -1.0f; }
+
+// Unit vector to [-1, 1]^2, the lower hemisphere is folded over the diagonals
+PACKING_FN vec2 octahedral_encode(vec3 n) {
+	const float l1 = abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 p = vec2(n.x, n.y) / l1;
+	if (n.z < 0.0f) {
+		p = vec2((1.0f - abs(p.y)) * packing_sign(p.x), (1.0f - abs(p.x)) * packing_sign(p.y));
+	}
+	return p;
+}
+
+PACKING_FN vec3 octahedral_decode(vec2 p) {
+	vec3 n = vec3(p.x, p.y, 1.0f - abs(p.x) - abs(p.y));
+	const float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// Signed normalized value with 2^bits - 1 levels, so that 0 is exact
+PACKING_FN uint quantize_snorm(float x, uint bits) {
+	const float scale = float((1u << (bits - 1u)) - 1u);
+	return uint(round(clamp(x, -1.0f, 1.0f) * scale) + scale);
+}
+
+PACKING_FN float dequantize_snorm(uint q, uint bits) {
+	const float scale = float((1u << (bits - 1u)) - 1u);
+	return (float(q) - scale) / scale;
+}
+
+PACKING_FN uint pack_normal(vec3 n) {
+	const vec2 p = octahedral_encode(n);
+	return quantize_snorm(p.x, 16u) | (quantize_snorm(p.y, 16u) << 16u);
+}
+
+PACKING_FN vec3 unpack_normal(uint packed) {
+	return octahedral_decode(vec2(dequantize_snorm(packed & 0xFFFFu, 16u), dequantize_snorm(packed >> 16u, 16u)));
+}
+
+// Meshes without generated tangents keep a zero tangent, which has no octahedral encoding and is stored as 0
+PACKING_FN uint pack_tangent(vec4 t) {
+	if (t.x == 0.0f && t.y == 0.0f && t.z == 0.0f) {
+		return 0u;
+	}
+	const vec2 p = octahedral_encode(vec3(t.x, t.y, t.z));
+	const uint packed = quantize_snorm(p.x, 16u) | (quantize_snorm(p.y, 15u) << 16u) | (t.w < 0.0f ? 0x80000000u : 0u);
+	// Directions next to -Z can round to the zero code, move them by one step
+	return packed == 0u ? 1u : packed;
+}
+
+PACKING_FN vec4 unpack_tangent(uint packed) {
+	if (packed == 0u) {
+		return vec4(0.0f);
+	}
+	const vec2 p = vec2(dequantize_snorm(packed & 0xFFFFu, 16u), dequantize_snorm((packed >> 16u) & 0x7FFFu, 15u));
+	const vec3 t = octahedral_decode(p);
+	return vec4(t.x, t.y, t.z, (packed & 0x80000000u) != 0u ? -1.0f : 1.0f);
+}
+
+PACKING_FN bool uv_fits_unorm16(vec4 uv_range) {
+	return uv_range.z / 65535.0f <= MAX_UV_STEP && uv_range.w / 65535.0f <= MAX_UV_STEP;
+}
+
+PACKING_FN uint pack_uv(vec2 uv, vec4 uv_range) {
+	const float u = uv_range.z > 0.0f ? (uv.x - uv_range.x) / uv_range.z : 0.0f;
+	const float v = uv_range.w > 0.0f ? (uv.y - uv_range.y) / uv_range.w : 0.0f;
+	return uint(round(clamp(u, 0.0f, 1.0f) * 65535.0f)) | (uint(round(clamp(v, 0.0f, 1.0f) * 65535.0f)) << 16u);
+}
+
+PACKING_FN vec2 unpack_uv(uint packed, vec4 uv_range) {
+	const vec2 uv = vec2(float(packed & 0xFFFFu), float(packed >> 16u)) / 65535.0f;
+	return vec2(uv_range.x + uv.x * uv_range.z, uv_range.y + uv.y * uv_range.w);
+}
+NAMESPACE_END()
+
+#endif